@@ -176,7 +176,9 @@ SOURCES += \
     backend/nvhttp.cpp \
     backend/nvpairingmanager.cpp \
     backend/computermanager.cpp \
+    backend/computerpoller.cpp \
     backend/boxartmanager.cpp \
+    backend/boxartthumbnailcache.cpp \
     backend/richpresencemanager.cpp \
     cli/commandlineparser.cpp \
     cli/listapps.cpp \
@@ -193,16 +195,23 @@ SOURCES += \
     streaming/input/reltouch.cpp \
     streaming/session.cpp \
     streaming/audio/audio.cpp \
+    streaming/audio/audiopacketqueue.cpp \
+    streaming/audio/driftcompensator.cpp \
     streaming/audio/renderers/sdlaud.cpp \
     gui/computermodel.cpp \
     gui/appmodel.cpp \
+    gui/boxartimageprovider.cpp \
     streaming/bandwidth.cpp \
+    streaming/metricsserver.cpp \
     streaming/streamutils.cpp \
     backend/autoupdatechecker.cpp \
     path.cpp \
     settings/mappingmanager.cpp \
     gui/sdlgamepadkeynavigation.cpp \
     streaming/video/overlaymanager.cpp \
+    streaming/video/frametracer.cpp \
+    streaming/video/latencyhistogram.cpp \
+    streaming/video/bitratecontroller.cpp \
     backend/systemproperties.cpp \
     wm.cpp
 
@@ -220,7 +229,9 @@ HEADERS += \
     backend/nvhttp.h \
     backend/nvpairingmanager.h \
     backend/computermanager.h \
+    backend/computerpoller.h \
     backend/boxartmanager.h \
+    backend/boxartthumbnailcache.h \
     backend/richpresencemanager.h \
     cli/commandlineparser.h \
     cli/listapps.h \
@@ -229,18 +240,25 @@ HEADERS += \
     settings/streamingpreferences.h \
     streaming/input/input.h \
     streaming/session.h \
+    streaming/audio/audiopacketqueue.h \
+    streaming/audio/driftcompensator.h \
     streaming/audio/renderers/renderer.h \
     streaming/audio/renderers/sdl.h \
     gui/computermodel.h \
     gui/appmodel.h \
+    gui/boxartimageprovider.h \
     streaming/video/decoder.h \
     streaming/bandwidth.h \
+    streaming/metricsserver.h \
     streaming/streamutils.h \
     backend/autoupdatechecker.h \
     path.h \
     settings/mappingmanager.h \
     gui/sdlgamepadkeynavigation.h \
     streaming/video/overlaymanager.h \
+    streaming/video/frametracer.h \
+    streaming/video/latencyhistogram.h \
+    streaming/video/bitratecontroller.h \
     backend/systemproperties.h
 
 # Platform-specific renderers and decoders
@@ -253,6 +271,9 @@ ffmpeg {
         streaming/video/ffmpeg-renderers/genhwaccel.cpp \
         streaming/video/ffmpeg-renderers/sdlvid.cpp \
         streaming/video/ffmpeg-renderers/swframemapper.cpp \
+        streaming/video/ffmpeg-renderers/framepool.cpp \
+        streaming/video/ffmpeg-renderers/planecopy.cpp \
+        streaming/video/ffmpeg-renderers/yuvtorgb.cpp \
         streaming/video/ffmpeg-renderers/pacer/pacer.cpp
 
     HEADERS += \
@@ -261,6 +282,9 @@ ffmpeg {
         streaming/video/ffmpeg-renderers/genhwaccel.h \
         streaming/video/ffmpeg-renderers/sdlvid.h \
         streaming/video/ffmpeg-renderers/swframemapper.h \
+        streaming/video/ffmpeg-renderers/framepool.h \
+        streaming/video/ffmpeg-renderers/planecopy.h \
+        streaming/video/ffmpeg-renderers/yuvtorgb.h \
         streaming/video/ffmpeg-renderers/pacer/pacer.h
 }
 libva {
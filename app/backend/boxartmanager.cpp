@@ -1,131 +1,257 @@
 #include "boxartmanager.h"
+#include "boxartthumbnailcache.h"
 #include "../path.h"
 
-#include <QImageReader>
-#include <QImageWriter>
+#include <QDir>
+#include <QSaveFile>
 
 BoxArtManager::BoxArtManager(QObject *parent) :
     QObject(parent),
-    m_BoxArtDir(Path::getBoxArtCacheDir()),
     m_ThreadPool(this)
 {
-    // 4 is a good balance between fast loading for large
-    // app grids and not crushing GFE with tons of requests
-    // and causing UI jank from constantly stalling to decode
-    // new images.
-    m_ThreadPool.setMaxThreadCount(4);
-    if (!m_BoxArtDir.exists()) {
-        m_BoxArtDir.mkpath(".");
+    // Box art is decoded and scaled on these threads rather than
+    // the UI thread now, so the limit is only there to avoid
+    // crushing GFE with tons of requests. 8 keeps large app
+    // grids loading quickly while staying well within that.
+    m_ThreadPool.setMaxThreadCount(8);
+
+    QDir boxArtDir(Path::getBoxArtCacheDir());
+    if (!boxArtDir.exists()) {
+        boxArtDir.mkpath(".");
     }
 }
 
 QString
-BoxArtManager::getFilePathForBoxArt(NvComputer* computer, int appId)
+BoxArtManager::getFilePathForBoxArt(const QString& uuid, int appId)
 {
-    QDir dir = m_BoxArtDir;
+    QDir dir(Path::getBoxArtCacheDir());
 
     // Create the cache directory if it did not already exist
-    if (!dir.exists(computer->uuid)) {
-        dir.mkdir(computer->uuid);
+    if (!dir.exists(uuid)) {
+        dir.mkdir(uuid);
     }
 
     // Change to this computer's box art cache folder
-    dir.cd(computer->uuid);
+    dir.cd(uuid);
 
-    // Try to open the cached file
+    // The file keeps the host's original encoding, which QImage
+    // detects from its contents regardless of the extension.
     return dir.filePath(QString::number(appId) + ".png");
 }
 
+QString
+BoxArtManager::getBoxArtId(const QString& uuid, int appId)
+{
+    return uuid + "/" + QString::number(appId);
+}
+
+QUrl
+BoxArtManager::getBoxArtUrl(const QString& uuid, int appId)
+{
+    // Served by BoxArtImageProvider
+    return QUrl("image://boxart/" + getBoxArtId(uuid, appId));
+}
+
+bool
+BoxArtManager::isBoxArtCached(const QString& uuid, int appId)
+{
+    // Box art only counts as cached once its thumbnail is in the pack, since
+    // that's all the image provider reads. Box art files cached before we had
+    // thumbnails, or whose thumbnails were evicted, are turned into thumbnails
+    // by a load task instead of on the GUI thread.
+    return BoxArtThumbnailCache::get(uuid)->contains(appId);
+}
+
 class NetworkBoxArtLoadTask : public QObject, public QRunnable
 {
     Q_OBJECT
 
 public:
-    NetworkBoxArtLoadTask(BoxArtManager* boxArtManager, NvComputer* computer, NvApp& app)
+    NetworkBoxArtLoadTask(BoxArtManager* boxArtManager, const BoxArtManager::PendingLoad& load)
         : m_Bam(boxArtManager),
-          m_Computer(computer),
-          m_App(app)
+          m_Load(load)
     {
         connect(this, &NetworkBoxArtLoadTask::boxArtFetchCompleted,
                 boxArtManager, &BoxArtManager::handleBoxArtLoadComplete);
     }
 
 signals:
-    void boxArtFetchCompleted(NvComputer* computer, NvApp app, QUrl image);
+    void boxArtFetchCompleted(QString uuid, NvApp app, QUrl image);
 
 private:
     void run()
     {
-        QUrl image = m_Bam->loadBoxArtFromNetwork(m_Computer, m_App.id);
+        QUrl image = m_Bam->loadBoxArtFromCache(m_Load.uuid, m_Load.app.id);
+        if (image.isEmpty()) {
+            image = m_Bam->loadBoxArtFromNetwork(m_Load);
+        }
         if (image.isEmpty()) {
             // Give it another shot if it fails once
-            image = m_Bam->loadBoxArtFromNetwork(m_Computer, m_App.id);
+            image = m_Bam->loadBoxArtFromNetwork(m_Load);
         }
-        emit boxArtFetchCompleted(m_Computer, m_App, image);
+        emit boxArtFetchCompleted(m_Load.uuid, m_Load.app, image);
     }
 
     BoxArtManager* m_Bam;
-    NvComputer* m_Computer;
-    NvApp m_App;
+    BoxArtManager::PendingLoad m_Load;
 };
 
 QUrl BoxArtManager::loadBoxArt(NvComputer* computer, NvApp& app)
 {
-    // Try to open the cached file if it exists and contains data
-    QFile cacheFile(getFilePathForBoxArt(computer, app.id));
-    if (cacheFile.exists() && cacheFile.size() > 0) {
-        return QUrl::fromLocalFile(cacheFile.fileName());
+    if (isBoxArtCached(computer->uuid, app.id)) {
+        return getBoxArtUrl(computer->uuid, app.id);
     }
 
-    // If we get here, we need to fetch asynchronously.
-    // Kick off a worker on our thread pool to do just that.
-    NetworkBoxArtLoadTask* netLoadTask = new NetworkBoxArtLoadTask(this, computer, app);
-    m_ThreadPool.start(netLoadTask);
+    // If we get here, we need to fetch asynchronously. The view
+    // is waiting on this one, so it goes ahead of any prefetches.
+    queueBoxArtLoad(computer, app, true);
 
     // Return the placeholder then we can notify the caller
     // later when the real image is ready.
     return QUrl("qrc:/res/no_app_image.png");
 }
 
+void BoxArtManager::prefetchBoxArt(NvComputer* computer, const QVector<NvApp>& apps)
+{
+    for (const NvApp& app : apps) {
+        if (!isBoxArtCached(computer->uuid, app.id)) {
+            queueBoxArtLoad(computer, app, false);
+        }
+    }
+}
+
+void BoxArtManager::queueBoxArtLoad(NvComputer* computer, const NvApp& app, bool urgent)
+{
+    PendingLoad load;
+    {
+        QReadLocker lock(&computer->lock);
+
+        load.uuid = computer->uuid;
+        load.address = computer->activeAddress;
+        load.httpsPort = computer->activeHttpsPort;
+        load.serverCert = computer->serverCert;
+        load.app = app;
+    }
+
+    QString id = getBoxArtId(load.uuid, app.id);
+
+    if (m_ActiveLoadIds.contains(id)) {
+        return;
+    }
+    else if (m_PendingLoadIds.contains(id)) {
+        if (!urgent) {
+            return;
+        }
+
+        // Move it to the front of the queue, picking up
+        // any change to the host's address while it waited
+        for (int i = 0; i < m_PendingLoads.count(); i++) {
+            if (m_PendingLoads[i].uuid == load.uuid && m_PendingLoads[i].app.id == app.id) {
+                m_PendingLoads.removeAt(i);
+                m_PendingLoads.prepend(load);
+                break;
+            }
+        }
+    }
+    else {
+        if (urgent) {
+            m_PendingLoads.prepend(load);
+        }
+        else {
+            m_PendingLoads.append(load);
+        }
+        m_PendingLoadIds.insert(id);
+    }
+
+    startPendingLoads();
+}
+
+void BoxArtManager::startPendingLoads()
+{
+    // Keep one load per thread in flight, so the queue
+    // can still be reordered until a thread is free.
+    while (m_ActiveLoadIds.count() < m_ThreadPool.maxThreadCount() && !m_PendingLoads.isEmpty()) {
+        PendingLoad load = m_PendingLoads.takeFirst();
+        QString id = getBoxArtId(load.uuid, load.app.id);
+
+        m_PendingLoadIds.remove(id);
+        m_ActiveLoadIds.insert(id);
+
+        // Kick off a worker on our thread pool to fetch it
+        m_ThreadPool.start(new NetworkBoxArtLoadTask(this, load));
+    }
+}
+
+QImage BoxArtManager::loadBoxArtThumbnail(const QString& uuid, int appId, QSize* originalSize)
+{
+    // Only read the pack here. Missing thumbnails are made by a load task.
+    return BoxArtThumbnailCache::get(uuid)->getThumbnail(appId, originalSize);
+}
+
 void BoxArtManager::deleteBoxArt(NvComputer* computer)
 {
     QDir dir(Path::getBoxArtCacheDir());
 
+    // Close the thumbnail pack before we delete it
+    BoxArtThumbnailCache::close(computer->uuid);
+
     // Delete everything in this computer's box art directory
     if (dir.cd(computer->uuid)) {
         dir.removeRecursively();
     }
 }
 
-void BoxArtManager::handleBoxArtLoadComplete(NvComputer* computer, NvApp app, QUrl image)
+void BoxArtManager::handleBoxArtLoadComplete(QString uuid, NvApp app, QUrl image)
 {
+    m_ActiveLoadIds.remove(getBoxArtId(uuid, app.id));
+    startPendingLoads();
+
     if (!image.isEmpty()) {
-        emit boxArtLoadComplete(computer, app, image);
+        emit boxArtLoadComplete(uuid, app, image);
+    }
+}
+
+QUrl BoxArtManager::loadBoxArtFromCache(const QString& uuid, int appId)
+{
+    QImage image(getFilePathForBoxArt(uuid, appId));
+    if (image.isNull()) {
+        return QUrl();
     }
+
+    BoxArtThumbnailCache::get(uuid)->addThumbnail(appId, image);
+    return getBoxArtUrl(uuid, appId);
 }
 
-QUrl BoxArtManager::loadBoxArtFromNetwork(NvComputer* computer, int appId)
+QUrl BoxArtManager::loadBoxArtFromNetwork(const PendingLoad& load)
 {
-    NvHTTP http(computer);
+    NvHTTP http(load.address, load.httpsPort, load.serverCert);
 
-    QString cachePath = getFilePathForBoxArt(computer, appId);
-    QImage image;
+    QByteArray data;
     try {
-        image = http.getBoxArt(appId);
+        data = http.getBoxArtData(load.app.id);
     } catch (...) {}
 
-    // Cache the box art on disk if it loaded
-    if (!image.isNull()) {
-        if (image.save(cachePath)) {
-            return QUrl::fromLocalFile(cachePath);
-        }
-        else {
-            // A failed save() may leave a zero byte file. Make sure that's removed.
-            QFile(cachePath).remove();
-        }
+    // Make sure the host actually sent us an image
+    QImage image = QImage::fromData(data);
+    if (image.isNull()) {
+        return QUrl();
     }
 
-    return QUrl();
+    // Cache the box art on disk exactly as we received it rather than
+    // spending time re-encoding it. QSaveFile ensures we never leave
+    // a partially written file behind if this fails.
+    QSaveFile cacheFile(getFilePathForBoxArt(load.uuid, load.app.id));
+    if (!cacheFile.open(QIODevice::WriteOnly) ||
+            cacheFile.write(data) != data.size() ||
+            !cacheFile.commit()) {
+        qWarning() << "Unable to cache box art:" << cacheFile.errorString();
+        return QUrl();
+    }
+
+    // We've already decoded it, so make the thumbnail while we're here
+    BoxArtThumbnailCache::get(load.uuid)->addThumbnail(load.app.id, image);
+
+    return getBoxArtUrl(load.uuid, load.app.id);
 }
 
 #include "boxartmanager.moc"
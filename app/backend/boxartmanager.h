@@ -1,8 +1,8 @@
 #pragma once
 
 #include "computermanager.h"
-#include <QDir>
 #include <QImage>
+#include <QSet>
 #include <QThreadPool>
 #include <QRunnable>
 
@@ -18,27 +18,74 @@ public:
     QUrl
     loadBoxArt(NvComputer* computer, NvApp& app);
 
+    // Queues box art downloads for these apps in the order given. Box art
+    // requested by loadBoxArt() always goes ahead of prefetched box art.
+    void
+    prefetchBoxArt(NvComputer* computer, const QVector<NvApp>& apps);
+
+    // Loads the thumbnail of the box art for the boxart image provider.
+    // Returns a null image if the thumbnail isn't in the pack yet.
+    static
+    QImage
+    loadBoxArtThumbnail(const QString& uuid, int appId, QSize* originalSize);
+
     static
     void
     deleteBoxArt(NvComputer* computer);
 
 signals:
     void
-    boxArtLoadComplete(NvComputer* computer, NvApp app, QUrl image);
+    boxArtLoadComplete(QString uuid, NvApp app, QUrl image);
 
 public slots:
 
 private slots:
     void
-    handleBoxArtLoadComplete(NvComputer* computer, NvApp app, QUrl image);
+    handleBoxArtLoadComplete(QString uuid, NvApp app, QUrl image);
 
 private:
+    // Loads can outlive the host, so they carry what they need
+    // to reach it rather than a pointer to the NvComputer
+    struct PendingLoad
+    {
+        QString uuid;
+        NvAddress address;
+        uint16_t httpsPort;
+        QSslCertificate serverCert;
+        NvApp app;
+    };
+
+    void
+    queueBoxArtLoad(NvComputer* computer, const NvApp& app, bool urgent);
+
+    void
+    startPendingLoads();
+
+    // Makes a thumbnail from box art we've already downloaded
+    QUrl
+    loadBoxArtFromCache(const QString& uuid, int appId);
+
+    QUrl
+    loadBoxArtFromNetwork(const PendingLoad& load);
+
+    static
+    bool
+    isBoxArtCached(const QString& uuid, int appId);
+
+    static
+    QString
+    getBoxArtId(const QString& uuid, int appId);
+
+    static
     QUrl
-    loadBoxArtFromNetwork(NvComputer* computer, int appId);
+    getBoxArtUrl(const QString& uuid, int appId);
 
+    static
     QString
-    getFilePathForBoxArt(NvComputer* computer, int appId);
+    getFilePathForBoxArt(const QString& uuid, int appId);
 
-    QDir m_BoxArtDir;
     QThreadPool m_ThreadPool;
+    QList<PendingLoad> m_PendingLoads;
+    QSet<QString> m_PendingLoadIds;
+    QSet<QString> m_ActiveLoadIds;
 };
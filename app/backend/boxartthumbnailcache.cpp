@@ -0,0 +1,422 @@
+#include "boxartthumbnailcache.h"
+#include "../path.h"
+
+#include <QDir>
+#include <QGuiApplication>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QThreadPool>
+#include <QVector>
+#include <QtMath>
+
+#include <algorithm>
+
+#define THUMBNAIL_PACK_FILE_NAME "thumbnails.pack"
+
+#define THUMBNAIL_PACK_MAGIC 0x5442464D // "MFBT"
+#define THUMBNAIL_PACK_VERSION 1
+
+// Thumbnails are stored at the size the app grid draws box art,
+// scaled by the device pixel ratio so they stay sharp on HiDPI.
+#define THUMBNAIL_WIDTH 200
+#define THUMBNAIL_HEIGHT 267
+
+// Largest pack file we'll keep for each host. Compacting the pack
+// shrinks it to 3/4 of this size to leave room for new thumbnails.
+#define THUMBNAIL_PACK_MAX_SIZE (128 * 1024 * 1024)
+
+// The pack at least doubles in size each time it grows, but never by less
+// than this, so we rarely have to map it again while adding thumbnails.
+#define THUMBNAIL_PACK_MIN_GROWTH (4 * 1024 * 1024)
+
+// All fields are 32 bits, so thumbnail pixels stay 32-bit aligned
+typedef struct _THUMBNAIL_PACK_HEADER {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t thumbnailWidth;
+    uint32_t thumbnailHeight;
+} THUMBNAIL_PACK_HEADER;
+
+// Each entry header is followed by height * bytesPerLine bytes
+// of pixels in QImage::Format_ARGB32_Premultiplied. The unused
+// space at the end of the pack is zeroed, so a zero width marks
+// the end of the thumbnails.
+typedef struct _THUMBNAIL_ENTRY_HEADER {
+    uint32_t appId;
+    uint32_t originalWidth;
+    uint32_t originalHeight;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytesPerLine;
+} THUMBNAIL_ENTRY_HEADER;
+
+static QMutex s_CachesLock;
+static QHash<QString, QSharedPointer<BoxArtThumbnailCache>> s_Caches;
+
+QSharedPointer<BoxArtThumbnailCache> BoxArtThumbnailCache::get(const QString& uuid)
+{
+    QMutexLocker locker(&s_CachesLock);
+
+    QSharedPointer<BoxArtThumbnailCache> cache = s_Caches.value(uuid);
+    if (cache.isNull()) {
+        QDir dir(Path::getBoxArtCacheDir());
+        dir.mkpath(uuid);
+
+        cache.reset(new BoxArtThumbnailCache(dir.filePath(uuid + "/" THUMBNAIL_PACK_FILE_NAME)));
+        s_Caches.insert(uuid, cache);
+    }
+
+    return cache;
+}
+
+class ThumbnailCachePreloadTask : public QRunnable
+{
+public:
+    ThumbnailCachePreloadTask(const QStringList& uuids)
+        : m_Uuids(uuids) {}
+
+    void run()
+    {
+        for (const QString& uuid : std::as_const(m_Uuids)) {
+            BoxArtThumbnailCache::get(uuid);
+        }
+    }
+
+    QStringList m_Uuids;
+};
+
+void BoxArtThumbnailCache::preload(const QStringList& uuids)
+{
+    if (!uuids.isEmpty()) {
+        QThreadPool::globalInstance()->start(new ThumbnailCachePreloadTask(uuids));
+    }
+}
+
+void BoxArtThumbnailCache::close(const QString& uuid)
+{
+    QMutexLocker locker(&s_CachesLock);
+
+    // The pack is closed once the last user drops its reference
+    s_Caches.remove(uuid);
+}
+
+BoxArtThumbnailCache::BoxArtThumbnailCache(const QString& path)
+    : m_File(path),
+      m_Data(nullptr),
+      m_DataSize(0),
+      m_MapSize(0),
+      m_UseCounter(0)
+{
+    qreal devicePixelRatio = qGuiApp != nullptr ? qGuiApp->devicePixelRatio() : 1.0;
+    m_ThumbnailSize = QSize(qCeil(THUMBNAIL_WIDTH * devicePixelRatio),
+                            qCeil(THUMBNAIL_HEIGHT * devicePixelRatio));
+
+    if (!m_File.open(QIODevice::ReadWrite)) {
+        qWarning() << "Unable to open box art thumbnail pack:" << m_File.errorString();
+        return;
+    }
+
+    // Start over if the pack is from another version or display scale
+    THUMBNAIL_PACK_HEADER header;
+    if (m_File.read((char*)&header, sizeof(header)) != sizeof(header) ||
+            header.magic != THUMBNAIL_PACK_MAGIC ||
+            header.version != THUMBNAIL_PACK_VERSION ||
+            header.thumbnailWidth != (uint32_t)m_ThumbnailSize.width() ||
+            header.thumbnailHeight != (uint32_t)m_ThumbnailSize.height()) {
+        header.magic = THUMBNAIL_PACK_MAGIC;
+        header.version = THUMBNAIL_PACK_VERSION;
+        header.thumbnailWidth = m_ThumbnailSize.width();
+        header.thumbnailHeight = m_ThumbnailSize.height();
+
+        if (!m_File.resize(0) || !m_File.seek(0) ||
+                m_File.write((const char*)&header, sizeof(header)) != sizeof(header) ||
+                !m_File.flush()) {
+            qWarning() << "Unable to initialize box art thumbnail pack:" << m_File.errorString();
+            m_File.close();
+            return;
+        }
+    }
+
+    if (!map()) {
+        m_File.close();
+        return;
+    }
+
+    loadEntries();
+}
+
+BoxArtThumbnailCache::~BoxArtThumbnailCache()
+{
+    unmap();
+}
+
+bool BoxArtThumbnailCache::map()
+{
+    m_MapSize = m_File.size();
+    m_Data = m_File.map(0, m_MapSize);
+    if (m_Data == nullptr) {
+        qWarning() << "Unable to map box art thumbnail pack:" << m_File.errorString();
+        m_MapSize = 0;
+        return false;
+    }
+
+    return true;
+}
+
+void BoxArtThumbnailCache::unmap()
+{
+    if (m_Data != nullptr) {
+        m_File.unmap(m_Data);
+        m_Data = nullptr;
+    }
+}
+
+void BoxArtThumbnailCache::grow(qint64 sizeNeeded)
+{
+    qint64 newSize = qMin(qMax(m_MapSize * 2, sizeNeeded + THUMBNAIL_PACK_MIN_GROWTH),
+                          (qint64)THUMBNAIL_PACK_MAX_SIZE);
+    if (newSize < sizeNeeded) {
+        // Only possible if we couldn't compact the pack
+        return;
+    }
+
+    // The mapping can't be resized while the app grid may be reading it,
+    // so copy every thumbnail into a bigger pack instead. The new space
+    // is zero-filled.
+    rebuild(getEntriesByLastUse(), newSize);
+}
+
+void BoxArtThumbnailCache::loadEntries()
+{
+    qint64 offset = sizeof(THUMBNAIL_PACK_HEADER);
+
+    while (offset + (qint64)sizeof(THUMBNAIL_ENTRY_HEADER) <= m_MapSize) {
+        THUMBNAIL_ENTRY_HEADER header;
+        memcpy(&header, m_Data + offset, sizeof(header));
+
+        Entry entry;
+        entry.offset = offset;
+        entry.originalSize = QSize(header.originalWidth, header.originalHeight);
+        entry.size = QSize(header.width, header.height);
+        entry.bytesPerLine = header.bytesPerLine;
+
+        // Later thumbnails replace earlier ones for the same app, so
+        // pack order also tells us which thumbnails are the newest.
+        entry.lastUsed = ++m_UseCounter;
+
+        // Stop at the unused space or anything malformed
+        if (header.width == 0 || header.height == 0 ||
+                header.bytesPerLine < header.width * 4 ||
+                offset + getEntrySize(entry) > m_MapSize) {
+            break;
+        }
+
+        m_Entries.insert(header.appId, entry);
+        offset += getEntrySize(entry);
+    }
+
+    // New thumbnails go after the last one we could read. Clear the header
+    // there in case it's garbage, so it can't look valid after a partial write.
+    m_DataSize = offset;
+    if (m_DataSize + (qint64)sizeof(THUMBNAIL_ENTRY_HEADER) <= m_MapSize) {
+        memset(m_Data + m_DataSize, 0, sizeof(THUMBNAIL_ENTRY_HEADER));
+    }
+}
+
+qint64 BoxArtThumbnailCache::getEntrySize(const Entry& entry)
+{
+    return sizeof(THUMBNAIL_ENTRY_HEADER) + (qint64)entry.bytesPerLine * entry.size.height();
+}
+
+bool BoxArtThumbnailCache::contains(int appId)
+{
+    QMutexLocker locker(&m_Lock);
+
+    return m_Entries.contains(appId);
+}
+
+QImage BoxArtThumbnailCache::getThumbnail(int appId, QSize* originalSize)
+{
+    QMutexLocker locker(&m_Lock);
+
+    auto it = m_Entries.find(appId);
+    if (it == m_Entries.end() || m_Data == nullptr) {
+        return QImage();
+    }
+
+    it->lastUsed = ++m_UseCounter;
+    *originalSize = it->originalSize;
+
+    // Copy the pixels out of the mapping, since it's replaced whenever the
+    // pack grows. This is far cheaper than decoding and scaling the image.
+    return QImage(m_Data + it->offset + sizeof(THUMBNAIL_ENTRY_HEADER),
+                  it->size.width(), it->size.height(), it->bytesPerLine,
+                  QImage::Format_ARGB32_Premultiplied).copy();
+}
+
+QImage BoxArtThumbnailCache::addThumbnail(int appId, const QImage& image)
+{
+    // The app grid stretches box art to fill its cells, so we do too
+    QImage thumbnail = image.scaled(m_ThumbnailSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation)
+                            .convertToFormat(QImage::Format_ARGB32_Premultiplied);
+
+    THUMBNAIL_ENTRY_HEADER header;
+    header.appId = appId;
+    header.originalWidth = image.width();
+    header.originalHeight = image.height();
+    header.width = thumbnail.width();
+    header.height = thumbnail.height();
+    header.bytesPerLine = thumbnail.bytesPerLine();
+
+    Entry entry;
+    entry.originalSize = image.size();
+    entry.size = thumbnail.size();
+    entry.bytesPerLine = thumbnail.bytesPerLine();
+
+    qint64 entrySize = getEntrySize(entry);
+
+    QMutexLocker writeLocker(&m_WriteLock);
+
+    if (!m_File.isOpen()) {
+        return thumbnail;
+    }
+
+    if (m_DataSize + entrySize > THUMBNAIL_PACK_MAX_SIZE) {
+        compact(entrySize);
+    }
+    else if (m_DataSize + entrySize > m_MapSize) {
+        grow(m_DataSize + entrySize);
+    }
+
+    if (!m_File.isOpen() || m_DataSize + entrySize > m_MapSize) {
+        return thumbnail;
+    }
+
+    // Copy the thumbnail into the unused space after the last one, which
+    // no reader looks at. The header goes in last, so a thumbnail that's
+    // cut off partway through is ignored by loadEntries() rather than
+    // read back with missing pixels.
+    entry.offset = m_DataSize;
+    memcpy(m_Data + entry.offset + sizeof(header), thumbnail.constBits(), entrySize - sizeof(header));
+    memcpy(m_Data + entry.offset, &header, sizeof(header));
+    m_DataSize += entrySize;
+
+    QMutexLocker locker(&m_Lock);
+    entry.lastUsed = ++m_UseCounter;
+    m_Entries.insert(appId, entry);
+
+    return thumbnail;
+}
+
+BoxArtThumbnailCache::EntryList BoxArtThumbnailCache::getEntriesByLastUse()
+{
+    EntryList entries;
+
+    {
+        QMutexLocker locker(&m_Lock);
+
+        entries.reserve(m_Entries.size());
+        for (auto it = m_Entries.cbegin(); it != m_Entries.cend(); ++it) {
+            entries.append(qMakePair(it.key(), it.value()));
+        }
+    }
+
+    // Least recently used first, which is the order we
+    // assume thumbnails are in when we load the pack again
+    std::sort(entries.begin(), entries.end(), [](const QPair<int, Entry>& a, const QPair<int, Entry>& b) {
+        return a.second.lastUsed < b.second.lastUsed;
+    });
+
+    return entries;
+}
+
+void BoxArtThumbnailCache::compact(qint64 spaceNeeded)
+{
+    // Keep the most recently used thumbnails that fit in 3/4 of the limit
+    // along with the new one. Thumbnails replaced by a newer version for the
+    // same app aren't in m_Entries, so they're dropped here too.
+    EntryList entries = getEntriesByLastUse();
+    int oldCount = entries.count();
+
+    qint64 budget = THUMBNAIL_PACK_MAX_SIZE / 4 * 3 - (qint64)sizeof(THUMBNAIL_PACK_HEADER) - spaceNeeded;
+    int keepCount = 0;
+    for (auto it = entries.crbegin(); it != entries.crend(); ++it) {
+        if (getEntrySize(it->second) > budget) {
+            break;
+        }
+        budget -= getEntrySize(it->second);
+        keepCount++;
+    }
+    entries.remove(0, entries.count() - keepCount);
+
+    // Leave the rest of the limit free for new thumbnails
+    if (rebuild(entries, THUMBNAIL_PACK_MAX_SIZE)) {
+        qInfo() << "Evicted" << oldCount - keepCount << "box art thumbnails";
+    }
+}
+
+bool BoxArtThumbnailCache::rebuild(const EntryList& entries, qint64 newSize)
+{
+    // Write the new pack without m_Lock, so the app grid can keep reading
+    // thumbnails out of the old one. It won't be replaced under us, since
+    // we hold m_WriteLock. QSaveFile leaves the old pack alone if we fail.
+    QSaveFile newPack(m_File.fileName());
+    if (!newPack.open(QIODevice::WriteOnly)) {
+        qWarning() << "Unable to rebuild box art thumbnail pack:" << newPack.errorString();
+        return false;
+    }
+
+    QHash<int, Entry> newEntries;
+    qint64 offset = sizeof(THUMBNAIL_PACK_HEADER);
+    bool ok = newPack.write((const char*)m_Data, sizeof(THUMBNAIL_PACK_HEADER)) == sizeof(THUMBNAIL_PACK_HEADER);
+    for (const auto& entry : entries) {
+        if (!ok) {
+            break;
+        }
+        ok = newPack.write((const char*)m_Data + entry.second.offset, getEntrySize(entry.second)) == getEntrySize(entry.second);
+
+        Entry newEntry = entry.second;
+        newEntry.offset = offset;
+        newEntries.insert(entry.first, newEntry);
+        offset += getEntrySize(newEntry);
+    }
+
+    // The space after the thumbnails is zero-filled, which marks the end of them
+    if (!ok || !newPack.resize(qMax(newSize, offset))) {
+        qWarning() << "Unable to rebuild box art thumbnail pack:" << newPack.errorString();
+        return false;
+    }
+
+    QMutexLocker locker(&m_Lock);
+
+    // Release the old pack before replacing it
+    unmap();
+    m_File.close();
+
+    bool committed = newPack.commit();
+    if (!committed) {
+        qWarning() << "Unable to replace box art thumbnail pack:" << newPack.errorString();
+    }
+
+    // This is the old pack if we couldn't replace it
+    if (!m_File.open(QIODevice::ReadWrite) || !map()) {
+        m_Entries.clear();
+        m_File.close();
+        return false;
+    }
+
+    if (committed) {
+        // Carry over any uses of the thumbnails while we were writing
+        for (auto it = newEntries.begin(); it != newEntries.end(); ++it) {
+            auto current = m_Entries.constFind(it.key());
+            if (current != m_Entries.cend()) {
+                it->lastUsed = current->lastUsed;
+            }
+        }
+
+        m_Entries = newEntries;
+        m_DataSize = offset;
+    }
+
+    return committed;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <QFile>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QPair>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QVector>
+
+// Pre-scaled box art thumbnails for a single host, stored together in one
+// pack file. The pack is memory-mapped when it's opened, so the app
+// grid can paint box art without decoding and scaling each image again.
+//
+// The pack file is grown ahead of the thumbnails written into it, so most
+// new thumbnails are just copied into the existing mapping. When the pack
+// grows past its size limit, the thumbnails that have gone the longest
+// without being used are evicted.
+//
+// Growing or compacting the pack writes a new one alongside it, which can
+// take a while, so that's done without blocking readers. They only wait
+// while the new pack is swapped in.
+class BoxArtThumbnailCache
+{
+public:
+    // Returns the thumbnail cache for the host with this UUID, opening
+    // it first if it hasn't been preloaded
+    static QSharedPointer<BoxArtThumbnailCache> get(const QString& uuid);
+
+    // Opens the thumbnail caches for these hosts on a worker thread, so the
+    // first box art we paint for them doesn't wait on mapping the pack
+    static void preload(const QStringList& uuids);
+
+    // Closes the thumbnail cache for this host, so its files can be deleted
+    static void close(const QString& uuid);
+
+    ~BoxArtThumbnailCache();
+
+    bool contains(int appId);
+
+    // Returns a null image if there's no thumbnail for this app. originalSize
+    // is set to the size of the box art the thumbnail was made from.
+    QImage getThumbnail(int appId, QSize* originalSize);
+
+    // Scales the box art down and stores it. Returns the new thumbnail.
+    QImage addThumbnail(int appId, const QImage& image);
+
+private:
+    struct Entry
+    {
+        qint64 offset; // Offset of the entry header
+        QSize originalSize;
+        QSize size;
+        int bytesPerLine;
+        quint64 lastUsed;
+    };
+
+    explicit BoxArtThumbnailCache(const QString& path);
+
+    typedef QVector<QPair<int, Entry>> EntryList;
+
+    bool map();
+
+    void unmap();
+
+    void grow(qint64 sizeNeeded);
+
+    void loadEntries();
+
+    void compact(qint64 spaceNeeded);
+
+    bool rebuild(const EntryList& entries, qint64 newSize);
+
+    EntryList getEntriesByLastUse();
+
+    static qint64 getEntrySize(const Entry& entry);
+
+    // m_Lock guards the mapping and the entries, and is only held briefly.
+    // m_WriteLock is held by the one thread adding a thumbnail, which is the
+    // only one that replaces the mapping, so it may read it without m_Lock.
+    QMutex m_Lock;
+    QMutex m_WriteLock;
+    QFile m_File;
+    uchar* m_Data;
+    qint64 m_DataSize; // Bytes in use by the header and thumbnails
+    qint64 m_MapSize; // Size of the pack file and our mapping of it
+    QSize m_ThumbnailSize;
+    QHash<int, Entry> m_Entries;
+    quint64 m_UseCounter;
+};
@@ -1,5 +1,6 @@
 #include "computermanager.h"
 #include "boxartmanager.h"
+#include "boxartthumbnailcache.h"
 #include "nvhttp.h"
 #include "nvpairingmanager.h"
 
@@ -14,150 +15,6 @@
 #define SER_HOSTS "hosts"
 #define SER_HOSTS_BACKUP "hostsbackup"
 
-class PcMonitorThread : public QThread
-{
-    Q_OBJECT
-
-#define TRIES_BEFORE_OFFLINING 2
-#define POLLS_PER_APPLIST_FETCH 10
-
-public:
-    PcMonitorThread(NvComputer* computer)
-        : m_Computer(computer)
-    {
-        setObjectName("Polling thread for " + computer->name);
-    }
-
-private:
-    bool tryPollComputer(QNetworkAccessManager* nam, NvAddress address, bool& changed)
-    {
-        NvHTTP http(address, 0, m_Computer->serverCert, nam);
-
-        QString serverInfo;
-        try {
-            serverInfo = http.getServerInfo(NvHTTP::NvLogLevel::NVLL_NONE, true);
-        } catch (...) {
-            return false;
-        }
-
-        NvComputer newState(http, serverInfo);
-
-        // Ensure the machine that responded is the one we intended to contact
-        if (m_Computer->uuid != newState.uuid) {
-            qInfo() << "Found unexpected PC" << newState.name << "looking for" << m_Computer->name;
-            return false;
-        }
-
-        changed = m_Computer->update(newState);
-        return true;
-    }
-
-    bool updateAppList(QNetworkAccessManager* nam, bool& changed)
-    {
-        NvHTTP http(m_Computer, nam);
-
-        QVector<NvApp> appList;
-
-        try {
-            appList = http.getAppList();
-            if (appList.isEmpty()) {
-                return false;
-            }
-        } catch (...) {
-            return false;
-        }
-
-        QWriteLocker lock(&m_Computer->lock);
-        changed = m_Computer->updateAppList(appList);
-        return true;
-    }
-
-    void run() override
-    {
-        // Reduce the power and performance impact of our
-        // computer status polling while it's running.
-        setPriority(QThread::LowPriority);
-#if QT_VERSION >= QT_VERSION_CHECK(6, 9, 0)
-        setServiceLevel(QThread::QualityOfService::Eco);
-#endif
-
-        // Share the QNetworkAccessManager to conserve resources when polling.
-        // Each instance creates a worker thread, so sharing them ensures that
-        // we are not spamming a new thread for every single polling attempt.
-        //
-        // Since QThread inherit the priority of the current thread, this also
-        // ensures that the NAM's worker thread will inherit our lower priority.
-        QNetworkAccessManager nam;
-
-        // Always fetch the applist the first time
-        int pollsSinceLastAppListFetch = POLLS_PER_APPLIST_FETCH;
-        while (!isInterruptionRequested()) {
-            bool stateChanged = false;
-            bool online = false;
-            bool wasOnline = m_Computer->state == NvComputer::CS_ONLINE;
-            for (int i = 0; i < (wasOnline ? TRIES_BEFORE_OFFLINING : 1) && !online; i++) {
-                for (auto& address : m_Computer->uniqueAddresses()) {
-                    if (isInterruptionRequested()) {
-                        return;
-                    }
-
-                    if (tryPollComputer(&nam, address, stateChanged)) {
-                        if (!wasOnline) {
-                            qInfo() << m_Computer->name << "is now online at" << m_Computer->activeAddress.toString();
-                        }
-                        online = true;
-                        break;
-                    }
-                }
-            }
-
-            // Check if we failed after all retry attempts
-            // Note: we don't need to acquire the read lock here,
-            // because we're on the writing thread.
-            if (!online && m_Computer->state != NvComputer::CS_OFFLINE) {
-                qInfo() << m_Computer->name << "is now offline";
-                m_Computer->state = NvComputer::CS_OFFLINE;
-                stateChanged = true;
-            }
-
-            // Grab the applist if it's empty or it's been long enough that we need to refresh
-            pollsSinceLastAppListFetch++;
-            if (m_Computer->state == NvComputer::CS_ONLINE &&
-                    m_Computer->pairState == NvComputer::PS_PAIRED &&
-                    (m_Computer->appList.isEmpty() || pollsSinceLastAppListFetch >= POLLS_PER_APPLIST_FETCH)) {
-                // Notify prior to the app list poll since it may take a while, and we don't
-                // want to delay onlining of a machine, especially if we already have a cached list.
-                if (stateChanged) {
-                    emit computerStateChanged(m_Computer);
-                    stateChanged = false;
-                }
-
-                if (updateAppList(&nam, stateChanged)) {
-                    pollsSinceLastAppListFetch = 0;
-                }
-            }
-
-            if (stateChanged) {
-                // Tell anyone listening that we've changed state
-                emit computerStateChanged(m_Computer);
-            }
-
-            // Wait a bit to poll again, but do it in 100 ms chunks
-            // so we can be interrupted reasonably quickly.
-            // FIXME: QWaitCondition would be better.
-            for (int i = 0; i < 30 && !isInterruptionRequested(); i++) {
-                QThread::msleep(100);
-            }
-        }
-    }
-
-signals:
-   void computerStateChanged(NvComputer* computer);
-
-private:
-    NvComputer* m_Computer;
-};
-
 ComputerManager::ComputerManager(StreamingPreferences* prefs)
     : m_Prefs(prefs),
       m_PollingRef(0),
@@ -185,9 +42,19 @@ ComputerManager::ComputerManager(StreamingPreferences* prefs)
     }
     settings.endArray();
 
+    // Open the box art thumbnails of our hosts before the app grid needs them
+    BoxArtThumbnailCache::preload(m_KnownHosts.keys());
+
     // Fetch latest compatibility data asynchronously
     m_CompatFetcher.start();
 
+    // Start polling known hosts on a separate thread
+    m_Poller = new ComputerPoller();
+    connect(m_Poller, &ComputerPoller::computerStateChanged,
+            this, &ComputerManager::handleComputerStateChanged);
+    connect(m_Poller, &ComputerPoller::appListChanged,
+            this, &ComputerManager::appListChanged);
+
     // Start the delayed flush thread to handle saveHosts() calls
     m_DelayedFlushThread = new DelayedFlushThread(this);
     m_DelayedFlushThread->start();
@@ -230,15 +97,8 @@ ComputerManager::~ComputerManager()
     delete m_MdnsBrowser;
     m_MdnsBrowser = nullptr;
 
-    // Interrupt polling
-    for (ComputerPollingEntry* entry : std::as_const(m_PollEntries)) {
-        entry->interrupt();
-    }
-
-    // Delete all polling entries (and associated threads)
-    for (ComputerPollingEntry* entry : std::as_const(m_PollEntries)) {
-        delete entry;
-    }
+    // Stop polling and wait for the polling thread to terminate
+    delete m_Poller;
 
     // Destroy all NvComputer objects now that polling is halted
     for (NvComputer* computer : std::as_const(m_KnownHosts)) {
@@ -384,7 +244,7 @@ void ComputerManager::startPolling()
         qWarning() << "mDNS is disabled by user preference";
     }
 
-    // Start polling threads for each known host
+    // Start polling each known host
     QMapIterator<QString, NvComputer*> i(m_KnownHosts);
     while (i.hasNext()) {
         i.next();
@@ -399,22 +259,7 @@ void ComputerManager::startPollingComputer(NvComputer* computer)
         return;
     }
 
-    ComputerPollingEntry* pollingEntry;
-
-    if (!m_PollEntries.contains(computer->uuid)) {
-        pollingEntry = m_PollEntries[computer->uuid] = new ComputerPollingEntry();
-    }
-    else {
-        pollingEntry = m_PollEntries[computer->uuid];
-    }
-
-    if (!pollingEntry->isActive()) {
-        PcMonitorThread* thread = new PcMonitorThread(computer);
-        connect(thread, &PcMonitorThread::computerStateChanged,
-                this, &ComputerManager::handleComputerStateChanged);
-        pollingEntry->setActiveThread(thread);
-        thread->start();
-    }
+    m_Poller->addComputer(computer);
 }
 
 void ComputerManager::handleMdnsServiceResolved(MdnsPendingComputer* computer,
@@ -506,29 +351,25 @@ public:
 
     void run()
     {
-        ComputerPollingEntry* pollingEntry;
-
         // Only do the minimum amount of work while holding the writer lock.
         // We must release it before calling saveHosts().
         {
             QWriteLocker lock(&m_ComputerManager->m_Lock);
 
-            pollingEntry = m_ComputerManager->m_PollEntries.take(m_Computer->uuid);
-
             m_ComputerManager->m_KnownHosts.remove(m_Computer->uuid);
         }
 
         // Persist the new host list with this computer deleted
         m_ComputerManager->saveHosts();
 
-        // Delete the polling entry first. This will stop all polling threads too.
-        delete pollingEntry;
+        // Stop polling first. This waits until the poller is done with the computer.
+        m_ComputerManager->m_Poller->removeComputer(m_Computer);
 
         // Delete cached box art
         BoxArtManager::deleteBoxArt(m_Computer);
 
         // Finally, delete the computer itself. This must be done
-        // last because the polling thread might be using it.
+        // last because the poller might have been using it.
         delete m_Computer;
     }
 
@@ -567,11 +408,9 @@ void ComputerManager::handleAboutToQuit()
 {
     QReadLocker lock(&m_Lock);
 
-    // Interrupt polling threads immediately, so they
-    // avoid making additional requests while quitting
-    for (ComputerPollingEntry* entry : std::as_const(m_PollEntries)) {
-        entry->interrupt();
-    }
+    // Stop polling immediately, so we avoid
+    // making additional requests while quitting
+    m_Poller->removeAllComputers();
 }
 
 class PendingPairingTask : public QObject, public QRunnable
@@ -720,10 +559,8 @@ void ComputerManager::stopPollingAsync()
     m_MdnsBrowser = nullptr;
     m_MdnsServer.reset();
 
-    // Interrupt all threads, but don't wait for them to terminate
-    for (ComputerPollingEntry* entry : std::as_const(m_PollEntries)) {
-        entry->interrupt();
-    }
+    // Stop polling, but don't wait for requests in progress to be torn down
+    m_Poller->removeAllComputers();
 }
 
 void ComputerManager::addNewHostManually(QString address)
@@ -0,0 +1,360 @@
+#include "computerpoller.h"
+
+#include <QCoreApplication>
+#include <QRandomGenerator>
+
+#define TRIES_BEFORE_OFFLINING 2
+#define POLLS_PER_APPLIST_FETCH 10
+
+#define POLL_INTERVAL_MS 3000
+
+// How long each address gets to respond before we start racing
+// the next one, as recommended by RFC 8305 (Happy Eyeballs v2)
+#define ADDRESS_RACE_DELAY_MS 250
+
+// Hosts that stay offline are polled less often, doubling the
+// interval after each failed poll up to 4x POLL_INTERVAL_MS.
+#define MAX_OFFLINE_BACKOFF_SHIFT 2
+
+// Randomize poll intervals by this percentage to keep the
+// requests for many hosts from all being sent at once.
+#define POLL_JITTER_PERCENT 10
+
+ComputerPoller::ComputerPoller()
+    : m_Nam(nullptr)
+{
+    m_Thread.setObjectName("Computer polling thread");
+
+    // Reduce the power and performance impact of our
+    // computer status polling while it's running.
+    //
+    // Since QThread inherit the priority of the current thread, this also
+    // ensures that the NAM's worker thread will inherit our lower priority.
+    moveToThread(&m_Thread);
+    m_Thread.start(QThread::LowPriority);
+}
+
+ComputerPoller::~ComputerPoller()
+{
+    // Clean up our requests and timers on the polling thread that owns them
+    QMetaObject::invokeMethod(this, "shutdown", Qt::BlockingQueuedConnection);
+
+    m_Thread.quit();
+    m_Thread.wait();
+}
+
+void ComputerPoller::addComputer(NvComputer* computer)
+{
+    queueChange(computer, true, Qt::QueuedConnection);
+}
+
+void ComputerPoller::removeAllComputers()
+{
+    queueChange(nullptr, false, Qt::QueuedConnection);
+}
+
+void ComputerPoller::removeComputer(NvComputer* computer)
+{
+    queueChange(computer, false, Qt::BlockingQueuedConnection);
+}
+
+void ComputerPoller::queueChange(NvComputer* computer, bool add, Qt::ConnectionType type)
+{
+    {
+        QMutexLocker locker(&m_PendingChangesLock);
+        m_PendingChanges.append({ computer, add });
+    }
+
+    if (QThread::currentThread() == &m_Thread) {
+        processPendingChanges();
+    }
+    else {
+        QMetaObject::invokeMethod(this, "processPendingChanges", type);
+    }
+}
+
+void ComputerPoller::processPendingChanges()
+{
+    QVector<PendingChange> changes;
+
+    {
+        QMutexLocker locker(&m_PendingChangesLock);
+        changes.swap(m_PendingChanges);
+    }
+
+    // Apply the changes in the order they were made
+    for (const PendingChange& change : std::as_const(changes)) {
+        if (change.add) {
+            startPolling(change.computer);
+        }
+        else if (change.computer != nullptr) {
+            PollState* state = m_PollStates.take(change.computer);
+            if (state != nullptr) {
+                stopPolling(state);
+            }
+        }
+        else {
+            for (PollState* state : std::as_const(m_PollStates)) {
+                stopPolling(state);
+            }
+            m_PollStates.clear();
+        }
+    }
+}
+
+void ComputerPoller::shutdown()
+{
+    removeAllComputers();
+
+    // Requests must be gone before the NAM that created them
+    QCoreApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+
+    delete m_Nam;
+    m_Nam = nullptr;
+}
+
+void ComputerPoller::startPolling(NvComputer* computer)
+{
+    if (m_PollStates.contains(computer)) {
+        return;
+    }
+
+    if (m_Nam == nullptr) {
+#if QT_VERSION >= QT_VERSION_CHECK(6, 9, 0)
+        QThread::currentThread()->setServiceLevel(QThread::QualityOfService::Eco);
+#endif
+
+        // Share the QNetworkAccessManager between all hosts to conserve resources
+        // when polling. Each instance creates a worker thread, so sharing it ensures
+        // that we are not spamming a new thread for every single host.
+        m_Nam = new QNetworkAccessManager(this);
+    }
+
+    PollState* state = new PollState();
+    state->computer = computer;
+    state->appListRequest = nullptr;
+    state->wasOnline = false;
+    state->tries = 0;
+    state->failedPolls = 0;
+
+    // Always fetch the applist the first time
+    state->pollsSinceLastAppListFetch = POLLS_PER_APPLIST_FETCH;
+
+    state->pollTimer = new QTimer(this);
+    state->pollTimer->setSingleShot(true);
+    connect(state->pollTimer, &QTimer::timeout, this, [this, state]() {
+        pollComputer(state);
+    });
+
+    state->raceTimer = new QTimer(this);
+    state->raceTimer->setSingleShot(true);
+    connect(state->raceTimer, &QTimer::timeout, this, [this, state]() {
+        startNextServerInfoRequest(state);
+    });
+
+    m_PollStates.insert(computer, state);
+
+    pollComputer(state);
+}
+
+void ComputerPoller::stopPolling(PollState* state)
+{
+    cancelServerInfoRequests(state);
+
+    if (state->appListRequest != nullptr) {
+        disconnect(state->appListRequest, nullptr, this, nullptr);
+        state->appListRequest->deleteLater();
+    }
+
+    delete state->pollTimer;
+    delete state->raceTimer;
+    delete state;
+}
+
+void ComputerPoller::pollComputer(PollState* state)
+{
+    state->wasOnline = state->computer->state == NvComputer::CS_ONLINE;
+    state->tries = 0;
+
+    sendServerInfoRequests(state);
+}
+
+void ComputerPoller::sendServerInfoRequests(PollState* state)
+{
+    state->tries++;
+    state->pendingAddresses = state->computer->uniqueAddresses();
+
+    startNextServerInfoRequest(state);
+}
+
+void ComputerPoller::startNextServerInfoRequest(PollState* state)
+{
+    if (state->pendingAddresses.isEmpty()) {
+        // Wait for the requests in progress unless they've all failed
+        if (state->serverInfoRequests.isEmpty()) {
+            handlePollFailed(state);
+        }
+        return;
+    }
+
+    NvHTTP* http = new NvHTTP(state->pendingAddresses.takeFirst(), 0, state->computer->serverCert, m_Nam);
+    http->setParent(this);
+
+    connect(http, &NvHTTP::serverInfoReceived, this, [this, state, http](QString serverInfo) {
+        handleServerInfoReceived(state, http, serverInfo);
+    });
+    connect(http, &NvHTTP::requestFailed, this, [this, state, http]() {
+        handleServerInfoFailed(state, http);
+    });
+
+    state->serverInfoRequests.append(http);
+    http->getServerInfoAsync(NvHTTP::NvLogLevel::NVLL_NONE, true);
+
+    // Addresses are in order of preference, so give this one a head start
+    // before racing it against the next. If it fails sooner, we'll move on
+    // to the next address right away.
+    if (!state->pendingAddresses.isEmpty()) {
+        state->raceTimer->start(ADDRESS_RACE_DELAY_MS);
+    }
+}
+
+void ComputerPoller::handleServerInfoReceived(PollState* state, NvHTTP* http, QString serverInfo)
+{
+    NvComputer newState(*http, serverInfo);
+
+    // Ensure the machine that responded is the one we intended to contact
+    if (state->computer->uuid != newState.uuid) {
+        qInfo() << "Found unexpected PC" << newState.name << "looking for" << state->computer->name;
+        handleServerInfoFailed(state, http);
+        return;
+    }
+
+    // The first address to respond wins, so stop racing the others
+    cancelServerInfoRequests(state);
+
+    bool stateChanged = state->computer->update(newState);
+    if (!state->wasOnline) {
+        qInfo() << state->computer->name << "is now online at" << state->computer->activeAddress.toString();
+    }
+
+    state->failedPolls = 0;
+    completePoll(state, stateChanged);
+}
+
+void ComputerPoller::handleServerInfoFailed(PollState* state, NvHTTP* http)
+{
+    // We're inside a signal from this object, so it can't be deleted right away
+    state->serverInfoRequests.removeOne(http);
+    disconnect(http, nullptr, this, nullptr);
+    http->deleteLater();
+
+    state->raceTimer->stop();
+    startNextServerInfoRequest(state);
+}
+
+void ComputerPoller::handlePollFailed(PollState* state)
+{
+    // Give hosts that were online another chance before we offline them
+    if (state->wasOnline && state->tries < TRIES_BEFORE_OFFLINING) {
+        sendServerInfoRequests(state);
+        return;
+    }
+
+    // Note: we don't need to acquire the read lock here,
+    // because we're on the writing thread.
+    bool stateChanged = false;
+    if (state->computer->state != NvComputer::CS_OFFLINE) {
+        qInfo() << state->computer->name << "is now offline";
+        state->computer->state = NvComputer::CS_OFFLINE;
+        stateChanged = true;
+    }
+
+    state->failedPolls++;
+    completePoll(state, stateChanged);
+}
+
+void ComputerPoller::cancelServerInfoRequests(PollState* state)
+{
+    // Destroying the NvHTTP objects aborts their requests
+    for (NvHTTP* http : std::as_const(state->serverInfoRequests)) {
+        disconnect(http, nullptr, this, nullptr);
+        http->deleteLater();
+    }
+    state->serverInfoRequests.clear();
+    state->pendingAddresses.clear();
+    state->raceTimer->stop();
+}
+
+void ComputerPoller::completePoll(PollState* state, bool stateChanged)
+{
+    // Grab the applist if it's empty or it's been long enough that we need to refresh
+    state->pollsSinceLastAppListFetch++;
+    if (state->computer->state == NvComputer::CS_ONLINE &&
+            state->computer->pairState == NvComputer::PS_PAIRED &&
+            (state->computer->appList.isEmpty() || state->pollsSinceLastAppListFetch >= POLLS_PER_APPLIST_FETCH)) {
+        // Notify prior to the app list poll since it may take a while, and we don't
+        // want to delay onlining of a machine, especially if we already have a cached list.
+        if (stateChanged) {
+            emit computerStateChanged(state->computer);
+        }
+
+        NvHTTP* http = new NvHTTP(state->computer, m_Nam);
+        http->setParent(this);
+        state->appListRequest = http;
+
+        connect(http, &NvHTTP::appListReceived, this, [this, state, http](QVector<NvApp> appList, QByteArray hash) {
+            state->appListRequest = nullptr;
+            http->deleteLater();
+
+            if (!appList.isEmpty()) {
+                NvComputer::AppListChanges changes;
+
+                {
+                    QWriteLocker lock(&state->computer->lock);
+                    changes = state->computer->updateAppList(appList);
+                }
+
+                state->appListHash = hash;
+                state->pollsSinceLastAppListFetch = 0;
+                if (!changes.isEmpty()) {
+                    emit appListChanged(state->computer, changes);
+                    emit computerStateChanged(state->computer);
+                }
+            }
+
+            scheduleNextPoll(state);
+        });
+        connect(http, &NvHTTP::appListUnchanged, this, [this, state, http]() {
+            state->appListRequest = nullptr;
+            http->deleteLater();
+
+            state->pollsSinceLastAppListFetch = 0;
+            scheduleNextPoll(state);
+        });
+        connect(http, &NvHTTP::requestFailed, this, [this, state, http]() {
+            state->appListRequest = nullptr;
+            http->deleteLater();
+
+            scheduleNextPoll(state);
+        });
+
+        // Only send the hash if we still have the app list it came from
+        http->getAppListAsync(state->computer->appList.isEmpty() ? QByteArray() : state->appListHash);
+        return;
+    }
+
+    if (stateChanged) {
+        // Tell anyone listening that we've changed state
+        emit computerStateChanged(state->computer);
+    }
+
+    scheduleNextPoll(state);
+}
+
+void ComputerPoller::scheduleNextPoll(PollState* state)
+{
+    int intervalMs = POLL_INTERVAL_MS << qMin(state->failedPolls, MAX_OFFLINE_BACKOFF_SHIFT);
+    int jitterMs = intervalMs * POLL_JITTER_PERCENT / 100;
+
+    state->pollTimer->start(intervalMs + QRandomGenerator::global()->bounded(-jitterMs, jitterMs + 1));
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "nvcomputer.h"
+
+#include <QThread>
+#include <QMutex>
+#include <QTimer>
+#include <QNetworkAccessManager>
+
+// Polls the state of known hosts from a single low priority thread.
+// Rather than dedicating a blocking thread to each host, the requests
+// for every host are made concurrently from the event loop of the
+// polling thread. The addresses of each host are raced Happy Eyeballs
+// style, so a dead preferred address doesn't hold up the others.
+class ComputerPoller : public QObject
+{
+    Q_OBJECT
+
+public:
+    ComputerPoller();
+
+    virtual ~ComputerPoller();
+
+    // These may be called from any thread. Adding a computer that
+    // is already being polled has no effect.
+    void addComputer(NvComputer* computer);
+
+    void removeAllComputers();
+
+    // Blocks until the poller is no longer using the computer
+    void removeComputer(NvComputer* computer);
+
+signals:
+    void computerStateChanged(NvComputer* computer);
+
+    // Emitted before computerStateChanged() when apps were added, removed or changed
+    void appListChanged(NvComputer* computer, NvComputer::AppListChanges changes);
+
+private slots:
+    void processPendingChanges();
+
+    void shutdown();
+
+private:
+    struct PollState
+    {
+        NvComputer* computer;
+        QTimer* pollTimer;
+        QTimer* raceTimer;
+        QVector<NvAddress> pendingAddresses;
+        QVector<NvHTTP*> serverInfoRequests;
+        NvHTTP* appListRequest;
+        QByteArray appListHash; // Hash of the last app list we applied
+        bool wasOnline;
+        int tries;
+        int failedPolls;
+        int pollsSinceLastAppListFetch;
+    };
+
+    struct PendingChange
+    {
+        // nullptr removes all computers
+        NvComputer* computer;
+        bool add;
+    };
+
+    void queueChange(NvComputer* computer, bool add, Qt::ConnectionType type);
+
+    void startPolling(NvComputer* computer);
+
+    void stopPolling(PollState* state);
+
+    void pollComputer(PollState* state);
+
+    void sendServerInfoRequests(PollState* state);
+
+    void startNextServerInfoRequest(PollState* state);
+
+    void handleServerInfoReceived(PollState* state, NvHTTP* http, QString serverInfo);
+
+    void handleServerInfoFailed(PollState* state, NvHTTP* http);
+
+    void handlePollFailed(PollState* state);
+
+    void cancelServerInfoRequests(PollState* state);
+
+    void completePoll(PollState* state, bool stateChanged);
+
+    void scheduleNextPoll(PollState* state);
+
+    QThread m_Thread;
+    QNetworkAccessManager* m_Nam;
+    QMap<NvComputer*, PollState*> m_PollStates;
+
+    // Protects m_PendingChanges
+    QMutex m_PendingChangesLock;
+    QVector<PendingChange> m_PendingChanges;
+};
@@ -120,11 +120,14 @@ bool NvComputer::isEqualSerialized(const NvComputer &that) const
            this->appList == that.appList;
 }
 
+bool NvComputer::isAppOrderedBefore(const NvApp& app1, const NvApp& app2)
+{
+    return app1.name.toLower() < app2.name.toLower();
+}
+
 void NvComputer::sortAppList()
 {
-    std::stable_sort(appList.begin(), appList.end(), [](const NvApp& app1, const NvApp& app2) {
-       return app1.name.toLower() < app2.name.toLower();
-    });
+    std::stable_sort(appList.begin(), appList.end(), isAppOrderedBefore);
 }
 
 NvComputer::NvComputer(NvHTTP& http, QString serverInfo)
@@ -462,24 +465,42 @@ NvComputer::ReachabilityType NvComputer::getActiveAddressReachability() const
     }
 }
 
-bool NvComputer::updateAppList(QVector<NvApp> newAppList) {
-    if (appList == newAppList) {
-        return false;
-    }
+NvComputer::AppListChanges NvComputer::updateAppList(QVector<NvApp> newAppList) {
+    AppListChanges changes;
 
-    // Propagate client-side attributes to the new app list
+    // Index the existing apps by ID, so large app lists don't take quadratic time
+    QHash<int, const NvApp*> existingApps;
+    existingApps.reserve(appList.size());
     for (const NvApp& existingApp : std::as_const(appList)) {
-        for (NvApp& newApp : newAppList) {
-            if (existingApp.id == newApp.id) {
-                newApp.hidden = existingApp.hidden;
-                newApp.directLaunch = existingApp.directLaunch;
-            }
+        existingApps.insert(existingApp.id, &existingApp);
+    }
+
+    for (NvApp& newApp : newAppList) {
+        const NvApp* existingApp = existingApps.take(newApp.id);
+        if (existingApp == nullptr) {
+            changes.added.append(newApp);
+            continue;
+        }
+
+        // Propagate client-side attributes to the new app list
+        newApp.hidden = existingApp->hidden;
+        newApp.directLaunch = existingApp->directLaunch;
+
+        if (newApp != *existingApp) {
+            changes.changed.append(newApp);
         }
     }
 
-    appList = newAppList;
+    // Anything we didn't find in the new list is gone
+    for (auto it = existingApps.cbegin(); it != existingApps.cend(); ++it) {
+        changes.removed.append(it.key());
+    }
+
+    // The pointers in existingApps are into the old list, so we're done with them
+    std::swap(appList, newAppList);
     sortAppList();
-    return true;
+
+    return changes;
 }
 
 QVector<NvAddress> NvComputer::uniqueAddresses() const
@@ -20,14 +20,31 @@ public:
 
 class NvComputer
 {
-    friend class PcMonitorThread;
+    friend class ComputerPoller;
     friend class ComputerManager;
     friend class PendingQuitTask;
 
+public:
+    // The apps that changed in an update of the app list
+    struct AppListChanges
+    {
+        QVector<NvApp> added;
+        QVector<NvApp> changed; // As they are after the update
+        QVector<int> removed;
+
+        bool isEmpty() const
+        {
+            return added.isEmpty() && changed.isEmpty() && removed.isEmpty();
+        }
+    };
+
+    // The order of apps in appList
+    static bool isAppOrderedBefore(const NvApp& app1, const NvApp& app2);
+
 private:
     void sortAppList();
 
-    bool updateAppList(QVector<NvApp> newAppList);
+    AppListChanges updateAppList(QVector<NvApp> newAppList);
 
     bool pendingQuit;
 
@@ -121,3 +138,5 @@ public:
 private:
     uint16_t externalPort;
 };
+
+Q_DECLARE_METATYPE(NvComputer::AppListChanges)
@@ -1,4 +1,5 @@
 #include "nvcomputer.h"
+#include "utils.h"
 #include <Limelight.h>
 
 #include <QDebug>
@@ -8,9 +9,10 @@
 #include <QTimer>
 #include <QXmlStreamReader>
 #include <QSslKey>
-#include <QImageReader>
 #include <QtEndian>
 #include <QNetworkProxy>
+#include <QCryptographicHash>
+#include <QMutex>
 
 #define FAST_FAIL_TIMEOUT_MS 2000
 #define REQUEST_TIMEOUT_MS 5000
@@ -18,6 +20,22 @@
 #define RESUME_TIMEOUT_MS 30000
 #define QUIT_TIMEOUT_MS 30000
 
+// How long an idle HTTPS connection is kept open for reuse when
+// NVHTTP_SESSION_REUSE is enabled. This is long enough to cover bursts
+// of requests like box art downloads without holding connections open
+// between polls.
+#define KEEP_ALIVE_TIMEOUT_SECS 2
+
+// TLS session resumption and keep-alive state for each HTTPS host
+struct HostSessionState
+{
+    QByteArray sessionTicket;
+    bool reuseRejected = false;
+};
+
+static QMutex s_SessionStateLock;
+static QHash<QString, HostSessionState> s_SessionStates;
+
 #if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
 #define XML_NAME_EQUALS(x, y) ((x) == (y))
 #else
@@ -302,6 +320,12 @@ NvHTTP::getAppList()
                                             NvLogLevel::NVLL_ERROR);
     verifyResponseStatus(appxml);
 
+    return parseAppList(appxml);
+}
+
+QVector<NvApp>
+NvHTTP::parseAppList(QString appxml)
+{
     QXmlStreamReader xmlReader(appxml);
     QVector<NvApp> apps;
     while (!xmlReader.atEnd()) {
@@ -374,8 +398,8 @@ NvHTTP::verifyResponseStatus(QString xml)
     throw GfeHttpResponseException(-1, "Malformed XML (missing root element)");
 }
 
-QImage
-NvHTTP::getBoxArt(int appId)
+QByteArray
+NvHTTP::getBoxArtData(int appId)
 {
     QNetworkReply* reply = openConnection(m_BaseUrlHttps,
                                           "appasset",
@@ -383,10 +407,10 @@ NvHTTP::getBoxArt(int appId)
                                           "&AssetType=2&AssetIdx=0",
                                           REQUEST_TIMEOUT_MS,
                                           NvLogLevel::NVLL_VERBOSE);
-    QImage image = QImageReader(reply).read();
+    QByteArray data = reply->readAll();
     delete reply;
 
-    return image;
+    return data;
 }
 
 QByteArray
@@ -448,28 +472,64 @@ NvHTTP::openConnectionToString(QUrl baseUrl,
                                NvLogLevel logLevel)
 {
     QNetworkReply* reply = openConnection(baseUrl, command, arguments, timeoutMs, logLevel);
-    QString ret;
+    QString ret = readReplyString(reply);
+    delete reply;
 
-    QTextStream stream(reply);
+    return ret;
+}
 
-#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
-    stream.setEncoding(QStringConverter::Utf8);
-#else
-    stream.setCodec("UTF-8");
-#endif
+static bool isSessionReuseEnabled()
+{
+    // GFE doesn't tolerate persistent connections, so this is opt-in
+    static const bool enabled = []() {
+        int value;
+        return Utils::getEnvironmentVariableOverride("NVHTTP_SESSION_REUSE", &value) && value != 0;
+    }();
 
-    ret = stream.readAll();
-    delete reply;
+    return enabled;
+}
 
-    return ret;
+// Only errors that mean the host dropped our kept-alive connection or
+// choked on the resumed session. Handshake failures must still reach
+// checkReplyError() so a changed host certificate is handled properly.
+static bool isSessionReuseError(QNetworkReply::NetworkError error)
+{
+    switch (error) {
+    case QNetworkReply::RemoteHostClosedError:
+    case QNetworkReply::ProtocolFailure:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void updateHostSessionState(QNetworkReply* reply, const QString& sessionKey)
+{
+    QMutexLocker locker(&s_SessionStateLock);
+    HostSessionState& state = s_SessionStates[sessionKey];
+
+    if (reply->error() == QNetworkReply::NoError) {
+        // Save the ticket so our next connection can skip the full handshake
+        QByteArray sessionTicket = reply->sslConfiguration().sessionTicket();
+        if (!sessionTicket.isEmpty()) {
+            state.sessionTicket = sessionTicket;
+        }
+    }
+    else if (isSessionReuseError(reply->error()) && !state.reuseRejected) {
+        // Assume the host can't handle a resumed session or a reused
+        // connection and stop trying them for the rest of this run.
+        qInfo() << "Disabling session reuse for" << sessionKey << "after error:" << reply->error();
+        state.reuseRejected = true;
+        state.sessionTicket.clear();
+    }
 }
 
 QNetworkReply*
-NvHTTP::openConnection(QUrl baseUrl,
-                       QString command,
-                       QString arguments,
-                       int timeoutMs,
-                       NvLogLevel logLevel)
+NvHTTP::startRequest(QUrl baseUrl,
+                     QString command,
+                     QString arguments,
+                     NvLogLevel logLevel,
+                     bool* sessionReused)
 {
     // Port must be set
     Q_ASSERT(baseUrl.port(0) != 0);
@@ -488,7 +548,31 @@ NvHTTP::openConnection(QUrl baseUrl,
     QNetworkRequest request(url);
 
     // Add our client certificate
-    request.setSslConfiguration(IdentityManager::get()->getSslConfig());
+    QSslConfiguration sslConfig = IdentityManager::get()->getSslConfig();
+
+    // Resume the last TLS session with this host if session reuse is enabled
+    // and the host hasn't rejected it before
+    bool reuseSession = false;
+    QString sessionKey;
+    if (baseUrl.scheme() == "https" && isSessionReuseEnabled()) {
+        sessionKey = baseUrl.host() + ":" + QString::number(baseUrl.port());
+
+        QMutexLocker locker(&s_SessionStateLock);
+        const HostSessionState& state = s_SessionStates[sessionKey];
+        if (!state.reuseRejected) {
+            reuseSession = true;
+            sslConfig.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+            if (!state.sessionTicket.isEmpty()) {
+                sslConfig.setSessionTicket(state.sessionTicket);
+            }
+        }
+    }
+
+    request.setSslConfiguration(sslConfig);
+
+    if (sessionReused != nullptr) {
+        *sessionReused = reuseSession;
+    }
 
 #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
     // Disable HTTP/2 (GFE 3.22 doesn't like it) and Qt 6 enables it by default
@@ -498,13 +582,231 @@ NvHTTP::openConnection(QUrl baseUrl,
 #if QT_VERSION >= QT_VERSION_CHECK(6, 3, 0)
     // Use fine-grained idle timeouts to avoid calling QNetworkAccessManager::clearAccessCache(),
     // which tears down the NAM's global thread each time. We must not keep persistent connections
-    // or GFE will puke.
-    request.setAttribute(QNetworkRequest::ConnectionCacheExpiryTimeoutSecondsAttribute, 0);
+    // or GFE will puke, unless the user has opted into session reuse.
+    request.setAttribute(QNetworkRequest::ConnectionCacheExpiryTimeoutSecondsAttribute,
+                         reuseSession ? KEEP_ALIVE_TIMEOUT_SECS : 0);
+#else
+    // We can't clear the access cache while other requests may be in flight
+    // on this NAM, so ask for the connection to be closed after the request.
+    request.setRawHeader("Connection", "close");
 #endif
 
-    auto sslErrorsConnection = connect(m_Nam, &QNetworkAccessManager::sslErrors, this, &NvHTTP::handleSslErrors);
+    if (logLevel >= NvLogLevel::NVLL_VERBOSE) {
+        qInfo() << "Executing request:" << url.toString();
+    }
+
     QNetworkReply* reply = m_Nam->get(request);
 
+    // Learn the new session ticket or whether the host rejected our
+    // session reuse. This must be connected before anyone else can
+    // observe the reply finishing.
+    if (reuseSession) {
+        connect(reply, &QNetworkReply::finished, reply, [reply, sessionKey]() {
+            updateHostSessionState(reply, sessionKey);
+        });
+    }
+
+    // Only accept the certificate we've pinned for this host
+    connect(reply, &QNetworkReply::sslErrors, this, [this, reply](const QList<QSslError>& errors) {
+        handleSslErrors(reply, errors);
+    });
+
+    return reply;
+}
+
+void
+NvHTTP::checkReplyError(QNetworkReply* reply,
+                        QString command,
+                        NvLogLevel logLevel)
+{
+    if (reply->error() != QNetworkReply::NoError)
+    {
+        if (logLevel >= NvLogLevel::NVLL_ERROR) {
+            qWarning() << command << "request failed with error:" << reply->error();
+        }
+
+        if (reply->error() == QNetworkReply::SslHandshakeFailedError) {
+            // This will trigger falling back to HTTP for the serverinfo query
+            // then pairing again to get the updated certificate.
+            throw GfeHttpResponseException(401, "Server certificate mismatch");
+        }
+        else if (reply->error() == QNetworkReply::OperationCanceledError) {
+            throw QtNetworkReplyException(QNetworkReply::TimeoutError, "Request timed out");
+        }
+        else {
+            throw QtNetworkReplyException(reply->error(), reply->errorString());
+        }
+    }
+}
+
+QString
+NvHTTP::readReplyString(QNetworkReply* reply)
+{
+    QTextStream stream(reply);
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    stream.setEncoding(QStringConverter::Utf8);
+#else
+    stream.setCodec("UTF-8");
+#endif
+
+    return stream.readAll();
+}
+
+void
+NvHTTP::startAsyncRequest(QUrl baseUrl,
+                          QString command,
+                          int timeoutMs,
+                          NvLogLevel logLevel,
+                          std::function<void(QString)> completion,
+                          std::function<void(QNetworkReply::NetworkError)> failure)
+{
+    bool sessionReused;
+    QNetworkReply* reply = startRequest(baseUrl, command, nullptr, logLevel, &sessionReused);
+
+    // Tie the request to our lifetime, so destroying us aborts it
+    reply->setParent(this);
+
+    // Aborting the reply completes it with OperationCanceledError,
+    // which checkReplyError() reports as a timeout.
+    QTimer::singleShot(timeoutMs, reply, [reply, logLevel]() {
+        if (logLevel >= NvLogLevel::NVLL_ERROR) {
+            qWarning() << "Aborting timed out request for" << reply->url().toString();
+        }
+        reply->abort();
+    });
+
+    connect(reply, &QNetworkReply::finished, this, [this, reply, baseUrl, command, timeoutMs, logLevel, sessionReused, completion, failure]() {
+        // We're inside the reply's signal, so it can't be deleted right away
+        reply->deleteLater();
+
+        // Like openConnection(), retry once if the host rejected our reused
+        // session. We only make idempotent requests asynchronously.
+        if (sessionReused && isSessionReuseError(reply->error())) {
+            if (logLevel >= NvLogLevel::NVLL_ERROR) {
+                qWarning() << "Retrying" << command << "request without session reuse";
+            }
+            startAsyncRequest(baseUrl, command, timeoutMs, logLevel, completion, failure);
+            return;
+        }
+
+        QString response;
+        try {
+            checkReplyError(reply, command, logLevel);
+            response = readReplyString(reply);
+        } catch (...) {
+            if (failure) {
+                failure(reply->error());
+            }
+            else {
+                emit requestFailed();
+            }
+            return;
+        }
+
+        completion(response);
+    });
+}
+
+void
+NvHTTP::getServerInfoAsync(NvLogLevel logLevel, bool fastFail)
+{
+    // Mirror getServerInfo() by preferring HTTPS once we have the pinned cert and HTTPS port
+    startServerInfoRequest(!m_ServerCert.isNull() && httpsPort() != 0 ? SIR_HTTPS : SIR_HTTP,
+                           logLevel, fastFail);
+}
+
+void
+NvHTTP::startServerInfoRequest(ServerInfoRequest requestType, NvLogLevel logLevel, bool fastFail)
+{
+    // Like getServerInfo(), a certificate validation error over HTTPS falls back
+    // to HTTP, whether the host reports it with a 401 status or our handshake
+    // fails because the host's certificate no longer matches the pinned one.
+    auto handleFailure = [this, requestType, logLevel, fastFail](int statusCode) {
+        if (requestType == SIR_HTTPS && statusCode == 401) {
+            startServerInfoRequest(SIR_HTTP_FALLBACK, logLevel, fastFail);
+        }
+        else {
+            emit requestFailed();
+        }
+    };
+
+    // checkReplyError() reports a failed handshake as a 401 for the same reason
+    auto handleReplyError = [handleFailure](QNetworkReply::NetworkError error) {
+        handleFailure(error == QNetworkReply::SslHandshakeFailedError ? 401 : -1);
+    };
+
+    startAsyncRequest(requestType == SIR_HTTPS ? m_BaseUrlHttps : m_BaseUrlHttp,
+                      "serverinfo",
+                      fastFail ? FAST_FAIL_TIMEOUT_MS : REQUEST_TIMEOUT_MS,
+                      logLevel,
+                      [this, requestType, logLevel, fastFail, handleFailure](QString serverInfo) {
+        try {
+            verifyResponseStatus(serverInfo);
+        } catch (const GfeHttpResponseException& e) {
+            handleFailure(e.getStatusCode());
+            return;
+        }
+
+        if (requestType == SIR_HTTP) {
+            // Populate the HTTPS port
+            uint16_t httpsPort = getXmlString(serverInfo, "HttpsPort").toUShort();
+            if (httpsPort == 0) {
+                httpsPort = DEFAULT_HTTPS_PORT;
+            }
+            setHttpsPort(httpsPort);
+
+            // If we just needed to determine the HTTPS port, we'll try again over
+            // HTTPS now that we have the port number
+            if (!m_ServerCert.isNull()) {
+                startServerInfoRequest(SIR_HTTPS, logLevel, fastFail);
+                return;
+            }
+        }
+
+        emit serverInfoReceived(serverInfo);
+    }, handleReplyError);
+}
+
+void
+NvHTTP::getAppListAsync(QByteArray previousHash)
+{
+    startAsyncRequest(m_BaseUrlHttps,
+                      "applist",
+                      REQUEST_TIMEOUT_MS,
+                      NvLogLevel::NVLL_ERROR,
+                      [this, previousHash](QString appxml) {
+        // Hosts with large libraries send a lot of XML, so don't bother
+        // parsing it again if it's identical to what we got last time.
+        QByteArray hash = QCryptographicHash::hash(appxml.toUtf8(), QCryptographicHash::Sha1);
+        if (!previousHash.isEmpty() && hash == previousHash) {
+            emit appListUnchanged();
+            return;
+        }
+
+        QVector<NvApp> apps;
+        try {
+            verifyResponseStatus(appxml);
+            apps = parseAppList(appxml);
+        } catch (...) {
+            emit requestFailed();
+            return;
+        }
+
+        emit appListReceived(apps, hash);
+    });
+}
+
+QNetworkReply*
+NvHTTP::openConnection(QUrl baseUrl,
+                       QString command,
+                       QString arguments,
+                       int timeoutMs,
+                       NvLogLevel logLevel)
+{
+    bool sessionReused;
+    QNetworkReply* reply = startRequest(baseUrl, command, arguments, logLevel, &sessionReused);
+
     // Run the request with a timeout if requested
     QEventLoop loop;
     connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
@@ -512,16 +814,13 @@ NvHTTP::openConnection(QUrl baseUrl,
     if (timeoutMs) {
         QTimer::singleShot(timeoutMs, &loop, &QEventLoop::quit);
     }
-    if (logLevel >= NvLogLevel::NVLL_VERBOSE) {
-        qInfo() << "Executing request:" << url.toString();
-    }
     loop.exec(QEventLoop::ExcludeUserInputEvents);
 
     // Abort the request if it timed out
     if (!reply->isFinished())
     {
         if (logLevel >= NvLogLevel::NVLL_ERROR) {
-            qWarning() << "Aborting timed out request for" << url.toString();
+            qWarning() << "Aborting timed out request for" << reply->url().toString();
         }
         reply->abort();
     }
@@ -530,32 +829,24 @@ NvHTTP::openConnection(QUrl baseUrl,
     // If we couldn't use fine-grained connection idle timeouts, kill them all now
     m_Nam->clearAccessCache();
 #endif
-    disconnect(sslErrorsConnection);
 
-    // Handle error
-    if (reply->error() != QNetworkReply::NoError)
-    {
+    // If the host rejected our reused session, we won't reuse sessions with it
+    // anymore, so try again if the request is safe to send a second time.
+    if (sessionReused && isSessionReuseError(reply->error()) &&
+            (command == "serverinfo" || command == "applist" || command == "appasset")) {
         if (logLevel >= NvLogLevel::NVLL_ERROR) {
-            qWarning() << command << "request failed with error:" << reply->error();
+            qWarning() << "Retrying" << command << "request without session reuse";
         }
+        delete reply;
+        return openConnection(baseUrl, command, arguments, timeoutMs, logLevel);
+    }
 
-        if (reply->error() == QNetworkReply::SslHandshakeFailedError) {
-            // This will trigger falling back to HTTP for the serverinfo query
-            // then pairing again to get the updated certificate.
-            GfeHttpResponseException exception(401, "Server certificate mismatch");
-            delete reply;
-            throw exception;
-        }
-        else if (reply->error() == QNetworkReply::OperationCanceledError) {
-            QtNetworkReplyException exception(QNetworkReply::TimeoutError, "Request timed out");
-            delete reply;
-            throw exception;
-        }
-        else {
-            QtNetworkReplyException exception(reply->error(), reply->errorString());
-            delete reply;
-            throw exception;
-        }
+    // Handle error
+    try {
+        checkReplyError(reply, command, logLevel);
+    } catch (...) {
+        delete reply;
+        throw;
     }
 
     return reply;
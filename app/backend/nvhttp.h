@@ -10,6 +10,8 @@
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
 
+#include <functional>
+
 class NvComputer;
 
 class NvDisplayMode
@@ -120,6 +122,11 @@ public:
     QString
     getServerInfo(NvLogLevel logLevel, bool fastFail = false);
 
+    // Non-blocking version of getServerInfo() which emits serverInfoReceived()
+    // or requestFailed() from the event loop of the calling thread
+    void
+    getServerInfoAsync(NvLogLevel logLevel, bool fastFail = false);
+
     static
     void
     verifyResponseStatus(QString xml);
@@ -175,8 +182,15 @@ public:
     QVector<NvApp>
     getAppList();
 
-    QImage
-    getBoxArt(int appId);
+    // Non-blocking version of getAppList() which emits appListReceived()
+    // or requestFailed() from the event loop of the calling thread. If the
+    // app list matches previousHash, appListUnchanged() is emitted instead.
+    void
+    getAppListAsync(QByteArray previousHash = QByteArray());
+
+    // Returns the box art image file exactly as the host sent it
+    QByteArray
+    getBoxArtData(int appId);
 
     static
     QVector<NvDisplayMode>
@@ -184,10 +198,60 @@ public:
 
     QUrl m_BaseUrlHttp;
     QUrl m_BaseUrlHttps;
+
+signals:
+    void serverInfoReceived(QString serverInfo);
+
+    void appListReceived(QVector<NvApp> appList, QByteArray hash);
+
+    void appListUnchanged();
+
+    void requestFailed();
+
 private:
+    enum ServerInfoRequest {
+        SIR_HTTP,
+        SIR_HTTPS,
+        SIR_HTTP_FALLBACK
+    };
+
     void
     handleSslErrors(QNetworkReply* reply, const QList<QSslError>& errors);
 
+    static
+    QVector<NvApp>
+    parseAppList(QString appxml);
+
+    QNetworkReply*
+    startRequest(QUrl baseUrl,
+                 QString command,
+                 QString arguments,
+                 NvLogLevel logLevel,
+                 bool* sessionReused);
+
+    static
+    void
+    checkReplyError(QNetworkReply* reply,
+                    QString command,
+                    NvLogLevel logLevel);
+
+    static
+    QString
+    readReplyString(QNetworkReply* reply);
+
+    void
+    startAsyncRequest(QUrl baseUrl,
+                      QString command,
+                      int timeoutMs,
+                      NvLogLevel logLevel,
+                      std::function<void(QString)> completion,
+                      std::function<void(QNetworkReply::NetworkError)> failure = nullptr);
+
+    void
+    startServerInfoRequest(ServerInfoRequest requestType,
+                           NvLogLevel logLevel,
+                           bool fastFail);
+
     QNetworkReply*
     openConnection(QUrl baseUrl,
                    QString command,
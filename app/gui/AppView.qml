@@ -88,6 +88,9 @@ CenteredGridView {
             y: 10
             source: model.boxart
 
+            // Keep reading thumbnails out of the pack off the GUI thread
+            asynchronous: true
+
             onSourceSizeChanged: {
                 // Nearly all of Nvidia's official box art does not match the dimensions of placeholder
                 // images, however the one known exception is Overcooked. Therefore, we only execute
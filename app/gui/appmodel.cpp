@@ -1,5 +1,7 @@
 #include "appmodel.h"
 
+#include <algorithm>
+
 AppModel::AppModel(QObject *parent)
     : QAbstractListModel(parent)
 {
@@ -12,13 +14,20 @@ void AppModel::initialize(ComputerManager* computerManager, int computerIndex, b
     m_ComputerManager = computerManager;
     connect(m_ComputerManager, &ComputerManager::computerStateChanged,
             this, &AppModel::handleComputerStateChanged);
+    connect(m_ComputerManager, &ComputerManager::appListChanged,
+            this, &AppModel::handleAppListChanged);
 
     Q_ASSERT(computerIndex < m_ComputerManager->getComputers().count());
     m_Computer = m_ComputerManager->getComputers().at(computerIndex);
     m_CurrentGameId = m_Computer->currentGameId;
     m_ShowHiddenGames = showHiddenGames;
 
-    updateAppList(m_Computer->appList);
+    beginResetModel();
+    m_AllApps = m_Computer->appList;
+    m_VisibleApps = getVisibleApps(m_AllApps);
+    endResetModel();
+
+    prefetchBoxArt();
 }
 
 int AppModel::getRunningAppId()
@@ -120,13 +129,7 @@ void AppModel::quitRunningApp()
 
 bool AppModel::isAppCurrentlyVisible(const NvApp& app)
 {
-    for (const NvApp& visibleApp : std::as_const(m_VisibleApps)) {
-        if (app.id == visibleApp.id) {
-            return true;
-        }
-    }
-
-    return false;
+    return findVisibleApp(app.id) >= 0;
 }
 
 QVector<NvApp> AppModel::getVisibleApps(const QVector<NvApp>& appList)
@@ -145,70 +148,110 @@ QVector<NvApp> AppModel::getVisibleApps(const QVector<NvApp>& appList)
     return visibleApps;
 }
 
-void AppModel::updateAppList(QVector<NvApp> newList)
+int AppModel::findVisibleApp(int appId)
 {
-    m_AllApps = newList;
-
-    QVector<NvApp> newVisibleList = getVisibleApps(newList);
-
-    // Process removals and updates first
     for (int i = 0; i < m_VisibleApps.count(); i++) {
-        const NvApp& existingApp = m_VisibleApps.at(i);
-
-        bool found = false;
-        for (const NvApp& newApp : std::as_const(newVisibleList)) {
-            if (existingApp.id == newApp.id) {
-                // If the data changed, update it in our list
-                if (existingApp != newApp) {
-                    m_VisibleApps.replace(i, newApp);
-                    emit dataChanged(createIndex(i, 0), createIndex(i, 0));
-                }
+        if (m_VisibleApps[i].id == appId) {
+            return i;
+        }
+    }
 
-                found = true;
-                break;
-            }
+    return -1;
+}
+
+void AppModel::removeApp(int appId)
+{
+    for (int i = 0; i < m_AllApps.count(); i++) {
+        if (m_AllApps[i].id == appId) {
+            m_AllApps.removeAt(i);
+            break;
         }
+    }
+
+    int row = findVisibleApp(appId);
+    if (row >= 0) {
+        beginRemoveRows(QModelIndex(), row, row);
+        m_VisibleApps.removeAt(row);
+        endRemoveRows();
+    }
+}
 
-        if (!found) {
-            beginRemoveRows(QModelIndex(), i, i);
-            m_VisibleApps.removeAt(i);
-            endRemoveRows();
-            i--;
+void AppModel::updateApp(const NvApp& app)
+{
+    // Keep our copy of the full list in the same order as the host's
+    for (int i = 0; i < m_AllApps.count(); i++) {
+        if (m_AllApps[i].id == app.id) {
+            m_AllApps.removeAt(i);
+            break;
         }
     }
+    m_AllApps.insert(std::upper_bound(m_AllApps.begin(), m_AllApps.end(), app, NvComputer::isAppOrderedBefore), app);
+
+    int row = findVisibleApp(app.id);
+    if (row >= 0) {
+        // Update the app where it is, unless it was renamed out of order
+        if ((row == 0 || !NvComputer::isAppOrderedBefore(app, m_VisibleApps[row - 1])) &&
+                (row == m_VisibleApps.count() - 1 || !NvComputer::isAppOrderedBefore(m_VisibleApps[row + 1], app))) {
+            m_VisibleApps.replace(row, app);
+            emit dataChanged(createIndex(row, 0), createIndex(row, 0));
+            return;
+        }
 
-    // Process additions now
-    for (const NvApp& newApp : std::as_const(newVisibleList)) {
-        int insertionIndex = m_VisibleApps.size();
-        bool found = false;
+        beginRemoveRows(QModelIndex(), row, row);
+        m_VisibleApps.removeAt(row);
+        endRemoveRows();
+    }
+    else if (!m_ShowHiddenGames && app.hidden) {
+        // Hidden games only stay visible if they already were
+        return;
+    }
 
-        for (int i = 0; i < m_VisibleApps.count(); i++) {
-            const NvApp& existingApp = m_VisibleApps.at(i);
+    row = std::upper_bound(m_VisibleApps.begin(), m_VisibleApps.end(), app, NvComputer::isAppOrderedBefore) - m_VisibleApps.begin();
+    beginInsertRows(QModelIndex(), row, row);
+    m_VisibleApps.insert(row, app);
+    endInsertRows();
+}
 
-            if (existingApp.id == newApp.id) {
-                found = true;
-                break;
-            }
-            else if (existingApp.name.toLower() > newApp.name.toLower()) {
-                insertionIndex = i;
-                break;
-            }
-        }
+void AppModel::applyAppListChanges(const NvComputer::AppListChanges& changes)
+{
+    // These may repeat changes we already have if they happened before we
+    // copied the app list, so updateApp() also adds apps and removeApp()
+    // ignores apps we don't have.
+    for (int appId : changes.removed) {
+        removeApp(appId);
+    }
+    for (const NvApp& app : changes.changed) {
+        updateApp(app);
+    }
+    for (const NvApp& app : changes.added) {
+        updateApp(app);
+    }
+}
 
-        if (!found) {
-            beginInsertRows(QModelIndex(), insertionIndex, insertionIndex);
-            m_VisibleApps.insert(insertionIndex, newApp);
-            endInsertRows();
+void AppModel::prefetchBoxArt()
+{
+    // Fetch box art in the order it appears in the grid,
+    // followed by hidden apps that may be shown later.
+    QVector<NvApp> apps = m_VisibleApps;
+
+    QSet<int> visibleIds;
+    for (const NvApp& app : std::as_const(m_VisibleApps)) {
+        visibleIds.insert(app.id);
+    }
+    for (const NvApp& app : std::as_const(m_AllApps)) {
+        if (!visibleIds.contains(app.id)) {
+            apps.append(app);
         }
     }
 
-    Q_ASSERT(newVisibleList == m_VisibleApps);
+    m_BoxArtManager.prefetchBoxArt(m_Computer, apps);
 }
 
 void AppModel::setAppHidden(int appIndex, bool hidden)
 {
     Q_ASSERT(appIndex < m_VisibleApps.count());
     int appId = m_VisibleApps.at(appIndex).id;
+    NvComputer::AppListChanges changes;
 
     {
         QWriteLocker lock(&m_Computer->lock);
@@ -216,11 +259,13 @@ void AppModel::setAppHidden(int appIndex, bool hidden)
         for (NvApp& app : m_Computer->appList) {
             if (app.id == appId) {
                 app.hidden = hidden;
+                changes.changed.append(app);
                 break;
             }
         }
     }
 
+    applyAppListChanges(changes);
     m_ComputerManager->clientSideAttributeUpdated(m_Computer);
 }
 
@@ -228,25 +273,31 @@ void AppModel::setAppDirectLaunch(int appIndex, bool directLaunch)
 {
     Q_ASSERT(appIndex < m_VisibleApps.count());
     int appId = m_VisibleApps.at(appIndex).id;
+    NvComputer::AppListChanges changes;
 
     {
         QWriteLocker lock(&m_Computer->lock);
 
         for (NvApp& app : m_Computer->appList) {
+            bool oldDirectLaunch = app.directLaunch;
+
             if (directLaunch) {
                 // We must clear direct launch from all other apps
                 // to set it on the new app.
                 app.directLaunch = app.id == appId;
             }
             else if (app.id == appId) {
-                // If we're clearing direct launch, we're done once we
-                // find our matching app ID.
+                // If we're clearing direct launch, only our app changes
                 app.directLaunch = false;
-                break;
+            }
+
+            if (app.directLaunch != oldDirectLaunch) {
+                changes.changed.append(app);
             }
         }
     }
 
+    applyAppListChanges(changes);
     m_ComputerManager->clientSideAttributeUpdated(m_Computer);
 }
 
@@ -265,14 +316,10 @@ void AppModel::handleComputerStateChanged(NvComputer* computer)
         return;
     }
 
-    // First, process additions/removals from the app list. This
-    // is required because the new game may now be running, so
-    // we can't check that first.
-    if (computer->appList != m_AllApps) {
-        updateAppList(computer->appList);
-    }
+    // Changes to the app list itself arrive through handleAppListChanged()
+    // before this, so the new game is already in our list if it's running.
 
-    // Finally, process changes to the active app
+    // Process changes to the active app
     if (computer->currentGameId != m_CurrentGameId) {
         // First, invalidate the running state of newly running game
         for (int i = 0; i < m_VisibleApps.count(); i++) {
@@ -301,9 +348,22 @@ void AppModel::handleComputerStateChanged(NvComputer* computer)
     }
 }
 
-void AppModel::handleBoxArtLoaded(NvComputer* computer, NvApp app, QUrl /* image */)
+void AppModel::handleAppListChanged(NvComputer* computer, NvComputer::AppListChanges changes)
+{
+    // Ignore updates for computers that aren't ours
+    if (computer != m_Computer) {
+        return;
+    }
+
+    applyAppListChanges(changes);
+
+    // Only the new apps can be missing box art
+    m_BoxArtManager.prefetchBoxArt(m_Computer, changes.added);
+}
+
+void AppModel::handleBoxArtLoaded(QString uuid, NvApp app, QUrl /* image */)
 {
-    Q_ASSERT(computer == m_Computer);
+    Q_ASSERT(uuid == m_Computer->uuid);
 
     int index = m_VisibleApps.indexOf(app);
 
@@ -314,7 +374,8 @@ void AppModel::handleBoxArtLoaded(NvComputer* computer, NvApp app, QUrl /* image
                          createIndex(index, 0),
                          QVector<int>() << BoxArtRole);
     }
-    else {
+    else if (!app.hidden) {
+        // Prefetched box art for hidden apps is expected to land here
         qWarning() << "App not found for box art callback:" << app.name;
     }
 }
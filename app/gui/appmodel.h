@@ -50,13 +50,24 @@ public:
 private slots:
     void handleComputerStateChanged(NvComputer* computer);
 
-    void handleBoxArtLoaded(NvComputer* computer, NvApp app, QUrl image);
+    void handleAppListChanged(NvComputer* computer, NvComputer::AppListChanges changes);
+
+    void handleBoxArtLoaded(QString uuid, NvApp app, QUrl image);
 
 signals:
     void computerLost();
 
 private:
-    void updateAppList(QVector<NvApp> newList);
+    void applyAppListChanges(const NvComputer::AppListChanges& changes);
+
+    // Adds the app if we don't have it yet
+    void updateApp(const NvApp& app);
+
+    void removeApp(int appId);
+
+    int findVisibleApp(int appId);
+
+    void prefetchBoxArt();
 
     QVector<NvApp> getVisibleApps(const QVector<NvApp>& appList);
 
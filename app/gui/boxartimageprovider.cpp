@@ -0,0 +1,29 @@
+#include "boxartimageprovider.h"
+#include "backend/boxartmanager.h"
+
+BoxArtImageProvider::BoxArtImageProvider()
+    : QQuickImageProvider(QQuickImageProvider::Image)
+{
+}
+
+QImage BoxArtImageProvider::requestImage(const QString& id, QSize* size, const QSize&)
+{
+    int separator = id.lastIndexOf('/');
+    QString uuid = id.left(separator);
+    int appId = id.mid(separator + 1).toInt();
+
+    // Report the size of the original box art rather than the thumbnail,
+    // since AppView uses it to detect placeholder images from the host.
+    QSize originalSize;
+    QImage image = BoxArtManager::loadBoxArtThumbnail(uuid, appId, &originalSize);
+    if (image.isNull()) {
+        image = QImage(":/res/no_app_image.png");
+        originalSize = image.size();
+    }
+
+    if (size != nullptr) {
+        *size = originalSize;
+    }
+
+    return image;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <QQuickImageProvider>
+
+// Serves box art to QML as image://boxart/<host UUID>/<app ID>
+// from the memory-mapped thumbnail cache, so scrolling the app
+// grid doesn't decode and scale full size images.
+class BoxArtImageProvider : public QQuickImageProvider
+{
+public:
+    BoxArtImageProvider();
+
+    QImage requestImage(const QString& id, QSize* size, const QSize& requestedSize) override;
+};
@@ -48,6 +48,7 @@
 #include "utils.h"
 #include "gui/computermodel.h"
 #include "gui/appmodel.h"
+#include "gui/boxartimageprovider.h"
 #include "backend/autoupdatechecker.h"
 #include "backend/computermanager.h"
 #include "backend/systemproperties.h"
@@ -655,6 +656,7 @@ int main(int argc, char *argv[])
 
     // Register custom metatypes for use in signals
     qRegisterMetaType<NvApp>("NvApp");
+    qRegisterMetaType<NvComputer::AppListChanges>("NvComputer::AppListChanges");
 
     // Allow the display to sleep by default. We will manually use SDL_DisableScreenSaver()
     // and SDL_EnableScreenSaver() when appropriate. This hint must be set before
@@ -988,6 +990,8 @@ int main(int argc, char *argv[])
     }
 
     QQmlApplicationEngine engine;
+    engine.addImageProvider("boxart", new BoxArtImageProvider());
+
     QString initialView;
     bool hasGUI = true;
 
@@ -1,4 +1,5 @@
 #include "../session.h"
+#include "utils.h"
 #include "renderers/renderer.h"
 
 #ifdef HAVE_SLAUDIO
@@ -6,9 +7,156 @@
 #endif
 
 #include "renderers/sdl.h"
+#include "audiopacketqueue.h"
 
 #include <Limelight.h>
 
+static void addToQueueDelayHistogram(uint32_t* histogram, uint64_t delayUs)
+{
+    histogram[SDL_min(delayUs / AUDIO_QUEUE_DELAY_BUCKET_US, AUDIO_QUEUE_DELAY_BUCKETS - 1)]++;
+}
+
+// Returns the upper bound of the bucket containing the given percentile
+static uint32_t getQueueDelayPercentileUs(const uint32_t* histogram, int percentile)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < AUDIO_QUEUE_DELAY_BUCKETS; i++) {
+        total += histogram[i];
+    }
+
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t threshold = (total * percentile + 99) / 100;
+    uint64_t count = 0;
+    for (int i = 0; i < AUDIO_QUEUE_DELAY_BUCKETS; i++) {
+        count += histogram[i];
+        if (count >= threshold) {
+            return (i + 1) * AUDIO_QUEUE_DELAY_BUCKET_US;
+        }
+    }
+
+    return AUDIO_QUEUE_DELAY_BUCKETS * AUDIO_QUEUE_DELAY_BUCKET_US;
+}
+
+// Reads a frame length from an Opus packet (RFC 6716 section 3.2.1)
+static int readOpusFrameLength(const unsigned char*& data, int& remaining)
+{
+    if (remaining < 1) {
+        return -1;
+    }
+    else if (data[0] < 252) {
+        data++;
+        remaining--;
+        return data[-1];
+    }
+    else if (remaining < 2) {
+        return -1;
+    }
+
+    data += 2;
+    remaining -= 2;
+    return data[-2] + 4 * data[-1];
+}
+
+// Returns true if the first Opus stream in this packet carries LBRR (in-band FEC)
+// data for the previous frame. This does the same check as opus_packet_has_lbrr(),
+// which needs libopus 1.5 and can't parse the self-delimited framing (RFC 6716
+// appendix B) used for all but the last stream of a multistream packet.
+static bool opusPacketHasLbrr(const unsigned char* data, int length, bool selfDelimited)
+{
+    if (length < 1) {
+        return false;
+    }
+
+    // Only SILK and hybrid frames can carry LBRR data. CELT-only
+    // packets use configurations 16 to 31 in the TOC byte.
+    if (data[0] & 0x80) {
+        return false;
+    }
+
+    int samplesPerFrame = opus_packet_get_samples_per_frame(data, 48000);
+    int silkFrames = samplesPerFrame > 960 ? samplesPerFrame / 960 : 1;
+    int channels = opus_packet_get_nb_channels(data);
+
+    // Find the first frame. Self-delimited packets have an extra length
+    // for the last frame after the usual header fields.
+    const unsigned char* frame = data + 1;
+    int remaining = length - 1;
+    int frameLength;
+    switch (data[0] & 0x3) {
+    case 0:
+        frameLength = selfDelimited ? readOpusFrameLength(frame, remaining) : remaining;
+        break;
+    case 1:
+        frameLength = selfDelimited ? readOpusFrameLength(frame, remaining) : remaining / 2;
+        break;
+    case 2:
+        frameLength = readOpusFrameLength(frame, remaining);
+        if (selfDelimited && readOpusFrameLength(frame, remaining) < 0) {
+            return false;
+        }
+        break;
+    default:
+    {
+        if (remaining < 1) {
+            return false;
+        }
+
+        int frameCount = frame[0] & 0x3F;
+        bool vbr = (frame[0] & 0x80) != 0;
+        bool padded = (frame[0] & 0x40) != 0;
+        frame++;
+        remaining--;
+
+        if (frameCount == 0) {
+            return false;
+        }
+
+        // Skip the padding length. The padding itself is at the end.
+        while (padded) {
+            if (remaining < 1) {
+                return false;
+            }
+            padded = frame[0] == 255;
+            frame++;
+            remaining--;
+        }
+
+        frameLength = remaining / frameCount;
+        if (vbr) {
+            for (int i = 0; i < frameCount - 1; i++) {
+                int vbrFrameLength = readOpusFrameLength(frame, remaining);
+                if (i == 0) {
+                    frameLength = vbrFrameLength;
+                }
+            }
+        }
+        if (selfDelimited) {
+            int lastFrameLength = readOpusFrameLength(frame, remaining);
+            if (!vbr || frameCount == 1) {
+                frameLength = lastFrameLength;
+            }
+        }
+        break;
+    }
+    }
+
+    if (frameLength <= 0 || remaining < 1) {
+        return false;
+    }
+
+    // The SILK header starts with the VAD flags for each SILK frame
+    // followed by the LBRR flag, for the mid channel then the side channel.
+    bool lbrr = (frame[0] >> (7 - silkFrames)) & 0x1;
+    if (channels == 2) {
+        lbrr = lbrr || ((frame[0] >> (6 - 2 * silkFrames)) & 0x1);
+    }
+
+    return lbrr;
+}
+
 #define TRY_INIT_RENDERER(renderer, opusConfig)        \
 {                                                      \
     IAudioRenderer* __renderer = new renderer();       \
@@ -90,6 +238,27 @@ bool Session::initializeAudioRenderer()
     SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
                 "Audio stream has %d channels",
                 m_ActiveAudioConfig.channelCount);
+
+    // Any lost frame we were holding belonged to the old decoder
+    m_AudioLostFramePending = false;
+
+    // We can only compensate for clock drift if the renderer tells us how
+    // its buffer level compares to its target
+    AUDIO_STATS stats = {};
+    int driftCompensation;
+    m_AudioRenderer->getStats(&stats);
+    if (!Utils::getEnvironmentVariableOverride("AUDIO_DRIFT_COMPENSATION", &driftCompensation)) {
+        driftCompensation = 1;
+    }
+    if (driftCompensation && stats.targetBufferMs != 0) {
+        m_AudioDecodeBuffer = SDL_malloc(m_ActiveAudioConfig.samplesPerFrame *
+                                         m_ActiveAudioConfig.channelCount *
+                                         m_AudioRenderer->getAudioBufferSampleSize());
+        if (m_AudioDecodeBuffer != nullptr) {
+            m_AudioDriftCompensator = new AudioDriftCompensator(m_ActiveAudioConfig.channelCount);
+        }
+    }
+
     return true;
 }
 
@@ -134,42 +303,224 @@ int Session::arInit(int /* audioConfiguration */,
                     void* /* arContext */, int /* arFlags */)
 {
     SDL_memcpy(&s_ActiveSession->m_OriginalAudioConfig, opusConfig, sizeof(*opusConfig));
-    s_ActiveSession->initializeAudioRenderer();
+
+    // Decoding and playback happen on our own thread, so a slow audio device
+    // can never stall the receive thread that calls arDecodeAndPlaySample().
+    s_ActiveSession->m_AudioPacketQueue = new AudioPacketQueue();
+    SDL_AtomicSet(&s_ActiveSession->m_AudioThreadShouldQuit, 0);
+    s_ActiveSession->m_AudioThread = SDL_CreateThread(Session::audioThreadProc,
+                                                      "AudioPlayback",
+                                                      s_ActiveSession);
+    if (s_ActiveSession->m_AudioThread == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to create audio thread: %s",
+                     SDL_GetError());
+        delete s_ActiveSession->m_AudioPacketQueue;
+        s_ActiveSession->m_AudioPacketQueue = nullptr;
+        return -1;
+    }
+
     return 0;
 }
 
 void Session::arCleanup()
 {
-    delete s_ActiveSession->m_AudioRenderer;
-    s_ActiveSession->m_AudioRenderer = nullptr;
+    if (s_ActiveSession->m_AudioThread != nullptr) {
+        SDL_AtomicSet(&s_ActiveSession->m_AudioThreadShouldQuit, 1);
+        s_ActiveSession->m_AudioPacketQueue->wakeUp();
+        SDL_WaitThread(s_ActiveSession->m_AudioThread, nullptr);
+        s_ActiveSession->m_AudioThread = nullptr;
+    }
 
-    opus_multistream_decoder_destroy(s_ActiveSession->m_OpusDecoder);
-    s_ActiveSession->m_OpusDecoder = nullptr;
+    delete s_ActiveSession->m_AudioPacketQueue;
+    s_ActiveSession->m_AudioPacketQueue = nullptr;
 }
 
-void Session::arDecodeAndPlaySample(char* sampleData, int sampleLength)
+int Session::audioThreadProc(void* context)
 {
-    int samplesDecoded;
+    auto me = (Session*)context;
 
 #ifndef STEAM_LINK
     // Set this thread to high priority to reduce the chance of missing
     // our sample delivery time. On Steam Link, this causes starvation
     // of other threads due to severely restricted CPU time available,
     // so we will skip it on that platform.
-    if (s_ActiveSession->m_AudioSampleCount == 0) {
-        if (SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH) < 0) {
-            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
-                        "Unable to set audio thread to high priority: %s",
-                        SDL_GetError());
-        }
+    if (SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH) < 0) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Unable to set audio thread to high priority: %s",
+                    SDL_GetError());
     }
 #endif
 
+    me->initializeAudioRenderer();
+
+    while (!SDL_AtomicGet(&me->m_AudioThreadShouldQuit)) {
+        PAUDIO_PACKET packet = me->m_AudioPacketQueue->peek();
+        if (packet == nullptr) {
+            // Woken up to quit
+            continue;
+        }
+
+        me->m_AudioMaxQueuedPackets = SDL_max(me->m_AudioMaxQueuedPackets, me->m_AudioPacketQueue->count());
+
+        uint64_t queueDelayUs = LiGetMicroseconds() - packet->enqueueTimeUs;
+        addToQueueDelayHistogram(me->m_AudioQueueDelayHistogram, queueDelayUs);
+        addToQueueDelayHistogram(me->m_AudioTotalQueueDelayHistogram, queueDelayUs);
+
+        me->processAudioPacket(packet->length != 0 ? packet->data : nullptr, packet->length);
+        me->m_AudioPacketQueue->pop();
+    }
+
+    me->logAudioPipelineSummary();
+    me->destroyAudioRenderer();
+    return 0;
+}
+
+void Session::arDecodeAndPlaySample(char* sampleData, int sampleLength)
+{
+    // Hand off the packet to the audio thread. This never blocks. If the
+    // queue is full, the audio thread has fallen far behind, so dropping
+    // the packet is the right thing to do anyway.
+    s_ActiveSession->m_AudioPacketQueue->enqueue(sampleData, sampleLength);
+
+    // Count what the host sent, even if we end up dropping it
+    s_ActiveSession->m_BwTracker.AddBytes(sampleLength, BW_SERIES_AUDIO);
+}
+
+void Session::destroyAudioRenderer()
+{
+    delete m_AudioRenderer;
+    m_AudioRenderer = nullptr;
+
+    delete m_AudioDriftCompensator;
+    m_AudioDriftCompensator = nullptr;
+
+    SDL_free(m_AudioDecodeBuffer);
+    m_AudioDecodeBuffer = nullptr;
+
+    opus_multistream_decoder_destroy(m_OpusDecoder);
+    m_OpusDecoder = nullptr;
+}
+
+bool Session::playAudioFrame(const unsigned char* data, int length, bool decodeFec)
+{
+    int samplesDecoded;
+    AudioDriftCompensator* driftCompensator = m_AudioDriftCompensator;
+    int sampleSize = m_AudioRenderer->getAudioBufferSampleSize();
+    int frameSize = sampleSize * m_ActiveAudioConfig.channelCount;
+    int desiredBufferSize = frameSize * m_ActiveAudioConfig.samplesPerFrame;
+
+    // Drift compensation may stretch the frame by one sample
+    if (driftCompensator != nullptr) {
+        desiredBufferSize += frameSize;
+    }
+
+    void* buffer = m_AudioRenderer->getAudioBuffer(&desiredBufferSize);
+    if (buffer == nullptr) {
+        return true;
+    }
+
+    // If we're compensating for drift, we decode into our own buffer
+    // and resample from there into the renderer's buffer.
+    void* decodeBuffer = buffer;
+    int decodeBufferSize = desiredBufferSize;
+    if (driftCompensator != nullptr) {
+        decodeBuffer = m_AudioDecodeBuffer;
+        decodeBufferSize = frameSize * m_ActiveAudioConfig.samplesPerFrame;
+    }
+
+    // When recovering a lost frame with FEC, Opus requires that we ask
+    // for exactly the duration of the lost frame.
+    int maxSamples = decodeFec ? m_ActiveAudioConfig.samplesPerFrame : decodeBufferSize / frameSize;
+
+    uint64_t decodeStartUs = LiGetMicroseconds();
+    if (m_AudioRenderer->getAudioBufferFormat() == IAudioRenderer::AudioFormat::Float32NE) {
+        samplesDecoded = opus_multistream_decode_float(m_OpusDecoder,
+                                                       data,
+                                                       length,
+                                                       (float*)decodeBuffer,
+                                                       maxSamples,
+                                                       decodeFec ? 1 : 0);
+    }
+    else {
+        samplesDecoded = opus_multistream_decode(m_OpusDecoder,
+                                                 data,
+                                                 length,
+                                                 (short*)decodeBuffer,
+                                                 maxSamples,
+                                                 decodeFec ? 1 : 0);
+    }
+    uint64_t decodeTimeUs = LiGetMicroseconds() - decodeStartUs;
+    m_AudioDecodeTimeUs += decodeTimeUs;
+    m_AudioDecodedFrames++;
+    m_AudioTotalDecodeTimeUs += decodeTimeUs;
+    m_AudioTotalDecodedFrames++;
+
+    if (driftCompensator != nullptr && samplesDecoded > 0) {
+        AUDIO_STATS stats = {};
+        m_AudioRenderer->getStats(&stats);
+        driftCompensator->updateBufferError((int)stats.deviceBufferedUs - (int)stats.targetBufferMs * 1000,
+                                            samplesDecoded * 1000 / (m_ActiveAudioConfig.sampleRate / 1000));
+
+        if (m_AudioRenderer->getAudioBufferFormat() == IAudioRenderer::AudioFormat::Float32NE) {
+            samplesDecoded = driftCompensator->process((float*)decodeBuffer, samplesDecoded,
+                                                       (float*)buffer, desiredBufferSize / frameSize);
+        }
+        else {
+            samplesDecoded = driftCompensator->process((short*)decodeBuffer, samplesDecoded,
+                                                       (short*)buffer, desiredBufferSize / frameSize);
+        }
+    }
+
+    // Update desiredSize with the number of bytes actually populated by the decoding operation
+    if (samplesDecoded > 0) {
+        SDL_assert(desiredBufferSize >= frameSize * samplesDecoded);
+        desiredBufferSize = frameSize * samplesDecoded;
+    }
+    else {
+        desiredBufferSize = 0;
+    }
+
+    return m_AudioRenderer->submitAudio(desiredBufferSize);
+}
+
+void Session::logAudioPipelineSummary()
+{
+    AUDIO_STATS stats = {};
+
+    if (m_AudioTotalDecodedFrames == 0) {
+        return;
+    }
+
+    if (m_AudioRenderer != nullptr) {
+        m_AudioRenderer->getStats(&stats);
+    }
+
+    m_AudioDroppedPackets += m_AudioPacketQueue->takeDroppedCount();
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Audio pipeline: %u frames decoded (%.1f us/frame), queueing delay p50/p95/p99: %.1f/%.1f/%.1f ms",
+                m_AudioTotalDecodedFrames,
+                (double)m_AudioTotalDecodeTimeUs / m_AudioTotalDecodedFrames,
+                getQueueDelayPercentileUs(m_AudioTotalQueueDelayHistogram, 50) / 1000.0,
+                getQueueDelayPercentileUs(m_AudioTotalQueueDelayHistogram, 95) / 1000.0,
+                getQueueDelayPercentileUs(m_AudioTotalQueueDelayHistogram, 99) / 1000.0);
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Audio glitches: %u underruns, %u overruns, %u dropped packets, %u concealed frames (%u using FEC)",
+                stats.underruns,
+                stats.overruns,
+                m_AudioDroppedPackets,
+                m_AudioConcealedFrames,
+                m_AudioFecFrames);
+}
+
+void Session::processAudioPacket(const unsigned char* sampleData, int sampleLength)
+{
     // See if we need to drop this sample
-    if (s_ActiveSession->m_DropAudioEndTime != 0) {
-        if (SDL_TICKS_PASSED(SDL_GetTicks(), s_ActiveSession->m_DropAudioEndTime)) {
+    if (m_DropAudioEndTime != 0) {
+        if (SDL_TICKS_PASSED(SDL_GetTicks(), m_DropAudioEndTime)) {
             // Avoid calling SDL_GetTicks() now
-            s_ActiveSession->m_DropAudioEndTime = 0;
+            m_DropAudioEndTime = 0;
 
             SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
                         "Audio drop window has ended");
@@ -180,76 +531,184 @@ void Session::arDecodeAndPlaySample(char* sampleData, int sampleLength)
         }
     }
 
-    s_ActiveSession->m_AudioSampleCount++;
+    m_AudioSampleCount++;
 
     // If audio is muted, don't decode or play the audio
-    if (s_ActiveSession->m_AudioMuted) {
+    if (m_AudioMuted) {
         return;
     }
 
-    if (s_ActiveSession->m_AudioRenderer != nullptr) {
-        int sampleSize = s_ActiveSession->m_AudioRenderer->getAudioBufferSampleSize();
-        int frameSize = sampleSize * s_ActiveSession->m_ActiveAudioConfig.channelCount;
-        int desiredBufferSize = frameSize * s_ActiveSession->m_ActiveAudioConfig.samplesPerFrame;
-        void* buffer = s_ActiveSession->m_AudioRenderer->getAudioBuffer(&desiredBufferSize);
-        if (buffer == nullptr) {
-            return;
-        }
+    if (m_AudioRenderer != nullptr) {
+        bool playing = true;
+
+        if (sampleData == nullptr) {
+            // We get a NULL sample in place of each lost packet. We hold off on
+            // concealing the latest loss until the next packet arrives, because
+            // it may carry in-band FEC data that lets us recover the lost frame.
+            // If we were already holding one, conceal it now using PLC.
+            if (m_AudioLostFramePending) {
+                playing = playAudioFrame(nullptr, 0, false);
+                m_AudioConcealedFrames++;
+            }
 
-        if (s_ActiveSession->m_AudioRenderer->getAudioBufferFormat() == IAudioRenderer::AudioFormat::Float32NE) {
-            samplesDecoded = opus_multistream_decode_float(s_ActiveSession->m_OpusDecoder,
-                                                           (unsigned char*)sampleData,
-                                                           sampleLength,
-                                                           (float*)buffer,
-                                                           desiredBufferSize / frameSize,
-                                                           0);
+            m_AudioLostFramePending = true;
         }
         else {
-            samplesDecoded = opus_multistream_decode(s_ActiveSession->m_OpusDecoder,
-                                                     (unsigned char*)sampleData,
-                                                     sampleLength,
-                                                     (short*)buffer,
-                                                     desiredBufferSize / frameSize,
-                                                     0);
+            if (m_AudioLostFramePending) {
+                // Opus falls back to PLC if this packet doesn't have FEC data,
+                // so we only count it as FEC if the packet has LBRR data.
+                playing = playAudioFrame(sampleData, sampleLength, true);
+                m_AudioConcealedFrames++;
+                if (opusPacketHasLbrr(sampleData, sampleLength, m_OriginalAudioConfig.streams > 1)) {
+                    m_AudioFecFrames++;
+                }
+                m_AudioLostFramePending = false;
+            }
+
+            if (playing) {
+                playing = playAudioFrame(sampleData, sampleLength, false);
+            }
         }
 
-        // Update desiredSize with the number of bytes actually populated by the decoding operation
-        if (samplesDecoded > 0) {
-            SDL_assert(desiredBufferSize >= frameSize * samplesDecoded);
-            desiredBufferSize = frameSize * samplesDecoded;
-        }
-        else {
-            desiredBufferSize = 0;
+        // Refresh our stats snapshot for the overlay about once a second
+        if (SDL_TICKS_PASSED(SDL_GetTicks(), m_AudioStatsUpdateTime)) {
+            AUDIO_STATS stats = {};
+            m_AudioRenderer->getStats(&stats);
+            if (m_AudioDriftCompensator != nullptr) {
+                stats.driftCompensation = true;
+                stats.driftPpm = m_AudioDriftCompensator->getDriftPpm();
+                stats.driftCorrectionPpm = m_AudioDriftCompensator->getCorrectionPpm();
+            }
+            stats.concealedFrames = m_AudioConcealedFrames;
+            stats.fecFrames = m_AudioFecFrames;
+
+            m_AudioDroppedPackets += m_AudioPacketQueue->takeDroppedCount();
+            stats.queuedPackets = m_AudioPacketQueue->count();
+            stats.maxQueuedPackets = m_AudioMaxQueuedPackets;
+            stats.droppedPackets = m_AudioDroppedPackets;
+            if (m_AudioDecodedFrames != 0) {
+                stats.avgDecodeTimeUs = (uint32_t)(m_AudioDecodeTimeUs / m_AudioDecodedFrames);
+            }
+            stats.queueDelayP50Us = getQueueDelayPercentileUs(m_AudioQueueDelayHistogram, 50);
+            stats.queueDelayP99Us = getQueueDelayPercentileUs(m_AudioQueueDelayHistogram, 99);
+            stats.valid = true;
+
+            // Start a new measurement window
+            m_AudioMaxQueuedPackets = 0;
+            m_AudioDecodeTimeUs = 0;
+            m_AudioDecodedFrames = 0;
+            SDL_zero(m_AudioQueueDelayHistogram);
+
+            SDL_AtomicLock(&m_AudioStatsLock);
+            m_AudioStats = stats;
+            SDL_AtomicUnlock(&m_AudioStatsLock);
+
+            m_AudioStatsUpdateTime = SDL_GetTicks() + 1000;
         }
 
-        if (!s_ActiveSession->m_AudioRenderer->submitAudio(desiredBufferSize)) {
+        if (!playing) {
             SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
                         "Reinitializing audio renderer after failure");
-
-            opus_multistream_decoder_destroy(s_ActiveSession->m_OpusDecoder);
-            s_ActiveSession->m_OpusDecoder = nullptr;
-
-            delete s_ActiveSession->m_AudioRenderer;
-            s_ActiveSession->m_AudioRenderer = nullptr;
+            destroyAudioRenderer();
         }
     }
 
     // Only try to recreate the audio renderer every 200 samples (1 second)
     // to avoid thrashing if the audio device is unavailable. It is
-    // safe to reinitialize here because we can't be torn down while
-    // the audio decoder/playback thread is still alive.
-    if (s_ActiveSession->m_AudioRenderer == nullptr && (s_ActiveSession->m_AudioSampleCount % 200) == 0) {
-        // Since we're doing this inline and audio initialization takes time, we need
-        // to drop samples to account for the time we've spent blocking audio rendering
-        // so we return to real-time playback and don't accumulate latency.
+    // safe to reinitialize here because arCleanup() waits for the
+    // audio thread to exit before tearing anything down.
+    if (m_AudioRenderer == nullptr && (m_AudioSampleCount % 200) == 0) {
+        // Audio initialization takes time and packets will queue up while we're
+        // blocked, so we need to drop samples to account for the time we've spent
+        // here so we return to real-time playback and don't accumulate latency.
         Uint32 audioReinitStartTime = SDL_GetTicks();
-        if (s_ActiveSession->initializeAudioRenderer()) {
+        if (initializeAudioRenderer()) {
             Uint32 audioReinitStopTime = SDL_GetTicks();
 
-            s_ActiveSession->m_DropAudioEndTime = audioReinitStopTime + (audioReinitStopTime - audioReinitStartTime);
+            m_DropAudioEndTime = audioReinitStopTime + (audioReinitStopTime - audioReinitStartTime);
             SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
                         "Audio reinitialization took %d ms - starting drop window",
                         audioReinitStopTime - audioReinitStartTime);
         }
     }
 }
+
+void Session::getAudioStats(PAUDIO_STATS stats)
+{
+    SDL_AtomicLock(&m_AudioStatsLock);
+    *stats = m_AudioStats;
+    SDL_AtomicUnlock(&m_AudioStatsLock);
+}
+
+void Session::stringifyAudioStats(char* output, int length)
+{
+    AUDIO_STATS stats;
+    int offset = 0;
+    int ret;
+
+    getAudioStats(&stats);
+
+    if (!stats.valid) {
+        return;
+    }
+
+    // Renderers that don't track buffering won't report a target
+    if (stats.targetBufferMs != 0) {
+        ret = snprintf(&output[offset],
+                       length - offset,
+                       "Audio buffer: %u ms (target: %u ms)\n"
+                       "Audio underruns/overruns: %u/%u\n",
+                       stats.bufferedMs,
+                       stats.targetBufferMs,
+                       stats.underruns,
+                       stats.overruns);
+        if (ret < 0 || ret >= length - offset) {
+            return;
+        }
+
+        offset += ret;
+    }
+
+    if (stats.driftCompensation) {
+        ret = snprintf(&output[offset],
+                       length - offset,
+                       "Audio clock drift: %+d ppm (correction: %+d ppm)\n",
+                       stats.driftPpm,
+                       stats.driftCorrectionPpm);
+        if (ret < 0 || ret >= length - offset) {
+            return;
+        }
+
+        offset += ret;
+    }
+
+    ret = snprintf(&output[offset],
+                   length - offset,
+                   "Audio packet queue: %d (max: %u, dropped: %u)\n"
+                   "Audio queueing delay (p50/p99): %.1f/%.1f ms\n"
+                   "Average audio decoding time: %.2f ms\n",
+                   stats.queuedPackets,
+                   stats.maxQueuedPackets,
+                   stats.droppedPackets,
+                   stats.queueDelayP50Us / 1000.0,
+                   stats.queueDelayP99Us / 1000.0,
+                   stats.avgDecodeTimeUs / 1000.0);
+    if (ret < 0 || ret >= length - offset) {
+        return;
+    }
+
+    offset += ret;
+
+    if (stats.concealedFrames != 0) {
+        ret = snprintf(&output[offset],
+                       length - offset,
+                       "Lost audio frames concealed: %u (%u using FEC)\n",
+                       stats.concealedFrames,
+                       stats.fecFrames);
+        if (ret < 0 || ret >= length - offset) {
+            return;
+        }
+
+        offset += ret;
+    }
+}
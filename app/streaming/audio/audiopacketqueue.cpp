@@ -0,0 +1,86 @@
+#include "audiopacketqueue.h"
+
+#include <Limelight.h>
+
+AudioPacketQueue::AudioPacketQueue()
+    : m_Packets((AUDIO_PACKET*)SDL_malloc(sizeof(AUDIO_PACKET) * AUDIO_PACKET_QUEUE_SLOTS)),
+      m_PacketsAvailable(SDL_CreateSemaphore(0))
+{
+    SDL_AtomicSet(&m_Head, 0);
+    SDL_AtomicSet(&m_Tail, 0);
+    SDL_AtomicSet(&m_Dropped, 0);
+}
+
+AudioPacketQueue::~AudioPacketQueue()
+{
+    SDL_free(m_Packets);
+
+    if (m_PacketsAvailable != nullptr) {
+        SDL_DestroySemaphore(m_PacketsAvailable);
+    }
+}
+
+bool AudioPacketQueue::enqueue(const char* data, int length)
+{
+    int tail = SDL_AtomicGet(&m_Tail);
+
+    if (m_Packets == nullptr || m_PacketsAvailable == nullptr ||
+            tail - SDL_AtomicGet(&m_Head) == AUDIO_PACKET_QUEUE_SLOTS ||
+            length > AUDIO_PACKET_MAX_SIZE) {
+        SDL_AtomicIncRef(&m_Dropped);
+        return false;
+    }
+
+    PAUDIO_PACKET packet = &m_Packets[tail & (AUDIO_PACKET_QUEUE_SLOTS - 1)];
+    if (data != nullptr) {
+        SDL_memcpy(packet->data, data, length);
+        packet->length = length;
+    }
+    else {
+        packet->length = 0;
+    }
+    packet->enqueueTimeUs = LiGetMicroseconds();
+
+    // Publish the packet to the consumer
+    SDL_AtomicSet(&m_Tail, tail + 1);
+    SDL_SemPost(m_PacketsAvailable);
+    return true;
+}
+
+PAUDIO_PACKET AudioPacketQueue::peek()
+{
+    // Each enqueue() posts the semaphore once and each packet is peeked
+    // once before it is popped, so we only wake up without a packet if
+    // wakeUp() was called.
+    SDL_SemWait(m_PacketsAvailable);
+
+    int head = SDL_AtomicGet(&m_Head);
+    if (SDL_AtomicGet(&m_Tail) == head) {
+        return nullptr;
+    }
+
+    return &m_Packets[head & (AUDIO_PACKET_QUEUE_SLOTS - 1)];
+}
+
+void AudioPacketQueue::pop()
+{
+    SDL_assert(SDL_AtomicGet(&m_Tail) != SDL_AtomicGet(&m_Head));
+
+    // Release the slot back to the producer
+    SDL_AtomicAdd(&m_Head, 1);
+}
+
+void AudioPacketQueue::wakeUp()
+{
+    SDL_SemPost(m_PacketsAvailable);
+}
+
+int AudioPacketQueue::count()
+{
+    return SDL_AtomicGet(&m_Tail) - SDL_AtomicGet(&m_Head);
+}
+
+int AudioPacketQueue::takeDroppedCount()
+{
+    return SDL_AtomicSet(&m_Dropped, 0);
+}
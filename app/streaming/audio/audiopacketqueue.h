@@ -0,0 +1,58 @@
+#pragma once
+
+#include "SDL_compat.h"
+
+// Number of packets the queue can hold (must be a power of 2). This is
+// 160 ms of audio at the usual 5 ms packet duration.
+#define AUDIO_PACKET_QUEUE_SLOTS 32
+
+// Largest audio packet we can queue. This is comfortably larger than
+// anything that fits in a single RTP packet.
+#define AUDIO_PACKET_MAX_SIZE 2048
+
+// Resolution and range of the queueing delay histograms kept by the
+// session. This covers delays up to 32 ms in 0.5 ms steps.
+#define AUDIO_QUEUE_DELAY_BUCKET_US 500
+#define AUDIO_QUEUE_DELAY_BUCKETS 64
+
+typedef struct _AUDIO_PACKET {
+    int length;  // 0 for a lost packet
+    uint64_t enqueueTimeUs;
+    unsigned char data[AUDIO_PACKET_MAX_SIZE];
+} AUDIO_PACKET, *PAUDIO_PACKET;
+
+// A bounded lock-free queue of audio packets with a single producer (the
+// network receive thread) and a single consumer (the audio playback thread).
+// The producer never blocks. If the queue is full, the packet is dropped.
+class AudioPacketQueue
+{
+public:
+    AudioPacketQueue();
+    ~AudioPacketQueue();
+
+    // Producer side. A NULL packet marks a lost packet.
+    // Returns false if the packet was dropped.
+    bool enqueue(const char* data, int length);
+
+    // Consumer side. Blocks until a packet is available or wakeUp() is
+    // called. Each packet must be peeked exactly once, and the returned
+    // packet stays valid until pop() is called.
+    PAUDIO_PACKET peek();
+
+    void pop();
+
+    // Wakes the consumer from peek() even if no packet is available
+    void wakeUp();
+
+    int count();
+
+    // Returns the number of packets dropped since the last call
+    int takeDroppedCount();
+
+private:
+    AUDIO_PACKET* m_Packets;
+    SDL_atomic_t m_Head;
+    SDL_atomic_t m_Tail;
+    SDL_atomic_t m_Dropped;
+    SDL_sem* m_PacketsAvailable;
+};
@@ -0,0 +1,138 @@
+#include "driftcompensator.h"
+
+#include <climits>
+#include <cmath>
+
+// Proportional gain of the buffer level controller. At this gain, we
+// reach the maximum correction when the buffer is 10 ms off target.
+#define DRIFT_PROPORTIONAL_PPM_PER_MS 50.0
+
+// Time constant of the integral term (in seconds). This is what slowly
+// converges on the actual clock drift between the host and client.
+#define DRIFT_INTEGRAL_TIME_SECS 30.0
+
+// Time constant of the filter applied to the buffer level error. This
+// smooths out the variation caused by packet and callback timing.
+#define ERROR_SMOOTHING_TIME_SECS 0.5
+
+AudioDriftCompensator::AudioDriftCompensator(int channelCount)
+    : m_ChannelCount(channelCount),
+      m_SmoothedErrorMs(0),
+      m_DriftPpm(0),
+      m_CorrectionPpm(0),
+      m_Position(1.0)
+{
+    SDL_assert(channelCount <= AUDIO_CONFIGURATION_MAX_CHANNEL_COUNT);
+    SDL_zero(m_History);
+}
+
+void AudioDriftCompensator::updateBufferError(int errorUs, int frameDurationUs)
+{
+    double dt = frameDurationUs / 1000000.0;
+
+    m_SmoothedErrorMs += (errorUs / 1000.0 - m_SmoothedErrorMs) * dt / (ERROR_SMOOTHING_TIME_SECS + dt);
+
+    m_DriftPpm += DRIFT_PROPORTIONAL_PPM_PER_MS / DRIFT_INTEGRAL_TIME_SECS * m_SmoothedErrorMs * dt;
+    m_DriftPpm = SDL_clamp(m_DriftPpm, -MAX_DRIFT_CORRECTION_PPM, MAX_DRIFT_CORRECTION_PPM);
+
+    m_CorrectionPpm = m_DriftPpm + DRIFT_PROPORTIONAL_PPM_PER_MS * m_SmoothedErrorMs;
+    m_CorrectionPpm = SDL_clamp(m_CorrectionPpm, -MAX_DRIFT_CORRECTION_PPM, MAX_DRIFT_CORRECTION_PPM);
+}
+
+int AudioDriftCompensator::getDriftPpm()
+{
+    return (int)lround(m_DriftPpm);
+}
+
+int AudioDriftCompensator::getCorrectionPpm()
+{
+    return (int)lround(m_CorrectionPpm);
+}
+
+static inline float sampleToFloat(float sample)
+{
+    return sample;
+}
+
+static inline float sampleToFloat(short sample)
+{
+    return sample;
+}
+
+template <typename T>
+static inline T floatToSample(float sample);
+
+template <>
+inline float floatToSample<float>(float sample)
+{
+    return sample;
+}
+
+template <>
+inline short floatToSample<short>(float sample)
+{
+    return (short)SDL_clamp(lrintf(sample), SHRT_MIN, SHRT_MAX);
+}
+
+template <typename T>
+int AudioDriftCompensator::processInternal(const T* input, int inputFrames, T* output, int maxOutputFrames)
+{
+    // A positive correction means we have too much audio buffered,
+    // so we step through the input faster to produce fewer samples.
+    double step = 1.0 + m_CorrectionPpm / 1000000.0;
+    int totalFrames = inputFrames + 3;
+    int outputFrames = 0;
+
+    // Indexes below 3 refer to our history and the rest refer to the input
+    auto sample = [&](int index, int channel) -> float {
+        return index < 3 ?
+                    m_History[index][channel] :
+                    sampleToFloat(input[(index - 3) * m_ChannelCount + channel]);
+    };
+
+    while (outputFrames < maxOutputFrames) {
+        int index = (int)m_Position;
+        if (index + 2 >= totalFrames) {
+            break;
+        }
+
+        // Catmull-Rom interpolation between index and index + 1
+        float t = (float)(m_Position - index);
+        for (int ch = 0; ch < m_ChannelCount; ch++) {
+            float p0 = sample(index - 1, ch);
+            float p1 = sample(index, ch);
+            float p2 = sample(index + 1, ch);
+            float p3 = sample(index + 2, ch);
+
+            float value = p1 + 0.5f * t * (p2 - p0 + t * (2 * p0 - 5 * p1 + 4 * p2 - p3 + t * (3 * (p1 - p2) + p3 - p0)));
+            output[outputFrames * m_ChannelCount + ch] = floatToSample<T>(value);
+        }
+
+        outputFrames++;
+        m_Position += step;
+    }
+
+    // Keep the last 3 frames as history for the next call
+    float history[3][AUDIO_CONFIGURATION_MAX_CHANNEL_COUNT] = {};
+    for (int i = 0; i < 3; i++) {
+        for (int ch = 0; ch < m_ChannelCount; ch++) {
+            history[i][ch] = sample(inputFrames + i, ch);
+        }
+    }
+    SDL_memcpy(m_History, history, sizeof(history));
+
+    // If the output buffer was too small, skip the input we couldn't consume
+    m_Position = SDL_max(m_Position - inputFrames, 1.0);
+
+    return outputFrames;
+}
+
+int AudioDriftCompensator::process(const float* input, int inputFrames, float* output, int maxOutputFrames)
+{
+    return processInternal(input, inputFrames, output, maxOutputFrames);
+}
+
+int AudioDriftCompensator::process(const short* input, int inputFrames, short* output, int maxOutputFrames)
+{
+    return processInternal(input, inputFrames, output, maxOutputFrames);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <Limelight.h>
+#include "SDL_compat.h"
+
+// Maximum sample rate correction that we'll apply. This is far below
+// the threshold where pitch changes become audible.
+#define MAX_DRIFT_CORRECTION_PPM 500
+
+// Compensates for the difference between the host and client audio clocks
+// by slightly stretching or compressing the decoded audio, so the renderer's
+// buffer level stays at its target instead of slowly draining or filling.
+class AudioDriftCompensator
+{
+public:
+    explicit AudioDriftCompensator(int channelCount);
+
+    // Feeds the latest renderer buffer level error (positive when more
+    // audio is buffered than targeted) for a frame of the given duration
+    void updateBufferError(int errorUs, int frameDurationUs);
+
+    // Resamples a frame of interleaved audio at the current correction.
+    // Returns the number of sample frames written to the output, which
+    // may differ by one from the number of input frames.
+    int process(const float* input, int inputFrames, float* output, int maxOutputFrames);
+    int process(const short* input, int inputFrames, short* output, int maxOutputFrames);
+
+    // The estimated clock drift (long term correction) in ppm
+    int getDriftPpm();
+
+    // The correction currently being applied in ppm
+    int getCorrectionPpm();
+
+private:
+    template <typename T>
+    int processInternal(const T* input, int inputFrames, T* output, int maxOutputFrames);
+
+    int m_ChannelCount;
+
+    // Controller state
+    double m_SmoothedErrorMs;
+    double m_DriftPpm;
+    double m_CorrectionPpm;
+
+    // Resampler state. The last 3 input frames are kept as history for
+    // the cubic interpolator, and m_Position is the fractional read
+    // position relative to the start of the history.
+    float m_History[3][AUDIO_CONFIGURATION_MAX_CHANNEL_COUNT];
+    double m_Position;
+};
@@ -3,6 +3,28 @@
 #include <Limelight.h>
 #include <QtGlobal>
 
+typedef struct _AUDIO_STATS {
+    uint32_t bufferedMs;        // audio waiting in the renderer's buffer
+    uint32_t targetBufferMs;    // buffer level the renderer is aiming for
+    uint32_t underruns;         // times the device ran out of audio to play
+    uint32_t overruns;          // frames discarded because too much audio was buffered
+    uint32_t deviceBufferedUs;  // audio buffered when the device last asked for more
+
+    // Populated by the session rather than the renderer
+    bool valid;                 // whether these stats have been populated
+    uint32_t concealedFrames;   // lost frames replaced by PLC or FEC
+    uint32_t fecFrames;         // lost frames decoded using FEC data from the next packet
+    int32_t queuedPackets;      // packets waiting for the audio thread
+    uint32_t maxQueuedPackets;  // most packets waiting during the last window
+    uint32_t droppedPackets;    // packets dropped because the audio thread fell behind
+    uint32_t avgDecodeTimeUs;   // average Opus decode time during the last window
+    uint32_t queueDelayP50Us;   // median time packets waited for the audio thread during the last window
+    uint32_t queueDelayP99Us;   // 99th percentile of the same
+    bool driftCompensation;     // whether clock drift compensation is active
+    int32_t driftPpm;           // estimated clock drift
+    int32_t driftCorrectionPpm; // sample rate correction currently applied
+} AUDIO_STATS, *PAUDIO_STATS;
+
 class IAudioRenderer
 {
 public:
@@ -15,6 +37,9 @@ public:
     // Return false if an unrecoverable error has occurred and the renderer must be reinitialized
     virtual bool submitAudio(int bytesWritten) = 0;
 
+    // Renderers that track buffering statistics should fill them in here
+    virtual void getStats(PAUDIO_STATS) {}
+
     virtual void remapChannels(POPUS_MULTISTREAM_CONFIGURATION) {
         // Use default channel mapping:
         // 0 - Front Left
@@ -16,11 +16,44 @@ public:
 
     virtual bool submitAudio(int bytesWritten);
 
+    virtual void getStats(PAUDIO_STATS stats);
+
     virtual AudioFormat getAudioBufferFormat();
 
 private:
+    static void SDLCALL audioCallback(void* userdata, Uint8* stream, int len);
+
+    // False if the caller initialized the audio subsystem for us
+    bool m_OwnsAudioSubsystem;
+
     SDL_AudioDeviceID m_AudioDevice;
     void* m_AudioBuffer;
+    Uint32 m_AudioBufferSize;
     Uint32 m_FrameSize;
-    Uint32 m_FrameDurationMs;
+    Uint32 m_BytesPerMs;
+
+    // Single producer (submitAudio) and single consumer (audioCallback)
+    // ring buffer. The positions are free-running byte counters, so the
+    // buffer size must be a power of 2.
+    Uint8* m_RingBuffer;
+    Uint32 m_RingBufferSize;
+    SDL_atomic_t m_RingReadPos;
+    SDL_atomic_t m_RingWritePos;
+
+    // The buffer level (in bytes) that we prime to after an underrun.
+    // This is adjusted by the audio callback based on observed jitter.
+    SDL_atomic_t m_TargetFill;
+    Uint32 m_MinTargetFill;
+    Uint32 m_MaxTargetFill;
+    Uint32 m_TargetFillStep;
+
+    SDL_atomic_t m_DeviceFill;
+    SDL_atomic_t m_Underruns;
+    SDL_atomic_t m_Overruns;
+
+    // Only touched by the audio callback
+    bool m_Priming;
+    Uint32 m_WindowBytes;
+    Uint32 m_WindowMinFill;
+    bool m_WindowHadUnderrun;
 };
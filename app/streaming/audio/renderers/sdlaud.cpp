@@ -1,38 +1,79 @@
 #include "sdl.h"
+#include "utils.h"
 
 #include <Limelight.h>
 
+// Default lower bound for the buffer level we aim to keep (overridable
+// with AUDIO_TARGET_BUFFER_MS). The target will grow from here if we
+// see underruns due to jitter.
+#define DEFAULT_TARGET_BUFFER_MS 10
+#define MAX_TARGET_BUFFER_MS 100
+
+// Minimum amount of audio that the ring buffer can hold
+#define RING_BUFFER_MS 250
+
+// How often we consider lowering the target buffer level
+#define ADAPTATION_WINDOW_MS 1000
+
 SdlAudioRenderer::SdlAudioRenderer()
-    : m_AudioDevice(0),
-      m_AudioBuffer(nullptr)
+    : m_OwnsAudioSubsystem(false),
+      m_AudioDevice(0),
+      m_AudioBuffer(nullptr),
+      m_AudioBufferSize(0),
+      m_RingBuffer(nullptr),
+      m_RingBufferSize(0),
+      m_Priming(true),
+      m_WindowBytes(0),
+      m_WindowMinFill(UINT32_MAX),
+      m_WindowHadUnderrun(false)
 {
-    SDL_assert(!SDL_WasInit(SDL_INIT_AUDIO));
+    SDL_AtomicSet(&m_RingReadPos, 0);
+    SDL_AtomicSet(&m_RingWritePos, 0);
+    SDL_AtomicSet(&m_TargetFill, 0);
+    SDL_AtomicSet(&m_DeviceFill, 0);
+    SDL_AtomicSet(&m_Underruns, 0);
+    SDL_AtomicSet(&m_Overruns, 0);
+
+    // The audio test runs off the main thread, so Session initializes the
+    // audio subsystem on the main thread beforehand. In that case, we just
+    // open and close the device and leave the subsystem alone.
+    if (SDL_WasInit(SDL_INIT_AUDIO)) {
+        return;
+    }
 
     if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                      "SDL_InitSubSystem(SDL_INIT_AUDIO) failed: %s",
                      SDL_GetError());
-        SDL_assert(SDL_WasInit(SDL_INIT_AUDIO));
+        SDL_assert(!SDL_WasInit(SDL_INIT_AUDIO));
+        return;
     }
+
+    m_OwnsAudioSubsystem = true;
 }
 
 bool SdlAudioRenderer::prepareForPlayback(const OPUS_MULTISTREAM_CONFIGURATION* opusConfig)
 {
     SDL_AudioSpec want, have;
+    int targetBufferMs;
 
     SDL_zero(want);
     want.freq = opusConfig->sampleRate;
     want.format = AUDIO_F32SYS;
     want.channels = opusConfig->channelCount;
+    want.callback = audioCallback;
+    want.userdata = this;
 
     // On PulseAudio systems, setting a value too small can cause underruns for other
     // applications sharing this output device. We impose a floor of 480 samples (10 ms)
-    // to mitigate this issue. Otherwise, we will buffer up to 3 frames of audio which
-    // is 15 ms at regular 5 ms frames and 30 ms at 10 ms frames for slow connections.
-    // The buffering helps avoid audio underruns due to network jitter.
+    // to mitigate this issue. Otherwise, we will request up to 3 frames of audio per
+    // callback which is 15 ms at regular 5 ms frames and 30 ms at 10 ms frames for
+    // slow connections.
     want.samples = SDL_max(480, opusConfig->samplesPerFrame * 3);
 
-    m_FrameDurationMs = opusConfig->samplesPerFrame / (opusConfig->sampleRate / 1000);
+    m_BytesPerMs = (opusConfig->sampleRate / 1000) *
+                   opusConfig->channelCount *
+                   getAudioBufferSampleSize();
     m_FrameSize = opusConfig->samplesPerFrame *
                   opusConfig->channelCount *
                   getAudioBufferSampleSize();
@@ -45,13 +86,40 @@ bool SdlAudioRenderer::prepareForPlayback(const OPUS_MULTISTREAM_CONFIGURATION*
         return false;
     }
 
-    m_AudioBuffer = SDL_malloc(m_FrameSize);
+    // Leave room for one extra sample per channel in case
+    // the frame is stretched by clock drift compensation
+    m_AudioBufferSize = m_FrameSize + opusConfig->channelCount * getAudioBufferSampleSize();
+    m_AudioBuffer = SDL_malloc(m_AudioBufferSize);
     if (m_AudioBuffer == nullptr) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                      "Failed to allocate audio buffer");
         return false;
     }
 
+    // Round the ring buffer up to a power of 2 so our free-running
+    // positions stay consistent when they wrap around
+    m_RingBufferSize = 1;
+    while (m_RingBufferSize < SDL_max(RING_BUFFER_MS * m_BytesPerMs, have.size * 4)) {
+        m_RingBufferSize <<= 1;
+    }
+
+    m_RingBuffer = (Uint8*)SDL_malloc(m_RingBufferSize);
+    if (m_RingBuffer == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Failed to allocate audio ring buffer");
+        return false;
+    }
+
+    if (!Utils::getEnvironmentVariableOverride("AUDIO_TARGET_BUFFER_MS", &targetBufferMs)) {
+        targetBufferMs = DEFAULT_TARGET_BUFFER_MS;
+    }
+
+    // We always need at least one callback's worth of audio buffered
+    m_MinTargetFill = SDL_max((Uint32)SDL_max(targetBufferMs, 0) * m_BytesPerMs, have.size);
+    m_MaxTargetFill = SDL_max((Uint32)MAX_TARGET_BUFFER_MS * m_BytesPerMs, m_MinTargetFill);
+    m_TargetFillStep = SDL_max(m_FrameSize, 2 * m_BytesPerMs);
+    SDL_AtomicSet(&m_TargetFill, (int)m_MinTargetFill);
+
     SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
                 "Desired audio buffer: %u samples (%u bytes)",
                 want.samples,
@@ -62,6 +130,10 @@ bool SdlAudioRenderer::prepareForPlayback(const OPUS_MULTISTREAM_CONFIGURATION*
                 have.samples,
                 have.size);
 
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Initial audio buffer target: %u ms",
+                m_MinTargetFill / m_BytesPerMs);
+
     SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
                 "SDL audio driver: %s",
                 SDL_GetCurrentAudioDriver());
@@ -84,12 +156,24 @@ SdlAudioRenderer::~SdlAudioRenderer()
         SDL_free(m_AudioBuffer);
     }
 
-    SDL_QuitSubSystem(SDL_INIT_AUDIO);
-    SDL_assert(!SDL_WasInit(SDL_INIT_AUDIO));
+    if (m_RingBuffer != nullptr) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Audio buffer underruns: %d, overruns: %d (final target: %u ms)",
+                    SDL_AtomicGet(&m_Underruns),
+                    SDL_AtomicGet(&m_Overruns),
+                    (Uint32)SDL_AtomicGet(&m_TargetFill) / m_BytesPerMs);
+        SDL_free(m_RingBuffer);
+    }
+
+    if (m_OwnsAudioSubsystem) {
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        SDL_assert(!SDL_WasInit(SDL_INIT_AUDIO));
+    }
 }
 
-void* SdlAudioRenderer::getAudioBuffer(int*)
+void* SdlAudioRenderer::getAudioBuffer(int* size)
 {
+    SDL_assert((Uint32)*size <= m_AudioBufferSize);
     return m_AudioBuffer;
 }
 
@@ -106,31 +190,103 @@ bool SdlAudioRenderer::submitAudio(int bytesWritten)
         return true;
     }
 
-    // Provide backpressure on the queue to ensure too many frames don't build up
-    // in SDL's audio queue, but don't wait forever to avoid a deadlock if the
-    // audio device fails.
-    for (int i = 0; i < 100; i++) {
-        // Our device may enter a permanent error status upon removal, so we need
-        // to recreate the audio device to pick up the new default audio device.
-        if (SDL_GetAudioDeviceStatus(m_AudioDevice) == SDL_AUDIO_STOPPED) {
-            return false;
-        }
+    // Our device may enter a permanent error status upon removal, so we need
+    // to recreate the audio device to pick up the new default audio device.
+    if (SDL_GetAudioDeviceStatus(m_AudioDevice) == SDL_AUDIO_STOPPED) {
+        return false;
+    }
+
+    Uint32 writePos = (Uint32)SDL_AtomicGet(&m_RingWritePos);
+    Uint32 fill = writePos - (Uint32)SDL_AtomicGet(&m_RingReadPos);
 
-        // Only queue more samples where there is 50 ms or less in SDL's queue
-        if (SDL_GetQueuedAudioSize(m_AudioDevice) / m_FrameSize * m_FrameDurationMs <= 50) {
-            break;
+    // Drop this frame if it would take us too far past our target level.
+    // We allow a couple of frames over the target to absorb bursts.
+    Uint32 maxFill = SDL_min((Uint32)SDL_AtomicGet(&m_TargetFill) + m_FrameSize * 2,
+                             m_RingBufferSize);
+    if (fill + bytesWritten > maxFill) {
+        SDL_AtomicIncRef(&m_Overruns);
+        return true;
+    }
+
+    // Copy into the ring buffer, wrapping around if needed
+    Uint32 offset = writePos & (m_RingBufferSize - 1);
+    Uint32 firstChunk = SDL_min((Uint32)bytesWritten, m_RingBufferSize - offset);
+    SDL_memcpy(m_RingBuffer + offset, m_AudioBuffer, firstChunk);
+    SDL_memcpy(m_RingBuffer, (Uint8*)m_AudioBuffer + firstChunk, bytesWritten - firstChunk);
+
+    // Publish the new data to the audio callback
+    SDL_AtomicSet(&m_RingWritePos, (int)(writePos + bytesWritten));
+
+    return true;
+}
+
+void SDLCALL SdlAudioRenderer::audioCallback(void* userdata, Uint8* stream, int len)
+{
+    auto me = (SdlAudioRenderer*)userdata;
+    Uint32 readPos = (Uint32)SDL_AtomicGet(&me->m_RingReadPos);
+    Uint32 fill = (Uint32)SDL_AtomicGet(&me->m_RingWritePos) - readPos;
+    Uint32 targetFill = (Uint32)SDL_AtomicGet(&me->m_TargetFill);
+
+    // After an underrun, play silence until we've built the buffer back up
+    // to the target level, otherwise we'd just underrun again right away.
+    if (me->m_Priming) {
+        if (fill < targetFill) {
+            SDL_memset(stream, 0, len);
+            return;
         }
 
-        SDL_Delay(1);
+        me->m_Priming = false;
     }
 
-    if (SDL_QueueAudio(m_AudioDevice, m_AudioBuffer, bytesWritten) < 0) {
-        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                     "Failed to queue audio sample: %s",
-                     SDL_GetError());
+    SDL_AtomicSet(&me->m_DeviceFill, (int)fill);
+    me->m_WindowMinFill = SDL_min(me->m_WindowMinFill, fill);
+
+    Uint32 bytesToCopy = SDL_min(fill, (Uint32)len);
+    Uint32 offset = readPos & (me->m_RingBufferSize - 1);
+    Uint32 firstChunk = SDL_min(bytesToCopy, me->m_RingBufferSize - offset);
+    SDL_memcpy(stream, me->m_RingBuffer + offset, firstChunk);
+    SDL_memcpy(stream + firstChunk, me->m_RingBuffer, bytesToCopy - firstChunk);
+
+    // Release the space back to the producer
+    SDL_AtomicSet(&me->m_RingReadPos, (int)(readPos + bytesToCopy));
+
+    if (bytesToCopy < (Uint32)len) {
+        SDL_memset(stream + bytesToCopy, 0, len - bytesToCopy);
+        SDL_AtomicIncRef(&me->m_Underruns);
+
+        // Our target wasn't enough to ride out the jitter, so raise it
+        targetFill = SDL_min(targetFill + me->m_TargetFillStep, me->m_MaxTargetFill);
+        SDL_AtomicSet(&me->m_TargetFill, (int)targetFill);
+
+        me->m_Priming = true;
+        me->m_WindowHadUnderrun = true;
     }
 
-    return true;
+    me->m_WindowBytes += len;
+    if (me->m_WindowBytes >= ADAPTATION_WINDOW_MS * me->m_BytesPerMs) {
+        // If we never came within a step of running dry during this window,
+        // the jitter is lower than our target accounts for, so lower it.
+        if (!me->m_WindowHadUnderrun &&
+                me->m_WindowMinFill >= (Uint32)len + me->m_TargetFillStep &&
+                targetFill >= me->m_MinTargetFill + me->m_TargetFillStep) {
+            SDL_AtomicSet(&me->m_TargetFill, (int)(targetFill - me->m_TargetFillStep));
+        }
+
+        me->m_WindowBytes = 0;
+        me->m_WindowMinFill = UINT32_MAX;
+        me->m_WindowHadUnderrun = false;
+    }
+}
+
+void SdlAudioRenderer::getStats(PAUDIO_STATS stats)
+{
+    Uint32 fill = (Uint32)SDL_AtomicGet(&m_RingWritePos) - (Uint32)SDL_AtomicGet(&m_RingReadPos);
+
+    stats->bufferedMs = fill / m_BytesPerMs;
+    stats->targetBufferMs = (Uint32)SDL_AtomicGet(&m_TargetFill) / m_BytesPerMs;
+    stats->underruns = (uint32_t)SDL_AtomicGet(&m_Underruns);
+    stats->overruns = (uint32_t)SDL_AtomicGet(&m_Overruns);
+    stats->deviceBufferedUs = (Uint32)((Uint64)(Uint32)SDL_AtomicGet(&m_DeviceFill) * 1000 / m_BytesPerMs);
 }
 
 IAudioRenderer::AudioFormat SdlAudioRenderer::getAudioBufferFormat()
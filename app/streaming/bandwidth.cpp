@@ -2,48 +2,77 @@
 
 using namespace std::chrono;
 
-BandwidthTracker::BandwidthTracker(uint32_t windowSeconds, uint32_t bucketIntervalMs)
+// Each bucket word packs the bucket's epoch and byte count
+static inline std::uint32_t getEpoch(std::uint64_t word) {
+    return (std::uint32_t)(word >> 32);
+}
+
+static inline std::uint32_t getBytes(std::uint64_t word) {
+    return (std::uint32_t)word;
+}
+
+BandwidthTracker::BandwidthTracker(uint32_t windowSeconds, uint32_t bucketIntervalMs, uint32_t seriesCount)
   : windowSeconds(seconds(windowSeconds)),
-    bucketIntervalMs(bucketIntervalMs)
+    bucketIntervalMs(bucketIntervalMs > 0 ? bucketIntervalMs : 250),
+    bucketCount((windowSeconds * 1000) / this->bucketIntervalMs),
+    seriesCount(seriesCount > 0 ? seriesCount : 1),
+    buckets(new std::atomic<std::uint64_t>[bucketCount * this->seriesCount])
 {
-    if (bucketIntervalMs <= 0) {
-        bucketIntervalMs = 250;
+    for (uint32_t i = 0; i < bucketCount * this->seriesCount; i++) {
+        buckets[i].store(0, std::memory_order_relaxed);
     }
-    bucketCount = (windowSeconds * 1000) / bucketIntervalMs;
-    buckets.resize(bucketCount);
 }
 
 // Add bytes recorded at the current time.
-void BandwidthTracker::AddBytes(size_t bytes) {
-    std::lock_guard<std::mutex> lock(mtx);
-    auto now = steady_clock::now();
-    updateBucket(bytes, now);
+void BandwidthTracker::AddBytes(size_t bytes, uint32_t series) {
+    if (series >= seriesCount) {
+        return;
+    }
+
+    uint32_t epoch = getCurrentEpoch();
+    std::atomic<uint64_t> &bucket = buckets[series * bucketCount + epoch % bucketCount];
+    uint64_t oldWord = bucket.load(std::memory_order_relaxed);
+    uint64_t newWord;
+
+    do {
+        // If another writer has already moved this bucket on to a newer
+        // interval, our interval has left the window and we're done.
+        int32_t age = (int32_t)(epoch - getEpoch(oldWord));
+        if (age < 0) {
+            return;
+        }
+
+        // Start the bucket over if it holds an older interval
+        uint64_t total = (age == 0 ? getBytes(oldWord) : 0) + (uint64_t)bytes;
+        newWord = ((uint64_t)epoch << 32) | (total < UINT32_MAX ? total : UINT32_MAX);
+    } while (!bucket.compare_exchange_weak(oldWord, newWord, std::memory_order_relaxed));
 }
 
 // We don't want to average the entire window used for peak,
 // so average only the newest 25% of complete buckets
-double BandwidthTracker::GetAverageMbps() {
-    std::lock_guard<std::mutex> lock(mtx);
-    auto now = steady_clock::now();
-    auto ms = duration_cast<milliseconds>(now.time_since_epoch());
-    int currentIndex = (ms.count() / bucketIntervalMs) % bucketCount;
-    int maxBuckets = bucketCount / 4;
-    size_t totalBytes = 0;
-    steady_clock::time_point oldestBucket = now;
+double BandwidthTracker::GetAverageMbps(uint32_t series) {
+    if (series >= seriesCount) {
+        return 0.0;
+    }
+
+    auto now = duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+    uint64_t currentEpoch = now / 1000 / bucketIntervalMs;
+    uint32_t maxBuckets = bucketCount / 4;
+    uint64_t totalBytes = 0;
+    int64_t oldestBucketStart = now;
 
     // Sum bytes from 25% most recent buckets as long as they are completed
-    for (int i = 0; i < maxBuckets; i++) {
-        int idx = (currentIndex - i + bucketCount) % bucketCount;
-        const Bucket &bucket = buckets[idx];
-        if (isValid(bucket, now) && (now - bucket.start >= milliseconds(bucketIntervalMs))) {
-            totalBytes += bucket.bytes;
-            if (bucket.start < oldestBucket) {
-                oldestBucket = bucket.start;
-            }
+    // (skipping the in-progress bucket)
+    for (uint32_t i = 1; i < maxBuckets && i <= currentEpoch; i++) {
+        uint64_t epoch = currentEpoch - i;
+        uint64_t word = buckets[series * bucketCount + (uint32_t)epoch % bucketCount].load(std::memory_order_relaxed);
+        if (getEpoch(word) == (uint32_t)epoch) {
+            totalBytes += getBytes(word);
+            oldestBucketStart = (int64_t)epoch * bucketIntervalMs * 1000;
         }
     }
 
-    double elapsed = duration<double>(now - oldestBucket).count();
+    double elapsed = (now - oldestBucketStart) / 1000000.0;
     if (elapsed <= 0.0) {
         return 0.0;
     }
@@ -51,13 +80,19 @@ double BandwidthTracker::GetAverageMbps() {
     return totalBytes * 8.0 / 1000000.0 / elapsed;
 }
 
-double BandwidthTracker::GetPeakMbps() {
-    std::lock_guard<std::mutex> lock(mtx);
-    auto now = steady_clock::now();
+double BandwidthTracker::GetPeakMbps(uint32_t series) {
+    if (series >= seriesCount) {
+        return 0.0;
+    }
+
+    uint32_t currentEpoch = getCurrentEpoch();
     double peak = 0.0;
-    for (const auto& bucket : buckets) {
-        if (isValid(bucket, now)) {
-            double throughput = getBucketMbps(bucket);
+    for (uint32_t i = 0; i < bucketCount; i++) {
+        uint64_t word = buckets[series * bucketCount + i].load(std::memory_order_relaxed);
+
+        // Only consider buckets within the window
+        if ((uint32_t)(currentEpoch - getEpoch(word)) < bucketCount) {
+            double throughput = getBucketMbps(getBytes(word));
             if (throughput > peak) {
                 peak = throughput;
             }
@@ -72,33 +107,11 @@ unsigned int BandwidthTracker::GetWindowSeconds() {
 
 /// private methods
 
-inline double BandwidthTracker::getBucketMbps(const Bucket &bucket) const {
-    return bucket.bytes * 8.0 / 1000000.0 / (bucketIntervalMs / 1000.0);
-}
-
-// Check if a bucket's data is still valid (within the window)
-inline bool BandwidthTracker::isValid(const Bucket &bucket, steady_clock::time_point now) const {
-    return (now - bucket.start) <= windowSeconds;
+inline uint32_t BandwidthTracker::getCurrentEpoch() const {
+    auto ms = duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+    return (uint32_t)(ms / bucketIntervalMs);
 }
 
-void BandwidthTracker::updateBucket(size_t bytes, steady_clock::time_point now) {
-    auto ms          = duration_cast<milliseconds>(now.time_since_epoch()).count();
-    int bucketIndex  = (ms / bucketIntervalMs) % bucketCount;
-    auto aligned_ms  = ms - (ms % bucketIntervalMs);
-    auto bucketStart = steady_clock::time_point(milliseconds(aligned_ms));
-
-    Bucket &bucket = buckets[bucketIndex];
-
-    if (now - bucket.start > windowSeconds) {
-        bucket.bytes = 0;
-        bucket.start = bucketStart;
-    }
-
-    if (bucket.start != bucketStart) {
-        bucket.bytes = bytes;
-        bucket.start = bucketStart;
-    }
-    else {
-        bucket.bytes += bytes;
-    }
+inline double BandwidthTracker::getBucketMbps(uint64_t bytes) const {
+    return bytes * 8.0 / 1000000.0 / (bucketIntervalMs / 1000.0);
 }
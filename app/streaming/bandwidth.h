@@ -1,9 +1,9 @@
 #pragma once
 
+#include <atomic>
 #include <chrono>
 #include <cstdint>
-#include <mutex>
-#include <vector>
+#include <memory>
 
 /**
  * @brief The BandwidthTracker class tracks network bandwidth usage over a sliding time window (default 10s).
@@ -17,8 +17,12 @@
  *
  * GetPeakMbps() returns the peak bandwidth seen during any one bucket interval across the full time window.
  *
- * All public methods are thread safe. A typical use case is calling AddBytes() in a data processing thread while
- * calling GetAverageMbps() from a UI thread.
+ * A tracker can record several independent series (e.g. video and audio) that share the same window and buckets.
+ *
+ * All public methods are thread safe and lock-free. Each bucket of each series is a single atomic word holding the
+ * bucket's epoch (its interval number since the clock's epoch) and its byte count, so writers never block and
+ * readers always see a consistent byte count for a given interval. A typical use case is calling AddBytes() in a
+ * data processing thread while calling GetAverageMbps() from a UI thread.
  *
  * Example usage:
  * @code
@@ -40,8 +44,9 @@ public:
      *
      * @param windowSeconds The duration of the tracking window in seconds. Default is 10 seconds.
      * @param bucketIntervalMs The interval for each bucket in milliseconds. Default is 250 ms.
+     * @param seriesCount The number of independent series to track. Default is 1.
      */
-    BandwidthTracker(std::uint32_t windowSeconds = 10, std::uint32_t bucketIntervalMs = 250);
+    BandwidthTracker(std::uint32_t windowSeconds = 10, std::uint32_t bucketIntervalMs = 250, std::uint32_t seriesCount = 1);
 
     /**
      * @brief Record bytes that were received or sent.
@@ -52,24 +57,27 @@ public:
      * were received. Callers should not maintain their own byte totals.
      *
      * @param bytes The number of bytes to add.
+     * @param series The series to add the bytes to.
      */
-    void AddBytes(size_t bytes);
+    void AddBytes(size_t bytes, std::uint32_t series = 0);
 
     /**
      * @brief Computes and returns the average bandwidth in Mbps for the most recent 25% of buckets.
      *
+     * @param series The series to compute the average of.
      * @return The average bandwidth in megabits per second.
      */
-    double GetAverageMbps();
+    double GetAverageMbps(std::uint32_t series = 0);
 
     /**
      * @brief Returns the peak bandwidth in Mbps observed in any single bucket within the current window.
      *
      * This value represents the highest instantaneous throughput measured over one bucket interval.
      *
+     * @param series The series to find the peak of.
      * @return The peak bandwidth in megabits per second.
      */
-    double GetPeakMbps();
+    double GetPeakMbps(std::uint32_t series = 0);
 
     /**
      * @brief Retrieves the duration of the tracking window.
@@ -85,23 +93,18 @@ public:
     unsigned int GetWindowSeconds();
 
 private:
+    const std::chrono::seconds windowSeconds;          ///< The duration of the tracking window.
+    const int bucketIntervalMs;                        ///< The duration of each bucket (in milliseconds).
+    const std::uint32_t bucketCount;                   ///< The total number of buckets covering the window.
+    const std::uint32_t seriesCount;                   ///< The number of series tracked.
+
     /**
-     * @brief A structure representing a single time bucket.
+     * @brief Fixed-size circular buffer of buckets for each series (series-major).
      *
-     * Each bucket holds the start time of the interval and the total number of bytes recorded during that interval.
+     * Each word holds the bucket's epoch in the upper 32 bits and its byte count in the lower 32 bits.
      */
-    struct Bucket {
-        std::chrono::steady_clock::time_point start{}; ///< The start time of the bucket's interval.
-        size_t bytes = 0;                              ///< The number of bytes recorded in this bucket.
-    };
-
-    const std::chrono::seconds windowSeconds;          ///< T he duration of the tracking window.
-    const int bucketIntervalMs;                        ///< The duration of each bucket (in milliseconds).
-    std::uint32_t bucketCount;                         ///< The total number of buckets covering the window.
-    std::vector<Bucket> buckets;                       ///< Fixed-size circular buffer of buckets.
-    std::mutex mtx;                                    ///< Mutex to ensure thread-safe access.
+    std::unique_ptr<std::atomic<std::uint64_t>[]> buckets;
 
-    bool isValid(const Bucket &bucket, std::chrono::steady_clock::time_point now) const;
-    void updateBucket(size_t bytes, std::chrono::steady_clock::time_point now);
-    double getBucketMbps(const Bucket &bucket) const;
+    std::uint32_t getCurrentEpoch() const;
+    double getBucketMbps(std::uint64_t bytes) const;
 };
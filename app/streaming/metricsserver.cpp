@@ -0,0 +1,249 @@
+#include "metricsserver.h"
+#include "session.h"
+#include "utils.h"
+
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+
+// Largest HTTP request we'll read before giving up on a client
+#define MAX_REQUEST_SIZE 8192
+
+// How long we'll wait on a connected client before giving up
+#define CLIENT_TIMEOUT_MS 1000
+
+MetricsServer* MetricsServer::create(Session* session)
+{
+    int port;
+
+    if (!Utils::getEnvironmentVariableOverride("METRICS_PORT", &port)) {
+        return nullptr;
+    }
+    else if (port <= 0 || port > 65535) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Ignoring invalid METRICS_PORT: %d",
+                    port);
+        return nullptr;
+    }
+
+    auto server = new MetricsServer(session, (quint16)port);
+    server->start(QThread::LowPriority);
+    return server;
+}
+
+MetricsServer::MetricsServer(Session* session, quint16 port)
+    : m_Session(session),
+      m_Port(port),
+      m_HaveVideoStats(false),
+      m_AverageMbps(0),
+      m_PeakMbps(0)
+{
+    setObjectName("Metrics Server");
+
+    SDL_zero(m_GlobalVideoStats);
+    SDL_zero(m_WindowVideoStats);
+}
+
+MetricsServer::~MetricsServer()
+{
+    // Stop our event loop, which makes run() return
+    quit();
+    wait();
+}
+
+void MetricsServer::updateVideoStats(const VIDEO_STATS& globalStats, const VIDEO_STATS& windowStats,
+                                     double averageMbps, double peakMbps)
+{
+    QMutexLocker locker(&m_Lock);
+
+    m_GlobalVideoStats = globalStats;
+    m_WindowVideoStats = windowStats;
+    m_AverageMbps = averageMbps;
+    m_PeakMbps = peakMbps;
+    m_HaveVideoStats = true;
+}
+
+void MetricsServer::run()
+{
+    QTcpServer server;
+
+    // Only local clients may read our metrics
+    if (!server.listen(QHostAddress::LocalHost, m_Port)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to listen for metrics clients on port %u: %s",
+                     m_Port,
+                     qPrintable(server.errorString()));
+        return;
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Serving metrics at http://127.0.0.1:%u/metrics",
+                m_Port);
+
+    // The server lives on our thread, so clients are handled here too
+    connect(&server, &QTcpServer::newConnection, &server, [this, &server]() {
+        QTcpSocket* socket;
+        while ((socket = server.nextPendingConnection()) != nullptr) {
+            handleClient(socket);
+        }
+    });
+
+    // Sleep until a client connects or we're asked to quit. Any clients
+    // still connected when we return are deleted along with the server.
+    exec();
+}
+
+void MetricsServer::handleClient(QTcpSocket* socket)
+{
+    connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+
+    // Give up on clients that are too slow sending their request or reading our response
+    QTimer::singleShot(CLIENT_TIMEOUT_MS, socket, [socket]() {
+        socket->abort();
+        socket->deleteLater();
+    });
+
+    connect(socket, &QTcpSocket::readyRead, socket, [this, socket]() {
+        // Ignore anything else the client sends after its request
+        if (socket->state() != QAbstractSocket::ConnectedState) {
+            socket->readAll();
+            return;
+        }
+
+        // Wait for the end of the request headers
+        QByteArray request = socket->peek(MAX_REQUEST_SIZE);
+        if (!request.contains("\r\n\r\n") && request.size() < MAX_REQUEST_SIZE) {
+            return;
+        }
+        socket->readAll();
+
+        QByteArray response;
+        if (request.startsWith("GET /metrics ") || request.startsWith("GET / ")) {
+            QByteArray body = generateMetrics();
+
+            response = "HTTP/1.0 200 OK\r\n"
+                       "Content-Type: text/plain; version=0.0.4\r\n"
+                       "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                       "Connection: close\r\n"
+                       "\r\n" + body;
+        }
+        else {
+            response = "HTTP/1.0 404 Not Found\r\n"
+                       "Content-Length: 0\r\n"
+                       "Connection: close\r\n"
+                       "\r\n";
+        }
+
+        // The socket closes once the response has been written
+        socket->write(response);
+        socket->disconnectFromHost();
+    });
+}
+
+QByteArray MetricsServer::generateMetrics()
+{
+    VIDEO_STATS globalStats, windowStats;
+    double averageMbps, peakMbps;
+    bool haveVideoStats;
+    AUDIO_STATS audioStats;
+    QByteArray metrics;
+
+    {
+        QMutexLocker locker(&m_Lock);
+
+        haveVideoStats = m_HaveVideoStats;
+        globalStats = m_GlobalVideoStats;
+        windowStats = m_WindowVideoStats;
+        averageMbps = m_AverageMbps;
+        peakMbps = m_PeakMbps;
+    }
+
+    m_Session->getAudioStats(&audioStats);
+
+    auto addMetric = [&](const char* name, const char* type, const char* help, double value) {
+        metrics += QByteArray("# HELP ") + name + " " + help + "\n";
+        metrics += QByteArray("# TYPE ") + name + " " + type + "\n";
+        metrics += QByteArray(name) + " " + QByteArray::number(value, 'g', 10) + "\n";
+    };
+
+    // Latency histograms are exported as summaries in seconds
+    auto addLatencySummary = [&](const char* name, const char* help, const LatencyHistogram& histogram) {
+        metrics += QByteArray("# HELP ") + name + " " + help + "\n";
+        metrics += QByteArray("# TYPE ") + name + " summary\n";
+        for (double quantile : { 0.5, 0.95, 0.99, 1.0 }) {
+            metrics += QByteArray(name) + "{quantile=\"" + QByteArray::number(quantile) + "\"} " +
+                       QByteArray::number(histogram.getPercentileUs(quantile * 100) / 1000000.0, 'g', 10) + "\n";
+        }
+        metrics += QByteArray(name) + "_sum " + QByteArray::number(histogram.totalUs / 1000000.0, 'g', 10) + "\n";
+        metrics += QByteArray(name) + "_count " + QByteArray::number(histogram.count) + "\n";
+    };
+
+    if (haveVideoStats) {
+        addMetric("moonlight_video_frames_received_total", "counter",
+                  "Video frames received from the network", globalStats.receivedFrames);
+        addMetric("moonlight_video_frames_decoded_total", "counter",
+                  "Video frames decoded", globalStats.decodedFrames);
+        addMetric("moonlight_video_frames_rendered_total", "counter",
+                  "Video frames rendered", globalStats.renderedFrames);
+        addMetric("moonlight_video_frames_network_dropped_total", "counter",
+                  "Video frames lost by the network", globalStats.networkDroppedFrames);
+        addMetric("moonlight_video_frames_pacer_dropped_total", "counter",
+                  "Video frames dropped due to network jitter", globalStats.pacerDroppedFrames);
+
+        addMetric("moonlight_video_received_fps", "gauge",
+                  "Incoming frame rate during the last stats window", windowStats.receivedFps);
+        addMetric("moonlight_video_decoded_fps", "gauge",
+                  "Decoding frame rate during the last stats window", windowStats.decodedFps);
+        addMetric("moonlight_video_rendered_fps", "gauge",
+                  "Rendering frame rate during the last stats window", windowStats.renderedFps);
+
+        addMetric("moonlight_video_bitrate_mbps", "gauge",
+                  "Recent average video bitrate", averageMbps);
+        addMetric("moonlight_video_peak_bitrate_mbps", "gauge",
+                  "Peak video bitrate over the bandwidth tracking window", peakMbps);
+
+        if (globalStats.lastRtt != 0) {
+            addMetric("moonlight_network_rtt_seconds", "gauge",
+                      "Estimated network round trip time", globalStats.lastRtt / 1000.0);
+            addMetric("moonlight_network_rtt_variance_seconds", "gauge",
+                      "Estimated network round trip time variance", globalStats.lastRttVariance / 1000.0);
+        }
+
+        addLatencySummary("moonlight_video_host_processing_latency_seconds",
+                          "Time the host took to capture and encode each frame",
+                          globalStats.hostProcessingLatencyHistogram);
+        addLatencySummary("moonlight_video_reassembly_time_seconds",
+                          "Time from the first packet of each frame until it was reassembled",
+                          globalStats.reassemblyTimeHistogram);
+        addLatencySummary("moonlight_video_decode_time_seconds",
+                          "Time from frame reassembly until the decoded frame was ready",
+                          globalStats.decodeTimeHistogram);
+        addLatencySummary("moonlight_video_pacer_time_seconds",
+                          "Time decoded frames spent waiting in the pacer",
+                          globalStats.pacerTimeHistogram);
+        addLatencySummary("moonlight_video_render_time_seconds",
+                          "Time spent rendering each frame including V-sync",
+                          globalStats.renderTimeHistogram);
+    }
+
+    if (audioStats.valid) {
+        addMetric("moonlight_audio_queued_packets", "gauge",
+                  "Audio packets waiting for the audio thread", audioStats.queuedPackets);
+        addMetric("moonlight_audio_dropped_packets_total", "counter",
+                  "Audio packets dropped because the audio thread fell behind", audioStats.droppedPackets);
+        addMetric("moonlight_audio_buffer_seconds", "gauge",
+                  "Audio waiting in the renderer's buffer", audioStats.bufferedMs / 1000.0);
+        addMetric("moonlight_audio_underruns_total", "counter",
+                  "Times the audio device ran out of audio to play", audioStats.underruns);
+        addMetric("moonlight_audio_overruns_total", "counter",
+                  "Audio frames discarded because too much audio was buffered", audioStats.overruns);
+        addMetric("moonlight_audio_concealed_frames_total", "counter",
+                  "Lost audio frames replaced by PLC or FEC", audioStats.concealedFrames);
+
+        // The tracker is lock-free, so we can read it from our thread
+        addMetric("moonlight_audio_bitrate_mbps", "gauge", "Recent average audio bitrate",
+                  m_Session->getBandwidthTracker().GetAverageMbps(Session::BW_SERIES_AUDIO));
+    }
+
+    return metrics;
+}
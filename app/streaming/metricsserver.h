@@ -0,0 +1,49 @@
+#pragma once
+
+#include <QThread>
+#include <QMutex>
+
+#include "video/decoder.h"
+#include "audio/renderers/renderer.h"
+
+class Session;
+class QTcpSocket;
+
+// Serves live statistics for the current session in the Prometheus text
+// format over HTTP on the loopback interface. This is enabled by setting
+// the METRICS_PORT environment variable to the port to listen on.
+//
+// The decoder publishes a snapshot of its stats once per stats window,
+// and the metrics text is only generated when a client asks for it.
+class MetricsServer : public QThread
+{
+public:
+    // Returns nullptr if the metrics server is not enabled
+    static MetricsServer* create(Session* session);
+
+    ~MetricsServer();
+
+    // Called by the decoder at the end of each stats window
+    void updateVideoStats(const VIDEO_STATS& globalStats, const VIDEO_STATS& windowStats,
+                          double averageMbps, double peakMbps);
+
+private:
+    MetricsServer(Session* session, quint16 port);
+
+    void run() override;
+
+    void handleClient(QTcpSocket* socket);
+
+    QByteArray generateMetrics();
+
+    Session* m_Session;
+    quint16 m_Port;
+
+    // Protects the video stats snapshot below
+    QMutex m_Lock;
+    bool m_HaveVideoStats;
+    VIDEO_STATS m_GlobalVideoStats;
+    VIDEO_STATS m_WindowVideoStats;
+    double m_AverageMbps;
+    double m_PeakMbps;
+};
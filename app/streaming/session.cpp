@@ -40,13 +40,30 @@
 #include <QGuiApplication>
 #include <QCursor>
 #include <QScreen>
+#include <QSettings>
+#include <QCryptographicHash>
+#include <QDir>
 
 #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
 #include <QQuickOpenGLUtils>
 #endif
 
+#ifdef Q_OS_WIN32
+#include <dxgi.h>
+#endif
+
+#ifdef HAVE_DRM
+#include <fcntl.h>
+#include <unistd.h>
+#include <xf86drm.h>
+#endif
+
 #define CONN_TEST_SERVER "qt.conntest.moonlight-stream.org"
 
+// Decoder probe results are cached here, keyed by the system fingerprint
+#define SER_DECODERCAPS "decodercapabilities"
+#define SER_DECODERCAPS_FINGERPRINT "fingerprint"
+
 CONNECTION_LISTENER_CALLBACKS Session::k_ConnCallbacks = {
     Session::clStageStarting,
     nullptr,
@@ -479,22 +496,159 @@ void Session::getDecoderInfo(SDL_Window* window,
                  "Failed to find ANY working H.264 or HEVC decoder!");
 }
 
+// Identifies the software and hardware that decoder probe results depend on.
+// If any of these change, all cached probe results are discarded.
+static QByteArray getDecoderCapabilityFingerprint()
+{
+    QStringList components;
+
+    components << VERSION_STR
+               << QSysInfo::kernelVersion()
+               << QSysInfo::productVersion()
+               << SDL_GetCurrentVideoDriver();
+
+#ifdef HAVE_FFMPEG
+    components << av_version_info();
+#endif
+
+#if defined(Q_OS_WIN32)
+    IDXGIFactory1* factory;
+    if (SUCCEEDED(CreateDXGIFactory1(__uuidof(IDXGIFactory1), (void**)&factory))) {
+        IDXGIAdapter1* adapter;
+        for (UINT i = 0; factory->EnumAdapters1(i, &adapter) != DXGI_ERROR_NOT_FOUND; i++) {
+            DXGI_ADAPTER_DESC1 desc;
+            LARGE_INTEGER umdVersion = {};
+
+            if (SUCCEEDED(adapter->GetDesc1(&desc))) {
+                // Include the user-mode driver version to catch driver updates
+                adapter->CheckInterfaceSupport(__uuidof(IDXGIDevice), &umdVersion);
+                components << QString("%1:%2:%3")
+                                  .arg(desc.VendorId, 0, 16)
+                                  .arg(desc.DeviceId, 0, 16)
+                                  .arg(umdVersion.QuadPart);
+            }
+
+            adapter->Release();
+        }
+
+        factory->Release();
+    }
+#elif defined(HAVE_DRM)
+    QDir dir("/dev/dri");
+    for (const QString& card : dir.entryList(QStringList("card*"), QDir::Files | QDir::System)) {
+        // drmGetVersion() only needs read access to the device
+        int fd = open(dir.filePath(card).toUtf8().constData(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+
+        drmVersionPtr version = drmGetVersion(fd);
+        if (version != nullptr) {
+            components << QString("%1:%2.%3.%4:%5")
+                              .arg(version->name)
+                              .arg(version->version_major)
+                              .arg(version->version_minor)
+                              .arg(version->version_patchlevel)
+                              .arg(version->date);
+            drmFreeVersion(version);
+        }
+
+        close(fd);
+    }
+#endif
+
+    return QCryptographicHash::hash(components.join('|').toUtf8(), QCryptographicHash::Sha1).toHex();
+}
+
+static QString getDecoderCapabilityCacheKey(SDL_Window* window,
+                                            StreamingPreferences::VideoDecoderSelection vds,
+                                            int videoFormat, int width, int height, int frameRate)
+{
+    QString display;
+    int displayIndex = SDL_GetWindowDisplayIndex(window);
+    SDL_DisplayMode mode;
+
+    if (displayIndex >= 0 && SDL_GetCurrentDisplayMode(displayIndex, &mode) == 0) {
+        display = QString("%1:%2x%3x%4")
+                      .arg(SDL_GetDisplayName(displayIndex))
+                      .arg(mode.w)
+                      .arg(mode.h)
+                      .arg(mode.refresh_rate);
+    }
+
+    QString key = QString("%1|%2|%3|%4x%5x%6")
+                      .arg(display)
+                      .arg(vds)
+                      .arg(videoFormat, 0, 16)
+                      .arg(width)
+                      .arg(height)
+                      .arg(frameRate);
+
+    // Display names may contain characters that aren't valid in QSettings keys
+    return QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex();
+}
+
+static void invalidateDecoderCapabilityCache()
+{
+    QSettings settings;
+    settings.remove(SER_DECODERCAPS);
+}
+
 Session::DecoderAvailability
 Session::getDecoderAvailability(SDL_Window* window,
                                 StreamingPreferences::VideoDecoderSelection vds,
                                 int videoFormat, int width, int height, int frameRate)
 {
     IVideoDecoder* decoder;
+    bool useCache;
+    QSettings settings;
+    QString cacheKey;
 
-    if (!chooseDecoder(vds, window, videoFormat, width, height, frameRate, false, false, true, decoder)) {
-        return DecoderAvailability::None;
+    if (!Utils::getEnvironmentVariableOverride("DECODER_CAPABILITY_CACHE", &useCache)) {
+        useCache = true;
     }
 
-    bool hw = decoder->isHardwareAccelerated();
+    if (useCache) {
+        // The fingerprint can't change while we're running, and it's not
+        // cheap to compute, so we only do it once per launch.
+        static const QByteArray fingerprint = getDecoderCapabilityFingerprint();
 
-    delete decoder;
+        settings.beginGroup(SER_DECODERCAPS);
+        if (settings.value(SER_DECODERCAPS_FINGERPRINT).toByteArray() != fingerprint) {
+            // Something changed, so none of the cached results can be trusted
+            settings.remove("");
+            settings.setValue(SER_DECODERCAPS_FINGERPRINT, fingerprint);
+        }
+
+        cacheKey = getDecoderCapabilityCacheKey(window, vds, videoFormat, width, height, frameRate);
+        if (settings.value(cacheKey).toInt() == (int)DecoderAvailability::Hardware) {
+            auto da = DecoderAvailability::Hardware;
+
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Using cached decoder availability for format %x: %d",
+                        videoFormat,
+                        (int)da);
+            return da;
+        }
+    }
+
+    DecoderAvailability da;
+    if (!chooseDecoder(vds, window, videoFormat, width, height, frameRate, false, false, true, decoder)) {
+        da = DecoderAvailability::None;
+    }
+    else {
+        da = decoder->isHardwareAccelerated() ? DecoderAvailability::Hardware : DecoderAvailability::Software;
+        delete decoder;
+    }
 
-    return hw ? DecoderAvailability::Hardware : DecoderAvailability::Software;
+    // Only remember hardware decoding. A negative result can be caused by
+    // something transient (like the GPU being busy or a driver hiccup), so
+    // we probe again next time rather than falling back to software forever.
+    if (useCache && da == DecoderAvailability::Hardware) {
+        settings.setValue(cacheKey, (int)da);
+    }
+
+    return da;
 }
 
 bool Session::populateDecoderProperties(SDL_Window* window)
@@ -567,8 +721,30 @@ Session::Session(NvComputer* computer, NvApp& app, StreamingPreferences *prefere
       m_OpusDecoder(nullptr),
       m_AudioRenderer(nullptr),
       m_AudioSampleCount(0),
-      m_DropAudioEndTime(0)
+      m_DropAudioEndTime(0),
+      m_AudioDriftCompensator(nullptr),
+      m_AudioDecodeBuffer(nullptr),
+      m_AudioLostFramePending(false),
+      m_AudioConcealedFrames(0),
+      m_AudioFecFrames(0),
+      m_AudioPacketQueue(nullptr),
+      m_AudioThread(nullptr),
+      m_AudioMaxQueuedPackets(0),
+      m_AudioDroppedPackets(0),
+      m_AudioDecodeTimeUs(0),
+      m_AudioDecodedFrames(0),
+      m_AudioTotalDecodeTimeUs(0),
+      m_AudioTotalDecodedFrames(0),
+      m_AudioStatsUpdateTime(0),
+      m_AudioStatsLock(0),
+      m_FrameTracer(nullptr),
+      m_MetricsServer(nullptr),
+      m_BwTracker(10, 250, BW_SERIES_COUNT)
 {
+    SDL_zero(m_AudioQueueDelayHistogram);
+    SDL_zero(m_AudioTotalQueueDelayHistogram);
+    SDL_zero(m_AudioStats);
+    SDL_AtomicSet(&m_AudioThreadShouldQuit, 0);
 }
 
 Session::~Session()
@@ -713,6 +889,27 @@ bool Session::initialize(QQuickWindow* qtWindow)
                 "Audio channel mask: %X",
                 CHANNEL_MASK_FROM_AUDIO_CONFIGURATION(m_StreamConfig.audioConfiguration));
 
+    // Opening the audio device can take a while and doesn't depend on any of
+    // the decoder probing below, so we'll test audio in parallel with it.
+    // validateLaunch() will wait for the result. SDL subsystems must be
+    // initialized on the main thread, so we do that here and the test
+    // thread only opens and closes the audio device. If we can't, the
+    // test runs serially in validateLaunch() instead.
+    SDL_Thread* audioTestThread = nullptr;
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "SDL_InitSubSystem(SDL_INIT_AUDIO) failed: %s",
+                     SDL_GetError());
+    }
+    else {
+        audioTestThread = SDL_CreateThread(Session::audioTestThreadProc, "AudioTest", this);
+        if (audioTestThread == nullptr) {
+            SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        }
+    }
+
+    Uint32 probeStartTime = SDL_GetTicks();
+
     // Start with all codecs and profiles in priority order
     m_SupportedVideoFormats.append(VIDEO_FORMAT_AV1_HIGH10_444);
     m_SupportedVideoFormats.append(VIDEO_FORMAT_AV1_MAIN10);
@@ -848,6 +1045,10 @@ bool Session::initialize(QQuickWindow* qtWindow)
         break;
     }
 
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Codec selection probing took %u ms",
+                SDL_GetTicks() - probeStartTime);
+
     // NB: Since deprioritization puts codecs in reverse order (at the bottom of the list),
     // we want to deprioritize for the most critical attributes last to ensure they are the
     // lowest priority codecs during server negotiation. Here we do that with YUV 4:4:4 and
@@ -922,7 +1123,7 @@ bool Session::initialize(QQuickWindow* qtWindow)
 
     // Check for validation errors/warnings and emit
     // signals for them, if appropriate
-    bool ret = validateLaunch(testWindow);
+    bool ret = validateLaunch(testWindow, audioTestThread);
 
     if (ret) {
         // Video format is now locked in
@@ -931,6 +1132,10 @@ bool Session::initialize(QQuickWindow* qtWindow)
         // Populate decoder-dependent properties.
         // Must be done after validateLaunch() since m_StreamConfig is finalized.
         ret = populateDecoderProperties(testWindow);
+        if (!ret) {
+            // Our cached probe results may have led us to pick this format
+            invalidateDecoderCapabilityCache();
+        }
     }
 
     SDL_DestroyWindow(testWindow);
@@ -952,13 +1157,25 @@ void Session::emitLaunchWarning(QString text)
     }
 }
 
-bool Session::validateLaunch(SDL_Window* testWindow)
+int Session::audioTestThreadProc(void* context)
+{
+    Session* me = reinterpret_cast<Session*>(context);
+    return me->testAudio(me->m_StreamConfig.audioConfiguration) ? 1 : 0;
+}
+
+bool Session::validateLaunch(SDL_Window* testWindow, SDL_Thread* audioTestThread)
 {
     if (!m_Computer->isSupportedServerVersion) {
         emit displayLaunchError(tr("The version of GeForce Experience on %1 is not supported by this build of Moonlight. You must update Moonlight to stream from %1.").arg(m_Computer->name));
+        if (audioTestThread != nullptr) {
+            SDL_WaitThread(audioTestThread, nullptr);
+            SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        }
         return false;
     }
 
+    Uint32 probeStartTime = SDL_GetTicks();
+
     if (m_Preferences->absoluteMouseMode && !m_App.isAppCollectorGame) {
         emitLaunchWarning(tr("Your selection to enable remote desktop mouse mode may cause problems in games."));
     }
@@ -1165,8 +1382,24 @@ bool Session::validateLaunch(SDL_Window* testWindow)
         }
     }
 
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Launch validation probing took %u ms",
+                SDL_GetTicks() - probeStartTime);
+
     // Test if audio works at the specified audio configuration
-    bool audioTestPassed = testAudio(m_StreamConfig.audioConfiguration);
+    bool audioTestPassed;
+    if (audioTestThread != nullptr) {
+        // Collect the result of the test started in initialize()
+        int audioTestStatus;
+        SDL_WaitThread(audioTestThread, &audioTestStatus);
+        audioTestPassed = audioTestStatus != 0;
+
+        // Drop the reference to the audio subsystem taken in initialize()
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+    }
+    else {
+        audioTestPassed = testAudio(m_StreamConfig.audioConfiguration);
+    }
 
     // Gracefully degrade to stereo if surround sound doesn't work
     if (!audioTestPassed && CHANNEL_COUNT_FROM_AUDIO_CONFIGURATION(m_StreamConfig.audioConfiguration) > 2) {
@@ -1741,6 +1974,10 @@ void Session::start()
     // NB: m_InputHandler must be initialize before starting the connection.
     m_InputHandler = new SdlInputHandler(*m_Preferences, m_StreamConfig.width, m_StreamConfig.height);
 
+    // Start frame tracing and the metrics server if they were requested
+    m_FrameTracer = FrameTracer::create();
+    m_MetricsServer = MetricsServer::create(this);
+
     // Kick off the async connection thread then return to the caller to pump the event loop
     auto thread = new AsyncConnectionStartThread(this);
     QObject::connect(thread, &QThread::finished, this, &Session::exec);
@@ -1766,6 +2003,10 @@ void Session::exec()
     if (!m_AsyncConnectionSuccess) {
         delete m_InputHandler;
         m_InputHandler = nullptr;
+        delete m_FrameTracer;
+        m_FrameTracer = nullptr;
+        delete m_MetricsServer;
+        m_MetricsServer = nullptr;
         SDL_QuitSubSystem(SDL_INIT_VIDEO);
         QThreadPool::globalInstance()->start(new DeferredSessionCleanupTask(this));
         return;
@@ -2201,6 +2442,9 @@ void Session::exec()
                     SDL_UnlockMutex(m_DecoderLock);
                     SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                                  "Failed to recreate decoder after reset");
+
+                    // Don't trust any cached probe results on the next launch
+                    invalidateDecoderCapabilityCache();
                     emit displayLaunchError(tr("Unable to initialize video decoder. Please check your streaming settings and try again."));
                     goto DispatchDeferredCleanup;
                 }
@@ -2319,6 +2563,17 @@ DispatchDeferredCleanup:
     m_VideoDecoder = nullptr;
     SDL_UnlockMutex(m_DecoderLock);
 
+    // Now that nothing is rendering, we can write out the frame trace
+    if (m_FrameTracer != nullptr) {
+        m_FrameTracer->writeTraceFile();
+        delete m_FrameTracer;
+        m_FrameTracer = nullptr;
+    }
+
+    // Stop serving metrics now that the decoder is no longer updating them
+    delete m_MetricsServer;
+    m_MetricsServer = nullptr;
+
     // Propagate state changes from the SDL window back to the Qt window
     //
     // NB: We're making a conscious decision not to propagate the maximized
@@ -9,7 +9,12 @@
 #include "input/input.h"
 #include "video/decoder.h"
 #include "audio/renderers/renderer.h"
+#include "audio/driftcompensator.h"
+#include "audio/audiopacketqueue.h"
 #include "video/overlaymanager.h"
+#include "video/frametracer.h"
+#include "bandwidth.h"
+#include "metricsserver.h"
 
 class SupportedVideoFormatList : public QList<int>
 {
@@ -121,8 +126,43 @@ public:
         return m_OverlayManager;
     }
 
+    // Returns nullptr if frame tracing is disabled
+    FrameTracer* getFrameTracer()
+    {
+        return m_FrameTracer;
+    }
+
+    // Returns nullptr if the metrics server is disabled
+    MetricsServer* getMetricsServer()
+    {
+        return m_MetricsServer;
+    }
+
+    // The series recorded by the session's bandwidth tracker
+    enum BandwidthSeries {
+        BW_SERIES_VIDEO,
+        BW_SERIES_AUDIO,
+        BW_SERIES_COUNT
+    };
+
+    BandwidthTracker& getBandwidthTracker()
+    {
+        return m_BwTracker;
+    }
+
+    int getStreamBitrateKbps()
+    {
+        return m_StreamConfig.bitrate;
+    }
+
     void flushWindowEvents();
 
+    // Appends the latest audio statistics for the debug overlay
+    void stringifyAudioStats(char* output, int length);
+
+    // Copies the latest audio statistics snapshot
+    void getAudioStats(PAUDIO_STATS stats);
+
     void setShouldExit(bool quitHostApp = false);
 
 signals:
@@ -148,7 +188,15 @@ private:
 
     bool startConnectionAsync();
 
-    bool validateLaunch(SDL_Window* testWindow);
+    bool validateLaunch(SDL_Window* testWindow, SDL_Thread* audioTestThread);
+
+    static
+    int audioTestThreadProc(void* context);
+
+    static
+    int audioThreadProc(void* context);
+
+    void processAudioPacket(const unsigned char* sampleData, int sampleLength);
 
     void emitLaunchWarning(QString text);
 
@@ -158,6 +206,12 @@ private:
 
     bool initializeAudioRenderer();
 
+    void destroyAudioRenderer();
+
+    bool playAudioFrame(const unsigned char* data, int length, bool decodeFec);
+
+    void logAudioPipelineSummary();
+
     bool testAudio(int audioConfiguration);
 
     int getAudioRendererCapabilities(int audioConfiguration);
@@ -278,8 +332,37 @@ private:
     OPUS_MULTISTREAM_CONFIGURATION m_OriginalAudioConfig;
     int m_AudioSampleCount;
     Uint32 m_DropAudioEndTime;
+    AudioDriftCompensator* m_AudioDriftCompensator;
+    void* m_AudioDecodeBuffer;
+    bool m_AudioLostFramePending;
+    uint32_t m_AudioConcealedFrames;
+    uint32_t m_AudioFecFrames;
+    AudioPacketQueue* m_AudioPacketQueue;
+    SDL_Thread* m_AudioThread;
+    SDL_atomic_t m_AudioThreadShouldQuit;
+    int m_AudioMaxQueuedPackets;
+    uint32_t m_AudioDroppedPackets;
+    uint64_t m_AudioDecodeTimeUs;
+    uint32_t m_AudioDecodedFrames;
+    uint64_t m_AudioTotalDecodeTimeUs;
+    uint32_t m_AudioTotalDecodedFrames;
+
+    // Time packets spent waiting for the audio thread, in buckets of
+    // AUDIO_QUEUE_DELAY_BUCKET_US. The last bucket collects everything
+    // longer. We keep one for the current stats window and one for
+    // the whole session.
+    uint32_t m_AudioQueueDelayHistogram[AUDIO_QUEUE_DELAY_BUCKETS];
+    uint32_t m_AudioTotalQueueDelayHistogram[AUDIO_QUEUE_DELAY_BUCKETS];
+
+    // Snapshot of audio statistics taken on the audio thread
+    AUDIO_STATS m_AudioStats;
+    Uint32 m_AudioStatsUpdateTime;
+    SDL_SpinLock m_AudioStatsLock;
 
     Overlay::OverlayManager m_OverlayManager;
+    FrameTracer* m_FrameTracer;
+    MetricsServer* m_MetricsServer;
+    BandwidthTracker m_BwTracker;
 
     static CONNECTION_LISTENER_CALLBACKS k_ConnCallbacks;
     static Session* s_ActiveSession;
@@ -0,0 +1,208 @@
+#include "bitratecontroller.h"
+
+// A window is congested if it loses more than this percentage of frames
+#define CONGESTION_LOSS_PERCENT 2.0
+
+// ... or if the RTT rises this far above the lowest RTT we've seen,
+// which means packets are queueing up somewhere along the path
+#define CONGESTION_QUEUEING_DELAY_MS 30
+
+// Number of consecutive congested windows before we recommend a lower
+// bitrate, and consecutive clear windows before we recommend a higher one.
+// Decreasing quickly and increasing slowly keeps us from oscillating.
+#define DECREASE_AFTER_WINDOWS 2
+#define INCREASE_AFTER_WINDOWS 10
+
+// Minimum number of windows between changes, so each change has
+// time to take effect before we judge the result
+#define CHANGE_COOLDOWN_WINDOWS 3
+
+#define DECREASE_FACTOR 0.8
+#define INCREASE_STEP_PERCENT 5
+#define MIN_BITRATE_KBPS 500
+
+// Decoding is overloaded if the decoder stays busy for more than this
+// percentage of each frame interval for DECODER_OVERLOAD_WINDOWS windows
+#define DECODER_OVERLOAD_PERCENT 90
+#define DECODER_OVERLOAD_WINDOWS 3
+
+BitrateController::BitrateController(int configuredBitrateKbps, int frameRate)
+    : m_ConfiguredBitrateKbps(configuredBitrateKbps),
+      m_RecommendedBitrateKbps(configuredBitrateKbps),
+      m_FrameRate(frameRate),
+      m_BaseRtt(0),
+      m_CongestedWindows(0),
+      m_ClearWindows(0),
+      m_OverloadedWindows(0),
+      m_WindowsSinceChange(0),
+      m_Reason("configured"),
+      m_StartTimeUs(LiGetMicroseconds())
+{
+    QString logPath = qgetenv("BITRATE_CONTROLLER_LOG");
+    if (!logPath.isEmpty()) {
+        // Append so decoders recreated during the session share one log
+        m_DecisionLog.setFileName(logPath);
+        if (!m_DecisionLog.open(QFile::WriteOnly | QFile::Append | QFile::Text)) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "Unable to open bitrate controller log %s: %s",
+                        qPrintable(logPath),
+                        qPrintable(m_DecisionLog.errorString()));
+        }
+        else if (m_DecisionLog.size() == 0) {
+            m_DecisionLog.write("time_ms,total_frames,network_dropped_frames,loss_percent,"
+                                "rtt_ms,rtt_variance_ms,base_rtt_ms,queueing_delay_ms,"
+                                "throughput_mbps,decoder_busy_ms,frame_rate,"
+                                "decision,recommended_kbps,configured_kbps,reason\n");
+        }
+    }
+}
+
+BitrateController::~BitrateController()
+{
+    if (m_RecommendedBitrateKbps != m_ConfiguredBitrateKbps) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Recommended video bitrate for this connection: %d kbps (configured: %d kbps, reason: %s)",
+                    m_RecommendedBitrateKbps,
+                    m_ConfiguredBitrateKbps,
+                    m_Reason);
+    }
+}
+
+void BitrateController::update(const VIDEO_STATS& windowStats, double throughputMbps)
+{
+    Decision decision = Decision::Hold;
+    double lossPercent = 0;
+    double queueingDelayMs = 0;
+    double decoderBusyMs = 0;
+
+    m_WindowsSinceChange++;
+
+    // Decode time includes frames waiting inside the decoder, which is
+    // latency rather than load, so judge the decoder by its busy time.
+    if (windowStats.decodedFrames != 0) {
+        decoderBusyMs = (double)windowStats.totalDecoderBusyTimeUs / windowStats.decodedFrames / 1000.0;
+    }
+
+    // Nothing to judge if no video arrived in this window
+    if (windowStats.totalFrames == 0) {
+        logDecision(windowStats, throughputMbps, lossPercent, queueingDelayMs, decoderBusyMs, decision);
+        return;
+    }
+
+    lossPercent = (double)windowStats.networkDroppedFrames / windowStats.totalFrames * 100;
+
+    if (windowStats.lastRtt != 0) {
+        if (m_BaseRtt == 0 || windowStats.lastRtt < m_BaseRtt) {
+            m_BaseRtt = windowStats.lastRtt;
+        }
+
+        queueingDelayMs = windowStats.lastRtt - m_BaseRtt;
+    }
+
+    if (lossPercent > CONGESTION_LOSS_PERCENT || queueingDelayMs > CONGESTION_QUEUEING_DELAY_MS) {
+        m_CongestedWindows++;
+        m_ClearWindows = 0;
+    }
+    else {
+        m_ClearWindows++;
+        m_CongestedWindows = 0;
+    }
+
+    if (m_WindowsSinceChange >= CHANGE_COOLDOWN_WINDOWS) {
+        if (m_CongestedWindows >= DECREASE_AFTER_WINDOWS && m_RecommendedBitrateKbps > MIN_BITRATE_KBPS) {
+            int newBitrateKbps = (int)(m_RecommendedBitrateKbps * DECREASE_FACTOR);
+
+            // If the throughput we actually got is lower still, head
+            // straight for it, but never cut by more than half at once.
+            int throughputKbps = (int)(throughputMbps * 1000);
+            if (throughputKbps > 0 && throughputKbps < newBitrateKbps) {
+                newBitrateKbps = qMax(throughputKbps, m_RecommendedBitrateKbps / 2);
+            }
+
+            m_RecommendedBitrateKbps = qMax(newBitrateKbps, MIN_BITRATE_KBPS);
+            m_Reason = lossPercent > CONGESTION_LOSS_PERCENT ? "frame loss" : "rising latency";
+            decision = Decision::Decrease;
+        }
+        else if (m_ClearWindows >= INCREASE_AFTER_WINDOWS && m_RecommendedBitrateKbps < m_ConfiguredBitrateKbps) {
+            m_RecommendedBitrateKbps = qMin(m_RecommendedBitrateKbps + m_ConfiguredBitrateKbps * INCREASE_STEP_PERCENT / 100,
+                                            m_ConfiguredBitrateKbps);
+            m_Reason = "network recovered";
+            decision = Decision::Increase;
+        }
+    }
+
+    if (decision != Decision::Hold) {
+        m_WindowsSinceChange = 0;
+        m_CongestedWindows = 0;
+        m_ClearWindows = 0;
+
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Recommended video bitrate %s to %d kbps (%s)",
+                    decision == Decision::Decrease ? "lowered" : "raised",
+                    m_RecommendedBitrateKbps,
+                    m_Reason);
+    }
+
+    // Decoder load doesn't depend much on bitrate, so an overloaded
+    // decoder calls for a lower resolution or frame rate instead.
+    if (m_FrameRate > 0 && decoderBusyMs > 1000.0 / m_FrameRate * DECODER_OVERLOAD_PERCENT / 100) {
+        if (++m_OverloadedWindows == DECODER_OVERLOAD_WINDOWS) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "Decoder can't keep up (%.2f ms per frame). Reduce resolution or frame rate.",
+                        decoderBusyMs);
+        }
+    }
+    else {
+        m_OverloadedWindows = 0;
+    }
+
+    logDecision(windowStats, throughputMbps, lossPercent, queueingDelayMs, decoderBusyMs, decision);
+}
+
+void BitrateController::logDecision(const VIDEO_STATS& windowStats, double throughputMbps, double lossPercent,
+                                    double queueingDelayMs, double decoderBusyMs, Decision decision)
+{
+    if (!m_DecisionLog.isOpen()) {
+        return;
+    }
+
+    char line[512];
+    snprintf(line, sizeof(line),
+             "%u,%u,%u,%.2f,%u,%u,%u,%.0f,%.3f,%.3f,%d,%s,%d,%d,%s\n",
+             (uint32_t)((LiGetMicroseconds() - m_StartTimeUs) / 1000),
+             windowStats.totalFrames,
+             windowStats.networkDroppedFrames,
+             lossPercent,
+             windowStats.lastRtt,
+             windowStats.lastRttVariance,
+             m_BaseRtt,
+             queueingDelayMs,
+             throughputMbps,
+             decoderBusyMs,
+             m_FrameRate,
+             decision == Decision::Decrease ? "decrease" : (decision == Decision::Increase ? "increase" : "hold"),
+             m_RecommendedBitrateKbps,
+             m_ConfiguredBitrateKbps,
+             m_Reason);
+    m_DecisionLog.write(line);
+}
+
+int BitrateController::getRecommendedBitrateKbps()
+{
+    return m_RecommendedBitrateKbps;
+}
+
+int BitrateController::getConfiguredBitrateKbps()
+{
+    return m_ConfiguredBitrateKbps;
+}
+
+bool BitrateController::isDecoderOverloaded()
+{
+    return m_OverloadedWindows >= DECODER_OVERLOAD_WINDOWS;
+}
+
+const char* BitrateController::getReason()
+{
+    return m_Reason;
+}
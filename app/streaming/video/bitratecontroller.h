@@ -0,0 +1,60 @@
+#pragma once
+
+#include <QFile>
+
+#include "decoder.h"
+
+// Recommends a video bitrate for the current network conditions based on
+// the stats of each video stats window. Since the bitrate can't be changed
+// without restarting the stream, the recommendation is shown in the debug
+// overlay and logged at the end of the session.
+//
+// Setting BITRATE_CONTROLLER_LOG to a path writes the inputs and decision
+// for every window to a CSV file, so the controller can be replayed and
+// tuned offline.
+class BitrateController
+{
+public:
+    enum class Decision {
+        Hold,
+        Decrease,
+        Increase,
+    };
+
+    explicit BitrateController(int configuredBitrateKbps, int frameRate);
+    ~BitrateController();
+
+    // Called at the end of each stats window with that window's stats
+    void update(const VIDEO_STATS& windowStats, double throughputMbps);
+
+    int getRecommendedBitrateKbps();
+
+    int getConfiguredBitrateKbps();
+
+    // Whether the decoder is busy for nearly all of the frame interval
+    bool isDecoderOverloaded();
+
+    // A short description of why the recommendation was last changed
+    const char* getReason();
+
+private:
+    void logDecision(const VIDEO_STATS& windowStats, double throughputMbps, double lossPercent,
+                     double queueingDelayMs, double decoderBusyMs, Decision decision);
+
+    int m_ConfiguredBitrateKbps;
+    int m_RecommendedBitrateKbps;
+    int m_FrameRate;
+
+    // Lowest RTT seen during the session, which approximates the
+    // RTT of the path without any queueing delay.
+    uint32_t m_BaseRtt;
+
+    int m_CongestedWindows;
+    int m_ClearWindows;
+    int m_OverloadedWindows;
+    int m_WindowsSinceChange;
+    const char* m_Reason;
+
+    QFile m_DecisionLog;
+    uint64_t m_StartTimeUs;
+};
@@ -3,11 +3,17 @@
 #include <Limelight.h>
 #include "SDL_compat.h"
 #include "settings/streamingpreferences.h"
+#include "latencyhistogram.h"
 
 #define SDL_CODE_FRAME_READY 0
 
 #define MAX_SLICES 4
 
+// Histogram buckets for the time a decode unit waits before the decoder
+// thread picks it up. Bucket N counts latencies below (250 << N) us and
+// the last bucket counts everything above that.
+#define DECODER_WAKE_LATENCY_BUCKETS 6
+
 typedef struct _VIDEO_STATS {
     uint32_t receivedFrames;
     uint32_t decodedFrames;
@@ -23,6 +29,16 @@ typedef struct _VIDEO_STATS {
     uint64_t totalDecodeTimeUs;                // high-res (1us)
     uint64_t totalPacerTimeUs;                 // high-res (1us)
     uint64_t totalRenderTimeUs;                // high-res (1us)
+    uint64_t copiedBytes;                      // bytes copied out of the DU during reassembly
+    uint32_t frameAllocations;                 // AVFrames allocated outside the frame pool
+    uint64_t totalDecoderBusyTimeUs;           // high-res (1us) time spent in libavcodec calls
+    uint32_t totalDecoderQueuedFrames;         // frames still inside the decoder at each output
+    uint32_t decoderWakeLatency[DECODER_WAKE_LATENCY_BUCKETS]; // high-res (1us) histogram
+    LatencyHistogram hostProcessingLatencyHistogram; // low-res from RTP (100us)
+    LatencyHistogram reassemblyTimeHistogram;        // high-res (1us)
+    LatencyHistogram decodeTimeHistogram;            // high-res (1us)
+    LatencyHistogram pacerTimeHistogram;             // high-res (1us)
+    LatencyHistogram renderTimeHistogram;            // high-res (1us)
     uint32_t lastRtt;                          // low-res from enet (1ms)
     uint32_t lastRttVariance;                  // low-res from enet (1ms)
     double totalFps;                           // high-res
@@ -4,6 +4,8 @@
 #endif
 
 #include "drm.h"
+#include "framepool.h"
+#include "planecopy.h"
 #include "utils.h"
 
 extern "C" {
@@ -1254,21 +1256,14 @@ bool DrmRenderer::mapSoftwareFrame(AVFrame *frame, AVDRMFrameDescriptor *mappedF
                     }
                 }
 
-                // Copy the plane data into the dumb buffer
-                if (frame->linesize[i] == (int)plane.pitch) {
-                    // We can do a single memcpy() if the pitch is compatible
-                    memcpy(drmFrame->mapping + plane.offset,
-                           frame->data[i],
-                           frame->linesize[i] * planeHeight);
-                }
-                else {
-                    // The pitch is incompatible, so we must copy line-by-line
-                    for (int j = 0; j < planeHeight; j++) {
-                        memcpy(drmFrame->mapping + (j * plane.pitch) + plane.offset,
-                               frame->data[i] + (j * frame->linesize[i]),
-                               qMin(frame->linesize[i], (int)plane.pitch));
-                    }
-                }
+                // Copy the plane data into the dumb buffer. Dumb buffer mappings are
+                // write-combined, so we must avoid partial cache line writes.
+                PlaneCopy::copyPlane(drmFrame->mapping + plane.offset, (int)plane.pitch,
+                                     frame->data[i], frame->linesize[i],
+                                     qMin(frame->linesize[i], (int)plane.pitch),
+                                     planeHeight,
+                                     PLANE_COPY_STREAMING_STORES |
+                                         ((freeFrame && m_SwFrameMapper.isMappingFrames()) ? PLANE_COPY_STREAMING_LOADS : 0));
 
                 layer.nb_planes++;
 
@@ -1282,7 +1277,7 @@ bool DrmRenderer::mapSoftwareFrame(AVFrame *frame, AVDRMFrameDescriptor *mappedF
 
 Exit:
     if (freeFrame) {
-        av_frame_free(&frame);
+        FramePool::release(&frame);
     }
 
     return ret;
@@ -0,0 +1,52 @@
+#include "framepool.h"
+
+void* FramePool::s_Frames[FRAME_POOL_SIZE];
+SDL_atomic_t FramePool::s_Allocations;
+
+AVFrame* FramePool::acquire()
+{
+    for (int i = 0; i < FRAME_POOL_SIZE; i++) {
+        AVFrame* frame = (AVFrame*)SDL_AtomicSetPtr(&s_Frames[i], nullptr);
+        if (frame != nullptr) {
+            return frame;
+        }
+    }
+
+    // The pool is empty, so we have to allocate a new frame
+    SDL_AtomicIncRef(&s_Allocations);
+    return av_frame_alloc();
+}
+
+void FramePool::release(AVFrame** frame)
+{
+    if (*frame == nullptr) {
+        return;
+    }
+
+    // Drop the frame's buffers now, so pooled frames
+    // don't keep decoder surfaces or GPU memory alive.
+    av_frame_unref(*frame);
+
+    for (int i = 0; i < FRAME_POOL_SIZE; i++) {
+        if (SDL_AtomicCASPtr(&s_Frames[i], nullptr, *frame)) {
+            *frame = nullptr;
+            return;
+        }
+    }
+
+    // The pool is full, so just free it
+    av_frame_free(frame);
+}
+
+void FramePool::drain()
+{
+    for (int i = 0; i < FRAME_POOL_SIZE; i++) {
+        AVFrame* frame = (AVFrame*)SDL_AtomicSetPtr(&s_Frames[i], nullptr);
+        av_frame_free(&frame);
+    }
+}
+
+uint32_t FramePool::takeAllocationCount()
+{
+    return (uint32_t)SDL_AtomicSet(&s_Allocations, 0);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "pacer/pacer.h"
+
+// The maximum number of frames we expect to be in flight at once:
+// - All frames held by the pacer
+// - 1 frame being received from the decoder
+// - 1 frame read back from the GPU by SwFrameMapper
+#define FRAME_POOL_SIZE (PACER_MAX_OUTSTANDING_FRAMES + 1 + 1)
+
+// A fixed-size lock-free cache of AVFrame structs shared by the decoder,
+// the pacer, and the renderers. Frames returned to the pool are unreferenced
+// but not freed, so steady state streaming doesn't need to allocate any.
+// FFmpegVideoDecoder drains the pool when it's reset.
+class FramePool
+{
+public:
+    static AVFrame* acquire();
+
+    static void release(AVFrame** frame);
+
+    // Frees the frames cached in the pool. Frames that are still in use
+    // are unaffected and will be pooled again when they're released.
+    static void drain();
+
+    // Returns the number of frames that missed the pool and
+    // were allocated since the last call to this function.
+    static uint32_t takeAllocationCount();
+
+private:
+    static void* s_Frames[FRAME_POOL_SIZE];
+    static SDL_atomic_t s_Allocations;
+};
@@ -1,4 +1,5 @@
 #include "pacer.h"
+#include "../framepool.h"
 #include "streaming/streamutils.h"
 
 #ifdef Q_OS_WIN32
@@ -21,6 +22,10 @@
 #define MAX_QUEUED_FRAMES 3
 static_assert(PACER_MAX_OUTSTANDING_FRAMES == MAX_QUEUED_FRAMES + 2,
               "PACER_MAX_OUTSTANDING_FRAMES and MAX_QUEUED_FRAMES must agree");
+static_assert(MAX_QUEUED_FRAMES <= PACER_QUEUE_SLOTS,
+              "PACER_QUEUE_SLOTS is too small for MAX_QUEUED_FRAMES");
+static_assert((PACER_QUEUE_SLOTS & (PACER_QUEUE_SLOTS - 1)) == 0,
+              "PACER_QUEUE_SLOTS must be a power of 2");
 
 // We may be woken up slightly late so don't go all the way
 // up to the next V-sync since we may accidentally step into
@@ -29,28 +34,87 @@ static_assert(PACER_MAX_OUTSTANDING_FRAMES == MAX_QUEUED_FRAMES + 2,
 // V-sync happens.
 #define TIMER_SLACK_MS 3
 
-Pacer::Pacer(IFFmpegRenderer* renderer, PVIDEO_STATS videoStats) :
+PacerFrameQueue::PacerFrameQueue()
+{
+    SDL_zero(m_Frames);
+    SDL_AtomicSet(&m_Head, 0);
+    SDL_AtomicSet(&m_Tail, 0);
+}
+
+int PacerFrameQueue::count()
+{
+    // Read the head first, so a concurrent dequeue can only make us overestimate
+    unsigned int head = (unsigned int)SDL_AtomicGet(&m_Head);
+    unsigned int tail = (unsigned int)SDL_AtomicGet(&m_Tail);
+    return (int)(tail - head);
+}
+
+bool PacerFrameQueue::isEmpty()
+{
+    return count() == 0;
+}
+
+void PacerFrameQueue::enqueue(AVFrame* frame)
+{
+    unsigned int tail = (unsigned int)SDL_AtomicGet(&m_Tail);
+
+    // Dequeues can only shrink the queue, so the producer's view of the
+    // free space can't be invalidated by another thread.
+    SDL_assert(count() < PACER_QUEUE_SLOTS);
+
+    // Publish the frame before publishing the new tail
+    SDL_AtomicSetPtr(&m_Frames[tail & (PACER_QUEUE_SLOTS - 1)], frame);
+    SDL_AtomicSet(&m_Tail, (int)(tail + 1));
+}
+
+AVFrame* PacerFrameQueue::dequeue()
+{
+    return dequeueIfAtLeast(1);
+}
+
+AVFrame* PacerFrameQueue::dequeueIfAtLeast(int minCount)
+{
+    for (;;) {
+        unsigned int head = (unsigned int)SDL_AtomicGet(&m_Head);
+        if ((int)((unsigned int)SDL_AtomicGet(&m_Tail) - head) < minCount) {
+            return nullptr;
+        }
+
+        // If another thread dequeues this slot before us, the producer may
+        // overwrite it with a new frame. We'll discard what we read here
+        // in that case, because the CAS on the head will fail.
+        AVFrame* frame = (AVFrame*)SDL_AtomicGetPtr(&m_Frames[head & (PACER_QUEUE_SLOTS - 1)]);
+        if (SDL_AtomicCAS(&m_Head, (int)head, (int)(head + 1))) {
+            return frame;
+        }
+    }
+}
+
+Pacer::Pacer(IFFmpegRenderer* renderer, PVIDEO_STATS videoStats, FrameTracer* frameTracer) :
+    m_RenderQueueNotEmpty(SDL_CreateSemaphore(0)),
+    m_PacingQueueNotEmpty(SDL_CreateSemaphore(0)),
+    m_VsyncSignalled(SDL_CreateSemaphore(0)),
     m_RenderThread(nullptr),
     m_VsyncThread(nullptr),
     m_DeferredFreeFrame(nullptr),
-    m_Stopping(false),
     m_VsyncSource(nullptr),
     m_VsyncRenderer(renderer),
     m_MaxVideoFps(0),
     m_DisplayFps(0),
-    m_VideoStats(videoStats)
+    m_VideoStats(videoStats),
+    m_FrameTracer(frameTracer)
 {
-
+    SDL_AtomicSet(&m_Stopping, 0);
 }
 
 Pacer::~Pacer()
 {
-    m_Stopping = true;
+    SDL_AtomicSet(&m_Stopping, 1);
 
     // Stop the V-sync thread
     if (m_VsyncThread != nullptr) {
-        m_PacingQueueNotEmpty.wakeAll();
-        m_VsyncSignalled.wakeAll();
+        SDL_SemPost(m_PacingQueueNotEmpty);
+        SDL_SemPost(m_VsyncSignalled);
         SDL_WaitThread(m_VsyncThread, nullptr);
     }
 
@@ -60,7 +124,7 @@ Pacer::~Pacer()
 
     // Stop the render thread
     if (m_RenderThread != nullptr) {
-        m_RenderQueueNotEmpty.wakeAll();
+        SDL_SemPost(m_RenderQueueNotEmpty);
         SDL_WaitThread(m_RenderThread, nullptr);
     }
     else {
@@ -70,15 +134,18 @@ Pacer::~Pacer()
     }
 
     // Delete any remaining unconsumed frames
-    while (!m_RenderQueue.isEmpty()) {
-        AVFrame* frame = m_RenderQueue.dequeue();
-        av_frame_free(&frame);
+    AVFrame* frame;
+    while ((frame = m_RenderQueue.dequeue()) != nullptr) {
+        FramePool::release(&frame);
     }
-    while (!m_PacingQueue.isEmpty()) {
-        AVFrame* frame = m_PacingQueue.dequeue();
-        av_frame_free(&frame);
+    while ((frame = m_PacingQueue.dequeue()) != nullptr) {
+        FramePool::release(&frame);
     }
-    av_frame_free(&m_DeferredFreeFrame);
+    FramePool::release(&m_DeferredFreeFrame);
+
+    SDL_DestroySemaphore(m_RenderQueueNotEmpty);
+    SDL_DestroySemaphore(m_PacingQueueNotEmpty);
+    SDL_DestroySemaphore(m_VsyncSignalled);
 }
 
 void Pacer::renderOnMainThread()
@@ -88,17 +155,10 @@ void Pacer::renderOnMainThread()
         return;
     }
 
-    m_FrameQueueLock.lock();
-
-    if (!m_RenderQueue.isEmpty()) {
-        AVFrame* frame = m_RenderQueue.dequeue();
-        m_FrameQueueLock.unlock();
-
+    AVFrame* frame = m_RenderQueue.dequeue();
+    if (frame != nullptr) {
         renderFrame(frame);
     }
-    else {
-        m_FrameQueueLock.unlock();
-    }
 }
 
 int Pacer::vsyncThread(void *context)
@@ -112,19 +172,21 @@ int Pacer::vsyncThread(void *context)
 #endif
 
     bool async = me->m_VsyncSource->isAsync();
-    while (!me->m_Stopping) {
+    while (!SDL_AtomicGet(&me->m_Stopping)) {
         if (async) {
             // Wait for the VSync source to invoke signalVsync() or 100ms to elapse
-            me->m_FrameQueueLock.lock();
-            me->m_VsyncSignalled.wait(&me->m_FrameQueueLock, 100);
-            me->m_FrameQueueLock.unlock();
+            SDL_SemWaitTimeout(me->m_VsyncSignalled, 100);
+
+            // Discard any signals that arrived while we were busy handling
+            // the last V-sync, since we only care about the latest one.
+            while (SDL_SemTryWait(me->m_VsyncSignalled) == 0);
         }
         else {
             // Let the VSync source wait in the context of our thread
             me->m_VsyncSource->waitForVsync();
         }
 
-        if (me->m_Stopping) {
+        if (SDL_AtomicGet(&me->m_Stopping)) {
             break;
         }
 
@@ -144,28 +206,28 @@ int Pacer::renderThread(void* context)
                     SDL_GetError());
     }
 
-    while (!me->m_Stopping) {
+    while (!SDL_AtomicGet(&me->m_Stopping)) {
         // Wait for the renderer to be ready for the next frame
         me->m_VsyncRenderer->waitToRender();
 
-        // Acquire the frame queue lock to protect the queue and
-        // the not empty condition
-        me->m_FrameQueueLock.lock();
-
         // Wait for a frame to be ready to render
-        while (!me->m_Stopping && me->m_RenderQueue.isEmpty()) {
-            me->m_RenderQueueNotEmpty.wait(&me->m_FrameQueueLock);
+        AVFrame* frame;
+        while ((frame = me->m_RenderQueue.dequeue()) == nullptr && !SDL_AtomicGet(&me->m_Stopping)) {
+            SDL_SemWait(me->m_RenderQueueNotEmpty);
         }
 
-        if (me->m_Stopping) {
+        // The semaphore is posted for every enqueued frame, but we only wait
+        // on it when the queue is empty. Discard the posts we didn't consume
+        // so the count can't build up and make later waits return early.
+        // We always check the queue before waiting, so we can't miss a frame.
+        while (SDL_SemTryWait(me->m_RenderQueueNotEmpty) == 0);
+
+        if (SDL_AtomicGet(&me->m_Stopping)) {
             // Exit this thread
-            me->m_FrameQueueLock.unlock();
+            FramePool::release(&frame);
             break;
         }
 
-        AVFrame* frame = me->m_RenderQueue.dequeue();
-        me->m_FrameQueueLock.unlock();
-
         me->renderFrame(frame);
     }
 
@@ -176,15 +238,18 @@ int Pacer::renderThread(void* context)
     return 0;
 }
 
-void Pacer::enqueueFrameForRenderingAndUnlock(AVFrame *frame)
+void Pacer::enqueueFrameForRendering(AVFrame *frame)
 {
+    // The frame may be rendered and freed as soon as it's enqueued
+    if (m_FrameTracer != nullptr) {
+        m_FrameTracer->tracePacerDequeue((uint32_t)(uintptr_t)frame->opaque, LiGetMicroseconds());
+    }
+
     dropFrameForEnqueue(m_RenderQueue);
     m_RenderQueue.enqueue(frame);
 
-    m_FrameQueueLock.unlock();
-
     if (m_RenderThread != nullptr) {
-        m_RenderQueueNotEmpty.wakeOne();
+        SDL_SemPost(m_RenderQueueNotEmpty);
     }
     else {
         SDL_Event event;
@@ -203,8 +268,6 @@ void Pacer::handleVsync(int timeUntilNextVsyncMillis)
     // Make sure initialize() has been called
     SDL_assert(m_MaxVideoFps != 0);
 
-    m_FrameQueueLock.lock();
-
     // If the queue length history entries are large, be strict
     // about dropping excess frames.
     int frameDropTarget = 1;
@@ -231,35 +294,36 @@ void Pacer::handleVsync(int timeUntilNextVsyncMillis)
     }
 
     // Catch up if we're several frames ahead
-    while (m_PacingQueue.count() > frameDropTarget) {
-        AVFrame* frame = m_PacingQueue.dequeue();
-
-        // Drop the lock while we call av_frame_free()
-        m_FrameQueueLock.unlock();
+    AVFrame* frame;
+    while ((frame = m_PacingQueue.dequeueIfAtLeast(frameDropTarget + 1)) != nullptr) {
         m_VideoStats->pacerDroppedFrames++;
-        av_frame_free(&frame);
-        m_FrameQueueLock.lock();
+        FramePool::release(&frame);
     }
 
-    if (m_PacingQueue.isEmpty()) {
-        // Wait for a frame to arrive or our V-sync timeout to expire
-        if (!m_PacingQueueNotEmpty.wait(&m_FrameQueueLock, SDL_max(timeUntilNextVsyncMillis, TIMER_SLACK_MS) - TIMER_SLACK_MS)) {
-            // Wait timed out - unlock and bail
-            m_FrameQueueLock.unlock();
+    // Wait for a frame to arrive or our V-sync timeout to expire
+    Uint32 deadline = SDL_GetTicks() + SDL_max(timeUntilNextVsyncMillis, TIMER_SLACK_MS) - TIMER_SLACK_MS;
+    while ((frame = m_PacingQueue.dequeue()) == nullptr) {
+        Uint32 now = SDL_GetTicks();
+        if (SDL_TICKS_PASSED(now, deadline) ||
+                SDL_SemWaitTimeout(m_PacingQueueNotEmpty, deadline - now) != 0) {
+            // Wait timed out - bail
             return;
         }
 
-        if (m_Stopping) {
-            m_FrameQueueLock.unlock();
+        if (SDL_AtomicGet(&m_Stopping)) {
             return;
         }
     }
 
+    // Discard posts for frames we didn't have to wait for (see renderThread())
+    while (SDL_SemTryWait(m_PacingQueueNotEmpty) == 0);
+
     // Place the first frame on the render queue
-    enqueueFrameForRenderingAndUnlock(m_PacingQueue.dequeue());
+    enqueueFrameForRendering(frame);
 }
 
-bool Pacer::initialize(SDL_Window* window, int maxVideoFps, bool enablePacing)
+bool Pacer::initialize(SDL_Window* window, int maxVideoFps, bool enablePacing,
+                       IVsyncSource* vsyncSource)
 {
     m_MaxVideoFps = maxVideoFps;
     m_DisplayFps = StreamUtils::getDisplayRefreshRate(window);
@@ -272,30 +336,34 @@ bool Pacer::initialize(SDL_Window* window, int maxVideoFps, bool enablePacing)
 
         SDL_SysWMinfo info;
         SDL_VERSION(&info.version);
-        if (!SDL_GetWindowWMInfo(window, &info)) {
+        if (vsyncSource != nullptr) {
+            m_VsyncSource = vsyncSource;
+        }
+        else if (!SDL_GetWindowWMInfo(window, &info)) {
             SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                          "SDL_GetWindowWMInfo() failed: %s",
                          SDL_GetError());
             return false;
         }
+        else {
+            switch (info.subsystem) {
+        #ifdef Q_OS_WIN32
+            case SDL_SYSWM_WINDOWS:
+                m_VsyncSource = new DxVsyncSource(this);
+                break;
+        #endif
 
-        switch (info.subsystem) {
-    #ifdef Q_OS_WIN32
-        case SDL_SYSWM_WINDOWS:
-            m_VsyncSource = new DxVsyncSource(this);
-            break;
-    #endif
-
-    #if defined(SDL_VIDEO_DRIVER_WAYLAND) && defined(HAS_WAYLAND)
-        case SDL_SYSWM_WAYLAND:
-            m_VsyncSource = new WaylandVsyncSource(this);
-            break;
-    #endif
+        #if defined(SDL_VIDEO_DRIVER_WAYLAND) && defined(HAS_WAYLAND)
+            case SDL_SYSWM_WAYLAND:
+                m_VsyncSource = new WaylandVsyncSource(this);
+                break;
+        #endif
 
-        default:
-            // Platforms without a VsyncSource will just render frames
-            // immediately like they used to.
-            break;
+            default:
+                // Platforms without a VsyncSource will just render frames
+                // immediately like they used to.
+                break;
+            }
         }
 
         SDL_assert(m_VsyncSource != nullptr || !(m_RendererAttributes & RENDERER_ATTRIBUTE_FORCE_PACING));
@@ -311,6 +379,8 @@ bool Pacer::initialize(SDL_Window* window, int maxVideoFps, bool enablePacing)
         SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
                     "Frame pacing disabled: target %d Hz with %d FPS stream",
                     m_DisplayFps, m_MaxVideoFps);
+
+        delete vsyncSource;
     }
 
     if (m_VsyncSource != nullptr) {
@@ -326,31 +396,36 @@ bool Pacer::initialize(SDL_Window* window, int maxVideoFps, bool enablePacing)
 
 void Pacer::signalVsync()
 {
-    m_VsyncSignalled.wakeOne();
+    SDL_SemPost(m_VsyncSignalled);
 }
 
 void Pacer::renderFrame(AVFrame* frame)
 {
     // Count time spent in Pacer's queues
     uint64_t beforeRender = LiGetMicroseconds();
-    m_VideoStats->totalPacerTimeUs += (beforeRender - (uint64_t)frame->pkt_dts);
+    uint64_t pacerTimeUs = beforeRender - (uint64_t)frame->pkt_dts;
+    m_VideoStats->totalPacerTimeUs += pacerTimeUs;
+    m_VideoStats->pacerTimeHistogram.record(pacerTimeUs);
 
     // Render it
     m_VsyncRenderer->renderFrame(frame);
     uint64_t afterRender = LiGetMicroseconds();
 
     m_VideoStats->totalRenderTimeUs += (afterRender - beforeRender);
+    m_VideoStats->renderTimeHistogram.record(afterRender - beforeRender);
     m_VideoStats->renderedFrames++;
 
+    if (m_FrameTracer != nullptr) {
+        m_FrameTracer->traceRender((uint32_t)(uintptr_t)frame->opaque, beforeRender, afterRender);
+    }
+
     // Wait until after next frame to free this one to ensure the GPU
     // doesn't stall or read garbage if the backing buffer gets returned
     // to the pool and the decoder tries to write a new frame into it
     std::swap(frame, m_DeferredFreeFrame);
-    av_frame_free(&frame);
+    FramePool::release(&frame);
 
     // Drop frames if we have too many queued up for a while
-    m_FrameQueueLock.lock();
-
     int frameDropTarget;
 
     if (m_RendererAttributes & RENDERER_ATTRIBUTE_NO_BUFFERING) {
@@ -378,26 +453,19 @@ void Pacer::renderFrame(AVFrame* frame)
     }
 
     // Catch up if we're several frames ahead
-    while (m_RenderQueue.count() > frameDropTarget) {
-        AVFrame* frame = m_RenderQueue.dequeue();
-
-        // Drop the lock while we call av_frame_free()
-        m_FrameQueueLock.unlock();
+    while ((frame = m_RenderQueue.dequeueIfAtLeast(frameDropTarget + 1)) != nullptr) {
         m_VideoStats->pacerDroppedFrames++;
-        av_frame_free(&frame);
-        m_FrameQueueLock.lock();
+        FramePool::release(&frame);
     }
-
-    m_FrameQueueLock.unlock();
 }
 
-void Pacer::dropFrameForEnqueue(QQueue<AVFrame*>& queue)
+void Pacer::dropFrameForEnqueue(PacerFrameQueue& queue)
 {
-    SDL_assert(queue.size() <= MAX_QUEUED_FRAMES);
-    if (queue.size() == MAX_QUEUED_FRAMES) {
-        AVFrame* frame = queue.dequeue();
-        av_frame_free(&frame);
-    }
+    SDL_assert(queue.count() <= MAX_QUEUED_FRAMES);
+
+    // If the consumer beats us to the oldest frame, that also makes room
+    AVFrame* frame = queue.dequeueIfAtLeast(MAX_QUEUED_FRAMES);
+    FramePool::release(&frame);
 }
 
 void Pacer::submitFrame(AVFrame* frame)
@@ -406,14 +474,12 @@ void Pacer::submitFrame(AVFrame* frame)
     SDL_assert(m_MaxVideoFps != 0);
 
     // Queue the frame and possibly wake up the render thread
-    m_FrameQueueLock.lock();
     if (m_VsyncSource != nullptr) {
         dropFrameForEnqueue(m_PacingQueue);
         m_PacingQueue.enqueue(frame);
-        m_FrameQueueLock.unlock();
-        m_PacingQueueNotEmpty.wakeOne();
+        SDL_SemPost(m_PacingQueueNotEmpty);
     }
     else {
-        enqueueFrameForRenderingAndUnlock(frame);
+        enqueueFrameForRendering(frame);
     }
 }
@@ -1,11 +1,10 @@
 #pragma once
 
 #include "../../decoder.h"
+#include "../../frametracer.h"
 #include "../renderer.h"
 
 #include <QQueue>
-#include <QMutex>
-#include <QWaitCondition>
 
 // The maximum number of frames pacer will ever hold is:
 // - 3 frames in the pacing queue
@@ -28,16 +27,50 @@ public:
     }
 };
 
+// Number of slots in each of the pacer's frame queues (must be a power of 2)
+#define PACER_QUEUE_SLOTS 4
+
+// A bounded lock-free frame queue with a single producer. Frames may be
+// dequeued by the consumer and by the producer (to drop the oldest frame
+// when the queue is full), so dequeues are arbitrated by a CAS on the head.
+class PacerFrameQueue
+{
+public:
+    PacerFrameQueue();
+
+    int count();
+
+    bool isEmpty();
+
+    // Only the producer may call this and the queue must not be full
+    void enqueue(AVFrame* frame);
+
+    // Returns nullptr if the queue is empty
+    AVFrame* dequeue();
+
+    // Dequeues the oldest frame only if the queue holds at least minCount
+    // frames, so racing threads can't drop more frames than intended.
+    AVFrame* dequeueIfAtLeast(int minCount);
+
+private:
+    void* m_Frames[PACER_QUEUE_SLOTS];
+    SDL_atomic_t m_Head;
+    SDL_atomic_t m_Tail;
+};
+
 class Pacer
 {
 public:
-    Pacer(IFFmpegRenderer* renderer, PVIDEO_STATS videoStats);
+    Pacer(IFFmpegRenderer* renderer, PVIDEO_STATS videoStats, FrameTracer* frameTracer);
 
     ~Pacer();
 
     void submitFrame(AVFrame* frame);
 
-    bool initialize(SDL_Window* window, int maxVideoFps, bool enablePacing);
+    // If vsyncSource is provided, the pacer takes ownership of it and uses
+    // it instead of the platform's V-sync source (for benchmarks and tests).
+    bool initialize(SDL_Window* window, int maxVideoFps, bool enablePacing,
+                    IVsyncSource* vsyncSource = nullptr);
 
     void signalVsync();
 
@@ -50,29 +83,29 @@ private:
 
     void handleVsync(int timeUntilNextVsyncMillis);
 
-    void enqueueFrameForRenderingAndUnlock(AVFrame* frame);
+    void enqueueFrameForRendering(AVFrame* frame);
 
     void renderFrame(AVFrame* frame);
 
-    void dropFrameForEnqueue(QQueue<AVFrame*>& queue);
+    void dropFrameForEnqueue(PacerFrameQueue& queue);
 
-    QQueue<AVFrame*> m_RenderQueue;
-    QQueue<AVFrame*> m_PacingQueue;
-    QQueue<int> m_PacingQueueHistory;
-    QQueue<int> m_RenderQueueHistory;
-    QMutex m_FrameQueueLock;
-    QWaitCondition m_RenderQueueNotEmpty;
-    QWaitCondition m_PacingQueueNotEmpty;
-    QWaitCondition m_VsyncSignalled;
+    PacerFrameQueue m_RenderQueue;
+    PacerFrameQueue m_PacingQueue;
+    QQueue<int> m_PacingQueueHistory; // Only accessed by the V-sync thread
+    QQueue<int> m_RenderQueueHistory; // Only accessed by the render thread
+    SDL_sem* m_RenderQueueNotEmpty;
+    SDL_sem* m_PacingQueueNotEmpty;
+    SDL_sem* m_VsyncSignalled;
     SDL_Thread* m_RenderThread;
     SDL_Thread* m_VsyncThread;
     AVFrame* m_DeferredFreeFrame;
-    bool m_Stopping;
+    SDL_atomic_t m_Stopping;
 
     IVsyncSource* m_VsyncSource;
     IFFmpegRenderer* m_VsyncRenderer;
     int m_MaxVideoFps;
     int m_DisplayFps;
     PVIDEO_STATS m_VideoStats;
+    FrameTracer* m_FrameTracer;
     int m_RendererAttributes;
 };
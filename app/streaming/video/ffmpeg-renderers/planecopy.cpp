@@ -0,0 +1,192 @@
+#include "planecopy.h"
+
+#include <QtGlobal>
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PLANE_COPY_X86
+#include <immintrin.h>
+
+// GCC and Clang need to be told which functions may use instructions beyond
+// the baseline ISA we're compiling for. MSVC allows any intrinsic anywhere.
+#ifdef __GNUC__
+#define TARGET_ISA(x) __attribute__((target(x)))
+#else
+#define TARGET_ISA(x)
+#endif
+#endif
+
+typedef void (*CopyRowFunc)(uint8_t* dst, const uint8_t* src, int length);
+
+#ifdef PLANE_COPY_X86
+
+// Copies bytes until dst reaches the requested alignment. Returns the number copied.
+static inline int copyRowHead(uint8_t* dst, const uint8_t* src, int length, uintptr_t alignment)
+{
+    int head = (int)((alignment - ((uintptr_t)dst & (alignment - 1))) & (alignment - 1));
+    head = SDL_min(head, length);
+    memcpy(dst, src, head);
+    return head;
+}
+
+TARGET_ISA("sse2")
+static void copyRowStreamingStoresSse2(uint8_t* dst, const uint8_t* src, int length)
+{
+    int offset = copyRowHead(dst, src, length, 16);
+    dst += offset;
+    src += offset;
+    length -= offset;
+
+    while (length >= 64) {
+        __m128i a = _mm_loadu_si128((const __m128i*)src + 0);
+        __m128i b = _mm_loadu_si128((const __m128i*)src + 1);
+        __m128i c = _mm_loadu_si128((const __m128i*)src + 2);
+        __m128i d = _mm_loadu_si128((const __m128i*)src + 3);
+        _mm_stream_si128((__m128i*)dst + 0, a);
+        _mm_stream_si128((__m128i*)dst + 1, b);
+        _mm_stream_si128((__m128i*)dst + 2, c);
+        _mm_stream_si128((__m128i*)dst + 3, d);
+        dst += 64;
+        src += 64;
+        length -= 64;
+    }
+
+    memcpy(dst, src, length);
+}
+
+TARGET_ISA("avx2")
+static void copyRowStreamingStoresAvx2(uint8_t* dst, const uint8_t* src, int length)
+{
+    int offset = copyRowHead(dst, src, length, 32);
+    dst += offset;
+    src += offset;
+    length -= offset;
+
+    while (length >= 128) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)src + 0);
+        __m256i b = _mm256_loadu_si256((const __m256i*)src + 1);
+        __m256i c = _mm256_loadu_si256((const __m256i*)src + 2);
+        __m256i d = _mm256_loadu_si256((const __m256i*)src + 3);
+        _mm256_stream_si256((__m256i*)dst + 0, a);
+        _mm256_stream_si256((__m256i*)dst + 1, b);
+        _mm256_stream_si256((__m256i*)dst + 2, c);
+        _mm256_stream_si256((__m256i*)dst + 3, d);
+        dst += 128;
+        src += 128;
+        length -= 128;
+    }
+
+    // Avoid the AVX-SSE transition penalty in the code that follows
+    _mm256_zeroupper();
+
+    memcpy(dst, src, length);
+}
+
+// Streaming loads require an aligned source, so we align the source here
+// and use streaming stores too if the destination happens to line up.
+TARGET_ISA("sse4.1")
+static void copyRowStreamingLoadsSse41Impl(uint8_t* dst, const uint8_t* src, int length, bool streamingStores)
+{
+    int head = (int)((16 - ((uintptr_t)src & 15)) & 15);
+    head = SDL_min(head, length);
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    length -= head;
+
+    streamingStores = streamingStores && ((uintptr_t)dst & 15) == 0;
+
+    while (length >= 64) {
+        __m128i a = _mm_stream_load_si128((__m128i*)src + 0);
+        __m128i b = _mm_stream_load_si128((__m128i*)src + 1);
+        __m128i c = _mm_stream_load_si128((__m128i*)src + 2);
+        __m128i d = _mm_stream_load_si128((__m128i*)src + 3);
+        if (streamingStores) {
+            _mm_stream_si128((__m128i*)dst + 0, a);
+            _mm_stream_si128((__m128i*)dst + 1, b);
+            _mm_stream_si128((__m128i*)dst + 2, c);
+            _mm_stream_si128((__m128i*)dst + 3, d);
+        }
+        else {
+            _mm_storeu_si128((__m128i*)dst + 0, a);
+            _mm_storeu_si128((__m128i*)dst + 1, b);
+            _mm_storeu_si128((__m128i*)dst + 2, c);
+            _mm_storeu_si128((__m128i*)dst + 3, d);
+        }
+        dst += 64;
+        src += 64;
+        length -= 64;
+    }
+
+    memcpy(dst, src, length);
+}
+
+static void copyRowStreamingLoadsSse41(uint8_t* dst, const uint8_t* src, int length)
+{
+    copyRowStreamingLoadsSse41Impl(dst, src, length, false);
+}
+
+static void copyRowStreamingLoadsAndStoresSse41(uint8_t* dst, const uint8_t* src, int length)
+{
+    copyRowStreamingLoadsSse41Impl(dst, src, length, true);
+}
+
+#endif
+
+static CopyRowFunc getCopyRowFunc(int flags)
+{
+#ifdef PLANE_COPY_X86
+    if ((flags & PLANE_COPY_STREAMING_LOADS) && SDL_HasSSE41()) {
+        return (flags & PLANE_COPY_STREAMING_STORES) ?
+                   copyRowStreamingLoadsAndStoresSse41 : copyRowStreamingLoadsSse41;
+    }
+    else if (flags & PLANE_COPY_STREAMING_STORES) {
+        if (SDL_HasAVX2()) {
+            return copyRowStreamingStoresAvx2;
+        }
+        else if (SDL_HasSSE2()) {
+            return copyRowStreamingStoresSse2;
+        }
+    }
+#else
+    // On ARM, memcpy() is already NEON-optimized and there's no way to issue
+    // non-temporal loads or stores from intrinsics, so it's the best we have.
+    Q_UNUSED(flags);
+#endif
+
+    return nullptr;
+}
+
+void PlaneCopy::copyPlane(uint8_t* dst, int dstPitch,
+                          const uint8_t* src, int srcPitch,
+                          int rowBytes, int height,
+                          int flags)
+{
+    CopyRowFunc copyRow = getCopyRowFunc(flags);
+
+    // If the pitches match, we can copy the whole plane as a single row
+    if (dstPitch == srcPitch) {
+        rowBytes = dstPitch * height;
+        height = 1;
+    }
+
+    if (copyRow == nullptr) {
+        for (int i = 0; i < height; i++) {
+            memcpy(dst + (dstPitch * i), src + (srcPitch * i), rowBytes);
+        }
+        return;
+    }
+
+    for (int i = 0; i < height; i++) {
+        copyRow(dst + (dstPitch * i), src + (srcPitch * i), rowBytes);
+    }
+
+#ifdef PLANE_COPY_X86
+    // Streaming stores are weakly ordered, so make sure they're globally
+    // visible before anyone else (like the GPU driver) reads the buffer.
+    if (flags & PLANE_COPY_STREAMING_STORES) {
+        _mm_sfence();
+    }
+#endif
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "SDL_compat.h"
+
+#include <stdint.h>
+
+// The destination won't be read by the CPU, so bypass the cache when writing it.
+// Use this for write-combined mappings like DRM dumb buffers and locked textures.
+#define PLANE_COPY_STREAMING_STORES 0x1
+
+// The source is uncached memory (like a mapped hardware frame), so read it
+// using streaming loads that fetch a full cache line at a time.
+#define PLANE_COPY_STREAMING_LOADS 0x2
+
+namespace PlaneCopy {
+    // Copies rowBytes from each of height rows between planes with
+    // possibly different pitches. If the pitches match, the padding
+    // at the end of each row is copied too.
+    void copyPlane(uint8_t* dst, int dstPitch,
+                   const uint8_t* src, int srcPitch,
+                   int rowBytes, int height,
+                   int flags);
+}
@@ -1,4 +1,6 @@
 #include "sdlvid.h"
+#include "framepool.h"
+#include "planecopy.h"
 
 #include "streaming/session.h"
 #include "streaming/streamutils.h"
@@ -18,6 +20,8 @@ SdlRenderer::SdlRenderer()
       m_Renderer(nullptr),
       m_Texture(nullptr),
       m_NeedsYuvToRgbConversion(false),
+      m_UseYuvToRgbConverter(false),
+      m_YuvToRgbConverter(this),
       m_SwsContext(nullptr),
       m_RgbFrame(av_frame_alloc()),
       m_SwFrameMapper(this)
@@ -224,6 +228,11 @@ bool SdlRenderer::initialize(PDECODER_PARAMETERS params)
 
 void SdlRenderer::renderOverlay(Overlay::OverlayType type)
 {
+    // There are no overlays to draw without a session
+    if (Session::get() == nullptr) {
+        return;
+    }
+
     if (Session::get()->getOverlayManager().isOverlayEnabled(type)) {
         // If a new surface has been created for updated overlay data, convert it into a texture.
         // NB: We have to do this conversion at render-time because we can only interact
@@ -311,6 +320,7 @@ ReadbackRetry:
 
         // Remember to keep this in sync with SdlRenderer::isPixelFormatSupported()!
         m_NeedsYuvToRgbConversion = false;
+        m_UseYuvToRgbConverter = false;
         switch (frame->format)
         {
         case AV_PIX_FMT_YUV420P:
@@ -333,7 +343,13 @@ ReadbackRetry:
             break;
         }
 
-        if (m_NeedsYuvToRgbConversion) {
+        if (m_NeedsYuvToRgbConversion &&
+                YuvToRgbConverter::isPixelFormatSupported((AVPixelFormat)frame->format) &&
+                m_YuvToRgbConverter.initialize(frame)) {
+            // Our own converter is much faster than swscale for these formats
+            m_UseYuvToRgbConverter = true;
+        }
+        else if (m_NeedsYuvToRgbConversion) {
             m_RgbFrame->width = frame->width;
             m_RgbFrame->height = frame->height;
             m_RgbFrame->format = AV_PIX_FMT_BGR0;
@@ -486,41 +502,46 @@ ReadbackRetry:
                 goto Exit;
             }
 
-            // If the planar pitches match, we can use a single memcpy() to transfer
-            // the data. If not, we'll need to do separate memcpy() calls for each
-            // line to ensure the pitch doesn't get screwed up.
-
-            if (frame->linesize[0] == texturePitch) {
-                memcpy(pixels,
-                       frame->data[0],
-                       frame->linesize[0] * frame->height);
-            }
-            else {
-                int pitch = SDL_min(frame->linesize[0], texturePitch);
-                for (int i = 0; i < frame->height; i++) {
-                    memcpy(pixels + (texturePitch * i),
-                           frame->data[0] + (frame->linesize[0] * i),
-                           pitch);
-                }
+            // The locked texture is only consumed by the GPU upload, so don't
+            // pollute the cache with it. If the frame was mapped directly from
+            // GPU memory, it may be uncached too.
+            int copyFlags = PLANE_COPY_STREAMING_STORES;
+            if (swFrame != nullptr && m_SwFrameMapper.isMappingFrames()) {
+                copyFlags |= PLANE_COPY_STREAMING_LOADS;
             }
 
-            if (frame->linesize[1] == texturePitch) {
-                memcpy(pixels + (texturePitch * frame->height),
-                       frame->data[1],
-                       frame->linesize[1] * frame->height / 2);
-            }
-            else {
-                int pitch = SDL_min(frame->linesize[1], texturePitch);
-                for (int i = 0; i < frame->height / 2; i++) {
-                    memcpy(pixels + (texturePitch * (frame->height + i)),
-                           frame->data[1] + (frame->linesize[1] * i),
-                           pitch);
-                }
-            }
+            PlaneCopy::copyPlane((uint8_t*)pixels, texturePitch,
+                                 frame->data[0], frame->linesize[0],
+                                 SDL_min(frame->linesize[0], texturePitch),
+                                 frame->height,
+                                 copyFlags);
+            PlaneCopy::copyPlane((uint8_t*)pixels + (texturePitch * frame->height), texturePitch,
+                                 frame->data[1], frame->linesize[1],
+                                 SDL_min(frame->linesize[1], texturePitch),
+                                 frame->height / 2,
+                                 copyFlags);
 
             SDL_UnlockTexture(m_Texture);
         }
     }
+    else if (m_UseYuvToRgbConverter) {
+        // We have a pixel format that SDL doesn't natively support, so we convert
+        // the YUV frame directly into the locked RGB texture buffer.
+        uint8_t* pixels;
+        int texturePitch;
+
+        err = SDL_LockTexture(m_Texture, nullptr, (void**)&pixels, &texturePitch);
+        if (err < 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "SDL_LockTexture() failed: %s",
+                         SDL_GetError());
+            goto Exit;
+        }
+
+        m_YuvToRgbConverter.convertFrame(frame, pixels, texturePitch);
+
+        SDL_UnlockTexture(m_Texture);
+    }
     else {
         // We have a pixel format that SDL doesn't natively support, so we must use
         // swscale to convert the YUV frame into an RGB frame to upload to the GPU.
@@ -596,7 +617,7 @@ ReadbackRetry:
 
 Exit:
     if (swFrame != nullptr) {
-        av_frame_free(&swFrame);
+        FramePool::release(&swFrame);
     }
 }
 
@@ -626,7 +647,7 @@ bool SdlRenderer::testRenderFrame(AVFrame* frame)
             return false;
         }
 
-        av_frame_free(&swFrame);
+        FramePool::release(&swFrame);
     }
     else if (!isPixelFormatSupported(m_VideoFormat, (AVPixelFormat)frame->format)) {
         SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
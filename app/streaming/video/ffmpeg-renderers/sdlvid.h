@@ -2,6 +2,7 @@
 
 #include "renderer.h"
 #include "swframemapper.h"
+#include "yuvtorgb.h"
 
 #ifdef HAVE_CUDA
 #include "cuda.h"
@@ -37,6 +38,8 @@ private:
 
     // Used for CPU conversion of YUV to RGB if needed
     bool m_NeedsYuvToRgbConversion;
+    bool m_UseYuvToRgbConverter;
+    YuvToRgbConverter m_YuvToRgbConverter;
     SwsContext* m_SwsContext;
     AVFrame* m_RgbFrame;
 
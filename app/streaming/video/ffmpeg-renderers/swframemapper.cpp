@@ -1,4 +1,5 @@
 #include "swframemapper.h"
+#include "framepool.h"
 
 SwFrameMapper::SwFrameMapper(IFFmpegRenderer* renderer)
     : m_Renderer(renderer),
@@ -113,7 +114,7 @@ AVFrame* SwFrameMapper::getSwFrameFromHwFrame(AVFrame* hwFrame)
         }
     }
 
-    AVFrame* swFrame = av_frame_alloc();
+    AVFrame* swFrame = FramePool::acquire();
     if (swFrame == nullptr) {
         return nullptr;
     }
@@ -129,7 +130,7 @@ AVFrame* SwFrameMapper::getSwFrameFromHwFrame(AVFrame* hwFrame)
             SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                          "av_hwframe_map() failed: %d",
                          err);
-            av_frame_free(&swFrame);
+            FramePool::release(&swFrame);
             return nullptr;
         }
     }
@@ -139,7 +140,7 @@ AVFrame* SwFrameMapper::getSwFrameFromHwFrame(AVFrame* hwFrame)
             SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                          "av_hwframe_transfer_data() failed: %d",
                          err);
-            av_frame_free(&swFrame);
+            FramePool::release(&swFrame);
             return nullptr;
         }
 
@@ -9,6 +9,10 @@ public:
     void setVideoFormat(int videoFormat);
     AVFrame* getSwFrameFromHwFrame(AVFrame* hwFrame);
 
+    // Mapped frames may point to uncached memory, so callers
+    // should use streaming loads when copying from them.
+    bool isMappingFrames() { return m_MapFrame; }
+
 private:
     bool initializeReadBackFormat(AVBufferRef* hwFrameCtxRef, AVFrame* testFrame);
 
@@ -0,0 +1,447 @@
+#include "yuvtorgb.h"
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define YUV_TO_RGB_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define YUV_TO_RGB_NEON
+#include <arm_neon.h>
+#endif
+
+// Rows are converted in tiles of this many pixels, so the
+// intermediate buffers stay in L1 cache.
+#define TILE_WIDTH 256
+
+// All samples are normalized to 10 bits, then offset and multiplied by 16
+// to make the most of the 16-bit intermediates. Each output channel is
+// computed in 8-bit units with 3 fractional bits by taking the high 16
+// bits of the product of a sample and a coefficient, so the coefficients
+// include all of these scale factors.
+#define SAMPLE_SCALE 16
+#define COEFF_SCALE (255.0 / 1023.0 * 8 * 65536 / SAMPLE_SCALE)
+
+// Widens an 8-bit sample to 10 bits by replicating its high bits into the
+// low bits. This maps 0-255 onto 0-1023 exactly, so it matches the
+// 255 / 1023 scaling in COEFF_SCALE, which a plain shift wouldn't.
+static inline int widen8To10(int value)
+{
+    return (value << 2) | (value >> 6);
+}
+
+YuvToRgbConverter::YuvToRgbConverter(IFFmpegRenderer* renderer)
+    : m_Renderer(renderer),
+      m_PixelFormat(AV_PIX_FMT_NONE),
+      m_ChromaLeftSited(true),
+      m_ChromaVerticalSiting(ChromaVerticalSiting::Center),
+      m_Frame(nullptr),
+      m_Dst(nullptr),
+      m_DstPitch(0),
+      m_WorkerCount(0),
+      m_WorkersDoneSem(nullptr)
+{
+    SDL_AtomicSet(&m_WorkersStopping, 0);
+}
+
+YuvToRgbConverter::~YuvToRgbConverter()
+{
+    SDL_AtomicSet(&m_WorkersStopping, 1);
+
+    for (int i = 0; i < m_WorkerCount; i++) {
+        SDL_SemPost(m_Workers[i].startSem);
+        SDL_WaitThread(m_Workers[i].thread, nullptr);
+        SDL_DestroySemaphore(m_Workers[i].startSem);
+    }
+
+    if (m_WorkersDoneSem != nullptr) {
+        SDL_DestroySemaphore(m_WorkersDoneSem);
+    }
+}
+
+bool YuvToRgbConverter::isPixelFormatSupported(enum AVPixelFormat pixelFormat)
+{
+    switch (pixelFormat) {
+    case AV_PIX_FMT_YUV444P:
+    case AV_PIX_FMT_YUVJ444P:
+    case AV_PIX_FMT_YUV444P10:
+    case AV_PIX_FMT_YUV420P10:
+    case AV_PIX_FMT_P010:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+bool YuvToRgbConverter::initialize(const AVFrame* frame)
+{
+    std::array<float, 9> cscMatrix;
+    std::array<float, 3> offsets;
+    std::array<float, 2> chromaOffsets;
+
+    SDL_assert(isPixelFormatSupported((AVPixelFormat)frame->format));
+    m_PixelFormat = (AVPixelFormat)frame->format;
+
+    // Compute the offsets in the native bit depth, then normalize them
+    // to 10 bits the same way we normalize the samples themselves.
+    int bitsPerChannel = m_Renderer->getFrameBitsPerChannel(frame);
+    int channelMax = (1 << bitsPerChannel) - 1;
+    m_Renderer->getFramePremultipliedCscConstants(frame, cscMatrix, offsets);
+    m_YOffset = (int16_t)lround(offsets[0] * channelMax);
+    m_UvOffset = (int16_t)lround(offsets[1] * channelMax);
+    if (bitsPerChannel == 8) {
+        m_YOffset = (int16_t)widen8To10(m_YOffset);
+        m_UvOffset = (int16_t)widen8To10(m_UvOffset);
+    }
+    else {
+        SDL_assert(bitsPerChannel == 10);
+    }
+
+    // Find where the chroma samples sit relative to luma for 4:2:0 formats
+    m_Renderer->getFrameChromaCositingOffsets(frame, chromaOffsets);
+    m_ChromaLeftSited = chromaOffsets[0] != 0;
+    if (chromaOffsets[1] > 0) {
+        m_ChromaVerticalSiting = ChromaVerticalSiting::Top;
+    }
+    else if (chromaOffsets[1] < 0) {
+        m_ChromaVerticalSiting = ChromaVerticalSiting::Bottom;
+    }
+    else {
+        m_ChromaVerticalSiting = ChromaVerticalSiting::Center;
+    }
+
+    // Y contributes equally to all channels, U doesn't contribute to R,
+    // and V doesn't contribute to B, so we only need 5 coefficients.
+    SDL_assert(cscMatrix[0] == cscMatrix[1] && cscMatrix[1] == cscMatrix[2]);
+    SDL_assert(cscMatrix[3] == 0 && cscMatrix[8] == 0);
+    m_YCoeff = (int16_t)lround(cscMatrix[0] * COEFF_SCALE);
+    m_GuCoeff = (int16_t)lround(cscMatrix[4] * COEFF_SCALE);
+    m_BuCoeff = (int16_t)lround(cscMatrix[5] * COEFF_SCALE);
+    m_RvCoeff = (int16_t)lround(cscMatrix[6] * COEFF_SCALE);
+    m_GvCoeff = (int16_t)lround(cscMatrix[7] * COEFF_SCALE);
+
+    // Spin up our worker threads the first time we're initialized
+    if (m_WorkersDoneSem == nullptr) {
+        m_WorkersDoneSem = SDL_CreateSemaphore(0);
+        if (m_WorkersDoneSem == nullptr) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "SDL_CreateSemaphore() failed: %s",
+                         SDL_GetError());
+            return false;
+        }
+
+        int threadCount = SDL_min(SDL_GetCPUCount(), YUV_TO_RGB_MAX_THREADS);
+        for (int i = 0; i < threadCount - 1; i++) {
+            Worker* worker = &m_Workers[m_WorkerCount];
+
+            worker->converter = this;
+            worker->startSem = SDL_CreateSemaphore(0);
+            if (worker->startSem == nullptr) {
+                break;
+            }
+
+            worker->thread = SDL_CreateThread(YuvToRgbConverter::workerThreadProc, "YuvToRgb", worker);
+            if (worker->thread == nullptr) {
+                SDL_DestroySemaphore(worker->startSem);
+                break;
+            }
+
+            m_WorkerCount++;
+        }
+
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Using %d threads for CPU color conversion",
+                    m_WorkerCount + 1);
+    }
+
+    return true;
+}
+
+int YuvToRgbConverter::workerThreadProc(void* context)
+{
+    Worker* worker = (Worker*)context;
+    YuvToRgbConverter* me = worker->converter;
+
+    for (;;) {
+        SDL_SemWait(worker->startSem);
+        if (SDL_AtomicGet(&me->m_WorkersStopping)) {
+            break;
+        }
+
+        me->convertRows(worker->startRow, worker->endRow);
+        SDL_SemPost(me->m_WorkersDoneSem);
+    }
+
+    return 0;
+}
+
+void YuvToRgbConverter::convertFrame(const AVFrame* frame, uint8_t* dst, int dstPitch)
+{
+    SDL_assert(frame->format == m_PixelFormat);
+
+    m_Frame = frame;
+    m_Dst = dst;
+    m_DstPitch = dstPitch;
+
+    // Split the frame into bands of rows. We take the first band ourselves.
+    int bandHeight = (frame->height + m_WorkerCount) / (m_WorkerCount + 1);
+    int workersStarted = 0;
+    for (int i = 0; i < m_WorkerCount; i++) {
+        int startRow = bandHeight * (i + 1);
+        if (startRow >= frame->height) {
+            break;
+        }
+
+        m_Workers[i].startRow = startRow;
+        m_Workers[i].endRow = SDL_min(startRow + bandHeight, frame->height);
+        SDL_SemPost(m_Workers[i].startSem);
+        workersStarted++;
+    }
+
+    convertRows(0, SDL_min(bandHeight, frame->height));
+
+    for (int i = 0; i < workersStarted; i++) {
+        SDL_SemWait(m_WorkersDoneSem);
+    }
+}
+
+static inline int16_t scaleSample(int value, int16_t offset)
+{
+    return (int16_t)((value - offset) * SAMPLE_SCALE);
+}
+
+// Upsamples 4:2:0 chroma with bilinear filtering. The two chroma rows are
+// blended by row0Weight and 4 - row0Weight to reach the vertical position of
+// our luma row. Horizontally, left-sited chroma lines up with even columns
+// and lies halfway between samples on odd columns, while centered chroma
+// always lies a quarter of the way to the next sample. stride and shift
+// describe how samples are packed.
+static void upsampleChroma420(const uint16_t* row0, const uint16_t* row1, int row0Weight,
+                              int stride, int shift, int chromaWidth, bool leftSited,
+                              int x, int count, int16_t offset, int16_t* out)
+{
+    int row1Weight = 4 - row0Weight;
+
+    // Returns the vertically blended sample in column cx, times 4
+    auto column = [=](int cx) {
+        cx = SDL_clamp(cx, 0, chromaWidth - 1);
+        return row0Weight * (row0[cx * stride] >> shift) + row1Weight * (row1[cx * stride] >> shift);
+    };
+
+    for (int i = 0; i < count; i++) {
+        int lumaX = x + i;
+        int cx = lumaX >> 1;
+        int value;
+
+        if (leftSited) {
+            value = (lumaX & 1) ? 2 * (column(cx) + column(cx + 1)) : 4 * column(cx);
+        }
+        else {
+            value = 3 * column(cx) + column((lumaX & 1) ? cx + 1 : cx - 1);
+        }
+
+        out[i] = scaleSample((value + 8) >> 4, offset);
+    }
+}
+
+template <typename T>
+static inline const T* getRow(const AVFrame* frame, int plane, int row)
+{
+    return (const T*)(frame->data[plane] + (ptrdiff_t)frame->linesize[plane] * row);
+}
+
+static void convertTile(const int16_t* y, const int16_t* u, const int16_t* v, int count,
+                        int16_t yCoeff, int16_t rvCoeff, int16_t guCoeff, int16_t gvCoeff, int16_t buCoeff,
+                        uint8_t* dst)
+{
+    int i = 0;
+
+#if defined(YUV_TO_RGB_SSE2)
+    const __m128i yc = _mm_set1_epi16(yCoeff);
+    const __m128i rvc = _mm_set1_epi16(rvCoeff);
+    const __m128i guc = _mm_set1_epi16(guCoeff);
+    const __m128i gvc = _mm_set1_epi16(gvCoeff);
+    const __m128i buc = _mm_set1_epi16(buCoeff);
+    const __m128i rounding = _mm_set1_epi16(4);
+    const __m128i alpha = _mm_set1_epi8((char)0xFF);
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i ys = _mm_loadu_si128((const __m128i*)(y + i));
+        __m128i us = _mm_loadu_si128((const __m128i*)(u + i));
+        __m128i vs = _mm_loadu_si128((const __m128i*)(v + i));
+
+        __m128i yy = _mm_add_epi16(_mm_mulhi_epi16(ys, yc), rounding);
+        __m128i r = _mm_add_epi16(yy, _mm_mulhi_epi16(vs, rvc));
+        __m128i g = _mm_add_epi16(yy, _mm_add_epi16(_mm_mulhi_epi16(us, guc), _mm_mulhi_epi16(vs, gvc)));
+        __m128i b = _mm_add_epi16(yy, _mm_mulhi_epi16(us, buc));
+
+        // Drop the fractional bits and saturate to 8 bits
+        __m128i r8 = _mm_packus_epi16(_mm_srai_epi16(r, 3), _mm_setzero_si128());
+        __m128i g8 = _mm_packus_epi16(_mm_srai_epi16(g, 3), _mm_setzero_si128());
+        __m128i b8 = _mm_packus_epi16(_mm_srai_epi16(b, 3), _mm_setzero_si128());
+
+        // Interleave into BGRX
+        __m128i bg = _mm_unpacklo_epi8(b8, g8);
+        __m128i rx = _mm_unpacklo_epi8(r8, alpha);
+        _mm_storeu_si128((__m128i*)(dst + i * 4), _mm_unpacklo_epi16(bg, rx));
+        _mm_storeu_si128((__m128i*)(dst + i * 4 + 16), _mm_unpackhi_epi16(bg, rx));
+    }
+#elif defined(YUV_TO_RGB_NEON)
+    const int16x8_t rounding = vdupq_n_s16(4);
+
+    // NEON has no 16-bit multiply high, so widen and narrow instead
+    auto mulhi = [](int16x8_t a, int16_t b) {
+        int32x4_t lo = vmull_n_s16(vget_low_s16(a), b);
+        int32x4_t hi = vmull_n_s16(vget_high_s16(a), b);
+        return vcombine_s16(vshrn_n_s32(lo, 16), vshrn_n_s32(hi, 16));
+    };
+
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t ys = vld1q_s16(y + i);
+        int16x8_t us = vld1q_s16(u + i);
+        int16x8_t vs = vld1q_s16(v + i);
+
+        int16x8_t yy = vaddq_s16(mulhi(ys, yCoeff), rounding);
+        int16x8_t r = vaddq_s16(yy, mulhi(vs, rvCoeff));
+        int16x8_t g = vaddq_s16(yy, vaddq_s16(mulhi(us, guCoeff), mulhi(vs, gvCoeff)));
+        int16x8_t b = vaddq_s16(yy, mulhi(us, buCoeff));
+
+        // Drop the fractional bits, saturate to 8 bits, and interleave into BGRX
+        uint8x8x4_t pixels;
+        pixels.val[0] = vqmovun_s16(vshrq_n_s16(b, 3));
+        pixels.val[1] = vqmovun_s16(vshrq_n_s16(g, 3));
+        pixels.val[2] = vqmovun_s16(vshrq_n_s16(r, 3));
+        pixels.val[3] = vdup_n_u8(0xFF);
+        vst4_u8(dst + i * 4, pixels);
+    }
+#endif
+
+    // Convert any remaining pixels one at a time. This must match the SIMD code above.
+    for (; i < count; i++) {
+        int yy = ((y[i] * yCoeff) >> 16) + 4;
+        int r = yy + ((v[i] * rvCoeff) >> 16);
+        int g = yy + ((u[i] * guCoeff) >> 16) + ((v[i] * gvCoeff) >> 16);
+        int b = yy + ((u[i] * buCoeff) >> 16);
+
+        dst[i * 4 + 0] = (uint8_t)SDL_clamp(b >> 3, 0, 255);
+        dst[i * 4 + 1] = (uint8_t)SDL_clamp(g >> 3, 0, 255);
+        dst[i * 4 + 2] = (uint8_t)SDL_clamp(r >> 3, 0, 255);
+        dst[i * 4 + 3] = 0xFF;
+    }
+}
+
+void YuvToRgbConverter::convertRows(int startRow, int endRow)
+{
+    int16_t y[TILE_WIDTH];
+    int16_t u[TILE_WIDTH];
+    int16_t v[TILE_WIDTH];
+
+    int chromaWidth = (m_Frame->width + 1) >> 1;
+    int chromaHeight = (m_Frame->height + 1) >> 1;
+
+    for (int row = startRow; row < endRow; row++) {
+        // Find the chroma rows to blend for 4:2:0 formats and how much
+        // weight (out of 4) the first one gets at this luma row
+        int chromaRow0, chromaRow1, chromaRow0Weight;
+        switch (m_ChromaVerticalSiting) {
+        case ChromaVerticalSiting::Top:
+            // Even rows line up with chroma and odd rows lie halfway between
+            chromaRow0 = row >> 1;
+            chromaRow1 = (row & 1) ? chromaRow0 + 1 : chromaRow0;
+            chromaRow0Weight = (row & 1) ? 2 : 4;
+            break;
+
+        case ChromaVerticalSiting::Bottom:
+            // Odd rows line up with chroma and even rows lie halfway between
+            chromaRow1 = row >> 1;
+            chromaRow0 = (row & 1) ? chromaRow1 : chromaRow1 - 1;
+            chromaRow0Weight = (row & 1) ? 4 : 2;
+            break;
+
+        case ChromaVerticalSiting::Center:
+        default:
+            // Chroma lies a quarter of the way from the nearest row to the next
+            chromaRow0 = row >> 1;
+            chromaRow1 = (row & 1) ? chromaRow0 + 1 : chromaRow0 - 1;
+            chromaRow0Weight = 3;
+            break;
+        }
+        chromaRow0 = SDL_clamp(chromaRow0, 0, chromaHeight - 1);
+        chromaRow1 = SDL_clamp(chromaRow1, 0, chromaHeight - 1);
+
+        uint8_t* dstRow = m_Dst + (ptrdiff_t)m_DstPitch * row;
+
+        for (int x = 0; x < m_Frame->width; x += TILE_WIDTH) {
+            int count = SDL_min(TILE_WIDTH, m_Frame->width - x);
+
+            switch (m_PixelFormat) {
+            case AV_PIX_FMT_YUV444P:
+            case AV_PIX_FMT_YUVJ444P:
+            {
+                const uint8_t* ySrc = getRow<uint8_t>(m_Frame, 0, row) + x;
+                const uint8_t* uSrc = getRow<uint8_t>(m_Frame, 1, row) + x;
+                const uint8_t* vSrc = getRow<uint8_t>(m_Frame, 2, row) + x;
+                for (int i = 0; i < count; i++) {
+                    y[i] = scaleSample(widen8To10(ySrc[i]), m_YOffset);
+                    u[i] = scaleSample(widen8To10(uSrc[i]), m_UvOffset);
+                    v[i] = scaleSample(widen8To10(vSrc[i]), m_UvOffset);
+                }
+                break;
+            }
+
+            case AV_PIX_FMT_YUV444P10:
+            {
+                const uint16_t* ySrc = getRow<uint16_t>(m_Frame, 0, row) + x;
+                const uint16_t* uSrc = getRow<uint16_t>(m_Frame, 1, row) + x;
+                const uint16_t* vSrc = getRow<uint16_t>(m_Frame, 2, row) + x;
+                for (int i = 0; i < count; i++) {
+                    y[i] = scaleSample(ySrc[i], m_YOffset);
+                    u[i] = scaleSample(uSrc[i], m_UvOffset);
+                    v[i] = scaleSample(vSrc[i], m_UvOffset);
+                }
+                break;
+            }
+
+            case AV_PIX_FMT_YUV420P10:
+            {
+                const uint16_t* ySrc = getRow<uint16_t>(m_Frame, 0, row) + x;
+                for (int i = 0; i < count; i++) {
+                    y[i] = scaleSample(ySrc[i], m_YOffset);
+                }
+                upsampleChroma420(getRow<uint16_t>(m_Frame, 1, chromaRow0),
+                                  getRow<uint16_t>(m_Frame, 1, chromaRow1), chromaRow0Weight,
+                                  1, 0, chromaWidth, m_ChromaLeftSited, x, count, m_UvOffset, u);
+                upsampleChroma420(getRow<uint16_t>(m_Frame, 2, chromaRow0),
+                                  getRow<uint16_t>(m_Frame, 2, chromaRow1), chromaRow0Weight,
+                                  1, 0, chromaWidth, m_ChromaLeftSited, x, count, m_UvOffset, v);
+                break;
+            }
+
+            case AV_PIX_FMT_P010:
+            {
+                // P010 stores samples in the high 10 bits with interleaved chroma
+                const uint16_t* ySrc = getRow<uint16_t>(m_Frame, 0, row) + x;
+                for (int i = 0; i < count; i++) {
+                    y[i] = scaleSample(ySrc[i] >> 6, m_YOffset);
+                }
+                upsampleChroma420(getRow<uint16_t>(m_Frame, 1, chromaRow0),
+                                  getRow<uint16_t>(m_Frame, 1, chromaRow1), chromaRow0Weight,
+                                  2, 6, chromaWidth, m_ChromaLeftSited, x, count, m_UvOffset, u);
+                upsampleChroma420(getRow<uint16_t>(m_Frame, 1, chromaRow0) + 1,
+                                  getRow<uint16_t>(m_Frame, 1, chromaRow1) + 1, chromaRow0Weight,
+                                  2, 6, chromaWidth, m_ChromaLeftSited, x, count, m_UvOffset, v);
+                break;
+            }
+
+            default:
+                SDL_assert(false);
+                return;
+            }
+
+            convertTile(y, u, v, count,
+                        m_YCoeff, m_RvCoeff, m_GuCoeff, m_GvCoeff, m_BuCoeff,
+                        dstRow + x * 4);
+        }
+    }
+}
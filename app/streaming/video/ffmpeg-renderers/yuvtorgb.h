@@ -0,0 +1,71 @@
+#pragma once
+
+#include "renderer.h"
+
+// Maximum number of threads (including the caller) used for conversion
+#define YUV_TO_RGB_MAX_THREADS 4
+
+// Converts planar and semi-planar YUV frames to BGRX for renderers
+// that can't perform color conversion on the GPU. This is much faster
+// than swscale for the handful of formats it supports, because it
+// does the unpacking and matrix multiply in a single pass.
+class YuvToRgbConverter
+{
+public:
+    explicit YuvToRgbConverter(IFFmpegRenderer* renderer);
+    ~YuvToRgbConverter();
+
+    static bool isPixelFormatSupported(enum AVPixelFormat pixelFormat);
+
+    // Prepares to convert frames with the format and color
+    // properties of this frame. Must be called again if they change.
+    bool initialize(const AVFrame* frame);
+
+    // Converts the frame into a BGRX buffer of the same dimensions
+    void convertFrame(const AVFrame* frame, uint8_t* dst, int dstPitch);
+
+private:
+    struct Worker {
+        YuvToRgbConverter* converter;
+        SDL_Thread* thread;
+        SDL_sem* startSem;
+        int startRow;
+        int endRow;
+    };
+
+    static int workerThreadProc(void* context);
+
+    void convertRows(int startRow, int endRow);
+
+    enum class ChromaVerticalSiting {
+        Center,
+        Top,
+        Bottom,
+    };
+
+    IFFmpegRenderer* m_Renderer;
+    enum AVPixelFormat m_PixelFormat;
+
+    // Position of 4:2:0 chroma samples relative to luma (see initialize())
+    bool m_ChromaLeftSited;
+    ChromaVerticalSiting m_ChromaVerticalSiting;
+
+    // Fixed-point conversion constants (see initialize())
+    int16_t m_YOffset;
+    int16_t m_UvOffset;
+    int16_t m_YCoeff;
+    int16_t m_RvCoeff;
+    int16_t m_GuCoeff;
+    int16_t m_GvCoeff;
+    int16_t m_BuCoeff;
+
+    // Parameters of the frame currently being converted
+    const AVFrame* m_Frame;
+    uint8_t* m_Dst;
+    int m_DstPitch;
+
+    Worker m_Workers[YUV_TO_RGB_MAX_THREADS - 1];
+    int m_WorkerCount;
+    SDL_sem* m_WorkersDoneSem;
+    SDL_atomic_t m_WorkersStopping;
+};
@@ -7,11 +7,13 @@
 
 extern "C" {
 #include <libavutil/mastering_display_metadata.h>
+#include <libavutil/opt.h>
 #include <libavutil/pixdesc.h>
 }
 
 #include "ffmpeg-renderers/sdlvid.h"
 #include "ffmpeg-renderers/genhwaccel.h"
+#include "ffmpeg-renderers/framepool.h"
 
 #ifdef Q_OS_WIN32
 #include "ffmpeg-renderers/dxva2.h"
@@ -57,8 +59,29 @@ extern "C" {
 
 #define MAX_SPS_EXTRA_SIZE 16
 
+// Initial size of each packet buffer. The pool will be recreated
+// with larger buffers if we receive a frame that doesn't fit.
+#define INITIAL_PACKET_BUFFER_SIZE (1024 * 1024)
+
 #define FAILED_DECODES_RESET_THRESHOLD 20
 
+// Decoders that complete frames asynchronously (hardware decoders and
+// frame-threaded software decoders) can't notify us when output is ready,
+// so we must wake up periodically while waiting for output from them.
+#define ASYNC_DECODER_OUTPUT_POLL_MS 2
+
+// Other decoders only produce output in response to new input, so this is
+// just a safety net in case we miss a wakeup.
+#define DECODER_OUTPUT_POLL_MS 100
+
+// Upper bound on the number of frames of latency that software
+// decoding may add in exchange for more parallelism.
+#define MAX_SW_DECODE_LATENCY_BUDGET 8
+
+// Streams at or above this pixel rate (1440p60) are heavy enough that
+// slice threading alone may not keep up on a CPU decoder.
+#define HEAVY_SW_DECODE_PIXEL_RATE (2560LL * 1440 * 60)
+
 bool FFmpegVideoDecoder::isHardwareAccelerated()
 {
     return m_HwDecodeCfg != nullptr ||
@@ -221,15 +244,23 @@ FFmpegVideoDecoder::FFmpegVideoDecoder(bool testOnly)
     : m_Pkt(av_packet_alloc()),
       m_VideoDecoderCtx(nullptr),
       m_RequiredPixelFormat(AV_PIX_FMT_NONE),
-      m_DecodeBuffer(1024 * 1024, 0),
+      m_PacketBufferPool(nullptr),
+      m_PacketBufferPoolSize(0),
       m_HwDecodeCfg(nullptr),
       m_BackendRenderer(nullptr),
       m_FrontendRenderer(nullptr),
       m_ConsecutiveFailedDecodes(0),
       m_Pacer(nullptr),
-      m_BwTracker(10, 250),
+      m_FrameTracer(nullptr),
+      m_OwnedFrameTracer(nullptr),
+      m_BwTracker(nullptr),
+      m_OwnedBwTracker(10, 250),
+      m_BitrateController(nullptr),
       m_FramesIn(0),
       m_FramesOut(0),
+      m_SwDecodeThreading(SwDecodeThreading::None),
+      m_SwDecodeThreadCount(1),
+      m_SwDecodeLatencyBudget(0),
       m_LastFrameNumber(0),
       m_StreamFps(0),
       m_VideoFormat(0),
@@ -243,6 +274,12 @@ FFmpegVideoDecoder::FFmpegVideoDecoder(bool testOnly)
     SDL_zero(m_GlobalVideoStats);
 
     SDL_AtomicSet(&m_DecoderThreadShouldQuit, 0);
+    SDL_AtomicSet(&m_DecoderThreadWaitingForOutput, 0);
+
+    // Record video bytes alongside the session's other streams. Test decoders
+    // and those without a session (like tests/decodebench) keep their own.
+    Session* session = Session::get();
+    m_BwTracker = (session != nullptr && !testOnly) ? &session->getBandwidthTracker() : &m_OwnedBwTracker;
 }
 
 FFmpegVideoDecoder::~FFmpegVideoDecoder()
@@ -256,6 +293,9 @@ FFmpegVideoDecoder::~FFmpegVideoDecoder()
     av_log_set_level(AV_LOG_INFO);
 
     av_packet_free(&m_Pkt);
+
+    // Outstanding packet buffers (if any) keep the pool alive until they're released
+    av_buffer_pool_uninit(&m_PacketBufferPool);
 }
 
 IFFmpegRenderer* FFmpegVideoDecoder::getBackendRenderer()
@@ -288,10 +328,18 @@ void FFmpegVideoDecoder::reset()
     // need to delete in the renderer destructor.
     avcodec_free_context(&m_VideoDecoderCtx);
 
-    if (m_CurrentTestMode != TestMode::TestFrameOnly) {
+    if (m_CurrentTestMode != TestMode::TestFrameOnly && Session::get() != nullptr) {
         Session::get()->getOverlayManager().setOverlayRenderer(nullptr);
     }
 
+    // The pacer and decoder thread are gone, so the trace is complete
+    if (m_OwnedFrameTracer != nullptr) {
+        m_OwnedFrameTracer->writeTraceFile();
+        delete m_OwnedFrameTracer;
+        m_OwnedFrameTracer = nullptr;
+    }
+    m_FrameTracer = nullptr;
+
     // If we have a separate frontend renderer, free that first
     if (m_FrontendRenderer != m_BackendRenderer) {
         delete m_FrontendRenderer;
@@ -308,6 +356,13 @@ void FFmpegVideoDecoder::reset()
         // Test-only decoders can't have any frames submitted
         SDL_assert(m_GlobalVideoStats.totalFrames == 0);
     }
+
+    delete m_BitrateController;
+    m_BitrateController = nullptr;
+
+    // The pacer and renderers have released all of their frames by now,
+    // so don't keep the pooled ones around after the decoder is gone.
+    FramePool::drain();
 }
 
 bool FFmpegVideoDecoder::initializeRendererInternal(IFFmpegRenderer* renderer, PDECODER_PARAMETERS params)
@@ -477,6 +532,101 @@ bool FFmpegVideoDecoder::createFrontendRenderer(PDECODER_PARAMETERS params, bool
     return true;
 }
 
+void FFmpegVideoDecoder::configureSoftwareDecodeThreading(const AVCodec* decoder, PDECODER_PARAMETERS params)
+{
+    int cpuCount = SDL_GetCPUCount();
+    int sliceThreads = qMin(MAX_SLICES, cpuCount);
+    int mode;
+
+    // The latency budget is the number of frames of delay that we're
+    // willing to add to get more decoding parallelism. By default, we
+    // don't add any latency.
+    if (!Utils::getEnvironmentVariableOverride("SW_DECODE_LATENCY_BUDGET", &m_SwDecodeLatencyBudget)) {
+        m_SwDecodeLatencyBudget = 0;
+    }
+    m_SwDecodeLatencyBudget = qBound(0, m_SwDecodeLatencyBudget, MAX_SW_DECODE_LATENCY_BUDGET);
+
+    // 0 = auto, 1 = slice, 2 = frame, 3 = hybrid
+    if (!Utils::getEnvironmentVariableOverride("SW_DECODE_THREADING", &mode)) {
+        mode = 0;
+    }
+
+    if (mode == 0) {
+        long long pixelRate = (long long)params->width * params->height * params->frameRate;
+
+        if (strcmp(decoder->name, "libdav1d") == 0) {
+            // dav1d schedules its own frame and tile threads. We just need
+            // to give it the threads and tell it how many frames it can
+            // have in flight.
+            mode = 3;
+        }
+        else if (m_SwDecodeLatencyBudget + 1 > sliceThreads &&
+                 pixelRate >= HEAVY_SW_DECODE_PIXEL_RATE &&
+                 (getAVCodecCapabilities(decoder) & AV_CODEC_CAP_FRAME_THREADS)) {
+            // Our encoder slice count caps slice threading at MAX_SLICES
+            // threads, so frame threading can only help if the budget
+            // allows more frames in flight than that.
+            mode = 2;
+        }
+        else {
+            mode = 1;
+        }
+    }
+
+    switch (mode) {
+    case 2:
+        m_SwDecodeThreading = SwDecodeThreading::Frame;
+        m_SwDecodeThreadCount = qMin(m_SwDecodeLatencyBudget + 1, cpuCount);
+        m_SwDecodeLatencyBudget = m_SwDecodeThreadCount - 1;
+        m_VideoDecoderCtx->thread_type = FF_THREAD_FRAME;
+        m_VideoDecoderCtx->thread_count = m_SwDecodeThreadCount;
+
+        // FFmpeg refuses to use frame threading in low delay mode
+        m_VideoDecoderCtx->flags &= ~AV_CODEC_FLAG_LOW_DELAY;
+        break;
+
+    case 3:
+        m_SwDecodeThreading = SwDecodeThreading::Hybrid;
+        m_SwDecodeThreadCount = cpuCount;
+        m_VideoDecoderCtx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+        m_VideoDecoderCtx->thread_count = m_SwDecodeThreadCount;
+
+        // A max frame delay of 1 means no frames are buffered
+        if (av_opt_set_int(m_VideoDecoderCtx->priv_data, "max_frame_delay", m_SwDecodeLatencyBudget + 1, 0) < 0) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "%s doesn't support a frame delay limit",
+                        decoder->name);
+            m_SwDecodeThreading = SwDecodeThreading::Slice;
+            m_SwDecodeThreadCount = sliceThreads;
+            m_SwDecodeLatencyBudget = 0;
+            m_VideoDecoderCtx->thread_type = FF_THREAD_SLICE;
+            m_VideoDecoderCtx->thread_count = m_SwDecodeThreadCount;
+        }
+        else if (m_SwDecodeLatencyBudget > 0) {
+            // libdav1d forces a max frame delay of 1 in low delay mode,
+            // which would silently override our latency budget.
+            m_VideoDecoderCtx->flags &= ~AV_CODEC_FLAG_LOW_DELAY;
+        }
+        break;
+
+    default:
+        SDL_assert(mode == 1);
+        m_SwDecodeThreading = SwDecodeThreading::Slice;
+        m_SwDecodeThreadCount = sliceThreads;
+        m_SwDecodeLatencyBudget = 0;
+        m_VideoDecoderCtx->thread_type = FF_THREAD_SLICE;
+        m_VideoDecoderCtx->thread_count = m_SwDecodeThreadCount;
+        break;
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Software decoding with %s threading: %d threads, up to %d frames of added latency",
+                m_SwDecodeThreading == SwDecodeThreading::Frame ? "frame" :
+                    (m_SwDecodeThreading == SwDecodeThreading::Hybrid ? "hybrid" : "slice"),
+                m_SwDecodeThreadCount,
+                m_SwDecodeLatencyBudget);
+}
+
 bool FFmpegVideoDecoder::completeInitialization(const AVCodec* decoder, enum AVPixelFormat requiredFormat, PDECODER_PARAMETERS params, TestMode testMode, bool useAlternateFrontend)
 {
     // In test-only mode, we should only see test frames
@@ -496,7 +646,17 @@ bool FFmpegVideoDecoder::completeInitialization(const AVCodec* decoder, enum AVP
 
     // Don't bother initializing Pacer if we're not actually going to render
     if (testMode != TestMode::TestFrameOnly) {
-        m_Pacer = new Pacer(m_FrontendRenderer, &m_ActiveWndVideoStats);
+        Session* session = Session::get();
+        if (session != nullptr) {
+            m_FrameTracer = session->getFrameTracer();
+            m_BitrateController = new BitrateController(session->getStreamBitrateKbps(), params->frameRate);
+        }
+        else {
+            // We can also decode without a session (like the offline benchmark
+            // in tests/decodebench), so trace frames ourselves in that case.
+            m_FrameTracer = m_OwnedFrameTracer = FrameTracer::create();
+        }
+        m_Pacer = new Pacer(m_FrontendRenderer, &m_ActiveWndVideoStats, m_FrameTracer);
         if (!m_Pacer->initialize(params->window, params->frameRate,
                                  params->enableFramePacing || (params->enableVsync && (m_FrontendRenderer->getRendererAttributes() & RENDERER_ATTRIBUTE_FORCE_PACING)))) {
             return false;
@@ -526,13 +686,15 @@ bool FFmpegVideoDecoder::completeInitialization(const AVCodec* decoder, enum AVP
     // runs out of output buffers.
     m_VideoDecoderCtx->err_recognition = AV_EF_EXPLODE;
 
-    // Enable slice multi-threading for software decoding
+    // Pick a multi-threading strategy for software decoding
     if (!isHardwareAccelerated()) {
-        m_VideoDecoderCtx->thread_type = FF_THREAD_SLICE;
-        m_VideoDecoderCtx->thread_count = qMin(MAX_SLICES, SDL_GetCPUCount());
+        configureSoftwareDecodeThreading(decoder, params);
     }
     else {
         // No threading for HW decode
+        m_SwDecodeThreading = SwDecodeThreading::None;
+        m_SwDecodeThreadCount = 1;
+        m_SwDecodeLatencyBudget = 0;
         m_VideoDecoderCtx->thread_count = 1;
     }
 
@@ -652,8 +814,9 @@ bool FFmpegVideoDecoder::completeInitialization(const AVCodec* decoder, enum AVP
         }
 
         // Some decoders won't output on the first frame, so we'll submit
-        // a few test frames if we get an EAGAIN error.
-        for (int retries = 0; retries < 5; retries++) {
+        // a few test frames if we get an EAGAIN error. Frame-threaded
+        // decoders also need one extra frame per frame of added latency.
+        for (int retries = 0; retries < 5 + m_SwDecodeLatencyBudget; retries++) {
             // Most FFmpeg decoders process input using a "push" model.
             // We'll see those fail here if the format is not supported.
             err = avcodec_send_packet(m_VideoDecoderCtx, m_Pkt);
@@ -675,8 +838,11 @@ bool FFmpegVideoDecoder::completeInitialization(const AVCodec* decoder, enum AVP
             err = avcodec_receive_frame(m_VideoDecoderCtx, frame);
 #endif
             if (err == AVERROR(EAGAIN)) {
-                // Wait a little while to let the hardware work
-                SDL_Delay(100);
+                // Wait a little while to let the hardware work, unless we're
+                // still filling a frame-threaded decoder's pipeline
+                if (retries >= m_SwDecodeLatencyBudget) {
+                    SDL_Delay(100);
+                }
             }
             else {
                 // Done!
@@ -724,7 +890,9 @@ bool FFmpegVideoDecoder::completeInitialization(const AVCodec* decoder, enum AVP
         }
 
         // Tell overlay manager to use this frontend renderer
-        Session::get()->getOverlayManager().setOverlayRenderer(m_FrontendRenderer);
+        if (Session::get() != nullptr) {
+            Session::get()->getOverlayManager().setOverlayRenderer(m_FrontendRenderer);
+        }
 
         // Allow the renderer to perform final preparations for rendering
         m_FrontendRenderer->prepareToRender();
@@ -766,6 +934,18 @@ void FFmpegVideoDecoder::addVideoStats(VIDEO_STATS& src, VIDEO_STATS& dst)
     dst.totalDecodeTimeUs += src.totalDecodeTimeUs;
     dst.totalPacerTimeUs += src.totalPacerTimeUs;
     dst.totalRenderTimeUs += src.totalRenderTimeUs;
+    dst.copiedBytes += src.copiedBytes;
+    dst.frameAllocations += src.frameAllocations;
+    dst.totalDecoderBusyTimeUs += src.totalDecoderBusyTimeUs;
+    dst.totalDecoderQueuedFrames += src.totalDecoderQueuedFrames;
+    for (int i = 0; i < DECODER_WAKE_LATENCY_BUCKETS; i++) {
+        dst.decoderWakeLatency[i] += src.decoderWakeLatency[i];
+    }
+    dst.hostProcessingLatencyHistogram.add(src.hostProcessingLatencyHistogram);
+    dst.reassemblyTimeHistogram.add(src.reassemblyTimeHistogram);
+    dst.decodeTimeHistogram.add(src.decodeTimeHistogram);
+    dst.pacerTimeHistogram.add(src.pacerTimeHistogram);
+    dst.renderTimeHistogram.add(src.renderTimeHistogram);
 
     if (dst.minHostProcessingLatency == 0) {
         dst.minHostProcessingLatency = src.minHostProcessingLatency;
@@ -802,6 +982,19 @@ void FFmpegVideoDecoder::addVideoStats(VIDEO_STATS& src, VIDEO_STATS& dst)
     dst.renderedFps     = (double)dst.renderedFrames / timeDiffSecs;
 }
 
+static int stringifyLatencyHistogram(char* output, int length, const char* name, const LatencyHistogram& histogram)
+{
+    return snprintf(output,
+                    length,
+                    "%s (avg/p50/p95/p99/max): %.2f/%.2f/%.2f/%.2f/%.2f ms\n",
+                    name,
+                    histogram.getAverageUs() / 1000.0,
+                    histogram.getPercentileUs(50) / 1000.0,
+                    histogram.getPercentileUs(95) / 1000.0,
+                    histogram.getPercentileUs(99) / 1000.0,
+                    histogram.maxUs / 1000.0);
+}
+
 void FFmpegVideoDecoder::stringifyVideoStats(VIDEO_STATS& stats, char* output, int length)
 {
     int offset = 0;
@@ -882,8 +1075,8 @@ void FFmpegVideoDecoder::stringifyVideoStats(VIDEO_STATS& stats, char* output, i
     if (stats.receivedFps > 0) {
         if (m_VideoDecoderCtx != nullptr) {
 #ifdef DISPLAY_BITRATE
-            double avgVideoMbps = m_BwTracker.GetAverageMbps();
-            double peakVideoMbps = m_BwTracker.GetPeakMbps();
+            double avgVideoMbps = m_BwTracker->GetAverageMbps(Session::BW_SERIES_VIDEO);
+            double peakVideoMbps = m_BwTracker->GetPeakMbps(Session::BW_SERIES_VIDEO);
 #endif
 
             ret = snprintf(&output[offset],
@@ -900,7 +1093,7 @@ void FFmpegVideoDecoder::stringifyVideoStats(VIDEO_STATS& stats, char* output, i
 #ifdef DISPLAY_BITRATE
                            ,
                            avgVideoMbps,
-                           m_BwTracker.GetWindowSeconds(),
+                           m_BwTracker->GetWindowSeconds(),
                            peakVideoMbps
 #endif
                            );
@@ -929,12 +1122,10 @@ void FFmpegVideoDecoder::stringifyVideoStats(VIDEO_STATS& stats, char* output, i
     }
 
     if (stats.framesWithHostProcessingLatency > 0) {
-        ret = snprintf(&output[offset],
-                       length - offset,
-                       "Host processing latency min/max/average: %.1f/%.1f/%.1f ms\n",
-                       (float)stats.minHostProcessingLatency / 10,
-                       (float)stats.maxHostProcessingLatency / 10,
-                       (float)stats.totalHostProcessingLatency / 10 / stats.framesWithHostProcessingLatency);
+        ret = stringifyLatencyHistogram(&output[offset],
+                                        length - offset,
+                                        "Host processing latency",
+                                        stats.hostProcessingLatencyHistogram);
         if (ret < 0 || ret >= length - offset) {
             SDL_assert(false);
             return;
@@ -957,16 +1148,136 @@ void FFmpegVideoDecoder::stringifyVideoStats(VIDEO_STATS& stats, char* output, i
                        length - offset,
                        "Frames dropped by your network connection: %.2f%%\n"
                        "Frames dropped due to network jitter: %.2f%%\n"
-                       "Average network latency: %s\n"
-                       "Average decoding time: %.2f ms\n"
-                       "Average frame queue delay: %.2f ms\n"
-                       "Average rendering time (including monitor V-sync latency): %.2f ms\n",
+                       "Average network latency: %s\n",
                        (float)stats.networkDroppedFrames / stats.totalFrames * 100,
                        (float)stats.pacerDroppedFrames / stats.decodedFrames * 100,
-                       rttString,
-                       (double)(stats.totalDecodeTimeUs / 1000.0) / stats.decodedFrames,
-                       (double)(stats.totalPacerTimeUs / 1000.0) / stats.renderedFrames,
-                       (double)(stats.totalRenderTimeUs / 1000.0) / stats.renderedFrames);
+                       rttString);
+        if (ret < 0 || ret >= length - offset) {
+            SDL_assert(false);
+            return;
+        }
+
+        offset += ret;
+
+        const struct {
+            const char* name;
+            const LatencyHistogram& histogram;
+        } latencies[] = {
+            { "Frame reassembly time", stats.reassemblyTimeHistogram },
+            { "Decoding time", stats.decodeTimeHistogram },
+            { "Frame queue delay", stats.pacerTimeHistogram },
+            { "Rendering time with V-sync", stats.renderTimeHistogram },
+        };
+
+        for (const auto& latency : latencies) {
+            ret = stringifyLatencyHistogram(&output[offset],
+                                            length - offset,
+                                            latency.name,
+                                            latency.histogram);
+            if (ret < 0 || ret >= length - offset) {
+                SDL_assert(false);
+                return;
+            }
+
+            offset += ret;
+        }
+    }
+
+    if (stats.receivedFrames != 0) {
+        uint32_t wakeups = 0;
+        for (int i = 0; i < DECODER_WAKE_LATENCY_BUCKETS; i++) {
+            wakeups += stats.decoderWakeLatency[i];
+        }
+
+        // Keep this in sync with DECODER_WAKE_LATENCY_BUCKETS
+        static_assert(DECODER_WAKE_LATENCY_BUCKETS == 6, "Update wake latency histogram string");
+        ret = snprintf(&output[offset],
+                       length - offset,
+                       "Decoder wakeup latency (<0.25/0.5/1/2/4/4+ ms): %.0f/%.0f/%.0f/%.0f/%.0f/%.0f%%\n",
+                       (float)stats.decoderWakeLatency[0] / wakeups * 100,
+                       (float)stats.decoderWakeLatency[1] / wakeups * 100,
+                       (float)stats.decoderWakeLatency[2] / wakeups * 100,
+                       (float)stats.decoderWakeLatency[3] / wakeups * 100,
+                       (float)stats.decoderWakeLatency[4] / wakeups * 100,
+                       (float)stats.decoderWakeLatency[5] / wakeups * 100);
+        if (ret < 0 || ret >= length - offset) {
+            SDL_assert(false);
+            return;
+        }
+
+        offset += ret;
+    }
+
+    if (stats.decodedFrames != 0 && stats.decodedFps > 0 && m_SwDecodeThreading != SwDecodeThreading::None) {
+        const char* threadingString;
+        double addedLatencyFrames = (double)stats.totalDecoderQueuedFrames / stats.decodedFrames;
+        double windowUs = stats.decodedFrames / stats.decodedFps * 1000000.0;
+
+        switch (m_SwDecodeThreading) {
+        case SwDecodeThreading::Frame:
+            threadingString = "frame";
+            break;
+        case SwDecodeThreading::Hybrid:
+            threadingString = "hybrid";
+            break;
+        default:
+            threadingString = "slice";
+            break;
+        }
+
+        // FFmpeg doesn't expose its worker threads, so we can only measure
+        // how much of the time our decoder thread is blocked in libavcodec.
+        ret = snprintf(&output[offset],
+                       length - offset,
+                       "Software decoder: %s threading, %d threads (decoder thread busy: %.0f%%)\n"
+                       "Decoder added latency: %.2f frames (%.2f ms, budget: %d frames)\n",
+                       threadingString,
+                       m_SwDecodeThreadCount,
+                       qMin(stats.totalDecoderBusyTimeUs / windowUs * 100, 100.0),
+                       addedLatencyFrames,
+                       m_StreamFps > 0 ? addedLatencyFrames * 1000.0 / m_StreamFps : 0.0,
+                       m_SwDecodeLatencyBudget);
+        if (ret < 0 || ret >= length - offset) {
+            SDL_assert(false);
+            return;
+        }
+
+        offset += ret;
+    }
+
+    if (m_BitrateController != nullptr && m_BitrateController->getRecommendedBitrateKbps() != m_BitrateController->getConfiguredBitrateKbps()) {
+        ret = snprintf(&output[offset],
+                       length - offset,
+                       "Recommended bitrate: %.1f Mbps (configured: %.1f Mbps, %s)\n",
+                       m_BitrateController->getRecommendedBitrateKbps() / 1000.0,
+                       m_BitrateController->getConfiguredBitrateKbps() / 1000.0,
+                       m_BitrateController->getReason());
+        if (ret < 0 || ret >= length - offset) {
+            SDL_assert(false);
+            return;
+        }
+
+        offset += ret;
+    }
+
+    if (m_BitrateController != nullptr && m_BitrateController->isDecoderOverloaded()) {
+        ret = snprintf(&output[offset],
+                       length - offset,
+                       "Decoder can't keep up: reduce resolution or frame rate\n");
+        if (ret < 0 || ret >= length - offset) {
+            SDL_assert(false);
+            return;
+        }
+
+        offset += ret;
+    }
+
+    // Steady state streaming should never need to allocate frames
+    if (stats.frameAllocations != 0) {
+        ret = snprintf(&output[offset],
+                       length - offset,
+                       "Frames allocated outside pool: %u\n",
+                       stats.frameAllocations);
         if (ret < 0 || ret >= length - offset) {
             SDL_assert(false);
             return;
@@ -979,12 +1290,19 @@ void FFmpegVideoDecoder::stringifyVideoStats(VIDEO_STATS& stats, char* output, i
 void FFmpegVideoDecoder::logVideoStats(VIDEO_STATS& stats, const char* title)
 {
     if (stats.renderedFps > 0 || stats.renderedFrames != 0) {
-        char videoStatsStr[512];
+        char videoStatsStr[2048];
         stringifyVideoStats(stats, videoStatsStr, sizeof(videoStatsStr));
 
         SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
                     "\n%s\n------------------\n%s",
                     title, videoStatsStr);
+
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Frame data copied during reassembly: %.1f MB",
+                    stats.copiedBytes / 1000000.0);
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Frames allocated outside the frame pool: %u",
+                    stats.frameAllocations);
     }
 }
 
@@ -1750,7 +2068,40 @@ bool FFmpegVideoDecoder::initialize(PDECODER_PARAMETERS params)
     return false;
 }
 
-void FFmpegVideoDecoder::writeBuffer(PLENTRY entry, int& offset)
+AVBufferRef* FFmpegVideoDecoder::getPacketBuffer(int size)
+{
+    // The decoder requires zeroed padding at the end of the packet data
+    size += AV_INPUT_BUFFER_PADDING_SIZE;
+
+    if (size > m_PacketBufferPoolSize) {
+        int newPoolSize = SDL_max(m_PacketBufferPoolSize, INITIAL_PACKET_BUFFER_SIZE);
+        while (newPoolSize < size) {
+            newPoolSize *= 2;
+        }
+
+        if (m_PacketBufferPool != nullptr) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Growing packet buffers from %d to %d bytes",
+                        m_PacketBufferPoolSize,
+                        newPoolSize);
+        }
+
+        // Buffers from the old pool that are still referenced by
+        // the decoder will free the old pool when released.
+        av_buffer_pool_uninit(&m_PacketBufferPool);
+        m_PacketBufferPool = av_buffer_pool_init(newPoolSize, nullptr);
+        if (m_PacketBufferPool == nullptr) {
+            m_PacketBufferPoolSize = 0;
+            return nullptr;
+        }
+
+        m_PacketBufferPoolSize = newPoolSize;
+    }
+
+    return av_buffer_pool_get(m_PacketBufferPool);
+}
+
+void FFmpegVideoDecoder::writeBuffer(uint8_t* buffer, PLENTRY entry, int& offset)
 {
     if (m_NeedsSpsFixup && entry->bufferType == BUFFER_TYPE_SPS) {
         h264_stream_t* stream = h264_new();
@@ -1788,18 +2139,18 @@ void FFmpegVideoDecoder::writeBuffer(PLENTRY entry, int& offset)
 
         // Copy the modified NALU data. This clobbers byte 0 and starts NALU data at byte 1.
         // Since it prepended one extra byte, subtract one from the returned length.
-        offset += write_nal_unit(stream, (uint8_t*)&m_DecodeBuffer.data()[initialOffset + nalStart - 1],
+        offset += write_nal_unit(stream, &buffer[initialOffset + nalStart - 1],
                                  MAX_SPS_EXTRA_SIZE + entry->length - nalStart) - 1;
 
         // Copy the NALU prefix over from the original SPS
-        memcpy(&m_DecodeBuffer.data()[initialOffset], entry->data, nalStart);
+        memcpy(&buffer[initialOffset], entry->data, nalStart);
         offset += nalStart;
 
         h264_free(stream);
     }
     else {
         // Write the buffer as-is
-        memcpy(&m_DecodeBuffer.data()[offset],
+        memcpy(&buffer[offset],
                entry->data,
                entry->length);
         offset += entry->length;
@@ -1812,8 +2163,37 @@ int FFmpegVideoDecoder::decoderThreadProcThunk(void *context)
     return 0;
 }
 
+Uint32 FFmpegVideoDecoder::decoderThreadWakeTimerCallback(Uint32, void* param)
+{
+    auto me = reinterpret_cast<FFmpegVideoDecoder*>(param);
+
+    // Interrupt the decoder thread's wait in LiWaitForNextVideoFrame()
+    // if it's still waiting for output. The decoder thread removes this
+    // timer when its wait completes, so we can only race with the end of
+    // the wait. If we lose, the next wait returns early without a frame,
+    // which the decoder thread tolerates.
+    if (SDL_AtomicGet(&me->m_DecoderThreadWaitingForOutput)) {
+        LiWakeWaitForVideoFrame();
+    }
+
+    // The decoder thread arms a new timer for each wait
+    return 0;
+}
+
 void FFmpegVideoDecoder::decoderThreadProc()
 {
+    // Frame-threaded decoders finish frames on their worker threads, so
+    // they need to be polled just like hardware decoders. libdav1d runs its
+    // own threads, so active_thread_type doesn't show it, but it holds
+    // frames back the same way when we give it a latency budget.
+    bool asyncOutput = (getAVCodecCapabilities(m_VideoDecoderCtx->codec) & AV_CODEC_CAP_HARDWARE) ||
+                       (m_VideoDecoderCtx->active_thread_type & FF_THREAD_FRAME) ||
+                       (m_SwDecodeThreading == SwDecodeThreading::Hybrid && m_SwDecodeLatencyBudget > 0);
+    Uint32 outputPollMs = asyncOutput ? ASYNC_DECODER_OUTPUT_POLL_MS : DECODER_OUTPUT_POLL_MS;
+    bool loggedTimerFailure = false;
+
+    SDL_AtomicSet(&m_DecoderThreadWaitingForOutput, 0);
+
     while (!SDL_AtomicGet(&m_DecoderThreadShouldQuit)) {
         if (m_FramesIn == m_FramesOut) {
             VIDEO_FRAME_HANDLE handle;
@@ -1834,7 +2214,7 @@ void FFmpegVideoDecoder::decoderThreadProc()
 
             // We have output frames to receive. Let's poll until we get one,
             // and submit new input data if/when we get it.
-            AVFrame* frame = av_frame_alloc();
+            AVFrame* frame = FramePool::acquire();
             if (!frame) {
                 // Failed to allocate a frame but we did submit,
                 // so we can return DR_OK
@@ -1845,11 +2225,16 @@ void FFmpegVideoDecoder::decoderThreadProc()
 
             int err;
             do {
+                uint64_t receiveStartUs = LiGetMicroseconds();
                 err = avcodec_receive_frame(m_VideoDecoderCtx, frame);
+                m_ActiveWndVideoStats.totalDecoderBusyTimeUs += LiGetMicroseconds() - receiveStartUs;
                 if (err == 0) {
                     SDL_assert(m_FrameInfoQueue.size() == m_FramesIn - m_FramesOut);
                     m_FramesOut++;
 
+                    // Any frames still inside the decoder are latency added by it
+                    m_ActiveWndVideoStats.totalDecoderQueuedFrames += m_FramesIn - m_FramesOut;
+
                     // Attach HDR metadata to the frame if it's not already present. We will defer to
                     // any metadata contained in the bitstream itself since that is guaranteed to be
                     // correctly synchronized to each frame, unlike our async HDR metadata message.
@@ -1926,7 +2311,16 @@ void FFmpegVideoDecoder::decoderThreadProc()
                         // Count time in avcodec_send_packet() and avcodec_receive_frame()
                         // as time spent decoding. Also count time spent in the decode unit
                         // queue because that's directly caused by decoder latency.
-                        m_ActiveWndVideoStats.totalDecodeTimeUs += (LiGetMicroseconds() - du.enqueueTimeUs);
+                        uint64_t decodeTimeUs = LiGetMicroseconds() - du.enqueueTimeUs;
+                        m_ActiveWndVideoStats.totalDecodeTimeUs += decodeTimeUs;
+                        m_ActiveWndVideoStats.decodeTimeHistogram.record(decodeTimeUs);
+
+                        if (m_FrameTracer != nullptr) {
+                            m_FrameTracer->traceDecodeEnd(du.frameNumber, (uint64_t)frame->pkt_dts);
+
+                            // Tag the frame so the pacer can trace it too
+                            frame->opaque = (void*)(uintptr_t)du.frameNumber;
+                        }
 
                         // Store the presentation time (90 kHz timebase)
                         frame->pts = (int64_t)du.rtpTimestamp;
@@ -1948,8 +2342,34 @@ void FFmpegVideoDecoder::decoderThreadProc()
                         LiCompleteVideoFrame(handle, submitDecodeUnit(du));
                     }
                     else {
-                        // No output data or input data. Let's wait a little bit.
-                        SDL_Delay(2);
+                        // No output data or input data. Block until new input arrives
+                        // or a one-shot timer wakes us to check for output again. The
+                        // timer is only armed during this wait, so the decoder thread
+                        // doesn't wake up at all while it's idle waiting for input.
+                        SDL_AtomicSet(&m_DecoderThreadWaitingForOutput, 1);
+                        SDL_TimerID wakeTimer = SDL_AddTimer(outputPollMs, decoderThreadWakeTimerCallback, this);
+                        if (wakeTimer == 0) {
+                            SDL_AtomicSet(&m_DecoderThreadWaitingForOutput, 0);
+
+                            if (!loggedTimerFailure) {
+                                SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                                            "SDL_AddTimer() failed: %s",
+                                            SDL_GetError());
+                                loggedTimerFailure = true;
+                            }
+
+                            // Fall back to polling if we couldn't create the timer
+                            SDL_Delay(ASYNC_DECODER_OUTPUT_POLL_MS);
+                        }
+                        else {
+                            bool gotFrame = LiWaitForNextVideoFrame(&handle, &du);
+                            SDL_AtomicSet(&m_DecoderThreadWaitingForOutput, 0);
+                            SDL_RemoveTimer(wakeTimer);
+
+                            if (gotFrame) {
+                                LiCompleteVideoFrame(handle, submitDecodeUnit(du));
+                            }
+                        }
                     }
                 }
                 else {
@@ -1983,7 +2403,7 @@ void FFmpegVideoDecoder::decoderThreadProc()
 
             if (err != 0) {
                 // Free the frame if we failed to submit it
-                av_frame_free(&frame);
+                FramePool::release(&frame);
             }
         }
     }
@@ -2012,25 +2432,49 @@ int FFmpegVideoDecoder::submitDecodeUnit(PDECODE_UNIT du)
         m_LastFrameNumber = du->frameNumber;
     }
 
-    m_BwTracker.AddBytes(du->fullLength);
+    m_BwTracker->AddBytes(du->fullLength, Session::BW_SERIES_VIDEO);
 
     // Flip stats windows roughly every second
     if (LiGetMicroseconds() > m_ActiveWndVideoStats.measurementStartUs + 1000000) {
+        // Attribute any frame allocations to this window
+        m_ActiveWndVideoStats.frameAllocations = FramePool::takeAllocationCount();
+
+        // Summarize this window on its own
+        VIDEO_STATS windowStats = {};
+        addVideoStats(m_ActiveWndVideoStats, windowStats);
+
+        if (m_BitrateController != nullptr) {
+            m_BitrateController->update(windowStats, m_BwTracker->GetAverageMbps(Session::BW_SERIES_VIDEO));
+        }
+
+        Session* session = Session::get();
+
         // Update overlay stats if it's enabled
-        if (Session::get()->getOverlayManager().isOverlayEnabled(Overlay::OverlayDebug)) {
+        if (session != nullptr && session->getOverlayManager().isOverlayEnabled(Overlay::OverlayDebug)) {
             VIDEO_STATS lastTwoWndStats = {};
             addVideoStats(m_LastWndVideoStats, lastTwoWndStats);
             addVideoStats(m_ActiveWndVideoStats, lastTwoWndStats);
 
-            stringifyVideoStats(lastTwoWndStats,
-                                Session::get()->getOverlayManager().getOverlayText(Overlay::OverlayDebug),
-                                Session::get()->getOverlayManager().getOverlayMaxTextLength());
-            Session::get()->getOverlayManager().setOverlayTextUpdated(Overlay::OverlayDebug);
+            char* overlayText = session->getOverlayManager().getOverlayText(Overlay::OverlayDebug);
+            int overlayMaxLength = session->getOverlayManager().getOverlayMaxTextLength();
+            stringifyVideoStats(lastTwoWndStats, overlayText, overlayMaxLength);
+
+            int overlayLength = (int)strlen(overlayText);
+            session->stringifyAudioStats(&overlayText[overlayLength], overlayMaxLength - overlayLength);
+            session->getOverlayManager().setOverlayTextUpdated(Overlay::OverlayDebug);
         }
 
         // Accumulate these values into the global stats
         addVideoStats(m_ActiveWndVideoStats, m_GlobalVideoStats);
 
+        // Publish the stats to metrics clients
+        MetricsServer* metricsServer = session != nullptr ? session->getMetricsServer() : nullptr;
+        if (metricsServer != nullptr) {
+            metricsServer->updateVideoStats(m_GlobalVideoStats, windowStats,
+                                            m_BwTracker->GetAverageMbps(Session::BW_SERIES_VIDEO),
+                                            m_BwTracker->GetPeakMbps(Session::BW_SERIES_VIDEO));
+        }
+
         // Move this window into the last window slot and clear it for next window
         SDL_memcpy(&m_LastWndVideoStats, &m_ActiveWndVideoStats, sizeof(m_ActiveWndVideoStats));
         SDL_zero(m_ActiveWndVideoStats);
@@ -2045,6 +2489,7 @@ int FFmpegVideoDecoder::submitDecodeUnit(PDECODE_UNIT du)
             m_ActiveWndVideoStats.minHostProcessingLatency = du->frameHostProcessingLatency;
         }
         m_ActiveWndVideoStats.framesWithHostProcessingLatency += 1;
+        m_ActiveWndVideoStats.hostProcessingLatencyHistogram.record(du->frameHostProcessingLatency * 100);
     }
     m_ActiveWndVideoStats.maxHostProcessingLatency = qMax(m_ActiveWndVideoStats.maxHostProcessingLatency, du->frameHostProcessingLatency);
     m_ActiveWndVideoStats.totalHostProcessingLatency += du->frameHostProcessingLatency;
@@ -2052,24 +2497,50 @@ int FFmpegVideoDecoder::submitDecodeUnit(PDECODE_UNIT du)
     m_ActiveWndVideoStats.receivedFrames++;
     m_ActiveWndVideoStats.totalFrames++;
 
+    // Track how long this frame was waiting for the decoder thread to pick it up
+    {
+        uint64_t wakeLatencyUs = LiGetMicroseconds() - du->enqueueTimeUs;
+        int bucket = 0;
+
+        while (bucket < DECODER_WAKE_LATENCY_BUCKETS - 1 && wakeLatencyUs >= (250ULL << bucket)) {
+            bucket++;
+        }
+
+        m_ActiveWndVideoStats.decoderWakeLatency[bucket]++;
+    }
+
     int requiredBufferSize = du->fullLength;
     if (du->frameType == FRAME_TYPE_IDR) {
         // Add some extra space in case we need to do an SPS fixup
         requiredBufferSize += MAX_SPS_EXTRA_SIZE;
     }
 
-    // Ensure the decoder buffer is large enough
-    m_DecodeBuffer.reserve(requiredBufferSize + AV_INPUT_BUFFER_PADDING_SIZE);
+    // The data buffers in the DU are only valid until we return, so we must copy them
+    // once to reassemble the frame. We do this directly into a reference-counted buffer
+    // so avcodec_send_packet() can take a reference to it rather than making yet another
+    // copy of the frame data internally.
+    AVBufferRef* packetBuffer = getPacketBuffer(requiredBufferSize);
+    if (packetBuffer == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Failed to allocate packet buffer");
+        return DR_NEED_IDR;
+    }
 
     int offset = 0;
     while (entry != nullptr) {
-        writeBuffer(entry, offset);
+        writeBuffer(packetBuffer->data, entry, offset);
         entry = entry->next;
     }
 
-    m_Pkt->data = reinterpret_cast<uint8_t*>(m_DecodeBuffer.data());
+    // Pooled buffers are reused, so we must zero the padding ourselves
+    memset(packetBuffer->data + offset, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+    m_Pkt->buf = packetBuffer;
+    m_Pkt->data = packetBuffer->data;
     m_Pkt->size = offset;
 
+    m_ActiveWndVideoStats.copiedBytes += offset;
+
     if (du->frameType == FRAME_TYPE_IDR) {
         m_Pkt->flags = AV_PKT_FLAG_KEY;
     }
@@ -2078,8 +2549,18 @@ int FFmpegVideoDecoder::submitDecodeUnit(PDECODE_UNIT du)
     }
 
     m_ActiveWndVideoStats.totalReassemblyTimeUs += (du->enqueueTimeUs - du->receiveTimeUs);
+    m_ActiveWndVideoStats.reassemblyTimeHistogram.record(du->enqueueTimeUs - du->receiveTimeUs);
 
+    uint64_t sendStartUs = LiGetMicroseconds();
+    if (m_FrameTracer != nullptr) {
+        m_FrameTracer->traceDecodeStart(du->frameNumber, du->receiveTimeUs, du->enqueueTimeUs, sendStartUs);
+    }
     err = avcodec_send_packet(m_VideoDecoderCtx, m_Pkt);
+    m_ActiveWndVideoStats.totalDecoderBusyTimeUs += LiGetMicroseconds() - sendStartUs;
+
+    // The decoder holds its own reference to the packet buffer if it needs it
+    av_packet_unref(m_Pkt);
+
     if (err < 0) {
         char errorstring[512];
         av_strerror(err, errorstring, sizeof(errorstring));
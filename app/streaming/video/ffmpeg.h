@@ -6,6 +6,8 @@
 
 #include "../bandwidth.h"
 #include "decoder.h"
+#include "frametracer.h"
+#include "bitratecontroller.h"
 #include "ffmpeg-renderers/renderer.h"
 #include "ffmpeg-renderers/pacer/pacer.h"
 
@@ -44,12 +46,28 @@ private:
         TestFrame
     };
 
+    enum class SwDecodeThreading {
+        // Hardware decoding or single-threaded decoding
+        None,
+
+        // Threads decode slices of the same frame
+        Slice,
+
+        // Threads decode consecutive frames (adds latency)
+        Frame,
+
+        // The decoder manages its own mix of frame and tile threads
+        Hybrid
+    };
+
     bool completeInitialization(const AVCodec* decoder,
                                 enum AVPixelFormat requiredFormat,
                                 PDECODER_PARAMETERS params,
                                 TestMode testMode,
                                 bool useAlternateFrontend);
 
+    void configureSoftwareDecodeThreading(const AVCodec* decoder, PDECODER_PARAMETERS params);
+
     void stringifyVideoStats(VIDEO_STATS& stats, char* output, int length);
 
     void logVideoStats(VIDEO_STATS& stats, const char* title);
@@ -94,7 +112,9 @@ private:
 
     void reset();
 
-    void writeBuffer(PLENTRY entry, int& offset);
+    AVBufferRef* getPacketBuffer(int size);
+
+    void writeBuffer(uint8_t* buffer, PLENTRY entry, int& offset);
 
     static
     enum AVPixelFormat ffGetFormat(AVCodecContext* context,
@@ -104,16 +124,23 @@ private:
 
     static int decoderThreadProcThunk(void* context);
 
+    static Uint32 decoderThreadWakeTimerCallback(Uint32 interval, void* param);
+
     AVPacket* m_Pkt;
     AVCodecContext* m_VideoDecoderCtx;
     enum AVPixelFormat m_RequiredPixelFormat;
-    QByteArray m_DecodeBuffer;
+    AVBufferPool* m_PacketBufferPool;
+    int m_PacketBufferPoolSize;
     const AVCodecHWConfig* m_HwDecodeCfg;
     IFFmpegRenderer* m_BackendRenderer;
     IFFmpegRenderer* m_FrontendRenderer;
     int m_ConsecutiveFailedDecodes;
     Pacer* m_Pacer;
-    BandwidthTracker m_BwTracker;
+    FrameTracer* m_FrameTracer;
+    FrameTracer* m_OwnedFrameTracer;
+    BandwidthTracker* m_BwTracker;
+    BandwidthTracker m_OwnedBwTracker;
+    BitrateController* m_BitrateController;
     VIDEO_STATS m_ActiveWndVideoStats;
     VIDEO_STATS m_LastWndVideoStats;
     VIDEO_STATS m_GlobalVideoStats;
@@ -121,6 +148,9 @@ private:
 
     int m_FramesIn;
     int m_FramesOut;
+    SwDecodeThreading m_SwDecodeThreading;
+    int m_SwDecodeThreadCount;
+    int m_SwDecodeLatencyBudget;
 
     int m_LastFrameNumber;
     int m_StreamFps;
@@ -132,6 +162,7 @@ private:
     TestMode m_CurrentTestMode;
     SDL_Thread* m_DecoderThread;
     SDL_atomic_t m_DecoderThreadShouldQuit;
+    SDL_atomic_t m_DecoderThreadWaitingForOutput;
 
     // Data buffers in the queued DU are not valid
     QQueue<DECODE_UNIT> m_FrameInfoQueue;
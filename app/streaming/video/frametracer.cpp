@@ -0,0 +1,244 @@
+#include "frametracer.h"
+
+#include <QFile>
+#include <QVector>
+
+#include <algorithm>
+
+FrameTracer* FrameTracer::create()
+{
+    QString path = qgetenv("FRAME_TRACE_FILE");
+    if (path.isEmpty()) {
+        return nullptr;
+    }
+
+    // Allocate the whole ring up front so tracing doesn't allocate while streaming
+    auto entries = (PFRAME_TRACE_ENTRY)SDL_calloc(FRAME_TRACE_MAX_FRAMES, sizeof(FRAME_TRACE_ENTRY));
+    if (entries == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to allocate frame trace buffer");
+        return nullptr;
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Frame tracing enabled: %s",
+                qPrintable(path));
+    return new FrameTracer(path, entries);
+}
+
+FrameTracer::FrameTracer(const QString& path, PFRAME_TRACE_ENTRY entries)
+    : m_Path(path),
+      m_Entries(entries)
+{
+
+}
+
+FrameTracer::~FrameTracer()
+{
+    SDL_free(m_Entries);
+}
+
+PFRAME_TRACE_ENTRY FrameTracer::getEntry(uint32_t frameNumber)
+{
+    // Frame number 0 is reserved for untraced frames
+    if (frameNumber == 0) {
+        return nullptr;
+    }
+
+    PFRAME_TRACE_ENTRY entry = &m_Entries[frameNumber & (FRAME_TRACE_MAX_FRAMES - 1)];
+    return entry->frameNumber == frameNumber ? entry : nullptr;
+}
+
+void FrameTracer::traceDecodeStart(uint32_t frameNumber, uint64_t receiveTimeUs, uint64_t enqueueTimeUs, uint64_t decodeStartUs)
+{
+    // Frame number 0 is reserved for untraced frames
+    if (frameNumber == 0) {
+        return;
+    }
+
+    // This claims the slot for this frame
+    PFRAME_TRACE_ENTRY entry = &m_Entries[frameNumber & (FRAME_TRACE_MAX_FRAMES - 1)];
+    SDL_zerop(entry);
+    entry->frameNumber = frameNumber;
+    entry->receiveTimeUs = receiveTimeUs;
+    entry->enqueueTimeUs = enqueueTimeUs;
+    entry->decodeStartUs = decodeStartUs;
+}
+
+void FrameTracer::traceDecodeEnd(uint32_t frameNumber, uint64_t decodeEndUs)
+{
+    PFRAME_TRACE_ENTRY entry = getEntry(frameNumber);
+    if (entry != nullptr) {
+        entry->decodeEndUs = decodeEndUs;
+    }
+}
+
+void FrameTracer::tracePacerDequeue(uint32_t frameNumber, uint64_t pacerDequeueUs)
+{
+    PFRAME_TRACE_ENTRY entry = getEntry(frameNumber);
+    if (entry != nullptr) {
+        entry->pacerDequeueUs = pacerDequeueUs;
+    }
+}
+
+void FrameTracer::traceRender(uint32_t frameNumber, uint64_t renderStartUs, uint64_t renderEndUs)
+{
+    PFRAME_TRACE_ENTRY entry = getEntry(frameNumber);
+    if (entry != nullptr) {
+        entry->renderStartUs = renderStartUs;
+        entry->renderEndUs = renderEndUs;
+    }
+}
+
+void FrameTracer::writeTraceFile()
+{
+    // Collect the traced frames in frame order, since the ring may have wrapped
+    QVector<PFRAME_TRACE_ENTRY> entries;
+    for (int i = 0; i < FRAME_TRACE_MAX_FRAMES; i++) {
+        if (m_Entries[i].frameNumber != 0) {
+            entries.append(&m_Entries[i]);
+        }
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](PFRAME_TRACE_ENTRY a, PFRAME_TRACE_ENTRY b) { return a->frameNumber < b->frameNumber; });
+
+    QFile file(m_Path);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to open frame trace file %s: %s",
+                     qPrintable(m_Path),
+                     qPrintable(file.errorString()));
+        return;
+    }
+
+    bool ok;
+    if (m_Path.endsWith(".json", Qt::CaseInsensitive)) {
+        ok = writeChromeTrace(file, entries.constData(), entries.count());
+    }
+    else {
+        ok = writeBinaryTrace(file, entries.constData(), entries.count());
+    }
+
+    if (ok) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Wrote trace of %d frames to %s",
+                    entries.count(),
+                    qPrintable(m_Path));
+    }
+    else {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Failed to write frame trace file %s: %s",
+                     qPrintable(m_Path),
+                     qPrintable(file.errorString()));
+    }
+}
+
+bool FrameTracer::writeBinaryTrace(QIODevice& file, const PFRAME_TRACE_ENTRY* entries, int count)
+{
+    FRAME_TRACE_HEADER header;
+
+    header.magic = FRAME_TRACE_MAGIC;
+    header.version = FRAME_TRACE_VERSION;
+    header.entrySize = sizeof(FRAME_TRACE_ENTRY);
+    header.entryCount = count;
+
+    if (file.write((const char*)&header, sizeof(header)) != sizeof(header)) {
+        return false;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (file.write((const char*)entries[i], sizeof(FRAME_TRACE_ENTRY)) != sizeof(FRAME_TRACE_ENTRY)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool FrameTracer::writeChromeTrace(QIODevice& file, const PFRAME_TRACE_ENTRY* entries, int count)
+{
+    // Each stage of the pipeline is shown as a separate track
+    static const char* const k_StageNames[] = {
+        "Reassembly",
+        "Decoder queue",
+        "Decode",
+        "Pacing queue",
+        "Render queue",
+        "Render",
+    };
+
+    QByteArray json;
+    char event[256];
+    uint64_t baseTimeUs = UINT64_MAX;
+    bool firstEvent = true;
+
+    auto appendEvent = [&]() {
+        if (!firstEvent) {
+            json.append(",\n");
+        }
+        json.append(event);
+        firstEvent = false;
+    };
+
+    // Make timestamps relative to the start of the trace
+    for (int i = 0; i < count; i++) {
+        if (entries[i]->receiveTimeUs != 0) {
+            baseTimeUs = SDL_min(baseTimeUs, entries[i]->receiveTimeUs);
+        }
+    }
+
+    json.append("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    for (int stage = 0; stage < (int)SDL_arraysize(k_StageNames); stage++) {
+        snprintf(event, sizeof(event),
+                 "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                 stage + 1, k_StageNames[stage]);
+        appendEvent();
+    }
+
+    for (int i = 0; i < count; i++) {
+        PFRAME_TRACE_ENTRY entry = entries[i];
+        uint64_t stageTimes[] = {
+            entry->receiveTimeUs,
+            entry->enqueueTimeUs,
+            entry->decodeStartUs,
+            entry->decodeEndUs,
+            entry->pacerDequeueUs,
+            entry->renderStartUs,
+            entry->renderEndUs,
+        };
+
+        // Emit a complete event for each stage that the frame got through
+        for (int stage = 0; stage < (int)SDL_arraysize(k_StageNames); stage++) {
+            uint64_t startUs = stageTimes[stage];
+            uint64_t endUs = stageTimes[stage + 1];
+            if (startUs == 0 || endUs == 0 || endUs < startUs) {
+                continue;
+            }
+
+            snprintf(event, sizeof(event),
+                     "{\"name\":\"Frame %u\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%" SDL_PRIu64 ",\"dur\":%" SDL_PRIu64 "}",
+                     entry->frameNumber, stage + 1, startUs - baseTimeUs, endUs - startUs);
+            appendEvent();
+        }
+
+        // Mark frames that were decoded but never rendered
+        if (entry->decodeEndUs != 0 && entry->renderStartUs == 0) {
+            snprintf(event, sizeof(event),
+                     "{\"name\":\"Frame %u dropped\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%d,\"ts\":%" SDL_PRIu64 "}",
+                     entry->frameNumber, 4, entry->decodeEndUs - baseTimeUs);
+            appendEvent();
+        }
+
+        // Don't buffer the whole trace in memory
+        if (json.size() > 1024 * 1024) {
+            if (file.write(json) != json.size()) {
+                return false;
+            }
+            json.clear();
+        }
+    }
+
+    json.append("\n]}\n");
+    return file.write(json) == json.size();
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <QString>
+
+#include "SDL_compat.h"
+
+class QIODevice;
+
+// Number of frames kept in the trace (must be a power of 2). This
+// is a little over 9 minutes of video at 120 FPS.
+#define FRAME_TRACE_MAX_FRAMES 65536
+
+// Timestamps (in microseconds from LiGetMicroseconds()) of a frame as it
+// moves through the video pipeline. Any timestamp may be 0 if the frame
+// never reached that stage (for example, if it was dropped by the pacer).
+typedef struct _FRAME_TRACE_ENTRY {
+    uint32_t frameNumber;
+    uint32_t reserved;
+    uint64_t receiveTimeUs;     // first packet of the frame received
+    uint64_t enqueueTimeUs;     // frame reassembled and queued for the decoder
+    uint64_t decodeStartUs;     // frame submitted to the decoder
+    uint64_t decodeEndUs;       // decoded frame received and submitted to the pacer
+    uint64_t pacerDequeueUs;    // frame moved from the pacing queue to the render queue
+    uint64_t renderStartUs;     // renderer started drawing the frame
+    uint64_t renderEndUs;       // renderer finished drawing (and presenting) the frame
+} FRAME_TRACE_ENTRY, *PFRAME_TRACE_ENTRY;
+
+// Header of the binary trace format, which is followed by entryCount
+// FRAME_TRACE_ENTRYs in frame order. All values are in native byte order.
+#define FRAME_TRACE_MAGIC 0x54464C4D // "MLFT"
+#define FRAME_TRACE_VERSION 1
+
+typedef struct _FRAME_TRACE_HEADER {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entrySize;
+    uint32_t entryCount;
+} FRAME_TRACE_HEADER, *PFRAME_TRACE_HEADER;
+
+// Records per-frame timestamps into a preallocated ring and writes
+// them out when the stream ends. Tracing is enabled by setting the
+// FRAME_TRACE_FILE environment variable to the output path. If the
+// path ends in .json, the trace is written in the Chrome trace event
+// format (for chrome://tracing or Perfetto). Otherwise, it's written
+// in the compact binary format described above.
+//
+// Each stage of the pipeline only writes its own fields, so no locking
+// is required. The ring is only read after the stream has ended.
+class FrameTracer
+{
+public:
+    // Returns nullptr if tracing is not enabled
+    static FrameTracer* create();
+
+    ~FrameTracer();
+
+    void traceDecodeStart(uint32_t frameNumber, uint64_t receiveTimeUs, uint64_t enqueueTimeUs, uint64_t decodeStartUs);
+    void traceDecodeEnd(uint32_t frameNumber, uint64_t decodeEndUs);
+    void tracePacerDequeue(uint32_t frameNumber, uint64_t pacerDequeueUs);
+    void traceRender(uint32_t frameNumber, uint64_t renderStartUs, uint64_t renderEndUs);
+
+    void writeTraceFile();
+
+private:
+    FrameTracer(const QString& path, PFRAME_TRACE_ENTRY entries);
+
+    // Returns nullptr if the slot has been reused by a newer frame
+    PFRAME_TRACE_ENTRY getEntry(uint32_t frameNumber);
+
+    bool writeBinaryTrace(QIODevice& file, const PFRAME_TRACE_ENTRY* entries, int count);
+    bool writeChromeTrace(QIODevice& file, const PFRAME_TRACE_ENTRY* entries, int count);
+
+    QString m_Path;
+    PFRAME_TRACE_ENTRY m_Entries;
+};
@@ -0,0 +1,82 @@
+#include "latencyhistogram.h"
+
+#include <cmath>
+
+#define SUB_BUCKET_COUNT (1 << LATENCY_HISTOGRAM_SUB_BUCKET_BITS)
+
+// Values below 2 * SUB_BUCKET_COUNT get a bucket each. Above that, the
+// bucket is picked by the position of the highest set bit followed by
+// the next LATENCY_HISTOGRAM_SUB_BUCKET_BITS bits of the value.
+static int getBucketIndex(uint32_t valueUs)
+{
+    if (valueUs < 2 * SUB_BUCKET_COUNT) {
+        return (int)valueUs;
+    }
+
+    int shift = SDL_MostSignificantBitIndex32(valueUs) - LATENCY_HISTOGRAM_SUB_BUCKET_BITS;
+    int index = (shift + 1) * SUB_BUCKET_COUNT + (int)(valueUs >> shift) - SUB_BUCKET_COUNT;
+    return SDL_min(index, LATENCY_HISTOGRAM_BUCKETS - 1);
+}
+
+// Returns the smallest value that falls in the next bucket
+static uint64_t getBucketUpperBound(int index)
+{
+    if (index < 2 * SUB_BUCKET_COUNT) {
+        return index + 1;
+    }
+
+    int shift = index / SUB_BUCKET_COUNT - 1;
+    return (uint64_t)(index % SUB_BUCKET_COUNT + SUB_BUCKET_COUNT + 1) << shift;
+}
+
+void LatencyHistogram::record(uint64_t valueUs)
+{
+    uint32_t clampedValueUs = (uint32_t)SDL_min(valueUs, (uint64_t)UINT32_MAX);
+
+    buckets[getBucketIndex(clampedValueUs)]++;
+    count++;
+    maxUs = SDL_max(maxUs, clampedValueUs);
+    totalUs += valueUs;
+}
+
+void LatencyHistogram::add(const LatencyHistogram& other)
+{
+    for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        buckets[i] += other.buckets[i];
+    }
+    count += other.count;
+    maxUs = SDL_max(maxUs, other.maxUs);
+    totalUs += other.totalUs;
+}
+
+double LatencyHistogram::getAverageUs() const
+{
+    return count != 0 ? (double)totalUs / count : 0.0;
+}
+
+uint32_t LatencyHistogram::getPercentileUs(double percentile) const
+{
+    if (count == 0) {
+        return 0;
+    }
+
+    // The rank of the value we're looking for (1-based)
+    uint64_t rank = (uint64_t)ceil(count * SDL_clamp(percentile, 0.0, 100.0) / 100.0);
+    rank = SDL_max(rank, (uint64_t)1);
+
+    uint64_t seen = 0;
+    for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            // The last bucket is unbounded, and nothing we
+            // recorded is larger than the max anyway.
+            if (i == LATENCY_HISTOGRAM_BUCKETS - 1) {
+                return maxUs;
+            }
+
+            return (uint32_t)SDL_min(getBucketUpperBound(i) - 1, (uint64_t)maxUs);
+        }
+    }
+
+    return maxUs;
+}
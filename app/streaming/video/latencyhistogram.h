@@ -0,0 +1,32 @@
+#pragma once
+
+#include "SDL_compat.h"
+
+// Each power of 2 is split into (1 << LATENCY_HISTOGRAM_SUB_BUCKET_BITS)
+// linear sub-buckets, so recorded values are accurate to within 12.5%.
+#define LATENCY_HISTOGRAM_SUB_BUCKET_BITS 3
+
+// Enough buckets to cover latencies up to 2^21 us (about 2 seconds).
+// Anything longer is counted in the last bucket.
+#define LATENCY_HISTOGRAM_BUCKETS 152
+
+// A fixed-size log-linear histogram of latencies in microseconds. This is
+// a plain struct so it can live inside VIDEO_STATS and be zeroed and
+// copied along with the rest of the stats.
+struct LatencyHistogram
+{
+    uint32_t buckets[LATENCY_HISTOGRAM_BUCKETS];
+    uint32_t count;
+    uint32_t maxUs;
+    uint64_t totalUs;
+
+    void record(uint64_t valueUs);
+
+    void add(const LatencyHistogram& other);
+
+    double getAverageUs() const;
+
+    // Returns an upper bound on the given percentile (0-100) of
+    // recorded values, or 0 if nothing has been recorded.
+    uint32_t getPercentileUs(double percentile) const;
+};
@@ -12,6 +12,12 @@ win32:!winrt {
     app.depends += AntiHooking
 }
 
+# Benchmarks and tests aren't built unless requested
+enable-tests {
+    SUBDIRS += tests
+    tests.depends = h264bitstream
+}
+
 # Support debug and release builds from command line for CI
 CONFIG += debug_and_release
 
@@ -0,0 +1,17 @@
+# Checks that ComputerPoller races the addresses of a host, so dead or
+# wrong addresses ahead of a working one don't hold it up for long.
+
+QT += core
+TARGET = addressracetest
+CONFIG += testcase
+
+TEST_DEPS = openssl
+include(../tests.pri)
+include(../common/standinhost.pri)
+
+SOURCES += \
+    main.cpp \
+    $$APP_DIR/backend/computerpoller.cpp
+
+HEADERS += \
+    $$APP_DIR/backend/computerpoller.h
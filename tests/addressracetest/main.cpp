@@ -0,0 +1,233 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTimer>
+
+#include "standinhost.h"
+#include "temporarysettings.h"
+#include "backend/computerpoller.h"
+
+// These must match ADDRESS_RACE_DELAY_MS in computerpoller.cpp
+// and FAST_FAIL_TIMEOUT_MS in nvhttp.cpp
+#define ADDRESS_RACE_DELAY_MS 250
+#define FAST_FAIL_TIMEOUT_MS 2000
+
+// Coarse timers may fire up to 5% early
+#define EARLY_TIMER_PERCENT 5
+
+// Give up on a scenario if the host hasn't come online or gone offline by now
+#define SCENARIO_TIMEOUT_MS 10000
+
+enum AddressKind {
+    AK_LIVE,            // The host we're looking for
+    AK_WRONG_HOST,      // A different host that answers
+    AK_UNRESPONSIVE,    // Accepts connections but never answers
+    AK_REFUSED,         // Nothing is listening
+};
+
+struct Scenario {
+    const char* name;
+
+    // In order of preference, starting with the active address
+    QVector<AddressKind> addresses;
+
+    bool expectOnline;
+    int minMs;
+    int maxMs;
+};
+
+// The stand-in hosts we start, in the order StandInHostProcess numbers them
+#define LIVE_HOST_INDEX 0
+#define WRONG_HOST_INDEX 1
+#define RESPONSIVE_HOST_COUNT 2
+#define FIRST_UNRESPONSIVE_HOST_INDEX RESPONSIVE_HOST_COUNT
+#define UNRESPONSIVE_HOST_COUNT 2
+
+static const Scenario k_Scenarios[] = {
+    // The live address answers before the next one is raced
+    { "Live address first", { AK_LIVE, AK_UNRESPONSIVE }, true, 0, ADDRESS_RACE_DELAY_MS },
+
+    // Each dead address only holds up the next one for the race delay,
+    // rather than until it times out
+    { "Unresponsive address first", { AK_UNRESPONSIVE, AK_LIVE }, true,
+      ADDRESS_RACE_DELAY_MS, FAST_FAIL_TIMEOUT_MS },
+    { "Two unresponsive addresses first", { AK_UNRESPONSIVE, AK_UNRESPONSIVE, AK_LIVE }, true,
+      ADDRESS_RACE_DELAY_MS * 2, FAST_FAIL_TIMEOUT_MS },
+
+    // Addresses that fail outright or belong to another host are
+    // skipped without waiting for the race delay
+    { "Refused address first", { AK_REFUSED, AK_LIVE }, true, 0, ADDRESS_RACE_DELAY_MS },
+    { "Different host first", { AK_WRONG_HOST, AK_LIVE }, true, 0, ADDRESS_RACE_DELAY_MS },
+
+    // Without a working address, the host goes offline once the last
+    // request in progress times out
+    { "No working address", { AK_UNRESPONSIVE, AK_REFUSED, AK_WRONG_HOST }, false,
+      FAST_FAIL_TIMEOUT_MS, FAST_FAIL_TIMEOUT_MS + ADDRESS_RACE_DELAY_MS },
+};
+
+const char* LiGetLaunchUrlQueryParameters(void)
+{
+    return "";
+}
+
+static NvAddress getLoopbackAddress(quint16 port)
+{
+    return NvAddress(QHostAddress(QHostAddress::LocalHost), port);
+}
+
+// Returns a loopback port that nothing is listening on
+static quint16 getRefusedPort()
+{
+    QTcpServer server;
+    if (!server.listen(QHostAddress::LocalHost)) {
+        return 0;
+    }
+
+    quint16 port = server.serverPort();
+    server.close();
+    return port;
+}
+
+static bool runScenario(const Scenario& scenario, const StandInHostProcess& standInHosts,
+                        quint16 refusedPort, QNetworkAccessManager* nam)
+{
+    QVector<NvAddress> addresses;
+    int unresponsiveCount = 0;
+    for (AddressKind kind : scenario.addresses) {
+        switch (kind) {
+        case AK_LIVE:
+            addresses.append(getLoopbackAddress(standInHosts.getPort(LIVE_HOST_INDEX)));
+            break;
+        case AK_WRONG_HOST:
+            addresses.append(getLoopbackAddress(standInHosts.getPort(WRONG_HOST_INDEX)));
+            break;
+        case AK_UNRESPONSIVE:
+            // Each one needs its own port, or it'll be pruned as a duplicate
+            Q_ASSERT(unresponsiveCount < UNRESPONSIVE_HOST_COUNT);
+            addresses.append(getLoopbackAddress(standInHosts.getPort(FIRST_UNRESPONSIVE_HOST_INDEX + unresponsiveCount++)));
+            break;
+        case AK_REFUSED:
+            addresses.append(getLoopbackAddress(refusedPort));
+            break;
+        }
+    }
+
+    // Set the host up as we last knew it, with the given addresses
+    NvAddress liveAddress = getLoopbackAddress(standInHosts.getPort(LIVE_HOST_INDEX));
+    NvHTTP http(liveAddress, 0, QSslCertificate(), nam);
+    NvComputer computer(http, StandInHost::createServerInfo(LIVE_HOST_INDEX, 0, false));
+    computer.state = NvComputer::CS_UNKNOWN;
+
+    NvAddress* addressFields[] = {
+        &computer.activeAddress,
+        &computer.localAddress,
+        &computer.remoteAddress,
+        &computer.ipv6Address,
+        &computer.manualAddress,
+    };
+    Q_ASSERT(addresses.count() <= (int)(sizeof(addressFields) / sizeof(addressFields[0])));
+    for (int i = 0; i < (int)(sizeof(addressFields) / sizeof(addressFields[0])); i++) {
+        *addressFields[i] = addresses.value(i);
+    }
+
+    ComputerPoller poller;
+    QEventLoop loop;
+    QElapsedTimer timer;
+    qint64 elapsedUs = -1;
+    NvComputer::ComputerState result = NvComputer::CS_UNKNOWN;
+
+    QObject::connect(&poller, &ComputerPoller::computerStateChanged, &loop, [&](NvComputer*) {
+        QReadLocker lock(&computer.lock);
+        if (computer.state != NvComputer::CS_UNKNOWN && elapsedUs < 0) {
+            elapsedUs = timer.nsecsElapsed() / 1000;
+            result = computer.state;
+            loop.quit();
+        }
+    }, Qt::QueuedConnection);
+    QTimer::singleShot(SCENARIO_TIMEOUT_MS, &loop, &QEventLoop::quit);
+
+    timer.start();
+    poller.addComputer(&computer);
+    loop.exec();
+
+    // Stop polling so we can look at the host without locking it
+    poller.removeComputer(&computer);
+
+    if (elapsedUs < 0) {
+        fprintf(stdout, "%-36s never changed state\n", scenario.name);
+        return false;
+    }
+
+    bool ok = true;
+    double elapsedMs = elapsedUs / 1000.0;
+    fprintf(stdout, "%-36s %s after %.1f ms (expected %d to %d ms)\n",
+            scenario.name, result == NvComputer::CS_ONLINE ? "online" : "offline",
+            elapsedMs, scenario.minMs, scenario.maxMs);
+
+    if ((result == NvComputer::CS_ONLINE) != scenario.expectOnline) {
+        fprintf(stderr, "%s: expected the host to be %s\n",
+                scenario.name, scenario.expectOnline ? "online" : "offline");
+        ok = false;
+    }
+    else if (elapsedMs < scenario.minMs * (100 - EARLY_TIMER_PERCENT) / 100.0 || elapsedMs > scenario.maxMs) {
+        fprintf(stderr, "%s: took %.1f ms\n", scenario.name, elapsedMs);
+        ok = false;
+    }
+
+    // Only the host we're looking for may bring it online
+    if (result == NvComputer::CS_ONLINE) {
+        if (computer.uuid != StandInHost::getUuid(LIVE_HOST_INDEX)) {
+            fprintf(stderr, "%s: UUID changed to %s\n", scenario.name, qPrintable(computer.uuid));
+            ok = false;
+        }
+        if (computer.activeAddress != liveAddress) {
+            fprintf(stderr, "%s: online at %s instead of %s\n", scenario.name,
+                    qPrintable(computer.activeAddress.toString()), qPrintable(liveAddress.toString()));
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("addressracetest");
+
+    if (StandInHostProcess::isChildProcess()) {
+        return StandInHostProcess::runChildProcess();
+    }
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Polls a host whose preferred addresses are unresponsive, refused "
+                                     "or belong to another host, using stand-in hosts on loopback ports, "
+                                     "and checks how long ComputerPoller takes to bring it online.");
+    parser.addHelpOption();
+    parser.process(app);
+
+    TemporarySettings settings;
+
+    StandInHostProcess standInHosts;
+    if (!standInHosts.start(RESPONSIVE_HOST_COUNT, UNRESPONSIVE_HOST_COUNT, false)) {
+        fprintf(stdout, "FAIL\n");
+        return 1;
+    }
+
+    quint16 refusedPort = getRefusedPort();
+    if (refusedPort == 0) {
+        fprintf(stderr, "Failed to find an unused port\n");
+        fprintf(stdout, "FAIL\n");
+        return 1;
+    }
+
+    QNetworkAccessManager nam;
+    bool ok = true;
+    for (const Scenario& scenario : k_Scenarios) {
+        ok &= runScenario(scenario, standInHosts, refusedPort, &nam);
+    }
+
+    fprintf(stdout, "%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,12 @@
+# Fetches a large app list from a stand-in host over HTTPS and compares a
+# full fetch and parse with the unchanged app list shortcut.
+
+QT += core
+TARGET = applistbench
+
+TEST_DEPS = openssl
+include(../tests.pri)
+include(../common/standinhost.pri)
+
+SOURCES += \
+    main.cpp
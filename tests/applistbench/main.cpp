@@ -0,0 +1,182 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+
+#include "processstats.h"
+#include "samples.h"
+#include "standinhost.h"
+#include "temporarysettings.h"
+#include "backend/nvcomputer.h"
+
+enum FetchResult {
+    FR_RECEIVED,
+    FR_UNCHANGED,
+    FR_FAILED,
+};
+
+const char* LiGetLaunchUrlQueryParameters(void)
+{
+    return "";
+}
+
+// Fetches the app list the way ComputerPoller does, passing the hash of
+// the app list we already have, if any
+static FetchResult fetchAppList(NvHTTP& http, QByteArray previousHash,
+                                QVector<NvApp>* appList, QByteArray* hash)
+{
+    QEventLoop loop;
+    FetchResult result = FR_FAILED;
+
+    QObject::connect(&http, &NvHTTP::appListReceived, &loop, [&](QVector<NvApp> newAppList, QByteArray newHash) {
+        result = FR_RECEIVED;
+        *appList = newAppList;
+        *hash = newHash;
+        loop.quit();
+    });
+    QObject::connect(&http, &NvHTTP::appListUnchanged, &loop, [&]() {
+        result = FR_UNCHANGED;
+        loop.quit();
+    });
+    QObject::connect(&http, &NvHTTP::requestFailed, &loop, [&]() {
+        result = FR_FAILED;
+        loop.quit();
+    });
+
+    http.getAppListAsync(previousHash);
+    loop.exec();
+
+    return result;
+}
+
+struct FetchStats {
+    Samples latencyUs;
+    uint64_t cpuUs;
+};
+
+static bool measureFetches(NvHTTP& http, QByteArray previousHash, FetchResult expectedResult,
+                           int iterations, FetchStats* stats)
+{
+    uint64_t cpuBeforeUs = getProcessCpuTimeUs();
+
+    for (int i = 0; i < iterations; i++) {
+        QVector<NvApp> appList;
+        QByteArray hash;
+        QElapsedTimer timer;
+
+        timer.start();
+        FetchResult result = fetchAppList(http, previousHash, &appList, &hash);
+        stats->latencyUs.add(timer.nsecsElapsed() / 1000);
+
+        if (result != expectedResult) {
+            fprintf(stderr, "Fetch %d returned %d instead of %d\n", i, result, expectedResult);
+            return false;
+        }
+    }
+
+    stats->cpuUs = getProcessCpuTimeUs() - cpuBeforeUs;
+    return true;
+}
+
+static void printFetchStats(const char* name, FetchStats& stats)
+{
+    fprintf(stdout, "%-24s %10.2f %10.2f %10.2f %14.2f\n", name,
+            stats.latencyUs.percentile(50) / 1000.0,
+            stats.latencyUs.percentile(99) / 1000.0,
+            stats.latencyUs.percentile(100) / 1000.0,
+            stats.cpuUs / 1000.0 / stats.latencyUs.count());
+}
+
+// Times merging fetched app lists into the host, which is what the poller
+// does with every app list that isn't skipped. Passing two different
+// lists makes every update a real change.
+static double measureUpdateUs(NvComputer& computer, const NvComputer& first,
+                              const NvComputer& second, int iterations)
+{
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < iterations; i++) {
+        computer.update(i % 2 == 0 ? first : second);
+    }
+    return timer.nsecsElapsed() / 1000.0 / iterations;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("applistbench");
+
+    if (StandInHostProcess::isChildProcess()) {
+        return StandInHostProcess::runChildProcess();
+    }
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Fetches a synthetic app list from a stand-in host over HTTPS, "
+                                     "then compares fetching and parsing it in full with skipping an "
+                                     "unchanged list by its hash, and times merging it into a host.");
+    parser.addHelpOption();
+
+    QCommandLineOption appsOption("apps", "Number of apps in the list", "count", "1000");
+    QCommandLineOption iterationsOption("iterations", "Fetches of each kind", "count", "100");
+    parser.addOptions({ appsOption, iterationsOption });
+    parser.process(app);
+
+    int appCount = parser.value(appsOption).toInt();
+    int iterations = parser.value(iterationsOption).toInt();
+    if (appCount <= 0 || iterations <= 0) {
+        fprintf(stderr, "Invalid app count or iterations\n");
+        return 1;
+    }
+
+    TemporarySettings settings;
+
+    StandInHostProcess standInHost;
+    if (!standInHost.start(1, 0, true, appCount)) {
+        return 1;
+    }
+
+    quint16 port = standInHost.getPort(0);
+    NvHTTP http(NvAddress(QHostAddress(QHostAddress::LocalHost), port), port, standInHost.getServerCert(), nullptr);
+
+    // The first fetch sets up the connection and gives us the hash
+    QVector<NvApp> appList;
+    QByteArray hash;
+    if (fetchAppList(http, QByteArray(), &appList, &hash) != FR_RECEIVED) {
+        fprintf(stderr, "Failed to fetch the app list\n");
+        return 1;
+    }
+    if (appList.count() != appCount) {
+        fprintf(stderr, "Fetched %d apps instead of %d\n", (int)appList.count(), appCount);
+        return 1;
+    }
+
+    FetchStats fullStats = {}, unchangedStats = {};
+    if (!measureFetches(http, QByteArray(), FR_RECEIVED, iterations, &fullStats) ||
+            !measureFetches(http, hash, FR_UNCHANGED, iterations, &unchangedStats)) {
+        return 1;
+    }
+
+    // NvComputer::updateAppList() is private to the poller, but update()
+    // merges the app list of the host it's given in the same way
+    NvComputer computer(http, StandInHost::createServerInfo(0, port, true));
+    NvComputer fetched = computer;
+    fetched.appList = appList;
+    computer.update(fetched);
+
+    NvComputer renamed = fetched;
+    renamed.appList[appCount / 2].name += " (Renamed)";
+
+    double unchangedUpdateUs = measureUpdateUs(computer, fetched, fetched, iterations);
+    double changedUpdateUs = measureUpdateUs(computer, renamed, fetched, iterations);
+
+    fprintf(stdout, "App list of %d apps (%d KB), %d fetches of each kind over HTTPS\n\n",
+            appCount, (int)(StandInHost::createAppList(appCount).size() / 1024), iterations);
+
+    fprintf(stdout, "%-24s %10s %10s %10s %14s\n", "Fetch", "p50 ms", "p99 ms", "max ms", "CPU ms/fetch");
+    printFetchStats("Full fetch and parse", fullStats);
+    printFetchStats("Unchanged (hash match)", unchangedStats);
+
+    fprintf(stdout, "\nMerging into the host: %.1f us unchanged, %.1f us with one app renamed\n",
+            unchangedUpdateUs, changedUpdateUs);
+    return 0;
+}
@@ -0,0 +1,15 @@
+# Feeds synthetic Opus packets through the audio packet queue, the Opus
+# decoder, and the SDL audio renderer, then reports decode time, queueing
+# delay, and glitches for stereo, 5.1, and 7.1 streams.
+
+QT += core
+TARGET = audiobench
+
+TEST_DEPS = sdl2 opus
+include(../tests.pri)
+
+SOURCES += \
+    main.cpp \
+    $$APP_DIR/streaming/audio/audiopacketqueue.cpp \
+    $$APP_DIR/streaming/audio/driftcompensator.cpp \
+    $$APP_DIR/streaming/audio/renderers/sdlaud.cpp
@@ -0,0 +1,452 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTemporaryDir>
+
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <thread>
+
+#include <opus_multistream.h>
+
+#include "samples.h"
+#include "utils.h"
+#include "streaming/audio/audiopacketqueue.h"
+#include "streaming/audio/driftcompensator.h"
+#include "streaming/audio/renderers/sdl.h"
+
+// The same stream parameters that Session::testAudio() uses
+#define SAMPLE_RATE 48000
+#define SAMPLES_PER_FRAME 240
+#define PACKET_DURATION_US ((uint64_t)SAMPLES_PER_FRAME * 1000000 / SAMPLE_RATE)
+
+// Packets in flight when feeding packets as fast as possible. This keeps
+// the audio thread busy without measuring a full queue.
+#define MAX_SPEED_PENDING_PACKETS 4
+
+// Stream layouts as the host sends them at normal audio quality
+struct AudioLayout {
+    const char* name;
+    int channelCount;
+    int streams;
+    int coupledStreams;
+    int bitrate;
+    unsigned char mapping[AUDIO_CONFIGURATION_MAX_CHANNEL_COUNT];
+};
+
+static const AudioLayout k_Layouts[] = {
+    { "stereo", 2, 1, 1, 96000, { 0, 1 } },
+    { "5.1", 6, 4, 2, 256000, { 0, 1, 4, 5, 2, 3 } },
+    { "7.1", 8, 5, 3, 450000, { 0, 1, 6, 7, 2, 3, 4, 5 } },
+};
+
+uint64_t LiGetMicroseconds(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Packets go straight into our queue, so nothing is ever waiting
+// in moonlight-common-c's own audio queue.
+int LiGetPendingAudioDuration(void)
+{
+    return 0;
+}
+
+static void sleepUntilUs(uint64_t timeUs)
+{
+    std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::microseconds(timeUs)));
+}
+
+// Encodes a different tone in each channel with a little noise on top,
+// so every stream carries real content for the decoder to work through
+static bool encodePackets(const AudioLayout& layout, int packetCount, QVector<QByteArray>& packets)
+{
+    const double pi = 3.14159265358979323846;
+    int error;
+
+    OpusMSEncoder* encoder = opus_multistream_encoder_create(SAMPLE_RATE,
+                                                             layout.channelCount,
+                                                             layout.streams,
+                                                             layout.coupledStreams,
+                                                             layout.mapping,
+                                                             OPUS_APPLICATION_RESTRICTED_LOWDELAY,
+                                                             &error);
+    if (encoder == nullptr) {
+        fprintf(stderr, "Failed to create Opus encoder: %d\n", error);
+        return false;
+    }
+
+    opus_multistream_encoder_ctl(encoder, OPUS_SET_BITRATE(layout.bitrate));
+
+    std::minstd_rand random(1);
+    QVector<float> pcm(SAMPLES_PER_FRAME * layout.channelCount);
+    unsigned char packet[AUDIO_PACKET_MAX_SIZE];
+
+    packets.clear();
+    for (int i = 0; i < packetCount; i++) {
+        for (int s = 0; s < SAMPLES_PER_FRAME; s++) {
+            double t = (double)(i * SAMPLES_PER_FRAME + s) / SAMPLE_RATE;
+            for (int c = 0; c < layout.channelCount; c++) {
+                double noise = (double)random() / random.max() - 0.5;
+                pcm[s * layout.channelCount + c] = (float)(0.3 * sin(2 * pi * 220 * (c + 1) * t) + 0.05 * noise);
+            }
+        }
+
+        int length = opus_multistream_encode_float(encoder, pcm.constData(), SAMPLES_PER_FRAME,
+                                                   packet, sizeof(packet));
+        if (length < 0) {
+            fprintf(stderr, "Opus encoding failed: %d\n", length);
+            opus_multistream_encoder_destroy(encoder);
+            return false;
+        }
+
+        packets.append(QByteArray((const char*)packet, length));
+    }
+
+    opus_multistream_encoder_destroy(encoder);
+    return true;
+}
+
+struct ProducerContext {
+    AudioPacketQueue* queue;
+    const QVector<QByteArray>* packets;
+    bool maxSpeed;
+    int lossPercent;
+    SDL_atomic_t done;
+};
+
+// Enqueues packets every 5 ms like the network receive thread does,
+// replacing a random share of them with lost packets
+static int producerThreadProc(void* context)
+{
+    auto producer = reinterpret_cast<ProducerContext*>(context);
+    std::minstd_rand random(2);
+    uint64_t startUs = LiGetMicroseconds();
+
+    for (int i = 0; i < producer->packets->count(); i++) {
+        if (producer->maxSpeed) {
+            while (producer->queue->count() >= MAX_SPEED_PENDING_PACKETS) {
+                std::this_thread::yield();
+            }
+        }
+        else {
+            sleepUntilUs(startUs + i * PACKET_DURATION_US);
+        }
+
+        if (producer->lossPercent > 0 && (int)(random() % 100) < producer->lossPercent) {
+            producer->queue->enqueue(nullptr, 0);
+        }
+        else {
+            const QByteArray& packet = producer->packets->at(i);
+            producer->queue->enqueue(packet.constData(), packet.length());
+        }
+    }
+
+    SDL_AtomicSet(&producer->done, 1);
+    producer->queue->wakeUp();
+    return 0;
+}
+
+// The decode and playback half of Session's audio thread, without the
+// overlay stats and renderer reinitialization
+class AudioPipeline
+{
+public:
+    AudioPipeline()
+        : concealedFrames(0),
+          m_Renderer(nullptr),
+          m_Decoder(nullptr),
+          m_DriftCompensator(nullptr),
+          m_DecodeBuffer(nullptr),
+          m_LostFramePending(false)
+    {
+    }
+
+    ~AudioPipeline()
+    {
+        delete m_Renderer;
+        delete m_DriftCompensator;
+        SDL_free(m_DecodeBuffer);
+        if (m_Decoder != nullptr) {
+            opus_multistream_decoder_destroy(m_Decoder);
+        }
+    }
+
+    bool initialize(const AudioLayout& layout)
+    {
+        int error;
+
+        SDL_zero(m_Config);
+        m_Config.sampleRate = SAMPLE_RATE;
+        m_Config.channelCount = layout.channelCount;
+        m_Config.streams = layout.streams;
+        m_Config.coupledStreams = layout.coupledStreams;
+        m_Config.samplesPerFrame = SAMPLES_PER_FRAME;
+        memcpy(m_Config.mapping, layout.mapping, sizeof(m_Config.mapping));
+
+        m_Renderer = new SdlAudioRenderer();
+        if (!m_Renderer->prepareForPlayback(&m_Config)) {
+            fprintf(stderr, "Failed to open the SDL audio renderer\n");
+            return false;
+        }
+
+        m_Renderer->remapChannels(&m_Config);
+
+        // SdlAudioRenderer always takes float samples
+        SDL_assert(m_Renderer->getAudioBufferFormat() == IAudioRenderer::AudioFormat::Float32NE);
+
+        m_Decoder = opus_multistream_decoder_create(m_Config.sampleRate,
+                                                    m_Config.channelCount,
+                                                    m_Config.streams,
+                                                    m_Config.coupledStreams,
+                                                    m_Config.mapping,
+                                                    &error);
+        if (m_Decoder == nullptr) {
+            fprintf(stderr, "Failed to create Opus decoder: %d\n", error);
+            return false;
+        }
+
+        int driftCompensation;
+        if (!Utils::getEnvironmentVariableOverride("AUDIO_DRIFT_COMPENSATION", &driftCompensation)) {
+            driftCompensation = 1;
+        }
+        if (driftCompensation) {
+            m_DecodeBuffer = (float*)SDL_malloc(sizeof(float) * m_Config.samplesPerFrame * m_Config.channelCount);
+            if (m_DecodeBuffer != nullptr) {
+                m_DriftCompensator = new AudioDriftCompensator(m_Config.channelCount);
+            }
+        }
+
+        return true;
+    }
+
+    // Same loss handling as Session::processAudioPacket()
+    bool processPacket(const unsigned char* data, int length)
+    {
+        bool playing = true;
+
+        if (data == nullptr) {
+            if (m_LostFramePending) {
+                playing = playFrame(nullptr, 0, false);
+                concealedFrames++;
+            }
+
+            m_LostFramePending = true;
+        }
+        else {
+            if (m_LostFramePending) {
+                playing = playFrame(data, length, true);
+                concealedFrames++;
+                m_LostFramePending = false;
+            }
+
+            if (playing) {
+                playing = playFrame(data, length, false);
+            }
+        }
+
+        return playing;
+    }
+
+    void getStats(PAUDIO_STATS stats)
+    {
+        m_Renderer->getStats(stats);
+    }
+
+    Samples decodeTimeUs;
+    int concealedFrames;
+
+private:
+    // Same as Session::playAudioFrame() for a float renderer
+    bool playFrame(const unsigned char* data, int length, bool decodeFec)
+    {
+        int frameSize = sizeof(float) * m_Config.channelCount;
+        int desiredBufferSize = frameSize * m_Config.samplesPerFrame;
+        if (m_DriftCompensator != nullptr) {
+            desiredBufferSize += frameSize;
+        }
+
+        auto buffer = (float*)m_Renderer->getAudioBuffer(&desiredBufferSize);
+        if (buffer == nullptr) {
+            return true;
+        }
+
+        float* decodeBuffer = buffer;
+        int decodeBufferSize = desiredBufferSize;
+        if (m_DriftCompensator != nullptr) {
+            decodeBuffer = m_DecodeBuffer;
+            decodeBufferSize = frameSize * m_Config.samplesPerFrame;
+        }
+
+        int maxSamples = decodeFec ? m_Config.samplesPerFrame : decodeBufferSize / frameSize;
+
+        uint64_t decodeStartUs = LiGetMicroseconds();
+        int samplesDecoded = opus_multistream_decode_float(m_Decoder, data, length,
+                                                           decodeBuffer, maxSamples,
+                                                           decodeFec ? 1 : 0);
+        decodeTimeUs.add(LiGetMicroseconds() - decodeStartUs);
+
+        if (m_DriftCompensator != nullptr && samplesDecoded > 0) {
+            AUDIO_STATS stats = {};
+            m_Renderer->getStats(&stats);
+            m_DriftCompensator->updateBufferError((int)stats.deviceBufferedUs - (int)stats.targetBufferMs * 1000,
+                                                  samplesDecoded * 1000 / (m_Config.sampleRate / 1000));
+            samplesDecoded = m_DriftCompensator->process(decodeBuffer, samplesDecoded,
+                                                         buffer, desiredBufferSize / frameSize);
+        }
+
+        return m_Renderer->submitAudio(samplesDecoded > 0 ? frameSize * samplesDecoded : 0);
+    }
+
+    OPUS_MULTISTREAM_CONFIGURATION m_Config;
+    IAudioRenderer* m_Renderer;
+    OpusMSDecoder* m_Decoder;
+    AudioDriftCompensator* m_DriftCompensator;
+    float* m_DecodeBuffer;
+    bool m_LostFramePending;
+};
+
+// Returns false if the pipeline couldn't be set up
+static bool runLayout(const AudioLayout& layout, int seconds, bool maxSpeed, int lossPercent)
+{
+    QVector<QByteArray> packets;
+    if (!encodePackets(layout, seconds * (int)(1000000 / PACKET_DURATION_US), packets)) {
+        return false;
+    }
+
+    AudioPipeline pipeline;
+    if (!pipeline.initialize(layout)) {
+        return false;
+    }
+
+    AudioPacketQueue queue;
+    ProducerContext producer;
+    producer.queue = &queue;
+    producer.packets = &packets;
+    producer.maxSpeed = maxSpeed;
+    producer.lossPercent = lossPercent;
+    SDL_AtomicSet(&producer.done, 0);
+
+    SDL_Thread* producerThread = SDL_CreateThread(producerThreadProc, "AudioBenchProducer", &producer);
+    if (producerThread == nullptr) {
+        fprintf(stderr, "SDL_CreateThread() failed: %s\n", SDL_GetError());
+        return false;
+    }
+
+    // Play packets as they arrive, just like Session's audio thread
+    Samples queueDelayUs;
+    int maxQueuedPackets = 0;
+    bool failed = false;
+    while (!SDL_AtomicGet(&producer.done) || queue.count() != 0) {
+        PAUDIO_PACKET packet = queue.peek();
+        if (packet == nullptr) {
+            // Woken up after the last packet
+            continue;
+        }
+
+        maxQueuedPackets = SDL_max(maxQueuedPackets, queue.count());
+        queueDelayUs.add(LiGetMicroseconds() - packet->enqueueTimeUs);
+
+        if (!failed && !pipeline.processPacket(packet->length != 0 ? packet->data : nullptr, packet->length)) {
+            fprintf(stderr, "The audio device stopped\n");
+            failed = true;
+        }
+        queue.pop();
+    }
+
+    SDL_WaitThread(producerThread, nullptr);
+
+    AUDIO_STATS stats = {};
+    pipeline.getStats(&stats);
+
+    fprintf(stdout, "%-7s %8d %9.1f %9.1f %9.1f %9.1f %9.1f %9d %9u %9u %9d %9d\n",
+            layout.name,
+            pipeline.decodeTimeUs.count(),
+            pipeline.decodeTimeUs.mean(),
+            (double)pipeline.decodeTimeUs.percentile(99),
+            (double)queueDelayUs.percentile(50),
+            (double)queueDelayUs.percentile(99),
+            (double)queueDelayUs.percentile(99.9),
+            maxQueuedPackets,
+            stats.underruns,
+            stats.overruns,
+            queue.takeDroppedCount(),
+            pipeline.concealedFrames);
+
+    return !failed;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("audiobench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Feeds synthetic Opus packets through the audio packet queue, "
+                                     "the Opus decoder, and the SDL audio renderer, then reports the "
+                                     "decode time per packet, how long packets waited in the queue, "
+                                     "and glitches. At maximum speed, the renderer discards the audio "
+                                     "it can't play in time, so overruns are expected.");
+    parser.addHelpOption();
+
+    QCommandLineOption layoutOption("layout", "Only run this layout: stereo, 5.1, or 7.1", "layout");
+    QCommandLineOption secondsOption("seconds", "Length of each run", "seconds", "5");
+    QCommandLineOption lossOption("loss-percent", "Share of packets to drop", "percent", "0");
+    QCommandLineOption maxSpeedOption("max-speed", "Feed packets as fast as the audio thread takes them");
+    parser.addOptions({ layoutOption, secondsOption, lossOption, maxSpeedOption });
+    parser.process(app);
+
+    int seconds = parser.value(secondsOption).toInt();
+    int lossPercent = parser.value(lossOption).toInt();
+    if (seconds <= 0 || lossPercent < 0 || lossPercent > 100) {
+        fprintf(stderr, "Invalid length or loss percentage\n");
+        return 1;
+    }
+
+    // The disk driver consumes audio in real time like a real device.
+    // Write its output to a scratch file unless the user picked a driver.
+    QTemporaryDir outputDir;
+    if (!qEnvironmentVariableIsSet("SDL_AUDIODRIVER")) {
+        qputenv("SDL_AUDIODRIVER", "disk");
+        qputenv("SDL_DISKAUDIOFILE", outputDir.filePath("audiobench.raw").toUtf8());
+    }
+
+    // Initialize audio on the main thread like Session does
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+        fprintf(stderr, "SDL_InitSubSystem() failed: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    // Run at the same priority as Session's audio thread
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
+
+    QString layoutName = parser.value(layoutOption);
+    bool maxSpeed = parser.isSet(maxSpeedOption);
+    bool ok = true;
+    bool foundLayout = false;
+
+    fprintf(stdout, "%s, %d%% packet loss, %s audio driver, times in us\n\n",
+            maxSpeed ? "Maximum speed" : "Real time", lossPercent, SDL_GetCurrentAudioDriver());
+    fprintf(stdout, "%-7s %8s %9s %9s %9s %9s %9s %9s %9s %9s %9s %9s\n",
+            "Layout", "Decoded", "Dec mean", "Dec p99", "Queue p50", "Queue p99", "Q p99.9",
+            "Max queue", "Underruns", "Overruns", "Dropped", "Concealed");
+
+    for (const AudioLayout& layout : k_Layouts) {
+        if (!layoutName.isEmpty() && layoutName != layout.name) {
+            continue;
+        }
+
+        foundLayout = true;
+        ok &= runLayout(layout, seconds, maxSpeed, lossPercent);
+    }
+
+    SDL_QuitSubSystem(SDL_INIT_AUDIO);
+
+    if (!foundLayout) {
+        fprintf(stderr, "Unknown layout: %s\n", qPrintable(layoutName));
+        return 1;
+    }
+
+    return ok ? 0 : 1;
+}
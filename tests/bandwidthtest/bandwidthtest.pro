@@ -0,0 +1,13 @@
+# Checks that BandwidthTracker counts every byte while several threads
+# add bytes and read from it at once ('make check' runs this). With
+# --bench, it measures the cost of each call under contention instead.
+
+QT += core
+TARGET = bandwidthtest
+CONFIG += testcase
+
+include(../tests.pri)
+
+SOURCES += \
+    main.cpp \
+    $$APP_DIR/streaming/bandwidth.cpp
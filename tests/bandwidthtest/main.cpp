@@ -0,0 +1,292 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "streaming/bandwidth.h"
+
+// The stress test uses long buckets so all of its writes can land in one
+// bucket, which lets us check that none of them were lost
+#define STRESS_WINDOW_SECONDS 20
+#define STRESS_BUCKET_MS 2000
+#define STRESS_WRITERS 8
+#define STRESS_READERS 2
+#define STRESS_ADDS_PER_WRITER 200000
+#define STRESS_MAX_ADD_BYTES 1500
+#define STRESS_ATTEMPTS 3
+
+// Length of each benchmark case
+#define BENCH_DURATION_MS 1000
+
+static uint64_t getMilliseconds()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// The same interval numbering that BandwidthTracker uses for its buckets
+static uint64_t getEpoch(int bucketIntervalMs)
+{
+    return getMilliseconds() / bucketIntervalMs;
+}
+
+static void sleepUntilNextEpoch(int bucketIntervalMs)
+{
+    uint64_t nextEpochMs = (getEpoch(bucketIntervalMs) + 1) * bucketIntervalMs;
+    std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::milliseconds(nextEpochMs)));
+}
+
+static double getExpectedMbps(uint64_t bytes, int bucketIntervalMs)
+{
+    return bytes * 8.0 / 1000000.0 / (bucketIntervalMs / 1000.0);
+}
+
+static bool isClose(double a, double b)
+{
+    return std::fabs(a - b) <= 1e-9 * std::fmax(std::fabs(a), std::fabs(b));
+}
+
+enum class StressResult {
+    Pass,
+    Fail,
+    Retry,
+};
+
+// Hammers one bucket with writers while readers poll the tracker, then checks
+// that every byte was counted. Returns Retry if the writers didn't finish
+// within the bucket, which can happen on a heavily loaded machine.
+static StressResult runStressTest()
+{
+    BandwidthTracker tracker(STRESS_WINDOW_SECONDS, STRESS_BUCKET_MS);
+    std::atomic<uint64_t> totalBytes(0);
+    std::atomic<bool> writersDone(false);
+    std::atomic<bool> readerFailed(false);
+
+    // Start at the beginning of a bucket to leave the writers as long as possible
+    sleepUntilNextEpoch(STRESS_BUCKET_MS);
+    uint64_t startEpoch = getEpoch(STRESS_BUCKET_MS);
+
+    std::vector<std::thread> writers;
+    for (int i = 0; i < STRESS_WRITERS; i++) {
+        writers.emplace_back([&tracker, &totalBytes, i]() {
+            std::minstd_rand random(i + 1);
+            uint64_t bytes = 0;
+
+            for (int j = 0; j < STRESS_ADDS_PER_WRITER; j++) {
+                size_t length = 1 + random() % STRESS_MAX_ADD_BYTES;
+                tracker.AddBytes(length);
+                bytes += length;
+            }
+
+            totalBytes += bytes;
+        });
+    }
+
+    // While the bucket fills, the peak can only grow and the average covers
+    // only completed buckets, so it must stay at zero
+    std::vector<std::thread> readers;
+    for (int i = 0; i < STRESS_READERS; i++) {
+        readers.emplace_back([&tracker, &writersDone, &readerFailed, startEpoch]() {
+            double lastPeak = 0.0;
+
+            while (!writersDone) {
+                double peak = tracker.GetPeakMbps();
+                double average = tracker.GetAverageMbps();
+
+                // The average covers the bucket once it's complete
+                if (getEpoch(STRESS_BUCKET_MS) != startEpoch) {
+                    break;
+                }
+
+                if (peak < lastPeak || average != 0.0) {
+                    fprintf(stderr, "Inconsistent read: peak %.3f after %.3f, average %.3f\n",
+                            peak, lastPeak, average);
+                    readerFailed = true;
+                    break;
+                }
+
+                lastPeak = peak;
+            }
+        });
+    }
+
+    for (std::thread& writer : writers) {
+        writer.join();
+    }
+    uint64_t endEpoch = getEpoch(STRESS_BUCKET_MS);
+    writersDone = true;
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+
+    if (endEpoch != startEpoch) {
+        return readerFailed ? StressResult::Fail : StressResult::Retry;
+    }
+
+    double expectedMbps = getExpectedMbps(totalBytes, STRESS_BUCKET_MS);
+    double peak = tracker.GetPeakMbps();
+    bool ok = !readerFailed;
+    if (!isClose(peak, expectedMbps)) {
+        fprintf(stderr, "Peak is %.6f Mbps but %.6f Mbps was added\n", peak, expectedMbps);
+        ok = false;
+    }
+
+    // Once the bucket completes, the average covers it and the time since it
+    // started, which is between one and two bucket intervals
+    sleepUntilNextEpoch(STRESS_BUCKET_MS);
+    double average = tracker.GetAverageMbps();
+    if (average <= expectedMbps / 2 || average > expectedMbps) {
+        fprintf(stderr, "Average is %.6f Mbps, expected between %.6f and %.6f Mbps\n",
+                average, expectedMbps / 2, expectedMbps);
+        ok = false;
+    }
+
+    fprintf(stdout, "Stress test: %d writers added %.1f MB with %d readers polling\n",
+            STRESS_WRITERS, totalBytes / 1000000.0, STRESS_READERS);
+    return ok ? StressResult::Pass : StressResult::Fail;
+}
+
+// Buckets that have left the window must not count towards the peak
+static bool runExpiryTest()
+{
+    BandwidthTracker tracker(1, 100);
+
+    sleepUntilNextEpoch(100);
+    tracker.AddBytes(1000000);
+    if (tracker.GetPeakMbps() == 0.0) {
+        fprintf(stderr, "Peak is zero right after adding bytes\n");
+        return false;
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1200));
+    if (tracker.GetPeakMbps() != 0.0 || tracker.GetAverageMbps() != 0.0) {
+        fprintf(stderr, "Bytes are still counted after leaving the window\n");
+        return false;
+    }
+
+    return true;
+}
+
+// Each series has its own buckets, and series past the end are ignored
+static bool runSeriesTest()
+{
+    BandwidthTracker tracker(1, 100, 2);
+
+    sleepUntilNextEpoch(100);
+    tracker.AddBytes(1000000, 1);
+    tracker.AddBytes(1000000, 2);
+    if (tracker.GetPeakMbps(0) != 0.0 || tracker.GetPeakMbps(1) == 0.0 || tracker.GetPeakMbps(2) != 0.0) {
+        fprintf(stderr, "Bytes added to one series were counted in another\n");
+        return false;
+    }
+
+    return true;
+}
+
+// Returns the nanoseconds per call of the given function when called
+// in a loop by each of the given number of threads at once
+template <typename Function>
+static double measureNsPerCall(int threadCount, Function function)
+{
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> totalCalls(0);
+    std::vector<std::thread> threads;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < threadCount; i++) {
+        threads.emplace_back([&stop, &totalCalls, &function]() {
+            uint64_t calls = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                function();
+                calls++;
+            }
+            totalCalls += calls;
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(BENCH_DURATION_MS));
+    stop = true;
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    double elapsedNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    return elapsedNs * threadCount / totalCalls;
+}
+
+static void runBenchmark()
+{
+    fprintf(stdout, "Time per call in ns, per thread\n\n");
+    fprintf(stdout, "%-8s %12s %12s %12s\n", "Threads", "AddBytes", "Average", "Peak");
+
+    static const int k_ThreadCounts[] = { 1, 2, 4, 8 };
+    for (int threadCount : k_ThreadCounts) {
+        BandwidthTracker tracker;
+
+        double addNs = measureNsPerCall(threadCount, [&tracker]() {
+            tracker.AddBytes(1400);
+        });
+
+        // Keep a writer running so the readers see the window change
+        std::atomic<bool> stopWriter(false);
+        std::thread writer([&tracker, &stopWriter]() {
+            while (!stopWriter.load(std::memory_order_relaxed)) {
+                tracker.AddBytes(1400);
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        });
+
+        volatile double sink;
+        double averageNs = measureNsPerCall(threadCount, [&tracker, &sink]() {
+            sink = tracker.GetAverageMbps();
+        });
+        double peakNs = measureNsPerCall(threadCount, [&tracker, &sink]() {
+            sink = tracker.GetPeakMbps();
+        });
+
+        stopWriter = true;
+        writer.join();
+
+        fprintf(stdout, "%-8d %12.1f %12.1f %12.1f\n", threadCount, addNs, averageNs, peakNs);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("bandwidthtest");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Checks that BandwidthTracker counts every byte while several "
+                                     "threads add bytes and read the average and peak at once.");
+    parser.addHelpOption();
+
+    QCommandLineOption benchOption("bench", "Measure the cost of each call with 1 to 8 threads instead");
+    parser.addOption(benchOption);
+    parser.process(app);
+
+    if (parser.isSet(benchOption)) {
+        runBenchmark();
+        return 0;
+    }
+
+    bool ok = runExpiryTest();
+    ok &= runSeriesTest();
+
+    StressResult result = StressResult::Retry;
+    for (int i = 0; i < STRESS_ATTEMPTS && result == StressResult::Retry; i++) {
+        result = runStressTest();
+    }
+    if (result == StressResult::Retry) {
+        fprintf(stderr, "The writers never finished within one bucket\n");
+    }
+    ok &= result == StressResult::Pass;
+
+    fprintf(stdout, "%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <QFile>
+
+#include <cstdint>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// CPU time (user and kernel) used by all threads of this process so far
+static inline uint64_t getProcessCpuTimeUs()
+{
+#ifdef Q_OS_WIN
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    if (!GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime)) {
+        return 0;
+    }
+
+    // FILETIMEs count in 100 ns units
+    uint64_t kernel100ns = ((uint64_t)kernelTime.dwHighDateTime << 32) | kernelTime.dwLowDateTime;
+    uint64_t user100ns = ((uint64_t)userTime.dwHighDateTime << 32) | userTime.dwLowDateTime;
+    return (kernel100ns + user100ns) / 10;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+
+    return (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 +
+           usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+#endif
+}
+
+// Number of threads in this process, or -1 where we can't tell
+static inline int getProcessThreadCount()
+{
+#ifdef Q_OS_LINUX
+    QFile status("/proc/self/status");
+    if (status.open(QIODevice::ReadOnly)) {
+        while (!status.atEnd()) {
+            QByteArray line = status.readLine();
+            if (line.startsWith("Threads:")) {
+                return line.mid(8).trimmed().toInt();
+            }
+        }
+    }
+#endif
+
+    return -1;
+}
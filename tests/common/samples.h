@@ -0,0 +1,58 @@
+#pragma once
+
+#include <QVector>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Collects raw samples (usually microseconds) for exact percentiles. The
+// app uses LatencyHistogram to keep this cheap while streaming, but the
+// benchmarks can afford to keep every sample.
+class Samples
+{
+public:
+    void add(uint64_t value)
+    {
+        m_Values.append(value);
+        m_Sorted = false;
+    }
+
+    int count() const
+    {
+        return m_Values.count();
+    }
+
+    double mean() const
+    {
+        if (m_Values.isEmpty()) {
+            return 0;
+        }
+
+        double total = 0;
+        for (uint64_t value : m_Values) {
+            total += value;
+        }
+        return total / m_Values.count();
+    }
+
+    // Nearest-rank percentile, so p100 is the maximum
+    uint64_t percentile(double percentile)
+    {
+        if (m_Values.isEmpty()) {
+            return 0;
+        }
+
+        if (!m_Sorted) {
+            std::sort(m_Values.begin(), m_Values.end());
+            m_Sorted = true;
+        }
+
+        int rank = (int)std::ceil(percentile / 100.0 * m_Values.count());
+        return m_Values[std::clamp(rank - 1, 0, (int)m_Values.count() - 1)];
+    }
+
+private:
+    QVector<uint64_t> m_Values;
+    bool m_Sorted = true;
+};
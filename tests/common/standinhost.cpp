@@ -0,0 +1,365 @@
+#include "standinhost.h"
+#include "temporarysettings.h"
+#include "backend/identitymanager.h"
+
+#include <QCoreApplication>
+#include <QSslSocket>
+#include <QTcpSocket>
+
+#ifndef Q_OS_WIN
+#include <QSocketNotifier>
+#include <unistd.h>
+#endif
+
+// Marks the command line of a child process started by StandInHostProcess
+#define CHILD_PROCESS_ARG "--stand-in-hosts"
+
+// Generating the HTTPS identity can take a moment on slow machines
+#define CHILD_STARTUP_TIMEOUT_MS 30000
+
+#define BOX_ART_SIZE (128 * 1024)
+
+StandInHost::StandInHost(int index, const QByteArray& appList, QObject* parent)
+    : QTcpServer(parent),
+      m_Index(index),
+      m_AppList(appList),
+      m_Https(false),
+      m_Unresponsive(false),
+      m_ConnectionCount(0),
+      m_RequestCount(0)
+{
+}
+
+void StandInHost::setSslConfiguration(const QSslConfiguration& sslConfig)
+{
+    m_SslConfig = sslConfig;
+    m_SslConfig.setPeerVerifyMode(QSslSocket::QueryPeer);
+    m_Https = true;
+}
+
+void StandInHost::setUnresponsive(bool unresponsive)
+{
+    m_Unresponsive = unresponsive;
+}
+
+int StandInHost::getConnectionCount() const
+{
+    return m_ConnectionCount;
+}
+
+int StandInHost::getRequestCount() const
+{
+    return m_RequestCount;
+}
+
+QString StandInHost::getUuid(int index)
+{
+    return QString("00000000-0000-0000-0000-%1").arg(index, 12, 10, QChar('0'));
+}
+
+QString StandInHost::getName(int index)
+{
+    return QString("StandIn%1").arg(index);
+}
+
+QByteArray StandInHost::createServerInfo(int index, quint16 httpsPort, bool paired)
+{
+    QString serverInfo =
+            "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+            "<root status_code=\"200\">\n"
+            "<hostname>" + getName(index) + "</hostname>\n"
+            "<appversion>7.1.431.-1</appversion>\n"
+            "<GfeVersion>3.23.0.74</GfeVersion>\n"
+            "<uniqueid>" + getUuid(index) + "</uniqueid>\n"
+            "<HttpsPort>" + QString::number(httpsPort) + "</HttpsPort>\n"
+            "<mac>00:00:00:00:00:00</mac>\n"
+            "<ServerCodecModeSupport>1</ServerCodecModeSupport>\n"
+            "<PairStatus>" + (paired ? "1" : "0") + "</PairStatus>\n"
+            "<currentgame>0</currentgame>\n"
+            "<state>SUNSHINE_SERVER_FREE</state>\n"
+            "</root>\n";
+
+    return serverInfo.toUtf8();
+}
+
+QByteArray StandInHost::createAppList(int appCount)
+{
+    QString appList =
+            "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+            "<root status_code=\"200\">\n";
+
+    // Hosts don't send their apps in name order, so shuffle the names
+    for (int i = 0; i < appCount; i++) {
+        appList += "<App>\n"
+                   "<IsHdrSupported>" + QString::number(i % 3 == 0 ? 1 : 0) + "</IsHdrSupported>\n"
+                   "<AppTitle>Stand-in Game " + QString::number((i * 7919) % appCount) + "</AppTitle>\n"
+                   "<ID>" + QString::number(10000 + i) + "</ID>\n"
+                   "<IsAppCollectorGame>" + QString::number(i % 4 == 0 ? 1 : 0) + "</IsAppCollectorGame>\n"
+                   "</App>\n";
+    }
+
+    appList += "</root>\n";
+    return appList.toUtf8();
+}
+
+void StandInHost::incomingConnection(qintptr socketDescriptor)
+{
+    auto socket = new QSslSocket(this);
+    if (!socket->setSocketDescriptor(socketDescriptor)) {
+        delete socket;
+        return;
+    }
+
+    m_ConnectionCount++;
+
+    connect(socket, &QSslSocket::disconnected, this, [this, socket]() {
+        m_RequestBuffers.remove(socket);
+        socket->deleteLater();
+    });
+
+    // Leave the connection open without ever reading from it
+    if (m_Unresponsive) {
+        return;
+    }
+
+    connect(socket, &QSslSocket::readyRead, this, [this, socket]() {
+        handleReadyRead(socket);
+    });
+
+    if (m_Https) {
+        socket->setSslConfiguration(m_SslConfig);
+        socket->startServerEncryption();
+    }
+}
+
+void StandInHost::handleReadyRead(QSslSocket* socket)
+{
+    QByteArray& buffer = m_RequestBuffers[socket];
+    buffer += socket->readAll();
+
+    // Answer each complete request. None of them have a body.
+    int end;
+    while ((end = buffer.indexOf("\r\n\r\n")) >= 0) {
+        QList<QByteArray> lines = buffer.left(end).split('\n');
+        buffer.remove(0, end + 4);
+
+        QByteArray path = lines.first().split(' ').value(1).split('?').first();
+        bool close = false;
+        for (const QByteArray& line : std::as_const(lines)) {
+            QByteArray header = line.trimmed().toLower();
+            if (header.startsWith("connection:") && header.contains("close")) {
+                close = true;
+            }
+        }
+
+        m_RequestCount++;
+
+        QByteArray body = createResponse(path, socket->isEncrypted());
+        QByteArray response = "HTTP/1.1 200 OK\r\n"
+                              "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+        if (close) {
+            response += "Connection: close\r\n";
+        }
+        response += "\r\n" + body;
+
+        socket->write(response);
+        if (close) {
+            socket->disconnectFromHost();
+            return;
+        }
+    }
+}
+
+QByteArray StandInHost::createResponse(const QByteArray& path, bool encrypted)
+{
+    if (path == "/serverinfo") {
+        // Like a real host, we only report being paired over HTTPS
+        return createServerInfo(m_Index, encrypted ? serverPort() : 0, encrypted);
+    }
+    else if (path == "/applist" && encrypted) {
+        return m_AppList;
+    }
+    else if (path == "/appasset" && encrypted) {
+        static QByteArray boxArt;
+        if (boxArt.isEmpty()) {
+            boxArt = QByteArray::fromHex("89504E470D0A1A0A");
+            while (boxArt.size() < BOX_ART_SIZE) {
+                boxArt.append((char)(boxArt.size() * 31));
+            }
+        }
+        return boxArt;
+    }
+
+    return "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+           "<root status_code=\"404\" status_message=\"Not found\"/>\n";
+}
+
+StandInHostProcess::StandInHostProcess()
+    : m_ControlPort(0)
+{
+}
+
+StandInHostProcess::~StandInHostProcess()
+{
+    if (m_Process.state() != QProcess::NotRunning) {
+        m_Process.kill();
+        m_Process.waitForFinished();
+    }
+}
+
+bool StandInHostProcess::start(int hostCount, int unresponsiveCount, bool https, int appCount)
+{
+    // Pass on stderr so any warnings from the child show up with ours
+    m_Process.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    m_Process.start(QCoreApplication::applicationFilePath(),
+                    { CHILD_PROCESS_ARG,
+                      QString::number(hostCount),
+                      QString::number(unresponsiveCount),
+                      https ? "1" : "0",
+                      QString::number(appCount) });
+    if (!m_Process.waitForStarted()) {
+        fprintf(stderr, "Failed to start the stand-in hosts: %s\n", qPrintable(m_Process.errorString()));
+        return false;
+    }
+
+    // The child reports its ports and certificate, then that it's ready
+    for (;;) {
+        if (!m_Process.canReadLine() && !m_Process.waitForReadyRead(CHILD_STARTUP_TIMEOUT_MS)) {
+            fprintf(stderr, "The stand-in hosts failed to start\n");
+            return false;
+        }
+
+        while (m_Process.canReadLine()) {
+            QList<QByteArray> fields = m_Process.readLine().trimmed().split(' ');
+            if (fields.first() == "ports") {
+                m_ControlPort = fields.value(1).toUShort();
+                for (int i = 2; i < fields.count(); i++) {
+                    m_Ports.append(fields[i].toUShort());
+                }
+            }
+            else if (fields.first() == "cert") {
+                m_ServerCert = QSslCertificate(QByteArray::fromBase64(fields.value(1)));
+            }
+            else if (fields.first() == "ready") {
+                return m_Ports.count() == hostCount + unresponsiveCount;
+            }
+        }
+    }
+}
+
+quint16 StandInHostProcess::getPort(int index) const
+{
+    return m_Ports.value(index);
+}
+
+QSslCertificate StandInHostProcess::getServerCert() const
+{
+    return m_ServerCert;
+}
+
+bool StandInHostProcess::getStats(StandInHostStats* stats)
+{
+    QTcpSocket socket;
+    socket.connectToHost(QHostAddress::LocalHost, m_ControlPort);
+    if (!socket.waitForConnected()) {
+        return false;
+    }
+
+    socket.write("stats\n");
+    while (!socket.canReadLine()) {
+        if (!socket.waitForReadyRead()) {
+            return false;
+        }
+    }
+
+    QList<QByteArray> fields = socket.readLine().trimmed().split(' ');
+    stats->connections = fields.value(0).toInt();
+    stats->requests = fields.value(1).toInt();
+    return true;
+}
+
+bool StandInHostProcess::isChildProcess()
+{
+    return QCoreApplication::arguments().value(1) == CHILD_PROCESS_ARG;
+}
+
+int StandInHostProcess::runChildProcess()
+{
+    QStringList args = QCoreApplication::arguments();
+    int hostCount = args.value(2).toInt();
+    int unresponsiveCount = args.value(3).toInt();
+    bool https = args.value(4) == "1";
+    int appCount = args.value(5).toInt();
+
+    // Real hosts have their own identity, so don't borrow the client's
+    TemporarySettings settings;
+    QSslConfiguration sslConfig;
+    if (https) {
+        sslConfig = IdentityManager::get()->getSslConfig();
+    }
+
+    QByteArray appList = StandInHost::createAppList(appCount);
+    QVector<StandInHost*> hosts;
+    QByteArray ports;
+    for (int i = 0; i < hostCount + unresponsiveCount; i++) {
+        auto host = new StandInHost(i, appList, QCoreApplication::instance());
+        if (https) {
+            host->setSslConfiguration(sslConfig);
+        }
+        host->setUnresponsive(i >= hostCount);
+
+        if (!host->listen(QHostAddress::LocalHost)) {
+            fprintf(stderr, "Failed to listen for stand-in host %d: %s\n", i, qPrintable(host->errorString()));
+            return 1;
+        }
+
+        hosts.append(host);
+        ports += " " + QByteArray::number(host->serverPort());
+    }
+
+    // The parent asks for our stats over a plain TCP connection
+    QTcpServer control;
+    if (!control.listen(QHostAddress::LocalHost)) {
+        fprintf(stderr, "Failed to listen for stand-in host stats: %s\n", qPrintable(control.errorString()));
+        return 1;
+    }
+    QObject::connect(&control, &QTcpServer::newConnection, &control, [&control, &hosts]() {
+        QTcpSocket* socket = control.nextPendingConnection();
+        QObject::connect(socket, &QTcpSocket::readyRead, socket, [socket, &hosts]() {
+            if (!socket->canReadLine()) {
+                return;
+            }
+            socket->readLine();
+
+            int connections = 0, requests = 0;
+            for (const StandInHost* host : std::as_const(hosts)) {
+                connections += host->getConnectionCount();
+                requests += host->getRequestCount();
+            }
+            socket->write(QByteArray::number(connections) + " " + QByteArray::number(requests) + "\n");
+            socket->disconnectFromHost();
+        });
+        QObject::connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+    });
+
+#ifndef Q_OS_WIN
+    // Exit if the parent goes away without stopping us
+    QSocketNotifier stdinNotifier(STDIN_FILENO, QSocketNotifier::Read);
+    QObject::connect(&stdinNotifier, &QSocketNotifier::activated, &stdinNotifier, [&stdinNotifier]() {
+        char buffer[64];
+        if (read(STDIN_FILENO, buffer, sizeof(buffer)) <= 0) {
+            stdinNotifier.setEnabled(false);
+            QCoreApplication::quit();
+        }
+    });
+#endif
+
+    fprintf(stdout, "ports %d%s\n", control.serverPort(), ports.constData());
+    if (https) {
+        fprintf(stdout, "cert %s\n", sslConfig.localCertificate().toPem().toBase64().constData());
+    }
+    fprintf(stdout, "ready\n");
+    fflush(stdout);
+
+    return QCoreApplication::exec();
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QProcess>
+#include <QSslCertificate>
+#include <QSslConfiguration>
+#include <QTcpServer>
+#include <QVector>
+
+class QSslSocket;
+
+// A minimal stand-in for a GameStream host. It answers serverinfo, applist
+// and appasset requests with canned responses over HTTP or HTTPS, which is
+// enough for NvHTTP and ComputerPoller to treat it as a real host.
+class StandInHost : public QTcpServer
+{
+public:
+    StandInHost(int index, const QByteArray& appList, QObject* parent = nullptr);
+
+    // Serve HTTPS with the given certificate and key instead of HTTP. Like
+    // a real host, we ask for a client certificate but we don't check it.
+    void setSslConfiguration(const QSslConfiguration& sslConfig);
+
+    // Accept connections but never answer them, like a host that
+    // went away without closing its connections
+    void setUnresponsive(bool unresponsive);
+
+    int getConnectionCount() const;
+    int getRequestCount() const;
+
+    // Each stand-in host has a stable UUID and name derived from its index
+    static QString getUuid(int index);
+    static QString getName(int index);
+
+    static QByteArray createServerInfo(int index, quint16 httpsPort, bool paired);
+
+    // Creates an applist response with the given number of apps
+    static QByteArray createAppList(int appCount);
+
+protected:
+    virtual void incomingConnection(qintptr socketDescriptor) override;
+
+private:
+    void handleReadyRead(QSslSocket* socket);
+
+    QByteArray createResponse(const QByteArray& path, bool encrypted);
+
+    int m_Index;
+    QByteArray m_AppList;
+    QSslConfiguration m_SslConfig;
+    bool m_Https;
+    bool m_Unresponsive;
+    int m_ConnectionCount;
+    int m_RequestCount;
+    QHash<QSslSocket*, QByteArray> m_RequestBuffers;
+};
+
+struct StandInHostStats {
+    int connections;
+    int requests;
+};
+
+// Runs stand-in hosts on loopback ports in a child process, so their
+// threads and CPU time don't show up in the measurements of the process
+// under test. The child is another instance of the same executable, and
+// main() hands it over to runChildProcess() before doing anything else.
+class StandInHostProcess
+{
+public:
+    StandInHostProcess();
+
+    ~StandInHostProcess();
+
+    // Starts hostCount responsive hosts followed by unresponsiveCount
+    // hosts that never answer. HTTPS hosts report themselves as paired
+    // and serve appCount apps.
+    bool start(int hostCount, int unresponsiveCount, bool https, int appCount = 0);
+
+    quint16 getPort(int index) const;
+
+    // The certificate of the HTTPS hosts, for pinning
+    QSslCertificate getServerCert() const;
+
+    // Connections and requests the hosts have handled so far
+    bool getStats(StandInHostStats* stats);
+
+    static bool isChildProcess();
+
+    static int runChildProcess();
+
+private:
+    QProcess m_Process;
+    QVector<quint16> m_Ports;
+    quint16 m_ControlPort;
+    QSslCertificate m_ServerCert;
+};
@@ -0,0 +1,19 @@
+# NvHTTP with the backend code it depends on, plus the stand-in hosts it
+# can talk to. Include this after tests.pri with openssl in TEST_DEPS.
+
+QT += network
+
+SOURCES += \
+    $$PWD/standinhost.cpp \
+    $$APP_DIR/path.cpp \
+    $$APP_DIR/backend/identitymanager.cpp \
+    $$APP_DIR/backend/nvaddress.cpp \
+    $$APP_DIR/backend/nvapp.cpp \
+    $$APP_DIR/backend/nvcomputer.cpp \
+    $$APP_DIR/backend/nvhttp.cpp \
+    $$APP_DIR/settings/compatfetcher.cpp
+
+HEADERS += \
+    $$PWD/standinhost.h \
+    $$APP_DIR/backend/nvhttp.h \
+    $$APP_DIR/settings/compatfetcher.h
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <QSettings>
+#include <QTemporaryDir>
+
+// Points the default QSettings at a temporary directory for the lifetime
+// of this object, so a harness never touches the settings of a real
+// Moonlight install (such as its client identity or saved hosts).
+class TemporarySettings
+{
+public:
+    TemporarySettings()
+    {
+        QSettings::setDefaultFormat(QSettings::IniFormat);
+        QSettings::setPath(QSettings::IniFormat, QSettings::UserScope, m_Dir.path());
+    }
+
+private:
+    QTemporaryDir m_Dir;
+};
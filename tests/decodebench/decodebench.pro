@@ -0,0 +1,33 @@
+# Decodes a recorded elementary stream through FFmpegVideoDecoder and the
+# SDL renderer without a host, and reports per-stage latency percentiles.
+
+QT += core gui quick network
+TARGET = decodebench
+
+TEST_DEPS = sdl2 sdl2_ttf ffmpeg opus h264bitstream
+include(../tests.pri)
+
+SOURCES += \
+    main.cpp \
+    elementarystream.cpp \
+    fakestream.cpp \
+    $$APP_DIR/path.cpp \
+    $$APP_DIR/wm.cpp \
+    $$APP_DIR/streaming/bandwidth.cpp \
+    $$APP_DIR/streaming/streamutils.cpp \
+    $$APP_DIR/streaming/video/frametracer.cpp \
+    $$APP_DIR/streaming/video/latencyhistogram.cpp \
+    $$APP_DIR/streaming/video/bitratecontroller.cpp \
+    $$APP_DIR/streaming/video/overlaymanager.cpp \
+    $$APP_DIR/streaming/video/ffmpeg.cpp \
+    $$APP_DIR/streaming/video/ffmpeg-renderers/genhwaccel.cpp \
+    $$APP_DIR/streaming/video/ffmpeg-renderers/sdlvid.cpp \
+    $$APP_DIR/streaming/video/ffmpeg-renderers/swframemapper.cpp \
+    $$APP_DIR/streaming/video/ffmpeg-renderers/framepool.cpp \
+    $$APP_DIR/streaming/video/ffmpeg-renderers/planecopy.cpp \
+    $$APP_DIR/streaming/video/ffmpeg-renderers/yuvtorgb.cpp \
+    $$APP_DIR/streaming/video/ffmpeg-renderers/pacer/pacer.cpp
+
+HEADERS += \
+    elementarystream.h \
+    fakestream.h
@@ -0,0 +1,206 @@
+#include "elementarystream.h"
+
+#include <QFile>
+
+#include <Limelight.h>
+#include "SDL_compat.h"
+
+bool ElementaryStream::load(const QString& path, int videoFormat)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Failed to open %s: %s",
+                     qPrintable(path),
+                     qPrintable(file.errorString()));
+        return false;
+    }
+
+    m_Data = file.readAll();
+    m_Frames.clear();
+
+    bool ok;
+    if (videoFormat & VIDEO_FORMAT_MASK_AV1) {
+        ok = parseObus();
+    }
+    else {
+        ok = parseAnnexB(videoFormat & VIDEO_FORMAT_MASK_H265);
+    }
+
+    if (ok && m_Frames.isEmpty()) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "No frames found in %s",
+                     qPrintable(path));
+        ok = false;
+    }
+
+    return ok;
+}
+
+void ElementaryStream::addBuffer(Frame& frame, int offset, int length, int bufferType)
+{
+    frame.buffers.append({ offset, length, bufferType });
+    frame.length += length;
+}
+
+bool ElementaryStream::parseAnnexB(bool hevc)
+{
+    auto data = (const uint8_t*)m_Data.constData();
+    int size = m_Data.size();
+
+    // Find the start of each NAL unit, including its start code
+    QVector<int> nalStarts;
+    for (int i = 0; i + 3 <= size; i++) {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+            // Include the leading zero byte of a 4 byte start code
+            nalStarts.append(i > 0 && data[i - 1] == 0 ? i - 1 : i);
+            i += 2;
+        }
+    }
+
+    if (nalStarts.isEmpty()) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "No Annex B start codes found");
+        return false;
+    }
+
+    Frame frame = {};
+    bool frameHasPicture = false;
+
+    for (int i = 0; i < nalStarts.count(); i++) {
+        int start = nalStarts[i];
+        int end = i + 1 < nalStarts.count() ? nalStarts[i + 1] : size;
+
+        // Skip the start code to find the NAL header
+        int header = start + (data[start + 2] == 1 ? 3 : 4);
+        if (header + 2 >= end) {
+            continue;
+        }
+
+        bool picture, firstSliceOfPicture, startsAccessUnit, idr;
+        int bufferType = BUFFER_TYPE_PICDATA;
+
+        if (hevc) {
+            int type = (data[header] >> 1) & 0x3F;
+
+            picture = type < 32;
+            firstSliceOfPicture = picture && (data[header + 2] & 0x80);
+            idr = type >= 16 && type <= 23; // IRAP
+
+            // VPS, SPS, PPS, AUD, prefix SEI, and reserved types
+            startsAccessUnit = (type >= 32 && type <= 35) || type == 39 ||
+                               (type >= 41 && type <= 44) || (type >= 48 && type <= 55);
+
+            if (type == 32) {
+                bufferType = BUFFER_TYPE_VPS;
+            }
+            else if (type == 33) {
+                bufferType = BUFFER_TYPE_SPS;
+            }
+            else if (type == 34) {
+                bufferType = BUFFER_TYPE_PPS;
+            }
+        }
+        else {
+            int type = data[header] & 0x1F;
+
+            picture = type >= 1 && type <= 5;
+
+            // first_mb_in_slice is 0 if the first bit of the slice header is set
+            firstSliceOfPicture = picture && (data[header + 1] & 0x80);
+            idr = type == 5;
+
+            // SEI, SPS, PPS, AUD, and reserved types
+            startsAccessUnit = (type >= 6 && type <= 9) || (type >= 14 && type <= 18);
+
+            if (type == 7) {
+                bufferType = BUFFER_TYPE_SPS;
+            }
+            else if (type == 8) {
+                bufferType = BUFFER_TYPE_PPS;
+            }
+        }
+
+        // A new access unit starts with the first non-picture NAL
+        // or the first slice of a new picture after a picture.
+        if (frameHasPicture && (startsAccessUnit || firstSliceOfPicture)) {
+            m_Frames.append(frame);
+            frame = {};
+            frameHasPicture = false;
+        }
+
+        addBuffer(frame, start, end - start, bufferType);
+        frameHasPicture |= picture;
+        frame.idr |= idr;
+    }
+
+    if (frameHasPicture) {
+        m_Frames.append(frame);
+    }
+
+    return true;
+}
+
+bool ElementaryStream::parseObus()
+{
+    auto data = (const uint8_t*)m_Data.constData();
+    int size = m_Data.size();
+
+    Frame frame = {};
+    int frameStart = 0;
+    int offset = 0;
+
+    while (offset < size) {
+        uint8_t header = data[offset];
+        int type = (header >> 3) & 0xF;
+        bool hasExtension = header & 0x04;
+        bool hasSize = header & 0x02;
+
+        if (!hasSize) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "OBU at offset %d has no size field",
+                         offset);
+            return false;
+        }
+
+        // The size is a LEB128 value after the header
+        int sizeOffset = offset + (hasExtension ? 2 : 1);
+        uint64_t obuSize = 0;
+        int i;
+        for (i = 0; i < 8 && sizeOffset + i < size; i++) {
+            obuSize |= (uint64_t)(data[sizeOffset + i] & 0x7F) << (i * 7);
+            if (!(data[sizeOffset + i] & 0x80)) {
+                break;
+            }
+        }
+
+        int end = sizeOffset + i + 1 + (int)obuSize;
+        if (i == 8 || end > size) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "OBU at offset %d is truncated",
+                         offset);
+            return false;
+        }
+
+        // Each temporal unit starts with a temporal delimiter. The
+        // host sends the whole temporal unit as a single buffer.
+        if (type == 2 && offset > frameStart) {
+            addBuffer(frame, frameStart, offset - frameStart, BUFFER_TYPE_PICDATA);
+            m_Frames.append(frame);
+            frame = {};
+            frameStart = offset;
+        }
+
+        // Sequence headers are only sent with key frames
+        frame.idr |= type == 1;
+
+        offset = end;
+    }
+
+    if (offset > frameStart) {
+        addBuffer(frame, frameStart, offset - frameStart, BUFFER_TYPE_PICDATA);
+        m_Frames.append(frame);
+    }
+
+    return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+// Splits a recorded elementary stream into the frames that the host would
+// send for it. H.264 and HEVC streams must be in Annex B format (as written
+// by 'ffmpeg -c:v copy -f h264' or '-f hevc'). AV1 streams must be a series
+// of OBUs with size fields (as written by 'ffmpeg -c:v copy -f obu').
+class ElementaryStream
+{
+public:
+    struct Buffer {
+        int offset;
+        int length;
+        int bufferType; // BUFFER_TYPE_*
+    };
+
+    struct Frame {
+        QVector<Buffer> buffers;
+        int length;
+        bool idr;
+    };
+
+    // Returns false if the file can't be read or parsed. videoFormat
+    // is one of the VIDEO_FORMAT_* values.
+    bool load(const QString& path, int videoFormat);
+
+    const QByteArray& getData() const
+    {
+        return m_Data;
+    }
+
+    const QVector<Frame>& getFrames() const
+    {
+        return m_Frames;
+    }
+
+private:
+    bool parseAnnexB(bool hevc);
+
+    bool parseObus();
+
+    void addBuffer(Frame& frame, int offset, int length, int bufferType);
+
+    QByteArray m_Data;
+    QVector<Frame> m_Frames;
+};
@@ -0,0 +1,145 @@
+#include "fakestream.h"
+
+#include <QQueue>
+#include <chrono>
+
+#include "SDL_compat.h"
+#include "streaming/session.h"
+#include "streaming/metricsserver.h"
+
+static SDL_mutex* s_Lock = SDL_CreateMutex();
+static SDL_cond* s_Cond = SDL_CreateCond();
+static QQueue<PDECODE_UNIT> s_Queue;
+static int s_PendingCount;
+static int s_FailedCount;
+static int s_IdrRequestCount;
+static bool s_WakeRequested;
+
+void FakeVideoStream::submit(PDECODE_UNIT du)
+{
+    SDL_LockMutex(s_Lock);
+    s_Queue.enqueue(du);
+    s_PendingCount++;
+    SDL_CondSignal(s_Cond);
+    SDL_UnlockMutex(s_Lock);
+}
+
+int FakeVideoStream::getPendingCount()
+{
+    SDL_LockMutex(s_Lock);
+    int count = s_PendingCount;
+    SDL_UnlockMutex(s_Lock);
+    return count;
+}
+
+int FakeVideoStream::getFailedCount()
+{
+    SDL_LockMutex(s_Lock);
+    int count = s_FailedCount;
+    SDL_UnlockMutex(s_Lock);
+    return count;
+}
+
+int FakeVideoStream::getIdrRequestCount()
+{
+    SDL_LockMutex(s_Lock);
+    int count = s_IdrRequestCount;
+    SDL_UnlockMutex(s_Lock);
+    return count;
+}
+
+uint64_t LiGetMicroseconds(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool LiWaitForNextVideoFrame(VIDEO_FRAME_HANDLE* frameHandle, PDECODE_UNIT* decodeUnit)
+{
+    SDL_LockMutex(s_Lock);
+    while (s_Queue.isEmpty() && !s_WakeRequested) {
+        SDL_CondWait(s_Cond, s_Lock);
+    }
+
+    // Like the real implementation, a wake request only interrupts one wait
+    bool gotFrame = !s_Queue.isEmpty() && !s_WakeRequested;
+    if (gotFrame) {
+        *decodeUnit = s_Queue.dequeue();
+        *frameHandle = (VIDEO_FRAME_HANDLE)*decodeUnit;
+    }
+    s_WakeRequested = false;
+    SDL_UnlockMutex(s_Lock);
+
+    return gotFrame;
+}
+
+bool LiPollNextVideoFrame(VIDEO_FRAME_HANDLE* frameHandle, PDECODE_UNIT* decodeUnit)
+{
+    SDL_LockMutex(s_Lock);
+    bool gotFrame = !s_Queue.isEmpty();
+    if (gotFrame) {
+        *decodeUnit = s_Queue.dequeue();
+        *frameHandle = (VIDEO_FRAME_HANDLE)*decodeUnit;
+    }
+    SDL_UnlockMutex(s_Lock);
+
+    return gotFrame;
+}
+
+void LiCompleteVideoFrame(VIDEO_FRAME_HANDLE handle, int drStatus)
+{
+    free(handle);
+
+    SDL_LockMutex(s_Lock);
+    s_PendingCount--;
+    if (drStatus == DR_NEED_IDR) {
+        s_FailedCount++;
+    }
+    SDL_UnlockMutex(s_Lock);
+}
+
+void LiWakeWaitForVideoFrame(void)
+{
+    SDL_LockMutex(s_Lock);
+    s_WakeRequested = true;
+    SDL_CondSignal(s_Cond);
+    SDL_UnlockMutex(s_Lock);
+}
+
+void LiRequestIdrFrame(void)
+{
+    SDL_LockMutex(s_Lock);
+    s_IdrRequestCount++;
+    SDL_UnlockMutex(s_Lock);
+}
+
+bool LiGetEstimatedRttInfo(uint32_t*, uint32_t*)
+{
+    return false;
+}
+
+bool LiGetHdrMetadata(PSS_HDR_METADATA)
+{
+    return false;
+}
+
+bool LiGetCurrentHostDisplayHdrMode(void)
+{
+    return false;
+}
+
+// There's never an active session, so these are unreachable
+// but are still referenced by the decoder.
+Session* Session::s_ActiveSession = nullptr;
+
+void Session::stringifyAudioStats(char*, int)
+{
+}
+
+void Session::flushWindowEvents()
+{
+}
+
+void MetricsServer::updateVideoStats(const VIDEO_STATS&, const VIDEO_STATS&, double, double)
+{
+}
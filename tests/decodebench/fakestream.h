@@ -0,0 +1,21 @@
+#pragma once
+
+#include <Limelight.h>
+
+// Stands in for the moonlight-common-c video stream, so FFmpegVideoDecoder
+// can be driven without a host. Decode units submitted here are returned to
+// the decoder thread by LiWaitForNextVideoFrame() and LiPollNextVideoFrame().
+namespace FakeVideoStream
+{
+    // Takes ownership of the decode unit, which must be a single
+    // allocation from malloc() that includes its buffers.
+    void submit(PDECODE_UNIT du);
+
+    // Decode units that haven't been completed by the decoder yet
+    int getPendingCount();
+
+    // Decode units that the decoder returned DR_NEED_IDR for
+    int getFailedCount();
+
+    int getIdrRequestCount();
+}
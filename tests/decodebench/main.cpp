@@ -0,0 +1,302 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QTemporaryDir>
+
+#include "elementarystream.h"
+#include "fakestream.h"
+#include "samples.h"
+#include "streaming/video/ffmpeg.h"
+
+// Decode units in flight when feeding frames as fast as possible. This
+// keeps the decoder busy without measuring a huge backlog in the queue.
+#define MAX_SPEED_PENDING_FRAMES 2
+
+// Time allowed for the last frames to be decoded and rendered
+#define DRAIN_TIME_MS 1000
+
+static PDECODE_UNIT createDecodeUnit(const ElementaryStream& stream, int frameIndex, int frameNumber)
+{
+    const ElementaryStream::Frame& frame = stream.getFrames()[frameIndex];
+    uint64_t receiveTimeUs = LiGetMicroseconds();
+
+    // Reassemble the frame like moonlight-common-c does, with the decode unit,
+    // its buffer list, and the frame data in a single allocation.
+    size_t entriesSize = sizeof(LENTRY) * frame.buffers.count();
+    auto du = (PDECODE_UNIT)malloc(sizeof(DECODE_UNIT) + entriesSize + frame.length);
+    auto entries = (PLENTRY)(du + 1);
+    auto data = (char*)entries + entriesSize;
+
+    memset(du, 0, sizeof(*du));
+    du->frameNumber = frameNumber;
+    du->frameType = frame.idr ? FRAME_TYPE_IDR : FRAME_TYPE_PFRAME;
+    du->fullLength = frame.length;
+    du->bufferList = entries;
+
+    for (int i = 0; i < frame.buffers.count(); i++) {
+        const ElementaryStream::Buffer& buffer = frame.buffers[i];
+
+        memcpy(data, stream.getData().constData() + buffer.offset, buffer.length);
+        entries[i].data = data;
+        entries[i].length = buffer.length;
+        entries[i].bufferType = buffer.bufferType;
+        entries[i].next = i + 1 < frame.buffers.count() ? &entries[i + 1] : nullptr;
+
+        data += buffer.length;
+    }
+
+    du->receiveTimeUs = receiveTimeUs;
+    du->enqueueTimeUs = LiGetMicroseconds();
+    return du;
+}
+
+static bool readTrace(const QString& path, QVector<FRAME_TRACE_ENTRY>& entries)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        fprintf(stderr, "Failed to open frame trace %s\n", qPrintable(path));
+        return false;
+    }
+
+    FRAME_TRACE_HEADER header;
+    if (file.read((char*)&header, sizeof(header)) != sizeof(header) ||
+            header.magic != FRAME_TRACE_MAGIC ||
+            header.version != FRAME_TRACE_VERSION ||
+            header.entrySize != sizeof(FRAME_TRACE_ENTRY)) {
+        fprintf(stderr, "Frame trace %s is not a supported binary trace\n", qPrintable(path));
+        return false;
+    }
+
+    entries.resize(header.entryCount);
+    qint64 size = (qint64)sizeof(FRAME_TRACE_ENTRY) * header.entryCount;
+    return file.read((char*)entries.data(), size) == size;
+}
+
+static void printStage(const char* name, Samples& samples)
+{
+    fprintf(stdout, "%-12s %8d %10.3f %10.3f %10.3f %10.3f\n",
+            name,
+            samples.count(),
+            samples.mean() / 1000.0,
+            samples.percentile(50) / 1000.0,
+            samples.percentile(99) / 1000.0,
+            samples.percentile(99.9) / 1000.0);
+}
+
+static void printReport(const QVector<FRAME_TRACE_ENTRY>& entries, int submittedFrames)
+{
+    Samples reassembly, decode, pacer, render, total;
+    uint64_t firstRenderEndUs = 0, lastRenderEndUs = 0;
+    int renderedFrames = 0;
+
+    for (const FRAME_TRACE_ENTRY& entry : entries) {
+        // Skip the decoder's own test frame
+        if (entry.frameNumber == 0) {
+            continue;
+        }
+
+        if (entry.enqueueTimeUs != 0) {
+            reassembly.add(entry.enqueueTimeUs - entry.receiveTimeUs);
+        }
+        if (entry.decodeEndUs != 0) {
+            decode.add(entry.decodeEndUs - entry.decodeStartUs);
+        }
+        if (entry.renderEndUs != 0) {
+            // Pacer time covers both the pacing and render queues
+            pacer.add(entry.renderStartUs - entry.decodeEndUs);
+            render.add(entry.renderEndUs - entry.renderStartUs);
+            total.add(entry.renderEndUs - entry.receiveTimeUs);
+
+            if (firstRenderEndUs == 0) {
+                firstRenderEndUs = entry.renderEndUs;
+            }
+            lastRenderEndUs = entry.renderEndUs;
+            renderedFrames++;
+        }
+    }
+
+    fprintf(stdout, "%-12s %8s %10s %10s %10s %10s\n",
+            "Stage (ms)", "Frames", "Mean", "p50", "p99", "p99.9");
+    printStage("Reassembly", reassembly);
+    printStage("Decode", decode);
+    printStage("Pacer", pacer);
+    printStage("Render", render);
+    printStage("Total", total);
+
+    fprintf(stdout, "\nRendered %d of %d frames (%d dropped)",
+            renderedFrames, submittedFrames, submittedFrames - renderedFrames);
+    if (renderedFrames > 1) {
+        fprintf(stdout, " at %.2f FPS",
+                (renderedFrames - 1) * 1000000.0 / (lastRenderEndUs - firstRenderEndUs));
+    }
+    fprintf(stdout, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("decodebench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Decodes and renders a recorded elementary stream with the "
+                                     "software decoder and SDL renderer, then reports the latency "
+                                     "of each stage of the video pipeline.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("file", "H.264 or HEVC Annex B stream, or AV1 OBU stream");
+
+    QCommandLineOption codecOption("codec", "Codec of the stream: h264, hevc, or av1", "codec", "h264");
+    QCommandLineOption widthOption("width", "Width of the stream", "width", "1920");
+    QCommandLineOption heightOption("height", "Height of the stream", "height", "1080");
+    QCommandLineOption fpsOption("fps", "Frame rate to feed frames at", "fps", "60");
+    QCommandLineOption framesOption("frames", "Maximum number of frames to feed", "frames");
+    QCommandLineOption maxSpeedOption("max-speed", "Feed frames as fast as the decoder accepts them");
+    QCommandLineOption traceOption("trace", "Keep the binary frame trace at this path", "path");
+    parser.addOptions({ codecOption, widthOption, heightOption, fpsOption,
+                        framesOption, maxSpeedOption, traceOption });
+    parser.process(app);
+
+    if (parser.positionalArguments().count() != 1) {
+        parser.showHelp(1);
+    }
+
+    QString codec = parser.value(codecOption).toLower();
+    int videoFormat;
+    if (codec == "h264") {
+        videoFormat = VIDEO_FORMAT_H264;
+    }
+    else if (codec == "hevc") {
+        videoFormat = VIDEO_FORMAT_H265;
+    }
+    else if (codec == "av1") {
+        videoFormat = VIDEO_FORMAT_AV1_MAIN8;
+    }
+    else {
+        fprintf(stderr, "Unknown codec: %s\n", qPrintable(codec));
+        return 1;
+    }
+
+    int fps = parser.value(fpsOption).toInt();
+    if (fps <= 0) {
+        fprintf(stderr, "Invalid frame rate\n");
+        return 1;
+    }
+
+    ElementaryStream stream;
+    if (!stream.load(parser.positionalArguments().first(), videoFormat)) {
+        return 1;
+    }
+
+    // Every frame has to fit in the trace to be reported
+    int frameCount = qMin((int)stream.getFrames().count(), FRAME_TRACE_MAX_FRAMES - 1);
+    if (parser.isSet(framesOption)) {
+        frameCount = qMin(frameCount, parser.value(framesOption).toInt());
+    }
+
+    // The decoder writes the trace when it's destroyed and we read it back
+    QTemporaryDir traceDir;
+    QString tracePath = parser.isSet(traceOption) ?
+                            parser.value(traceOption) : traceDir.filePath("decodebench.bin");
+    if (tracePath.endsWith(".json", Qt::CaseInsensitive)) {
+        fprintf(stderr, "The frame trace must use the binary format\n");
+        return 1;
+    }
+    qputenv("FRAME_TRACE_FILE", tracePath.toUtf8());
+
+    // Render off-screen unless another video driver was requested
+    if (!qEnvironmentVariableIsSet("SDL_VIDEODRIVER")) {
+        qputenv("SDL_VIDEODRIVER", "dummy");
+    }
+
+    if (SDL_InitSubSystem(SDL_INIT_VIDEO | SDL_INIT_TIMER) != 0) {
+        fprintf(stderr, "SDL_InitSubSystem() failed: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    DECODER_PARAMETERS params = {};
+    params.vds = StreamingPreferences::VDS_FORCE_SOFTWARE;
+    params.videoFormat = videoFormat;
+    params.width = parser.value(widthOption).toInt();
+    params.height = parser.value(heightOption).toInt();
+    params.frameRate = fps;
+    params.window = SDL_CreateWindow("decodebench",
+                                     SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                                     params.width, params.height, 0);
+    if (params.window == nullptr) {
+        fprintf(stderr, "SDL_CreateWindow() failed: %s\n", SDL_GetError());
+        SDL_QuitSubSystem(SDL_INIT_VIDEO | SDL_INIT_TIMER);
+        return 1;
+    }
+
+    auto decoder = new FFmpegVideoDecoder(false);
+    if (!decoder->initialize(&params)) {
+        fprintf(stderr, "Failed to initialize the software decoder\n");
+        delete decoder;
+        SDL_DestroyWindow(params.window);
+        SDL_QuitSubSystem(SDL_INIT_VIDEO | SDL_INIT_TIMER);
+        return 1;
+    }
+
+    bool maxSpeed = parser.isSet(maxSpeedOption);
+    uint64_t frameIntervalUs = 1000000 / fps;
+    uint64_t startTimeUs = LiGetMicroseconds();
+    uint64_t drainStartTimeUs = 0;
+    int nextFrame = 0;
+    bool quit = false;
+
+    while (!quit) {
+        uint64_t nowUs = LiGetMicroseconds();
+
+        if (nextFrame < frameCount) {
+            bool ready = maxSpeed ?
+                             FakeVideoStream::getPendingCount() < MAX_SPEED_PENDING_FRAMES :
+                             nowUs >= startTimeUs + nextFrame * frameIntervalUs;
+            if (ready) {
+                FakeVideoStream::submit(createDecodeUnit(stream, nextFrame, nextFrame + 1));
+                nextFrame++;
+                continue;
+            }
+        }
+        else if (FakeVideoStream::getPendingCount() == 0) {
+            // Give the last frames time to make it through the pacer
+            if (drainStartTimeUs == 0) {
+                drainStartTimeUs = nowUs;
+            }
+            else if (nowUs - drainStartTimeUs >= DRAIN_TIME_MS * 1000) {
+                break;
+            }
+        }
+
+        // Render frames as the pacer asks for them, just like Session does
+        SDL_Event event;
+        if (SDL_WaitEventTimeout(&event, 1)) {
+            do {
+                if (event.type == SDL_QUIT) {
+                    quit = true;
+                }
+                else if (event.type == SDL_USEREVENT && event.user.code == SDL_CODE_FRAME_READY) {
+                    decoder->renderFrameOnMainThread();
+                }
+            } while (SDL_PollEvent(&event));
+        }
+    }
+
+    // Destroying the decoder writes the frame trace
+    delete decoder;
+    SDL_DestroyWindow(params.window);
+    SDL_QuitSubSystem(SDL_INIT_VIDEO | SDL_INIT_TIMER);
+
+    QVector<FRAME_TRACE_ENTRY> entries;
+    if (!readTrace(tracePath, entries)) {
+        return 1;
+    }
+
+    printReport(entries, nextFrame);
+
+    if (FakeVideoStream::getFailedCount() != 0 || FakeVideoStream::getIdrRequestCount() != 0) {
+        fprintf(stdout, "%d frames failed to decode and %d IDR frames were requested\n",
+                FakeVideoStream::getFailedCount(),
+                FakeVideoStream::getIdrRequestCount());
+    }
+
+    return 0;
+}
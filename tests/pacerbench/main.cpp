@@ -0,0 +1,305 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+
+#include <chrono>
+#include <random>
+#include <thread>
+
+#include "samples.h"
+#include "streaming/streamutils.h"
+#include "streaming/video/ffmpeg-renderers/framepool.h"
+#include "streaming/video/ffmpeg-renderers/pacer/pacer.h"
+
+// Time allowed for the last frames to make it through the pacer
+#define DRAIN_TIME_MS 250
+
+uint64_t LiGetMicroseconds(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void sleepUntilUs(uint64_t timeUs)
+{
+    std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::microseconds(timeUs)));
+}
+
+static void spinForUs(uint64_t durationUs)
+{
+    uint64_t endUs = LiGetMicroseconds() + durationUs;
+    while (LiGetMicroseconds() < endUs);
+}
+
+// A synchronous V-sync source that ticks at the display refresh rate,
+// with optional random lateness to simulate a busy compositor.
+class FakeVsyncSource : public IVsyncSource
+{
+public:
+    explicit FakeVsyncSource(int jitterUs)
+        : m_JitterUs(jitterUs),
+          m_PeriodUs(0),
+          m_NextVsyncUs(0),
+          m_Random(1)
+    {
+    }
+
+    virtual bool initialize(SDL_Window*, int displayFps) override
+    {
+        m_PeriodUs = 1000000 / displayFps;
+        m_NextVsyncUs = LiGetMicroseconds() + m_PeriodUs;
+        return true;
+    }
+
+    virtual bool isAsync() override
+    {
+        return false;
+    }
+
+    virtual void waitForVsync() override
+    {
+        uint64_t jitterUs = m_JitterUs > 0 ? m_Random() % m_JitterUs : 0;
+        sleepUntilUs(m_NextVsyncUs + jitterUs);
+
+        // Skip any V-syncs we've already missed
+        uint64_t nowUs = LiGetMicroseconds();
+        do {
+            m_NextVsyncUs += m_PeriodUs;
+        } while (m_NextVsyncUs <= nowUs);
+    }
+
+private:
+    int m_JitterUs;
+    uint64_t m_PeriodUs;
+    uint64_t m_NextVsyncUs;
+    std::minstd_rand m_Random;
+};
+
+// A renderer that records when each frame is presented and spends
+// a fixed amount of time "rendering" it. Frames presented later than
+// stutterThresholdUs after the previous frame are counted as stutters.
+class FakeRenderer : public IFFmpegRenderer
+{
+public:
+    FakeRenderer(int renderUs, bool renderThread, uint64_t stutterThresholdUs)
+        : IFFmpegRenderer(RendererType::Unknown),
+          stutters(0),
+          m_RenderUs(renderUs),
+          m_RenderThread(renderThread),
+          m_StutterThresholdUs(stutterThresholdUs),
+          m_LastRenderUs(0)
+    {
+    }
+
+    virtual bool initialize(PDECODER_PARAMETERS) override
+    {
+        return true;
+    }
+
+    virtual bool prepareDecoderContext(AVCodecContext*, AVDictionary**) override
+    {
+        return true;
+    }
+
+    virtual void renderFrame(AVFrame* frame) override
+    {
+        uint64_t nowUs = LiGetMicroseconds();
+
+        // The pacer stores the time the frame was submitted in pkt_dts
+        latencyUs.add(nowUs - (uint64_t)frame->pkt_dts);
+        if (m_LastRenderUs != 0) {
+            intervalUs.add(nowUs - m_LastRenderUs);
+            if (nowUs - m_LastRenderUs > m_StutterThresholdUs) {
+                stutters++;
+            }
+        }
+        m_LastRenderUs = nowUs;
+
+        spinForUs(m_RenderUs);
+    }
+
+    virtual bool isRenderThreadSupported() override
+    {
+        return m_RenderThread;
+    }
+
+    // Only accessed by the rendering thread until the pacer is destroyed
+    Samples latencyUs;
+    Samples intervalUs;
+    int stutters;
+
+private:
+    int m_RenderUs;
+    bool m_RenderThread;
+    uint64_t m_StutterThresholdUs;
+    uint64_t m_LastRenderUs;
+};
+
+struct ProducerContext {
+    Pacer* pacer;
+    int frameCount;
+    int fps;
+    int jitterUs;
+    SDL_atomic_t done;
+};
+
+// Submits frames at the stream frame rate like the decoder thread does,
+// with random lateness to simulate network and decode jitter.
+static int producerThreadProc(void* context)
+{
+    auto producer = reinterpret_cast<ProducerContext*>(context);
+    std::minstd_rand random(2);
+    uint64_t startUs = LiGetMicroseconds();
+    uint64_t lastSubmitUs = startUs;
+
+    for (int i = 0; i < producer->frameCount; i++) {
+        uint64_t jitterUs = producer->jitterUs > 0 ? random() % producer->jitterUs : 0;
+        uint64_t submitUs = startUs + (uint64_t)i * 1000000 / producer->fps + jitterUs;
+
+        // Frames can be late but never reordered
+        lastSubmitUs = qMax(lastSubmitUs, submitUs);
+        sleepUntilUs(lastSubmitUs);
+
+        AVFrame* frame = FramePool::acquire();
+        frame->pkt_dts = LiGetMicroseconds();
+        frame->opaque = (void*)(uintptr_t)(i + 1);
+        producer->pacer->submitFrame(frame);
+    }
+
+    SDL_AtomicSet(&producer->done, 1);
+    return 0;
+}
+
+static void printSamples(const char* name, Samples& samples)
+{
+    fprintf(stdout, "%-20s %8d %10.3f %10.3f %10.3f %10.3f\n",
+            name,
+            samples.count(),
+            samples.mean() / 1000.0,
+            samples.percentile(50) / 1000.0,
+            samples.percentile(99) / 1000.0,
+            samples.percentile(99.9) / 1000.0);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("pacerbench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Submits synthetic frames to the pacer with a simulated V-sync "
+                                     "source and renderer, then reports frame latency, drops, and "
+                                     "how evenly frames were presented.");
+    parser.addHelpOption();
+
+    QCommandLineOption fpsOption("fps", "Stream frame rate", "fps", "60");
+    QCommandLineOption secondsOption("seconds", "Length of the run", "seconds", "10");
+    QCommandLineOption renderOption("render-us", "Time spent rendering each frame", "us", "1000");
+    QCommandLineOption frameJitterOption("frame-jitter-us", "Maximum lateness of each frame", "us", "2000");
+    QCommandLineOption vsyncJitterOption("vsync-jitter-us", "Maximum lateness of each V-sync", "us", "500");
+    QCommandLineOption noPacingOption("no-pacing", "Render frames as soon as they arrive");
+    QCommandLineOption mainThreadOption("main-thread", "Render on the main thread instead of a render thread");
+    parser.addOptions({ fpsOption, secondsOption, renderOption, frameJitterOption,
+                        vsyncJitterOption, noPacingOption, mainThreadOption });
+    parser.process(app);
+
+    int fps = parser.value(fpsOption).toInt();
+    int seconds = parser.value(secondsOption).toInt();
+    if (fps <= 0 || seconds <= 0) {
+        fprintf(stderr, "Invalid frame rate or length\n");
+        return 1;
+    }
+
+    // The pacer gets the display refresh rate from the window
+    if (!qEnvironmentVariableIsSet("SDL_VIDEODRIVER")) {
+        qputenv("SDL_VIDEODRIVER", "dummy");
+    }
+
+    if (SDL_InitSubSystem(SDL_INIT_VIDEO) != 0) {
+        fprintf(stderr, "SDL_InitSubSystem() failed: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    SDL_Window* window = SDL_CreateWindow("pacerbench",
+                                          SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                                          640, 480, 0);
+    if (window == nullptr) {
+        fprintf(stderr, "SDL_CreateWindow() failed: %s\n", SDL_GetError());
+        SDL_QuitSubSystem(SDL_INIT_VIDEO);
+        return 1;
+    }
+
+    bool enablePacing = !parser.isSet(noPacingOption);
+    int displayFps = StreamUtils::getDisplayRefreshRate(window);
+
+    // A frame presented more than half a refresh late counts as a stutter
+    uint64_t displayPeriodUs = 1000000 / displayFps;
+    uint64_t stutterThresholdUs = qMax(displayPeriodUs, (uint64_t)(1000000 / fps)) + displayPeriodUs / 2;
+
+    VIDEO_STATS stats = {};
+    FakeRenderer renderer(parser.value(renderOption).toInt(), !parser.isSet(mainThreadOption), stutterThresholdUs);
+    auto pacer = new Pacer(&renderer, &stats, nullptr);
+    if (!pacer->initialize(window, fps, enablePacing,
+                           new FakeVsyncSource(parser.value(vsyncJitterOption).toInt()))) {
+        fprintf(stderr, "Failed to initialize the pacer\n");
+        delete pacer;
+        SDL_DestroyWindow(window);
+        SDL_QuitSubSystem(SDL_INIT_VIDEO);
+        return 1;
+    }
+
+    ProducerContext producer;
+    producer.pacer = pacer;
+    producer.frameCount = fps * seconds;
+    producer.fps = fps;
+    producer.jitterUs = parser.value(frameJitterOption).toInt();
+    SDL_AtomicSet(&producer.done, 0);
+
+    SDL_Thread* producerThread = SDL_CreateThread(producerThreadProc, "PacerBenchProducer", &producer);
+    if (producerThread == nullptr) {
+        fprintf(stderr, "SDL_CreateThread() failed: %s\n", SDL_GetError());
+        delete pacer;
+        SDL_DestroyWindow(window);
+        SDL_QuitSubSystem(SDL_INIT_VIDEO);
+        return 1;
+    }
+
+    uint64_t drainStartUs = 0;
+    for (;;) {
+        if (SDL_AtomicGet(&producer.done)) {
+            if (drainStartUs == 0) {
+                drainStartUs = LiGetMicroseconds();
+            }
+            else if (LiGetMicroseconds() - drainStartUs >= DRAIN_TIME_MS * 1000) {
+                break;
+            }
+        }
+
+        // Render frames as the pacer asks for them, just like Session does
+        SDL_Event event;
+        if (SDL_WaitEventTimeout(&event, 1)) {
+            do {
+                if (event.type == SDL_USEREVENT && event.user.code == SDL_CODE_FRAME_READY) {
+                    pacer->renderOnMainThread();
+                }
+            } while (SDL_PollEvent(&event));
+        }
+    }
+
+    SDL_WaitThread(producerThread, nullptr);
+    delete pacer;
+    SDL_DestroyWindow(window);
+    SDL_QuitSubSystem(SDL_INIT_VIDEO);
+
+    fprintf(stdout, "%d FPS stream on a %d Hz display, pacing %s, rendering on the %s thread\n\n",
+            fps, displayFps, enablePacing ? "enabled" : "disabled",
+            parser.isSet(mainThreadOption) ? "main" : "render");
+    fprintf(stdout, "%-20s %8s %10s %10s %10s %10s\n",
+            "(ms)", "Frames", "Mean", "p50", "p99", "p99.9");
+    printSamples("Submit to render", renderer.latencyUs);
+    printSamples("Present interval", renderer.intervalUs);
+
+    fprintf(stdout, "\nSubmitted %d frames: %u rendered, %u dropped by the pacer, %d stutters\n",
+            producer.frameCount, stats.renderedFrames, stats.pacerDroppedFrames, renderer.stutters);
+
+    return 0;
+}
@@ -0,0 +1,21 @@
+# Drives the Pacer with synthetic frames, a simulated V-sync source, and a
+# renderer that only burns time, then reports frame latency and pacing.
+
+QT += core
+TARGET = pacerbench
+
+TEST_DEPS = sdl2 sdl2_ttf ffmpeg
+include(../tests.pri)
+
+SOURCES += \
+    main.cpp \
+    $$APP_DIR/streaming/streamutils.cpp \
+    $$APP_DIR/streaming/video/frametracer.cpp \
+    $$APP_DIR/streaming/video/latencyhistogram.cpp \
+    $$APP_DIR/streaming/video/ffmpeg-renderers/framepool.cpp \
+    $$APP_DIR/streaming/video/ffmpeg-renderers/pacer/pacer.cpp
+
+# The pacer references the platform V-sync source even though we supply our own
+win32 {
+    SOURCES += $$APP_DIR/streaming/video/ffmpeg-renderers/pacer/dxvsyncsource.cpp
+}
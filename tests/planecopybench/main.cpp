@@ -0,0 +1,156 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+
+#include <chrono>
+
+#include "samples.h"
+#include "streaming/video/ffmpeg-renderers/planecopy.h"
+
+// Source frames are spread over at least this much memory, so each copy
+// reads from memory rather than the cache like a freshly decoded frame.
+#define SOURCE_BYTES (256 * 1024 * 1024)
+
+struct Resolution {
+    const char* name;
+    int width;
+    int height;
+};
+
+static const Resolution k_Resolutions[] = {
+    { "1080p", 1920, 1080 },
+    { "1440p", 2560, 1440 },
+    { "4K", 3840, 2160 },
+};
+
+struct CopyMode {
+    const char* name;
+    int flags;
+};
+
+static const CopyMode k_CopyModes[] = {
+    { "memcpy", 0 },
+    { "streaming stores", PLANE_COPY_STREAMING_STORES },
+    { "streaming loads", PLANE_COPY_STREAMING_LOADS },
+    { "streaming both", PLANE_COPY_STREAMING_LOADS | PLANE_COPY_STREAMING_STORES },
+};
+
+static uint64_t getMicroseconds()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int alignPitch(int pitch, int alignment)
+{
+    return (pitch + alignment - 1) & ~(alignment - 1);
+}
+
+// Copies an NV12 frame the way SdlRenderer does, one plane at a time
+static void copyFrame(uint8_t* dst, int dstPitch, const uint8_t* src, int srcPitch,
+                      int width, int height, int flags)
+{
+    PlaneCopy::copyPlane(dst, dstPitch, src, srcPitch, width, height, flags);
+    PlaneCopy::copyPlane(dst + dstPitch * height, dstPitch,
+                         src + srcPitch * height, srcPitch,
+                         width, height / 2, flags);
+}
+
+// Returns false if the copy doesn't match the source
+static bool runCase(const Resolution& resolution, const CopyMode& mode,
+                    int srcPitch, int dstPitch, int iterations)
+{
+    int width = resolution.width;
+    int height = resolution.height;
+    size_t srcFrameSize = (size_t)srcPitch * height * 3 / 2;
+    size_t dstFrameSize = (size_t)dstPitch * height * 3 / 2;
+    int srcFrames = (int)qMax<size_t>(2, SOURCE_BYTES / srcFrameSize);
+
+    auto src = (uint8_t*)SDL_SIMDAlloc(srcFrameSize * srcFrames);
+    auto dst = (uint8_t*)SDL_SIMDAlloc(dstFrameSize);
+    if (src == nullptr || dst == nullptr) {
+        fprintf(stderr, "Out of memory\n");
+        SDL_SIMDFree(src);
+        SDL_SIMDFree(dst);
+        return false;
+    }
+
+    // Touch every page up front so we don't measure page faults
+    for (size_t i = 0; i < srcFrameSize * srcFrames; i++) {
+        src[i] = (uint8_t)(i * 7);
+    }
+    memset(dst, 0, dstFrameSize);
+
+    Samples frameTimeUs;
+    for (int i = 0; i < iterations; i++) {
+        const uint8_t* frame = src + srcFrameSize * (i % srcFrames);
+
+        uint64_t startUs = getMicroseconds();
+        copyFrame(dst, dstPitch, frame, srcPitch, width, height, mode.flags);
+        frameTimeUs.add(getMicroseconds() - startUs);
+    }
+
+    // Check the last copy, ignoring the padding at the end of each row
+    const uint8_t* lastFrame = src + srcFrameSize * ((iterations - 1) % srcFrames);
+    bool ok = true;
+    for (int y = 0; y < height * 3 / 2 && ok; y++) {
+        ok = memcmp(dst + (size_t)dstPitch * y, lastFrame + (size_t)srcPitch * y, width) == 0;
+    }
+
+    // Count the bytes that matter, not the row padding
+    double frameBytes = (double)width * height * 3 / 2;
+    fprintf(stdout, "%-6s %-17s %5d %5d %10.1f %10.1f %10.1f %10.2f%s\n",
+            resolution.name, mode.name, srcPitch, dstPitch,
+            (double)frameTimeUs.percentile(50),
+            (double)frameTimeUs.percentile(99),
+            (double)frameTimeUs.percentile(99.9),
+            frameBytes / frameTimeUs.mean() / 1000.0,
+            ok ? "" : "  MISMATCH");
+
+    SDL_SIMDFree(src);
+    SDL_SIMDFree(dst);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("planecopybench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Copies NV12 frames with PlaneCopy::copyPlane() using each set "
+                                     "of copy flags, with matching and mismatched pitches, and "
+                                     "reports the time per frame and throughput. The buffers are "
+                                     "ordinary cached memory, so streaming loads and stores only show "
+                                     "their cache bypass cost here, not the benefit they have on "
+                                     "uncached and write-combined mappings.");
+    parser.addHelpOption();
+
+    QCommandLineOption iterationsOption("iterations", "Frames copied for each case", "count", "300");
+    parser.addOption(iterationsOption);
+    parser.process(app);
+
+    int iterations = parser.value(iterationsOption).toInt();
+    if (iterations <= 0) {
+        fprintf(stderr, "Invalid iteration count\n");
+        return 1;
+    }
+
+    fprintf(stdout, "%-6s %-17s %5s %5s %10s %10s %10s %10s\n",
+            "Res", "Mode", "Src", "Dst", "p50 (us)", "p99 (us)", "p99.9 (us)", "GB/s");
+
+    bool ok = true;
+    for (const Resolution& resolution : k_Resolutions) {
+        // Decoders typically pad rows to 64 bytes. Textures and dumb buffers
+        // may use the same pitch (so the plane is copied in one go) or pad
+        // rows further (so it's copied a row at a time).
+        int srcPitch = alignPitch(resolution.width, 64);
+        int paddedPitch = alignPitch(srcPitch + 1, 256);
+
+        for (const CopyMode& mode : k_CopyModes) {
+            ok &= runCase(resolution, mode, srcPitch, srcPitch, iterations);
+            ok &= runCase(resolution, mode, srcPitch, paddedPitch, iterations);
+        }
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,12 @@
+# Measures PlaneCopy::copyPlane() throughput for NV12 frames at common
+# stream resolutions with each combination of copy flags.
+
+QT += core
+TARGET = planecopybench
+
+TEST_DEPS = sdl2
+include(../tests.pri)
+
+SOURCES += \
+    main.cpp \
+    $$APP_DIR/streaming/video/ffmpeg-renderers/planecopy.cpp
@@ -0,0 +1,153 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QTimer>
+
+#include "processstats.h"
+#include "samples.h"
+#include "standinhost.h"
+#include "temporarysettings.h"
+#include "backend/computerpoller.h"
+
+// How often we sample the thread count
+#define THREAD_SAMPLE_INTERVAL_MS 100
+
+const char* LiGetLaunchUrlQueryParameters(void)
+{
+    return "";
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("pollerbench");
+
+    if (StandInHostProcess::isChildProcess()) {
+        return StandInHostProcess::runChildProcess();
+    }
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Polls stand-in hosts on loopback ports with ComputerPoller, "
+                                     "then reports how long each host took to come online, the "
+                                     "threads the poller used, and its CPU time. The stand-in hosts "
+                                     "run in a child process, so they aren't counted.");
+    parser.addHelpOption();
+
+    QCommandLineOption hostsOption("hosts", "Number of hosts that answer", "count", "300");
+    QCommandLineOption unresponsiveOption("unresponsive", "Number of hosts that never answer", "count", "0");
+    QCommandLineOption secondsOption("seconds", "Length of the run", "seconds", "30");
+    parser.addOptions({ hostsOption, unresponsiveOption, secondsOption });
+    parser.process(app);
+
+    int hostCount = parser.value(hostsOption).toInt();
+    int unresponsiveCount = parser.value(unresponsiveOption).toInt();
+    int seconds = parser.value(secondsOption).toInt();
+    if (hostCount < 0 || unresponsiveCount < 0 || hostCount + unresponsiveCount == 0 || seconds <= 0) {
+        fprintf(stderr, "Invalid host count or length\n");
+        return 1;
+    }
+
+    TemporarySettings settings;
+
+    StandInHostProcess standInHosts;
+    if (!standInHosts.start(hostCount, unresponsiveCount, false)) {
+        return 1;
+    }
+
+    // Set the hosts up the way ComputerManager does after adding them manually
+    QNetworkAccessManager nam;
+    QVector<NvComputer*> computers;
+    QHash<NvComputer*, int> computerIndexes;
+    for (int i = 0; i < hostCount + unresponsiveCount; i++) {
+        NvHTTP http(NvAddress(QHostAddress(QHostAddress::LocalHost), standInHosts.getPort(i)), 0, QSslCertificate(), &nam);
+        auto computer = new NvComputer(http, StandInHost::createServerInfo(i, 0, false));
+        computer->state = NvComputer::CS_UNKNOWN;
+
+        computers.append(computer);
+        computerIndexes.insert(computer, i);
+    }
+
+    int threadsBefore = getProcessThreadCount();
+    int peakThreads = threadsBefore;
+    uint64_t cpuBeforeUs = getProcessCpuTimeUs();
+
+    QTimer threadSampler;
+    QObject::connect(&threadSampler, &QTimer::timeout, &threadSampler, [&peakThreads]() {
+        peakThreads = qMax(peakThreads, getProcessThreadCount());
+    });
+    threadSampler.start(THREAD_SAMPLE_INTERVAL_MS);
+
+    auto poller = new ComputerPoller();
+    QElapsedTimer runTimer;
+    QVector<qint64> onlineTimeUs(computers.count(), -1);
+    Samples timeToOnlineUs;
+    qint64 allOnlineUs = -1;
+
+    QObject::connect(poller, &ComputerPoller::computerStateChanged, &app, [&](NvComputer* computer) {
+        int index = computerIndexes.value(computer);
+        bool online;
+        {
+            QReadLocker lock(&computer->lock);
+            online = computer->state == NvComputer::CS_ONLINE;
+        }
+
+        if (online && onlineTimeUs[index] < 0) {
+            onlineTimeUs[index] = runTimer.nsecsElapsed() / 1000;
+            timeToOnlineUs.add(onlineTimeUs[index]);
+            if (timeToOnlineUs.count() == hostCount) {
+                allOnlineUs = onlineTimeUs[index];
+            }
+        }
+    }, Qt::QueuedConnection);
+
+    runTimer.start();
+    for (NvComputer* computer : std::as_const(computers)) {
+        poller->addComputer(computer);
+    }
+
+    QTimer::singleShot(seconds * 1000, &app, &QCoreApplication::quit);
+    app.exec();
+
+    int threadsWhilePolling = getProcessThreadCount();
+    uint64_t cpuUs = getProcessCpuTimeUs() - cpuBeforeUs;
+    qint64 elapsedUs = runTimer.nsecsElapsed() / 1000;
+
+    delete poller;
+
+    int offlineCount = 0;
+    for (NvComputer* computer : std::as_const(computers)) {
+        if (computer->state == NvComputer::CS_OFFLINE) {
+            offlineCount++;
+        }
+    }
+
+    StandInHostStats stats = {};
+    standInHosts.getStats(&stats);
+
+    fprintf(stdout, "Polled %d hosts (%d unresponsive) for %d seconds\n\n",
+            hostCount + unresponsiveCount, unresponsiveCount, seconds);
+
+    fprintf(stdout, "Time to online (ms): p50 %.1f, p99 %.1f, max %.1f, all %d hosts %s\n",
+            timeToOnlineUs.percentile(50) / 1000.0,
+            timeToOnlineUs.percentile(99) / 1000.0,
+            timeToOnlineUs.percentile(100) / 1000.0,
+            hostCount,
+            allOnlineUs >= 0 ? qPrintable(QString("after %1 ms").arg(allOnlineUs / 1000.0, 0, 'f', 1)) : "never");
+    fprintf(stdout, "Hosts online: %d, offline: %d\n", timeToOnlineUs.count(), offlineCount);
+
+    if (threadsBefore >= 0) {
+        fprintf(stdout, "Threads: %d before polling, %d while polling, %d at peak\n",
+                threadsBefore, threadsWhilePolling, peakThreads);
+    }
+    else {
+        fprintf(stdout, "Threads: not available on this platform\n");
+    }
+
+    fprintf(stdout, "CPU time: %.1f ms (%.2f%% of one core)\n",
+            cpuUs / 1000.0, cpuUs * 100.0 / elapsedUs);
+    fprintf(stdout, "Stand-in hosts handled %d requests on %d connections\n",
+            stats.requests, stats.connections);
+
+    qDeleteAll(computers);
+    return 0;
+}
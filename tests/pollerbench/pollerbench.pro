@@ -0,0 +1,16 @@
+# Polls a few hundred stand-in hosts with ComputerPoller and reports how
+# quickly they come online, plus the poller's thread count and CPU time.
+
+QT += core
+TARGET = pollerbench
+
+TEST_DEPS = openssl
+include(../tests.pri)
+include(../common/standinhost.pri)
+
+SOURCES += \
+    main.cpp \
+    $$APP_DIR/backend/computerpoller.cpp
+
+HEADERS += \
+    $$APP_DIR/backend/computerpoller.h
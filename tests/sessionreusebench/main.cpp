@@ -0,0 +1,192 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QProcess>
+#include <QTimer>
+
+#include <stdexcept>
+
+#include "processstats.h"
+#include "samples.h"
+#include "standinhost.h"
+#include "temporarysettings.h"
+#include "backend/nvhttp.h"
+
+struct PhaseStats {
+    Samples latencyUs;
+    uint64_t cpuUs;
+    StandInHostStats hostStats;
+};
+
+const char* LiGetLaunchUrlQueryParameters(void)
+{
+    return "";
+}
+
+// Waits without blocking the event loop, so idle connections expire normally
+static void waitMs(int ms)
+{
+    QEventLoop loop;
+    QTimer::singleShot(ms, &loop, &QEventLoop::quit);
+    loop.exec();
+}
+
+// Runs a request the given number of times, waiting intervalMs between them
+template <typename Function>
+static bool measurePhase(StandInHostProcess& standInHost, int requests, int intervalMs,
+                         PhaseStats* stats, Function request)
+{
+    StandInHostStats hostStatsBefore = {};
+    if (!standInHost.getStats(&hostStatsBefore)) {
+        fprintf(stderr, "Failed to get the stand-in host's stats\n");
+        return false;
+    }
+
+    for (int i = 0; i < requests; i++) {
+        if (i > 0 && intervalMs > 0) {
+            waitMs(intervalMs);
+        }
+
+        QElapsedTimer timer;
+        uint64_t cpuBeforeUs = getProcessCpuTimeUs();
+        timer.start();
+
+        try {
+            request();
+        } catch (...) {
+            fprintf(stderr, "Request %d failed\n", i);
+            return false;
+        }
+
+        stats->latencyUs.add(timer.nsecsElapsed() / 1000);
+        stats->cpuUs += getProcessCpuTimeUs() - cpuBeforeUs;
+    }
+
+    if (!standInHost.getStats(&stats->hostStats)) {
+        fprintf(stderr, "Failed to get the stand-in host's stats\n");
+        return false;
+    }
+    stats->hostStats.connections -= hostStatsBefore.connections;
+    stats->hostStats.requests -= hostStatsBefore.requests;
+    return true;
+}
+
+static void printPhaseStats(const char* name, PhaseStats& stats)
+{
+    fprintf(stdout, "%-20s %10.2f %10.2f %14.3f %10d %12d\n", name,
+            stats.latencyUs.percentile(50) / 1000.0,
+            stats.latencyUs.percentile(99) / 1000.0,
+            stats.cpuUs / 1000.0 / stats.latencyUs.count(),
+            stats.hostStats.requests,
+            stats.hostStats.connections);
+}
+
+static int runBenchmark(bool sessionReuse, int polls, int pollIntervalMs, int assets)
+{
+    // NvHTTP reads this once, on its first HTTPS request
+    qputenv("NVHTTP_SESSION_REUSE", sessionReuse ? "1" : "0");
+
+    TemporarySettings settings;
+
+    StandInHostProcess standInHost;
+    if (!standInHost.start(1, 0, true)) {
+        return 1;
+    }
+
+    quint16 port = standInHost.getPort(0);
+    NvHTTP http(NvAddress(QHostAddress(QHostAddress::LocalHost), port), port, standInHost.getServerCert(), nullptr);
+
+    // Get our client identity generated before we start measuring
+    try {
+        http.getServerInfo(NvHTTP::NvLogLevel::NVLL_ERROR);
+    } catch (...) {
+        fprintf(stderr, "Failed to reach the stand-in host\n");
+        return 1;
+    }
+
+    // Polls are further apart than the keep-alive timeout, so only
+    // TLS session resumption can help them
+    PhaseStats pollStats = {};
+    if (!measurePhase(standInHost, polls, pollIntervalMs, &pollStats, [&http]() {
+            http.getServerInfo(NvHTTP::NvLogLevel::NVLL_ERROR, true);
+        })) {
+        return 1;
+    }
+
+    // Box art is downloaded in bursts, which keep-alive connections cover
+    PhaseStats assetStats = {};
+    int appId = 0;
+    if (!measurePhase(standInHost, assets, 0, &assetStats, [&http, &appId]() {
+            if (http.getBoxArtData(++appId).isEmpty()) {
+                throw std::runtime_error("Empty box art");
+            }
+        })) {
+        return 1;
+    }
+
+    fprintf(stdout, "Session reuse %s: %d polls %d ms apart, then %d box art downloads\n",
+            sessionReuse ? "on" : "off", polls, pollIntervalMs, assets);
+    fprintf(stdout, "%-20s %10s %10s %14s %10s %12s\n",
+            "Phase", "p50 ms", "p99 ms", "CPU ms/request", "Requests", "Connections");
+    printPhaseStats("serverinfo polls", pollStats);
+    printPhaseStats("appasset burst", assetStats);
+    fprintf(stdout, "\n");
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("sessionreusebench");
+
+    if (StandInHostProcess::isChildProcess()) {
+        return StandInHostProcess::runChildProcess();
+    }
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measures the latency and client CPU time of NvHTTP requests to a "
+                                     "stand-in HTTPS host on a loopback port, along with how many "
+                                     "connections the host saw, with NVHTTP_SESSION_REUSE off and on.");
+    parser.addHelpOption();
+
+    QCommandLineOption sessionReuseOption("session-reuse", "Only measure with session reuse 'on' or 'off'", "mode");
+    QCommandLineOption pollsOption("polls", "Number of serverinfo polls", "count", "10");
+    QCommandLineOption pollIntervalOption("poll-interval", "Time between serverinfo polls", "ms", "2500");
+    QCommandLineOption assetsOption("assets", "Number of box art downloads", "count", "100");
+    parser.addOptions({ sessionReuseOption, pollsOption, pollIntervalOption, assetsOption });
+    parser.process(app);
+
+    int polls = parser.value(pollsOption).toInt();
+    int pollIntervalMs = parser.value(pollIntervalOption).toInt();
+    int assets = parser.value(assetsOption).toInt();
+    if (polls <= 0 || pollIntervalMs < 0 || assets <= 0) {
+        fprintf(stderr, "Invalid poll or box art count\n");
+        return 1;
+    }
+
+    if (parser.isSet(sessionReuseOption)) {
+        QString mode = parser.value(sessionReuseOption);
+        if (mode != "on" && mode != "off") {
+            fprintf(stderr, "Session reuse must be 'on' or 'off'\n");
+            return 1;
+        }
+
+        return runBenchmark(mode == "on", polls, pollIntervalMs, assets);
+    }
+
+    // NvHTTP only checks NVHTTP_SESSION_REUSE once per process, so measure
+    // each mode in a fresh instance of ourselves
+    for (const char* mode : { "off", "on" }) {
+        QProcess process;
+        process.setProcessChannelMode(QProcess::ForwardedChannels);
+        process.start(QCoreApplication::applicationFilePath(),
+                      QCoreApplication::arguments().mid(1) + QStringList { "--session-reuse", mode });
+        if (!process.waitForFinished(-1) || process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0) {
+            fprintf(stderr, "The benchmark failed with session reuse %s\n", mode);
+            return 1;
+        }
+    }
+
+    return 0;
+}
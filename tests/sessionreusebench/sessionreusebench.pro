@@ -0,0 +1,12 @@
+# Measures NvHTTP request latency and CPU time against a stand-in HTTPS
+# host with NVHTTP_SESSION_REUSE off and on.
+
+QT += core
+TARGET = sessionreusebench
+
+TEST_DEPS = openssl
+include(../tests.pri)
+include(../common/standinhost.pri)
+
+SOURCES += \
+    main.cpp
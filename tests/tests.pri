@@ -0,0 +1,65 @@
+# Common settings for the benchmarks and tests. A project lists the
+# libraries it needs in TEST_DEPS before including this file.
+
+TEMPLATE = app
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+include(../globaldefs.pri)
+
+APP_DIR = $$PWD/../app
+INCLUDEPATH += \
+    $$PWD/common \
+    $$APP_DIR \
+    $$PWD/../moonlight-common-c/moonlight-common-c/src
+
+DEFINES += QT_DEPRECATED_WARNINGS
+DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000
+
+win32 {
+    contains(QT_ARCH, x86_64) {
+        LIBS += -L$$PWD/../libs/windows/lib/x64
+        INCLUDEPATH += $$PWD/../libs/windows/include/x64 $$PWD/../libs/windows/include/x64/SDL2
+    }
+    contains(QT_ARCH, arm64) {
+        LIBS += -L$$PWD/../libs/windows/lib/arm64
+        INCLUDEPATH += $$PWD/../libs/windows/include/arm64 $$PWD/../libs/windows/include/arm64/SDL2
+    }
+
+    INCLUDEPATH += $$PWD/../libs/windows/include
+    LIBS += ws2_32.lib winmm.lib
+
+    contains(TEST_DEPS, openssl): LIBS += -llibssl -llibcrypto
+    contains(TEST_DEPS, sdl2): LIBS += -lSDL2
+    contains(TEST_DEPS, sdl2_ttf): LIBS += -lSDL2_ttf
+    contains(TEST_DEPS, ffmpeg): LIBS += -lavcodec -lavutil -lswscale
+    contains(TEST_DEPS, opus): LIBS += -lopus
+}
+macx:!disable-prebuilts {
+    INCLUDEPATH += $$PWD/../libs/mac/include $$PWD/../libs/mac/include/SDL2
+    LIBS += -L$$PWD/../libs/mac/lib
+
+    contains(TEST_DEPS, openssl): LIBS += -lssl.3 -lcrypto.3
+    contains(TEST_DEPS, sdl2): LIBS += -lSDL2
+    contains(TEST_DEPS, sdl2_ttf): LIBS += -lSDL2_ttf
+    contains(TEST_DEPS, ffmpeg): LIBS += -lavcodec.62 -lavutil.60 -lswscale.9
+    contains(TEST_DEPS, opus): LIBS += -lopus.0
+}
+unix:if(!macx|disable-prebuilts) {
+    CONFIG += link_pkgconfig
+
+    contains(TEST_DEPS, openssl): PKGCONFIG += openssl
+    contains(TEST_DEPS, sdl2): PKGCONFIG += sdl2
+    contains(TEST_DEPS, sdl2_ttf): PKGCONFIG += SDL2_ttf
+    contains(TEST_DEPS, ffmpeg): PKGCONFIG += libavcodec libavutil libswscale
+    contains(TEST_DEPS, opus): PKGCONFIG += opus
+}
+
+contains(TEST_DEPS, ffmpeg): DEFINES += HAVE_FFMPEG
+
+contains(TEST_DEPS, h264bitstream) {
+    INCLUDEPATH += $$PWD/../h264bitstream/h264bitstream
+    win32:CONFIG(release, debug|release): LIBS += -L$$OUT_PWD/../../h264bitstream/release/ -lh264bitstream
+    else:win32:CONFIG(debug, debug|release): LIBS += -L$$OUT_PWD/../../h264bitstream/debug/ -lh264bitstream
+    else:unix: LIBS += -L$$OUT_PWD/../../h264bitstream/ -lh264bitstream
+}
@@ -0,0 +1,23 @@
+TEMPLATE = subdirs
+
+# Benchmarks and tests for the streaming pipeline. These build the app
+# sources they exercise directly, so each one only needs the libraries
+# used by the code under test. Run them from the build directory after
+# building with 'qmake CONFIG+=enable-tests'.
+SUBDIRS = \
+    addressracetest \
+    applistbench \
+    audiobench \
+    bandwidthtest \
+    pacerbench \
+    planecopybench \
+    pollerbench \
+    sessionreusebench \
+    thumbnailbench \
+    yuvtorgb
+
+# FFmpegVideoDecoder pulls in the DXVA2/D3D11VA and VideoToolbox
+# renderers on Windows and macOS, so this is only built elsewhere.
+unix:!macx {
+    SUBDIRS += decodebench
+}
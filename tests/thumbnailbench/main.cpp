@@ -0,0 +1,192 @@
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+
+#include "samples.h"
+#include "path.h"
+#include "backend/boxartthumbnailcache.h"
+
+// The size of the box art GFE serves
+#define BOX_ART_WIDTH 628
+#define BOX_ART_HEIGHT 888
+
+// Encoding box art takes a while, so the apps share this many images
+#define DISTINCT_BOX_ART_COUNT 16
+
+#define HOST_UUID "00000000-0000-0000-0000-000000000000"
+#define FIRST_APP_ID 10000
+
+// This must match THUMBNAIL_PACK_FILE_NAME in boxartthumbnailcache.cpp
+#define THUMBNAIL_PACK_FILE_NAME "thumbnails.pack"
+
+// Creates PNG box art with enough noise that it doesn't compress trivially
+static QByteArray createBoxArt(int seed)
+{
+    QRandomGenerator random(seed);
+    QImage image(BOX_ART_WIDTH, BOX_ART_HEIGHT, QImage::Format_RGB32);
+    for (int y = 0; y < image.height(); y++) {
+        QRgb* line = (QRgb*)image.scanLine(y);
+        for (int x = 0; x < image.width(); x++) {
+            line[x] = qRgb((x + seed * 37) & 0xFF, (y + seed * 11) & 0xFF, ((x ^ y) + seed) & 0xFF) ^
+                      (random.generate() & 0x0F0F0F);
+        }
+    }
+
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    image.save(&buffer, "PNG");
+    return data;
+}
+
+template <typename Function>
+static uint64_t measureNs(Function function)
+{
+    QElapsedTimer timer;
+    timer.start();
+    function();
+    return timer.nsecsElapsed();
+}
+
+static void printSamples(const char* name, Samples& samples)
+{
+    fprintf(stdout, "%-28s %10.2f %10.2f %10.2f\n", name,
+            samples.percentile(50) / 1000.0,
+            samples.percentile(99) / 1000.0,
+            samples.percentile(100) / 1000.0);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("thumbnailbench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Fills a box art thumbnail pack for a synthetic library, then "
+                                     "compares painting from the pack with decoding and scaling the "
+                                     "box art each time, and times reopening the pack.");
+    parser.addHelpOption();
+
+    QCommandLineOption appsOption("apps", "Number of apps in the library", "count", "1000");
+    parser.addOption(appsOption);
+    parser.process(app);
+
+    int appCount = parser.value(appsOption).toInt();
+    if (appCount <= 0) {
+        fprintf(stderr, "Invalid app count\n");
+        return 1;
+    }
+
+    // Keep the pack out of the cache of a real Moonlight install
+    QTemporaryDir cacheDir;
+    QString originalDir = QDir::currentPath();
+    if (!cacheDir.isValid() || !QDir::setCurrent(cacheDir.path())) {
+        fprintf(stderr, "Failed to create a temporary directory\n");
+        return 1;
+    }
+    Path::initialize(true);
+
+    QVector<QByteArray> boxArt;
+    for (int i = 0; i < DISTINCT_BOX_ART_COUNT; i++) {
+        boxArt.append(createBoxArt(i));
+    }
+
+    QSharedPointer<BoxArtThumbnailCache> cache = BoxArtThumbnailCache::get(HOST_UUID);
+
+    // Fill the pack the way the box art prefetch does, from decoded box art
+    Samples decodeNs, addNs;
+    QVector<QImage> images(DISTINCT_BOX_ART_COUNT);
+    QSize thumbnailSize;
+    for (int i = 0; i < appCount; i++) {
+        QImage image;
+        decodeNs.add(measureNs([&]() {
+            image = QImage::fromData(boxArt[i % DISTINCT_BOX_ART_COUNT]);
+        }));
+        images[i % DISTINCT_BOX_ART_COUNT] = image;
+
+        addNs.add(measureNs([&]() {
+            thumbnailSize = cache->addThumbnail(FIRST_APP_ID + i, image).size();
+        }));
+    }
+
+    // Without the pack, the grid has to decode and scale each image itself
+    Samples scaleNs;
+    for (int i = 0; i < appCount; i++) {
+        const QImage& image = images[i % DISTINCT_BOX_ART_COUNT];
+        scaleNs.add(measureNs([&]() {
+            QImage thumbnail = image.scaled(thumbnailSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        }));
+    }
+
+    // Thumbnails beyond the size limit of the pack have been evicted
+    Samples containsNs;
+    QVector<int> keptAppIds;
+    for (int i = 0; i < appCount; i++) {
+        bool contains;
+        containsNs.add(measureNs([&]() {
+            contains = cache->contains(FIRST_APP_ID + i);
+        }));
+        if (contains) {
+            keptAppIds.append(FIRST_APP_ID + i);
+        }
+    }
+
+    Samples getNs;
+    for (int appId : std::as_const(keptAppIds)) {
+        QImage thumbnail;
+        QSize originalSize;
+        getNs.add(measureNs([&]() {
+            thumbnail = cache->getThumbnail(appId, &originalSize);
+        }));
+
+        if (thumbnail.size() != thumbnailSize || originalSize != QSize(BOX_ART_WIDTH, BOX_ART_HEIGHT)) {
+            fprintf(stderr, "Thumbnail for app %d is %dx%d from %dx%d box art\n", appId,
+                    thumbnail.width(), thumbnail.height(), originalSize.width(), originalSize.height());
+            return 1;
+        }
+    }
+
+    // Reopen the pack as if Moonlight just started, then paint every thumbnail
+    cache.reset();
+    BoxArtThumbnailCache::close(HOST_UUID);
+
+    uint64_t reopenNs = measureNs([&]() {
+        cache = BoxArtThumbnailCache::get(HOST_UUID);
+    });
+    uint64_t paintNs = measureNs([&]() {
+        for (int appId : std::as_const(keptAppIds)) {
+            QSize originalSize;
+            cache->getThumbnail(appId, &originalSize);
+        }
+    });
+
+    qint64 packSize = QFileInfo(QDir(Path::getBoxArtCacheDir()).filePath(HOST_UUID "/" THUMBNAIL_PACK_FILE_NAME)).size();
+
+    fprintf(stdout, "%d apps with %dx%d box art, %dx%d thumbnails\n\n",
+            appCount, BOX_ART_WIDTH, BOX_ART_HEIGHT, thumbnailSize.width(), thumbnailSize.height());
+
+    fprintf(stdout, "%-28s %10s %10s %10s\n", "Time per app", "p50 us", "p99 us", "max us");
+    printSamples("Decode box art", decodeNs);
+    printSamples("Scale box art", scaleNs);
+    printSamples("addThumbnail()", addNs);
+    printSamples("contains()", containsNs);
+    printSamples("getThumbnail()", getNs);
+
+    fprintf(stdout, "\nThe pack kept %d of %d thumbnails in a %.1f MB file\n",
+            (int)keptAppIds.count(), appCount, packSize / (1024.0 * 1024.0));
+    fprintf(stdout, "Reopening the pack took %.2f ms, then painting %d thumbnails from it took %.2f ms\n",
+            reopenNs / 1000000.0, (int)keptAppIds.count(), paintNs / 1000000.0);
+    fprintf(stdout, "Decoding and scaling the same box art would take about %.2f ms\n",
+            (decodeNs.mean() + scaleNs.mean()) * keptAppIds.count() / 1000000.0);
+
+    // Let go of the pack and the directory so the temporary one can be deleted
+    cache.reset();
+    BoxArtThumbnailCache::close(HOST_UUID);
+    QDir::setCurrent(originalDir);
+    return 0;
+}
@@ -0,0 +1,13 @@
+# Compares drawing box art from the thumbnail pack with decoding and
+# scaling it each time, and measures adding, evicting and reloading
+# thumbnails.
+
+QT += core gui
+TARGET = thumbnailbench
+
+include(../tests.pri)
+
+SOURCES += \
+    main.cpp \
+    $$APP_DIR/path.cpp \
+    $$APP_DIR/backend/boxartthumbnailcache.cpp
@@ -0,0 +1,341 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+
+#include <chrono>
+#include <random>
+
+#include "samples.h"
+#include "streaming/video/ffmpeg-renderers/yuvtorgb.h"
+
+extern "C" {
+#include <libavutil/opt.h>
+#include <libswscale/swscale.h>
+}
+
+// Largest difference allowed between our output and swscale's in any channel
+// of any pixel, and the largest average difference across all channels. Our
+// fixed-point math and chroma filtering differ slightly from swscale's.
+#define MAX_CHANNEL_ERROR 4
+#define MAX_MEAN_ERROR 1.0
+
+// Frames converted for each benchmark case
+#define BENCH_ITERATIONS 200
+
+// YuvToRgbConverter only needs a renderer for its colorspace helpers
+class TestRenderer : public IFFmpegRenderer
+{
+public:
+    TestRenderer() : IFFmpegRenderer(RendererType::Unknown) {}
+
+    virtual bool initialize(PDECODER_PARAMETERS) override
+    {
+        return true;
+    }
+
+    virtual bool prepareDecoderContext(AVCodecContext*, AVDictionary**) override
+    {
+        return true;
+    }
+
+    virtual void renderFrame(AVFrame*) override
+    {
+    }
+};
+
+struct Colorspace {
+    const char* name;
+    AVColorSpace colorspace;
+    AVColorRange range;
+    int swsColorspace;
+};
+
+static const Colorspace k_Colorspaces[] = {
+    { "Rec. 601 limited", AVCOL_SPC_SMPTE170M, AVCOL_RANGE_MPEG, SWS_CS_ITU601 },
+    { "Rec. 709 limited", AVCOL_SPC_BT709, AVCOL_RANGE_MPEG, SWS_CS_ITU709 },
+    { "Rec. 709 full", AVCOL_SPC_BT709, AVCOL_RANGE_JPEG, SWS_CS_ITU709 },
+    { "Rec. 2020 limited", AVCOL_SPC_BT2020_NCL, AVCOL_RANGE_MPEG, SWS_CS_BT2020 },
+};
+
+static const AVPixelFormat k_PixelFormats[] = {
+    AV_PIX_FMT_YUV444P,
+    AV_PIX_FMT_YUVJ444P,
+    AV_PIX_FMT_YUV444P10,
+    AV_PIX_FMT_YUV420P10,
+    AV_PIX_FMT_P010,
+};
+
+static uint64_t getMicroseconds()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void setSample(AVFrame* frame, const AVComponentDescriptor& comp, int x, int y, int value)
+{
+    uint8_t* sample = frame->data[comp.plane] + (ptrdiff_t)frame->linesize[comp.plane] * y + comp.step * x + comp.offset;
+    if (comp.depth > 8) {
+        *(uint16_t*)sample = (uint16_t)(value << comp.shift);
+    }
+    else {
+        *sample = (uint8_t)value;
+    }
+}
+
+// Fills the frame with a luma ramp with some noise and smooth chroma ramps.
+// Chroma doesn't have any sharp edges, so the differences between our
+// chroma upsampling and swscale's stay within rounding error.
+static AVFrame* createFrame(AVPixelFormat format, int width, int height, const Colorspace& colorspace)
+{
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(format);
+
+    AVFrame* frame = av_frame_alloc();
+    frame->format = format;
+    frame->width = width;
+    frame->height = height;
+    frame->colorspace = colorspace.colorspace;
+    frame->color_range = colorspace.range;
+    frame->chroma_location = AVCHROMA_LOC_LEFT;
+    if (av_frame_get_buffer(frame, 64) < 0) {
+        av_frame_free(&frame);
+        return nullptr;
+    }
+
+    std::minstd_rand random(width * height + format);
+    int maxValue = (1 << desc->comp[0].depth) - 1;
+    int noise = maxValue / 32;
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int value = maxValue * x / width + (int)(random() % (2 * noise + 1)) - noise;
+            setSample(frame, desc->comp[0], x, y, SDL_clamp(value, 0, maxValue));
+        }
+    }
+
+    int chromaWidth = AV_CEIL_RSHIFT(width, desc->log2_chroma_w);
+    int chromaHeight = AV_CEIL_RSHIFT(height, desc->log2_chroma_h);
+    for (int y = 0; y < chromaHeight; y++) {
+        for (int x = 0; x < chromaWidth; x++) {
+            setSample(frame, desc->comp[1], x, y, maxValue * x / chromaWidth);
+            setSample(frame, desc->comp[2], x, y, maxValue - maxValue * y / chromaHeight);
+        }
+    }
+
+    return frame;
+}
+
+static AVFrame* createRgbFrame(int width, int height)
+{
+    AVFrame* frame = av_frame_alloc();
+    frame->format = AV_PIX_FMT_BGR0;
+    frame->width = width;
+    frame->height = height;
+    if (av_frame_get_buffer(frame, 64) < 0) {
+        av_frame_free(&frame);
+    }
+    return frame;
+}
+
+// Creates a swscale context that converts to BGRX like SdlRenderer. For
+// comparisons, it's set up for the most accurate output with the same
+// chroma siting as the frame. Otherwise, it matches SdlRenderer's setup.
+static SwsContext* createSwsContext(const AVFrame* frame, const Colorspace& colorspace, bool accurate)
+{
+    SwsContext* context = sws_alloc_context();
+    if (context == nullptr) {
+        return nullptr;
+    }
+
+    av_opt_set_int(context, "srcw", frame->width, 0);
+    av_opt_set_int(context, "srch", frame->height, 0);
+    av_opt_set_int(context, "src_format", frame->format, 0);
+    av_opt_set_int(context, "dstw", frame->width, 0);
+    av_opt_set_int(context, "dsth", frame->height, 0);
+    av_opt_set_int(context, "dst_format", AV_PIX_FMT_BGR0, 0);
+    if (accurate) {
+        // Left-sited chroma is horizontally aligned with the even luma
+        // columns and vertically centered between the luma rows.
+        av_opt_set_int(context, "sws_flags", SWS_BILINEAR | SWS_ACCURATE_RND | SWS_FULL_CHR_H_INT | SWS_FULL_CHR_H_INP, 0);
+        av_opt_set_int(context, "src_h_chr_pos", 0, 0);
+        av_opt_set_int(context, "src_v_chr_pos", 128, 0);
+    }
+#if LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100)
+    else {
+        av_opt_set_int(context, "threads", std::min(SDL_GetCPUCount(), 4), 0);
+    }
+#endif
+
+    if (sws_init_context(context, nullptr, nullptr) < 0) {
+        sws_freeContext(context);
+        return nullptr;
+    }
+
+    if (sws_setColorspaceDetails(context,
+                                 sws_getCoefficients(colorspace.swsColorspace),
+                                 colorspace.range == AVCOL_RANGE_JPEG ? 1 : 0,
+                                 sws_getCoefficients(SWS_CS_DEFAULT), 1,
+                                 0, 1 << 16, 1 << 16) < 0) {
+        sws_freeContext(context);
+        return nullptr;
+    }
+
+    return context;
+}
+
+static bool swsConvert(SwsContext* context, const AVFrame* frame, AVFrame* rgbFrame)
+{
+#if LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100)
+    return sws_scale_frame(context, rgbFrame, frame) >= 0;
+#else
+    return sws_scale(context, frame->data, frame->linesize, 0, frame->height,
+                     rgbFrame->data, rgbFrame->linesize) == frame->height;
+#endif
+}
+
+static bool compareFormat(AVPixelFormat format, const Colorspace& colorspace, int width, int height)
+{
+    const char* formatName = av_get_pix_fmt_name(format);
+
+    AVFrame* frame = createFrame(format, width, height, colorspace);
+    AVFrame* expected = createRgbFrame(width, height);
+    AVFrame* actual = createRgbFrame(width, height);
+    SwsContext* swsContext = frame != nullptr ? createSwsContext(frame, colorspace, true) : nullptr;
+
+    TestRenderer renderer;
+    YuvToRgbConverter converter(&renderer);
+
+    bool ok = false;
+    if (frame == nullptr || expected == nullptr || actual == nullptr || swsContext == nullptr) {
+        fprintf(stderr, "%s %s: failed to set up frames\n", formatName, colorspace.name);
+    }
+    else if (!swsConvert(swsContext, frame, expected)) {
+        fprintf(stderr, "%s %s: swscale conversion failed\n", formatName, colorspace.name);
+    }
+    else if (!converter.initialize(frame)) {
+        fprintf(stderr, "%s %s: YuvToRgbConverter::initialize() failed\n", formatName, colorspace.name);
+    }
+    else {
+        converter.convertFrame(frame, actual->data[0], actual->linesize[0]);
+
+        int maxError = 0;
+        uint64_t totalError = 0;
+        for (int y = 0; y < height; y++) {
+            const uint8_t* expectedRow = expected->data[0] + (ptrdiff_t)expected->linesize[0] * y;
+            const uint8_t* actualRow = actual->data[0] + (ptrdiff_t)actual->linesize[0] * y;
+
+            // Compare B, G, and R but not X
+            for (int x = 0; x < width; x++) {
+                for (int c = 0; c < 3; c++) {
+                    int error = abs(expectedRow[x * 4 + c] - actualRow[x * 4 + c]);
+                    maxError = qMax(maxError, error);
+                    totalError += error;
+                }
+            }
+        }
+
+        double meanError = (double)totalError / ((double)width * height * 3);
+        ok = maxError <= MAX_CHANNEL_ERROR && meanError <= MAX_MEAN_ERROR;
+
+        fprintf(stdout, "%-12s %-18s %dx%d: max error %d, mean error %.3f%s\n",
+                formatName, colorspace.name, width, height, maxError, meanError,
+                ok ? "" : "  FAIL");
+    }
+
+    sws_freeContext(swsContext);
+    av_frame_free(&frame);
+    av_frame_free(&expected);
+    av_frame_free(&actual);
+    return ok;
+}
+
+static void benchmarkFormat(AVPixelFormat format, int width, int height)
+{
+    const Colorspace& colorspace = k_Colorspaces[1];
+
+    AVFrame* frame = createFrame(format, width, height, colorspace);
+    AVFrame* rgbFrame = createRgbFrame(width, height);
+    SwsContext* swsContext = frame != nullptr ? createSwsContext(frame, colorspace, false) : nullptr;
+
+    TestRenderer renderer;
+    YuvToRgbConverter converter(&renderer);
+
+    if (frame == nullptr || rgbFrame == nullptr || swsContext == nullptr || !converter.initialize(frame)) {
+        fprintf(stderr, "%s %dx%d: failed to set up conversion\n",
+                av_get_pix_fmt_name(format), width, height);
+    }
+    else {
+        Samples converterUs, swsUs;
+
+        for (int i = 0; i < BENCH_ITERATIONS; i++) {
+            uint64_t startUs = getMicroseconds();
+            converter.convertFrame(frame, rgbFrame->data[0], rgbFrame->linesize[0]);
+            converterUs.add(getMicroseconds() - startUs);
+
+            startUs = getMicroseconds();
+            swsConvert(swsContext, frame, rgbFrame);
+            swsUs.add(getMicroseconds() - startUs);
+        }
+
+        fprintf(stdout, "%-12s %9s %10.3f %10.3f %10.3f %10.3f %8.2fx\n",
+                av_get_pix_fmt_name(format),
+                qPrintable(QString("%1x%2").arg(width).arg(height)),
+                converterUs.percentile(50) / 1000.0,
+                converterUs.percentile(99) / 1000.0,
+                swsUs.percentile(50) / 1000.0,
+                swsUs.percentile(99) / 1000.0,
+                swsUs.mean() / converterUs.mean());
+    }
+
+    sws_freeContext(swsContext);
+    av_frame_free(&frame);
+    av_frame_free(&rgbFrame);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("yuvtorgbtest");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Compares the output of YuvToRgbConverter with swscale for each "
+                                     "supported pixel format and colorspace.");
+    parser.addHelpOption();
+
+    QCommandLineOption benchOption("bench", "Compare conversion time with swscale instead");
+    parser.addOption(benchOption);
+    parser.process(app);
+
+    if (parser.isSet(benchOption)) {
+        static const int k_Resolutions[][2] = {
+            { 1920, 1080 },
+            { 2560, 1440 },
+            { 3840, 2160 },
+        };
+
+        fprintf(stdout, "Time per frame in ms, with swscale set up like SdlRenderer\n\n");
+        fprintf(stdout, "%-12s %9s %10s %10s %10s %10s %9s\n",
+                "Format", "Size", "Ours p50", "Ours p99", "sws p50", "sws p99", "Speedup");
+        for (AVPixelFormat format : k_PixelFormats) {
+            for (const auto& resolution : k_Resolutions) {
+                benchmarkFormat(format, resolution[0], resolution[1]);
+            }
+        }
+
+        return 0;
+    }
+
+    bool ok = true;
+    for (AVPixelFormat format : k_PixelFormats) {
+        for (const Colorspace& colorspace : k_Colorspaces) {
+            // YUVJ formats are always full range
+            if (format == AV_PIX_FMT_YUVJ444P && colorspace.range != AVCOL_RANGE_JPEG) {
+                continue;
+            }
+
+            // The width isn't a multiple of 8, so the scalar tail of each row is covered too
+            ok &= compareFormat(format, colorspace, 1366, 768);
+        }
+    }
+
+    fprintf(stdout, "%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
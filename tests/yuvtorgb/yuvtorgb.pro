@@ -0,0 +1,14 @@
+# Checks YuvToRgbConverter against swscale for each supported pixel format
+# and colorspace ('make check' runs this). With --bench, it compares their
+# throughput at common stream resolutions instead.
+
+QT += core
+TARGET = yuvtorgbtest
+CONFIG += testcase
+
+TEST_DEPS = sdl2 sdl2_ttf ffmpeg
+include(../tests.pri)
+
+SOURCES += \
+    main.cpp \
+    $$APP_DIR/streaming/video/ffmpeg-renderers/yuvtorgb.cpp